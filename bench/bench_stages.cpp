@@ -0,0 +1,472 @@
+// Stage micro-benchmarks: throughput of each pipeline stage on a receipt
+// fixture, alone (ticket-sized) and repeated into a multi-megabyte input.
+//
+//   tv_bench [fixture.txt] [iterations]
+
+#include "tv/batch_summary.hpp"
+#include "tv/columnar.hpp"
+#include "tv/detect.hpp"
+#include "tv/engine.hpp"
+#include "tv/fingerprint.hpp"
+#include "tv/flight_recorder.hpp"
+#include "tv/input_dir.hpp"
+#include "tv/json.hpp"
+#include "tv/merchant_dict.hpp"
+#include "tv/near_duplicate.hpp"
+#include "tv/normalize.hpp"
+#include "tv/parse_company.hpp"
+#include "tv/parse_datetime.hpp"
+#include "tv/parse_items.hpp"
+#include "tv/parse_merchant.hpp"
+#include "tv/parse_total.hpp"
+#include "tv/registry.hpp"
+#include "tv/rule_pack.hpp"
+#include "tv/score.hpp"
+#include "tv/signals.hpp"
+#include "tv/task_pool.hpp"
+#include "tv/utf8.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+std::string load(const char *path) {
+  std::ifstream f(path, std::ios::binary);
+  std::stringstream ss;
+  ss << f.rdbuf();
+  return ss.str();
+}
+
+// Keeps the optimizer from dropping a result.
+volatile std::size_t sink = 0;
+
+template <typename F>
+void bench(const char *name, std::size_t bytes, int iters, F &&f) {
+  using clock = std::chrono::steady_clock;
+  f(); // warm-up
+  auto t0 = clock::now();
+  for (int i = 0; i < iters; i++)
+    f();
+  auto t1 = clock::now();
+  double sec = std::chrono::duration<double>(t1 - t0).count();
+  double ns_per = sec * 1e9 / iters;
+  double mb_s = (double)bytes * iters / sec / 1e6;
+  std::printf("  %-18s %12.0f ns/call %10.1f MB/s\n", name, ns_per, mb_s);
+}
+
+void run_suite(const char *title, const std::string &text, int iters) {
+  std::printf("%s (%zu bytes, %d iterations)\n", title, text.size(), iters);
+  auto norm = tv::normalize_ocr(text);
+  std::string repaired;
+  tv::Options opt;
+
+  bench("validate_utf8", text.size(), iters,
+        [&] { sink = sink + tv::validate_utf8(text); });
+  bench("repair_utf8", text.size(), iters,
+        [&] { sink = sink + tv::repair_utf8(text, repaired); });
+  bench("normalize_ocr", text.size(), iters,
+        [&] { sink = sink + tv::normalize_ocr(text).text.size(); });
+  bench("detect_locale",
+        std::min(norm.text.size(), tv::detect_window), iters, [&] {
+          sink = sink + static_cast<std::size_t>(
+                            tv::detect_locale_domain(norm.text).locale);
+        });
+  bench("detect_signals", norm.text.size(), iters, [&] {
+    sink = sink + tv::detect_signals(norm.text).has_tva;
+  });
+  bench("parse_total", norm.text.size(), iters, [&] {
+    tv::ParsedTicket t;
+    tv::parse_total(norm.text, t);
+    sink = sink + t.total.value.has_value();
+  });
+  bench("parse_merchant", norm.text.size(), iters, [&] {
+    tv::ParsedTicket t;
+    tv::parse_merchant(norm.text, t);
+    sink = sink + t.merchant.value.has_value();
+  });
+  bench("parse_items", norm.text.size(), iters, [&] {
+    tv::ParsedTicket t;
+    tv::parse_items(norm.text, t);
+    sink = sink + t.items.size();
+  });
+  bench("parse_datetime", norm.text.size(), iters, [&] {
+    tv::ParsedTicket t;
+    tv::parse_datetime(norm.text, t);
+    sink = sink + t.datetime_iso.value.has_value();
+  });
+  bench("parse_company", norm.text.size(), iters, [&] {
+    tv::ParsedTicket t;
+    tv::parse_company(norm.text, t);
+    sink = sink + t.company.value.has_value();
+  });
+  auto scored = tv::run(text, opt);
+  bench("score", 0, iters, [&] {
+    auto f = tv::score_features(scored);
+    sink = sink + (tv::score(f, tv::default_scoring) > 0.5);
+  });
+  // What serving adds per ticket for the flight recorder (a fast ticket).
+  tv::FlightRecorder recorder(1, 1000000);
+  tv::FlightRecord rec;
+  bench("flight_record", 0, iters * 10, [&] {
+    rec.id++;
+    recorder.record(0, rec, text);
+  });
+  bench("run", text.size(), iters, [&] {
+    opt.max_lines = 1u << 30;
+    sink = sink + tv::run(text, opt).ticket.warnings.size();
+  });
+  // The task graph on a private pool, whatever the machine has.
+  tv::TaskPool pool(3);
+  bench("task_graph_3w", text.size(), iters, [&] {
+    sink = sink + tv::run(text, opt, pool).ticket.warnings.size();
+  });
+  bench("session_4k", text.size(), iters, [&] {
+    tv::Session s;
+    s.begin(opt);
+    for (std::size_t i = 0; i < text.size(); i += 4096)
+      s.feed(std::string_view(text).substr(i, 4096));
+    sink = sink + s.finish().ticket.warnings.size();
+  });
+  // Shadow evaluation of a second pack (the built-in one again) on the same
+  // preprocessing: the difference with session_4k is its overhead.
+  bench("session_shadow", text.size(), iters, [&] {
+    tv::Session s;
+    s.begin(opt, tv::RulePack::builtin());
+    for (std::size_t i = 0; i < text.size(); i += 4096)
+      s.feed(std::string_view(text).substr(i, 4096));
+    sink = sink + s.finish().ticket.warnings.size();
+  });
+  // Live OCR: the same receipt again with its last line corrected.
+  tv::FrameCache frames;
+  std::string frame[2] = {text + "\nA", text + "\nB"};
+  int which = 0;
+  bench("frame_cache", text.size(), iters, [&] {
+    which ^= 1;
+    sink = sink + frames.run("bench", frame[which], opt).ticket.warnings.size();
+  });
+}
+
+// Batch reprocessing: many ticket-sized documents, per document against
+// run_batch() (packed normalization, keyword prefilter).
+void run_batch_suite(const std::string &ticket, std::size_t count, int iters) {
+  std::vector<std::string> texts;
+  std::vector<std::string_view> docs;
+  std::size_t bytes = 0;
+  for (std::size_t i = 0; i < count; i++) {
+    texts.push_back(ticket + "\nRef " + std::to_string(i) + "\n");
+    bytes += texts.back().size();
+  }
+  docs.assign(texts.begin(), texts.end());
+  std::printf("batch of %zu tickets (%zu bytes, %d iterations)\n", count,
+              bytes, iters);
+  tv::Options opt;
+  opt.locale = tv::Locale::FrFR;
+  opt.domain = tv::Domain::Cafe;
+
+  bench("normalize+parsers", bytes, iters, [&] {
+    for (auto doc : docs) {
+      auto norm = tv::normalize_ocr(doc);
+      tv::ParsedTicket t;
+      t.signals = tv::detect_signals(norm.text);
+      tv::parse_total(norm.text, t);
+      tv::parse_merchant(norm.text, t);
+      sink = sink + t.total.value.has_value();
+    }
+  });
+  bench("run_per_doc", bytes, iters, [&] {
+    for (auto doc : docs)
+      sink = sink + tv::run(doc, opt).ticket.warnings.size();
+  });
+  bench("run_batch", bytes, iters, [&] {
+    sink = sink + tv::run_batch(docs, opt).size();
+  });
+}
+
+// Company registry of `count` SIRETs: compile once, then open and look up
+// (the snapshot is written next to the system's temporary files).
+void run_registry_suite(std::size_t count, int iters) {
+  const std::string csv = "/tmp/tv_bench_registry.csv";
+  const std::string reg = "/tmp/tv_bench_registry.reg";
+  std::vector<std::string> sirets;
+  {
+    std::ofstream out(csv, std::ios::binary);
+    for (std::size_t i = 0; sirets.size() < count; i++) {
+      auto prefix = std::to_string(100000000000000ull + i * 7919ull);
+      auto siret = prefix.substr(1, 13) + '0';
+      for (char c = '0'; c <= '9' && !tv::valid_siret(siret); c++)
+        siret.back() = c;
+      if (!tv::valid_siret(siret))
+        continue; // SIREN part fails Luhn
+      out << siret << ";SOCIETE " << i << ";56.10A\n";
+      sirets.push_back(siret);
+    }
+  }
+  auto t0 = std::chrono::steady_clock::now();
+  tv::compile_registry(csv, reg);
+  double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                             t0)
+                   .count();
+  std::printf("registry of %zu entries (compiled in %.2f s, %d iterations)\n",
+              count, sec, iters);
+
+  bench("registry_open", 0, iters,
+        [&] { sink = sink + tv::CompanyRegistry::open(reg)->size(); });
+  auto r = tv::CompanyRegistry::open(reg);
+  std::size_t next = 0;
+  bench("registry_lookup", 14, iters * 100, [&] {
+    next = (next + 104729) % sirets.size();
+    sink = sink + r->find_siret(sirets[next]).has_value();
+  });
+  std::remove(csv.c_str());
+  std::remove(reg.c_str());
+}
+
+// Merchant dictionary of `count` names: compile once, then open and look up
+// names with one OCR error.
+void run_merchant_suite(std::size_t count, int iters) {
+  const std::string list = "/tmp/tv_bench_merchants.txt";
+  const std::string dict = "/tmp/tv_bench_merchants.dict";
+  static const char *const kinds[] = {"BOULANGERIE", "CAFE",  "PHARMACIE",
+                                      "BRASSERIE",   "TABAC", "SUPERETTE"};
+  std::vector<std::string> queries;
+  {
+    std::ofstream out(list, std::ios::binary);
+    for (std::size_t i = 0; i < count; i++) {
+      std::string name = std::string(kinds[i % 6]) + " DU " +
+                         std::to_string(i * 7919 % 1000003) + " RUE";
+      out << name << "\n";
+      if (i % 997 == 0) {
+        name[1] = '0'; // OCR error
+        queries.push_back(name);
+      }
+    }
+  }
+  auto t0 = std::chrono::steady_clock::now();
+  tv::compile_merchant_dictionary(list, dict);
+  double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                             t0)
+                   .count();
+  std::printf("merchant dictionary of %zu names (compiled in %.2f s, %d "
+              "iterations)\n",
+              count, sec, iters);
+
+  bench("merchants_open", 0, iters, [&] {
+    sink = sink + tv::MerchantDictionary::open(dict)->names();
+  });
+  auto d = tv::MerchantDictionary::open(dict);
+  std::size_t next = 0;
+  bench("merchants_lookup", 24, iters * 10, [&] {
+    next = (next + 1) % queries.size();
+    sink = sink + d->find(queries[next]).has_value();
+  });
+  std::remove(list.c_str());
+  std::remove(dict.c_str());
+}
+
+// Near-duplicate index of `count` random fingerprints: lookups of misses
+// (the usual case) and of close ones, additions, and the snapshot.
+void run_near_duplicate_suite(const std::string &ticket, std::size_t count,
+                              int iters) {
+  const std::string snapshot = "/tmp/tv_bench_near_duplicates.bin";
+  std::printf("near-duplicate index of %zu tickets (%d iterations)\n", count,
+              iters);
+  bench("simhash", ticket.size(), iters,
+        [&] { sink = sink + tv::simhash(ticket); });
+
+  std::mt19937_64 rng(1);
+  tv::NearDuplicateIndex index;
+  std::vector<std::uint64_t> seen;
+  for (std::size_t i = 0; i < count; i++) {
+    seen.push_back(rng());
+    index.add(seen.back());
+  }
+  bench("near_dup_miss", 8, iters * 10,
+        [&] { sink = sink + index.find(rng()).has_value(); });
+  std::size_t next = 0;
+  bench("near_dup_hit", 8, iters * 10, [&] {
+    next = (next + 7919) % seen.size();
+    sink = sink + index.find(seen[next] ^ 0x1001).has_value();
+  });
+  bench("near_dup_add", 8, iters * 10,
+        [&] { sink = sink + index.find_and_add(rng()).has_value(); });
+  index.save(snapshot);
+  bench("near_dup_load", 0, iters / 200 > 0 ? iters / 200 : 1, [&] {
+    sink = sink + tv::NearDuplicateIndex::load(snapshot)->size();
+  });
+  std::remove(snapshot.c_str());
+}
+
+// Batch summary: adding one ticket's output to it, and merging two filled
+// with `count` tickets between them, over as many merchant names (what the
+// end of a run costs per thread).
+void run_summary_suite(const std::string &ticket, std::size_t count,
+                       int iters) {
+  std::printf("batch summary (%zu tickets, %d iterations)\n", count, iters);
+  tv::Options opt;
+  auto out = tv::run(ticket, opt);
+  tv::BatchSummary summary;
+  bench("summary_add", 0, iters * 100, [&] { summary.add(out); });
+
+  tv::BatchSummary a, b;
+  std::mt19937_64 rng(5);
+  for (std::size_t i = 0; i < count; i++) {
+    out.ticket.merchant.value = "MERCHANT " + std::to_string(rng() % count);
+    out.ticket.total.value = tv::Money{double(rng() % 10000) / 100.0};
+    (i % 2 ? a : b).add(out);
+  }
+  bench("summary_merge", 0, iters / 10 > 0 ? iters / 10 : 1, [&] {
+    tv::BatchSummary m = a;
+    m.merge(b);
+    sink = sink + m.tickets();
+  });
+  std::printf("  %-18s %12zu bytes\n", "summary_memory", a.memory());
+}
+
+// Columnar output of `count` tickets against JSON lines: writing, then
+// loading the totals back (the analytics case: one field of every ticket).
+void run_columnar_suite(const std::string &ticket, std::size_t count,
+                        int iters) {
+  const std::string path = "/tmp/tv_bench_results.col";
+  tv::Options opt;
+  std::vector<tv::EngineOutput> outs;
+  for (std::size_t i = 0; i < 16; i++)
+    outs.push_back(tv::run(ticket + "\nTOTAL " + std::to_string(i) + ",50\n",
+                           opt));
+  std::string lines;
+  for (std::size_t i = 0; i < count; i++)
+    lines += tv::to_json_v1(outs[i % outs.size()]) + "\n";
+
+  auto write = [&] {
+    tv::ColumnarWriter writer(path);
+    for (std::size_t i = 0; i < count; i++)
+      writer.add(std::to_string(i), &outs[i % outs.size()]);
+    writer.finish();
+    return writer.bytes();
+  };
+  const std::size_t bytes = write();
+  std::printf("columnar output of %zu tickets (%zu bytes, JSON lines %zu "
+              "bytes, %d iterations)\n",
+              count, bytes, lines.size(), iters);
+  bench("columnar_write", bytes, iters, [&] { sink = sink + write(); });
+  bench("columnar_totals", bytes, iters, [&] {
+    tv::ColumnarReader reader(path);
+    tv::ColumnarBlock block;
+    while (reader.next(&block, tv::column_bit(tv::ColumnId::TotalCents)))
+      for (const auto &t : block.total_cents)
+        sink = sink + t.value_or(0);
+  });
+  bench("json_totals", lines.size(), iters, [&] {
+    std::size_t from = 0;
+    for (std::size_t nl; (nl = lines.find('\n', from)) != std::string::npos;
+         from = nl + 1) {
+      auto doc = nlohmann::json::parse(lines.begin() + from,
+                                       lines.begin() + nl);
+      sink = sink + doc["result"]["fields"]["total"]["value"].get<double>();
+    }
+  });
+  std::remove(path.c_str());
+}
+
+// A directory of `count` ticket-sized files (page cache warm): reading them
+// with each ReadMethod, then the whole --input-dir run with output to
+// /dev/null.
+void run_input_dir_suite(const std::string &ticket, std::size_t count,
+                         int iters) {
+  const std::string dir = "/tmp/tv_bench_input_dir";
+  ::mkdir(dir.c_str(), 0700);
+  std::vector<std::string> names;
+  std::size_t bytes = 0;
+  for (std::size_t i = 0; i < count; i++) {
+    names.push_back(std::to_string(i) + ".txt");
+    std::string text = ticket + "\nRef " + std::to_string(i) + "\n";
+    std::ofstream(dir + "/" + names.back(), std::ios::binary) << text;
+    bytes += text.size();
+  }
+  std::printf("input dir of %zu files (%zu bytes, %d iterations)\n", count,
+              bytes, iters);
+
+  auto files_per_s = [&](const char *name, auto &&f) {
+    f(); // warm-up
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < iters; i++)
+      f();
+    double sec = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - t0)
+                     .count();
+    std::printf("  %-18s %12.0f files/s %9.1f MB/s\n", name,
+                (double)count * iters / sec, (double)bytes * iters / sec / 1e6);
+  };
+  int dir_fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+  for (auto method : {tv::ReadMethod::Serial, tv::ReadMethod::Threads,
+                      tv::ReadMethod::Uring}) {
+    tv::FileReader reader(method);
+    std::string name = std::string("read_") + tv::read_method_name(method);
+    if (reader.method() != method)
+      name += "(n/a)";
+    files_per_s(name.c_str(), [&] {
+      reader.read(dir_fd, names, 0, names.size(),
+                  [](std::size_t, std::string &&text, int) {
+                    sink = sink + text.size();
+                  });
+    });
+  }
+  ::close(dir_fd);
+
+  int null_fd = ::open("/dev/null", O_WRONLY);
+  tv::Options opt;
+  for (auto method : {tv::ReadMethod::Serial, tv::ReadMethod::Uring}) {
+    std::string name = std::string("input_dir_") + tv::read_method_name(method);
+    files_per_s(name.c_str(), [&] {
+      sink = sink + tv::run_input_dir(dir, opt, null_fd, method).files;
+    });
+  }
+  ::close(null_fd);
+
+  for (const auto &n : names)
+    std::remove((dir + "/" + n).c_str());
+  ::rmdir(dir.c_str());
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *path =
+      argc > 1 ? argv[1] : "tests/fixtures/receipt_real_001.txt";
+  int iters = argc > 2 ? std::atoi(argv[2]) : 2000;
+
+  std::string ticket = load(path);
+  if (ticket.empty()) {
+    std::fprintf(stderr, "cannot read fixture: %s\n", path);
+    return 1;
+  }
+
+  run_suite("ticket", ticket, iters);
+
+  // Multi-megabyte input (merged multi-page scans): the fixture repeated.
+  std::string big;
+  while (big.size() < (4u << 20))
+    big += ticket;
+  run_suite("4 MB", big, iters / 200 > 0 ? iters / 200 : 1);
+
+  run_batch_suite(ticket, 256, iters / 100 > 0 ? iters / 100 : 1);
+  run_registry_suite(1u << 20, iters);
+  run_merchant_suite(200000, iters);
+  run_near_duplicate_suite(ticket, 1u << 20, iters);
+  run_summary_suite(ticket, 1u << 20, iters);
+  run_columnar_suite(ticket, 1u << 16, iters / 400 > 0 ? iters / 400 : 1);
+  run_input_dir_suite(ticket, 10000, iters / 400 > 0 ? iters / 400 : 1);
+  return 0;
+}
@@ -0,0 +1,198 @@
+// Cold start of the CLI, one process per ticket: time from spawning
+// ticketverify to the first byte of its JSON on stdout, split into phases
+// with the timestamps the process prints under --debug (src/main.cpp).
+// With a budget, exits 1 when the median exec-to-first-byte exceeds it, so
+// a startup regression fails the run.
+//
+//   tv_bench_startup path/to/ticketverify [fixture.txt] [runs] [budget_us]
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+namespace {
+
+// The phases, in the order they end: the child's (as --debug names them)
+// between spawning it and reading its first byte.
+enum Phase {
+  ToMain,    // spawn, exec, dynamic loading, static initialization
+  Args,      // argv copied and parsed
+  Input,     // stdin read and fed to the session
+  Engine,    // session finished
+  Json,      // output serialized
+  Write,     // written to stdout
+  FirstByte, // spawn to the first byte read by the parent
+  Exit,      // first byte to the process reaped
+  phase_count
+};
+
+constexpr const char *phase_names[phase_count] = {
+    "to_main", "args", "input", "engine",
+    "json",    "write", "first_byte", "exit"};
+constexpr const char *child_names[Write + 1] = {"main",   "args", "input",
+                                                "engine", "json", "write"};
+
+std::uint64_t now_ns() {
+  timespec ts{};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000u +
+         static_cast<std::uint64_t>(ts.tv_nsec);
+}
+
+std::string load(const char *path) {
+  std::ifstream f(path, std::ios::binary);
+  std::stringstream ss;
+  ss << f.rdbuf();
+  return ss.str();
+}
+
+void report(const char *name, std::vector<double> us) {
+  std::sort(us.begin(), us.end());
+  double sum = 0;
+  for (double v : us)
+    sum += v;
+  auto pct = [&](double p) { return us[(std::size_t)(p * (us.size() - 1))]; };
+  std::printf("  %-12s mean %8.1f us  p50 %8.1f us  p99 %8.1f us\n", name,
+              sum / us.size(), pct(0.5), pct(0.99));
+}
+
+// Reads the child's "[debug] startup ns: main N args N ..." line into
+// stamps[ToMain..Write].
+bool parse_stamps(const std::string &err, std::uint64_t *stamps) {
+  auto at = err.find("[debug] startup ns:");
+  if (at == std::string::npos)
+    return false;
+  std::istringstream line(err.substr(at + 19));
+  for (int p = ToMain; p <= Write; p++) {
+    std::string name;
+    if (!(line >> name >> stamps[p]) || name != child_names[p])
+      return false;
+  }
+  return true;
+}
+
+// One ticket through a fresh process. The ticket is in the stdin pipe
+// before the spawn, so the child never waits on the parent.
+bool run_once(const char *exe, const std::string &ticket, double *us) {
+  int in[2], out[2], err[2];
+  if (pipe(in) != 0 || pipe(out) != 0 || pipe(err) != 0)
+    return false;
+  if (fcntl(in[1], F_SETPIPE_SZ, 1 << 20) < (int)ticket.size() ||
+      write(in[1], ticket.data(), ticket.size()) != (ssize_t)ticket.size())
+    return false;
+  close(in[1]);
+
+  posix_spawn_file_actions_t fa;
+  posix_spawn_file_actions_init(&fa);
+  posix_spawn_file_actions_adddup2(&fa, in[0], 0);
+  posix_spawn_file_actions_adddup2(&fa, out[1], 1);
+  posix_spawn_file_actions_adddup2(&fa, err[1], 2);
+  posix_spawn_file_actions_addclose(&fa, out[0]);
+  posix_spawn_file_actions_addclose(&fa, err[0]);
+  char *argv[] = {const_cast<char *>(exe), const_cast<char *>("--debug"),
+                  nullptr};
+  pid_t pid;
+  const std::uint64_t t0 = now_ns();
+  int rc = posix_spawn(&pid, exe, &fa, nullptr, argv, environ);
+  posix_spawn_file_actions_destroy(&fa);
+  close(in[0]);
+  close(out[1]);
+  close(err[1]);
+  if (rc != 0)
+    return false;
+
+  char buf[4096];
+  ssize_t n = read(out[0], buf, sizeof(buf));
+  const std::uint64_t first = now_ns();
+  while (n > 0)
+    n = read(out[0], buf, sizeof(buf));
+  std::string errors;
+  while ((n = read(err[0], buf, sizeof(buf))) > 0)
+    errors.append(buf, (std::size_t)n);
+  close(out[0]);
+  close(err[0]);
+  int status;
+  waitpid(pid, &status, 0);
+  const std::uint64_t reaped = now_ns();
+
+  std::uint64_t stamps[Write + 1];
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 ||
+      !parse_stamps(errors, stamps))
+    return false;
+  std::uint64_t prev = t0;
+  for (int p = ToMain; p <= Write; p++) {
+    us[p] = (double)(stamps[p] - prev) / 1000.0;
+    prev = stamps[p];
+  }
+  us[FirstByte] = (double)(first - t0) / 1000.0;
+  us[Exit] = (double)(reaped - first) / 1000.0;
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::fprintf(stderr,
+                 "usage: %s path/to/ticketverify [fixture] [runs] "
+                 "[budget_us]\n",
+                 argv[0]);
+    return 2;
+  }
+  const char *exe = argv[1];
+  const char *path =
+      argc > 2 ? argv[2] : "tests/fixtures/receipt_real_001.txt";
+  int runs = argc > 3 ? std::max(1, std::atoi(argv[3])) : 500;
+  double budget_us = argc > 4 ? std::atof(argv[4]) : 0.0;
+
+  std::string ticket = load(path);
+  if (ticket.empty()) {
+    std::fprintf(stderr, "cannot read fixture: %s\n", path);
+    return 1;
+  }
+  std::printf("startup of %s (%zu bytes, %d runs)\n", exe, ticket.size(),
+              runs);
+
+  std::vector<double> lat[phase_count];
+  double us[phase_count];
+  for (int i = 0; i < runs + 20; i++) {
+    if (!run_once(exe, ticket, us)) {
+      std::fprintf(stderr, "run failed (no --debug startup line?)\n");
+      return 1;
+    }
+    if (i >= 20) // warm-up: page cache, binary mapped
+      for (int p = 0; p < phase_count; p++)
+        lat[p].push_back(us[p]);
+  }
+  for (int p = 0; p < phase_count; p++)
+    report(phase_names[p], lat[p]);
+
+  if (budget_us > 0) {
+    auto &first = lat[FirstByte];
+    std::nth_element(first.begin(), first.begin() + first.size() / 2,
+                     first.end());
+    double p50 = first[first.size() / 2];
+    if (p50 > budget_us) {
+      std::printf("  over budget: first_byte p50 %.1f us > %.1f us\n", p50,
+                  budget_us);
+      return 1;
+    }
+    std::printf("  within budget: first_byte p50 %.1f us <= %.1f us\n", p50,
+                budget_us);
+  }
+  return 0;
+}
@@ -0,0 +1,199 @@
+// Request latency by transport: one CLI process per ticket over pipes (what
+// the backend does today) against the shared-memory rings of --shm; then
+// interactive latency over --shm while bulk callers keep the engine busy,
+// with and without priority classes.
+//
+//   tv_bench_transport path/to/ticketverify [fixture.txt] [iterations]
+
+#include "tv/engine.hpp"
+#include "tv/json.hpp"
+#include "tv/shm.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+std::string load(const char *path) {
+  std::ifstream f(path, std::ios::binary);
+  std::stringstream ss;
+  ss << f.rdbuf();
+  return ss.str();
+}
+
+void report(const char *name, std::vector<double> us) {
+  std::sort(us.begin(), us.end());
+  double sum = 0;
+  for (double v : us)
+    sum += v;
+  auto pct = [&](double p) { return us[(std::size_t)(p * (us.size() - 1))]; };
+  std::printf("  %-14s mean %9.1f us  p50 %9.1f us  p99 %9.1f us\n", name,
+              sum / us.size(), pct(0.5), pct(0.99));
+}
+
+// One ticket through a fresh CLI process: spawn, write stdin, read stdout.
+bool pipe_request(const char *exe, const std::string &ticket,
+                  std::string *json) {
+  int in[2], out[2];
+  if (pipe(in) != 0 || pipe(out) != 0)
+    return false;
+  posix_spawn_file_actions_t fa;
+  posix_spawn_file_actions_init(&fa);
+  posix_spawn_file_actions_adddup2(&fa, in[0], 0);
+  posix_spawn_file_actions_adddup2(&fa, out[1], 1);
+  posix_spawn_file_actions_addclose(&fa, in[1]);
+  posix_spawn_file_actions_addclose(&fa, out[0]);
+  char *argv[] = {const_cast<char *>(exe), nullptr};
+  pid_t pid;
+  int rc = posix_spawn(&pid, exe, &fa, nullptr, argv, environ);
+  posix_spawn_file_actions_destroy(&fa);
+  close(in[0]);
+  close(out[1]);
+  if (rc != 0)
+    return false;
+
+  bool ok = write(in[1], ticket.data(), ticket.size()) ==
+            static_cast<ssize_t>(ticket.size());
+  close(in[1]);
+  json->clear();
+  char buf[4096];
+  ssize_t n;
+  while ((n = read(out[0], buf, sizeof(buf))) > 0)
+    json->append(buf, (std::size_t)n);
+  close(out[0]);
+  int status;
+  waitpid(pid, &status, 0);
+  return ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::fprintf(stderr, "usage: %s path/to/ticketverify [fixture] [iters]\n",
+                 argv[0]);
+    return 2;
+  }
+  const char *exe = argv[1];
+  const char *path =
+      argc > 2 ? argv[2] : "tests/fixtures/receipt_real_001.txt";
+  int iters = argc > 3 ? std::atoi(argv[3]) : 2000;
+
+  std::string ticket = load(path);
+  if (ticket.empty()) {
+    std::fprintf(stderr, "cannot read fixture: %s\n", path);
+    return 1;
+  }
+  std::printf("transport latency (%zu bytes, %d requests)\n", ticket.size(),
+              iters);
+
+  std::string json;
+  std::vector<double> lat;
+  int pipe_iters = std::max(1, iters / 10); // a spawn costs milliseconds
+  for (int i = 0; i < pipe_iters; i++) {
+    auto t0 = clock_type::now();
+    if (!pipe_request(exe, ticket, &json)) {
+      std::fprintf(stderr, "CLI request failed\n");
+      return 1;
+    }
+    lat.push_back(std::chrono::duration<double, std::micro>(clock_type::now() -
+                                                            t0)
+                      .count());
+  }
+  report("pipe_cli", lat);
+
+  std::string name = "/tv_bench_" + std::to_string(getpid());
+  pid_t server;
+  char *sargv[] = {const_cast<char *>(exe), const_cast<char *>("--shm"),
+                   name.data(), nullptr};
+  if (posix_spawn(&server, exe, nullptr, nullptr, sargv, environ) != 0) {
+    std::fprintf(stderr, "cannot start %s --shm\n", exe);
+    return 1;
+  }
+  tv::ShmClient client;
+  if (!client.open(name, 5000)) {
+    std::fprintf(stderr, "cannot attach to %s\n", name.c_str());
+    kill(server, SIGTERM);
+    return 1;
+  }
+
+  tv::Options opt;
+  lat.clear();
+  for (int i = 0; i < iters + 100; i++) {
+    auto t0 = clock_type::now();
+    if (client.call(ticket, opt, &json) != 0) {
+      std::fprintf(stderr, "shm request failed\n");
+      break;
+    }
+    if (i >= 100) // warm-up
+      lat.push_back(std::chrono::duration<double, std::micro>(
+                        clock_type::now() - t0)
+                        .count());
+  }
+  if (!lat.empty())
+    report("shm_ring", lat);
+
+  // Mixed load: bulk callers send receipts of ~48 KB back to back while one
+  // interactive caller measures its latency.
+  std::string bulk_ticket;
+  while (bulk_ticket.size() < 48 * 1024)
+    bulk_ticket += ticket;
+  for (auto bulk_class : {tv::Priority::Interactive, tv::Priority::Bulk}) {
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> bulk;
+    for (int t = 0; t < 4; t++)
+      bulk.emplace_back([&] {
+        std::string out;
+        while (!stop.load())
+          client.call(bulk_ticket, opt, &out, bulk_class);
+      });
+    lat.clear();
+    for (int i = 0; i < std::max(1, iters / 10); i++) {
+      auto t0 = clock_type::now();
+      client.call(ticket, opt, &json);
+      lat.push_back(std::chrono::duration<double, std::micro>(
+                        clock_type::now() - t0)
+                        .count());
+    }
+    stop = true;
+    for (auto &t : bulk)
+      t.join();
+    report(bulk_class == tv::Priority::Bulk ? "mixed_classes" : "mixed_fifo",
+           lat);
+  }
+  if (client.stats(&json) == 0)
+    std::printf("  stats %s\n", json.c_str());
+
+  // In-process floor: engine and serializer, no transport.
+  lat.clear();
+  for (int i = 0; i < iters; i++) {
+    auto t0 = clock_type::now();
+    json = tv::to_json_v1(tv::run(ticket, opt));
+    lat.push_back(std::chrono::duration<double, std::micro>(clock_type::now() -
+                                                            t0)
+                      .count());
+  }
+  report("in_process", lat);
+
+  client.close();
+  kill(server, SIGTERM);
+  waitpid(server, nullptr, 0);
+  return 0;
+}
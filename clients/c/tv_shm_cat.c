@@ -0,0 +1,66 @@
+/*
+ * Same contract as the CLI, over shared memory:
+ *
+ *   tv_shm_cat NAME < ocr.txt     (engine started with: ticketverify --shm NAME)
+ *
+ * Prints the JSON document and exits with the engine's exit code.
+ */
+#define _GNU_SOURCE /* syscall() in tv/shm_ring.h */
+
+#include "tv_shm_client.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main(int argc, char **argv) {
+  tv_shm_client *c;
+  char *text, *json = NULL;
+  size_t cap, len = 0, json_len = 0;
+  int code;
+
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s NAME < ocr.txt\n", argv[0]);
+    return 2;
+  }
+  c = tv_shm_client_open(argv[1], 1000);
+  if (!c) {
+    perror("tv_shm_client_open");
+    return 3;
+  }
+
+  /* Read one byte past the limit to tell "full" from "too large". */
+  cap = tv_shm_client_max_request(c) + 1;
+  text = (char *)malloc(cap);
+  if (!text) {
+    tv_shm_client_close(c);
+    return 3;
+  }
+  while (len < cap) {
+    size_t n = fread(text + len, 1, cap - len, stdin);
+    if (n == 0)
+      break;
+    len += n;
+  }
+  if (len == cap) {
+    fputs("{\"ok\":false,\"error\":{\"code\":\"INPUT_TOO_LARGE\","
+          "\"message\":\"stdin exceeds max size\"}}",
+          stdout);
+    free(text);
+    tv_shm_client_close(c);
+    return 2;
+  }
+
+  code = tv_shm_client_call(c, text, len, NULL, &json, &json_len);
+  free(text);
+  if (code < 0) {
+    fputs("engine unreachable\n", stderr);
+    tv_shm_client_close(c);
+    return 3;
+  }
+  fwrite(json, 1, json_len, stdout);
+  fputc('\n', stdout);
+  free(json);
+  tv_shm_client_close(c);
+  return code;
+}
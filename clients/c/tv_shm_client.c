@@ -0,0 +1,182 @@
+#define _GNU_SOURCE /* syscall(), usleep(), kill() */
+
+#include "tv_shm_client.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define IDLE_POLL_MS 100
+
+struct tv_shm_client {
+  tv_shm_header *seg;
+  size_t size;
+  uint64_t next_id;
+};
+
+static int process_alive(int32_t pid) {
+  return pid > 0 && (kill(pid, 0) == 0 || errno != ESRCH);
+}
+
+/* Maps the segment once the engine has published it; NULL to retry. */
+static tv_shm_header *map_ready(const char *path, size_t *size) {
+  int fd = shm_open(path, O_RDWR, 0);
+  struct stat st;
+  void *mem;
+  if (fd < 0)
+    return NULL;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(tv_shm_header)) {
+    close(fd);
+    return NULL;
+  }
+  *size = (size_t)st.st_size;
+  mem = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED)
+    return NULL;
+  if (__atomic_load_n(&((tv_shm_header *)mem)->magic, __ATOMIC_ACQUIRE) !=
+      TV_SHM_MAGIC) {
+    munmap(mem, *size);
+    return NULL;
+  }
+  return (tv_shm_header *)mem;
+}
+
+tv_shm_client *tv_shm_client_open(const char *name, int timeout_ms) {
+  char path[256];
+  tv_shm_header *h = NULL;
+  size_t size = 0;
+  int waited;
+  int32_t self = (int32_t)getpid(), owner;
+  tv_shm_client *c;
+
+  if (snprintf(path, sizeof(path), "%s%s", name[0] == '/' ? "" : "/", name) >=
+      (int)sizeof(path)) {
+    errno = ENAMETOOLONG;
+    return NULL;
+  }
+  for (waited = 0; !(h = map_ready(path, &size)); waited += 5) {
+    if (waited >= timeout_ms) {
+      errno = ENOENT;
+      return NULL;
+    }
+    usleep(5000);
+  }
+  if (h->version != TV_SHM_VERSION ||
+      tv_shm_segment_size(h->slot_count, h->slot_size) != size) {
+    munmap(h, size);
+    errno = EPROTO;
+    return NULL;
+  }
+
+  /* Single client: take the segment over only from a dead one. */
+  owner = __atomic_load_n(&h->client_pid, __ATOMIC_ACQUIRE);
+  if ((owner != 0 && process_alive(owner)) ||
+      !__atomic_compare_exchange_n(&h->client_pid, &owner, self, 0,
+                                   __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+    munmap(h, size);
+    errno = EBUSY;
+    return NULL;
+  }
+
+  c = (tv_shm_client *)malloc(sizeof(*c));
+  if (!c) {
+    munmap(h, size);
+    return NULL;
+  }
+  c->seg = h;
+  c->size = size;
+  c->next_id = (uint64_t)self << 32;
+  return c;
+}
+
+void tv_shm_client_close(tv_shm_client *c) {
+  int32_t self = (int32_t)getpid();
+  if (!c)
+    return;
+  __atomic_compare_exchange_n(&c->seg->client_pid, &self, 0, 0,
+                              __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+  munmap(c->seg, c->size);
+  free(c);
+}
+
+size_t tv_shm_client_max_request(const tv_shm_client *c) {
+  return c->seg->slot_size;
+}
+
+/* Publishes the request described by *head (id assigned here) and waits
+ * for its response. */
+static int exchange(tv_shm_client *c, const tv_shm_slot *head,
+                    const char *payload, char **json, size_t *json_len) {
+  tv_shm_header *h = c->seg;
+  tv_shm_slot *req, *resp;
+  uint64_t id;
+
+  while (!(req = tv_shm_wait_reserve(h, &h->req, IDLE_POLL_MS)))
+    if (!process_alive(h->server_pid))
+      return -1;
+
+  id = ++c->next_id;
+  *req = *head;
+  req->id = id;
+  if (head->len)
+    memcpy(tv_shm_payload(req), payload, head->len);
+  tv_shm_publish(&h->req);
+
+  for (;;) {
+    int code;
+    if (!(resp = tv_shm_wait_peek(h, &h->resp, IDLE_POLL_MS))) {
+      if (!process_alive(h->server_pid))
+        return -1;
+      continue;
+    }
+    if (resp->id != id) { /* left over from a previous client */
+      tv_shm_release(&h->resp);
+      continue;
+    }
+    code = (int)resp->code;
+    *json_len = resp->len < h->slot_size ? resp->len : h->slot_size;
+    *json = (char *)malloc(*json_len ? *json_len : 1);
+    if (*json)
+      memcpy(*json, tv_shm_payload(resp), *json_len);
+    tv_shm_release(&h->resp);
+    return *json ? code : -1;
+  }
+}
+
+int tv_shm_client_call(tv_shm_client *c, const char *text, size_t len,
+                       const tv_shm_options *opt, char **json,
+                       size_t *json_len) {
+  tv_shm_slot head;
+
+  if (len > c->seg->slot_size)
+    return -1;
+  memset(&head, 0, sizeof(head));
+  head.len = (uint32_t)len;
+  head.kind = TV_SHM_KIND_TICKET;
+  if (opt) {
+    head.locale = opt->locale;
+    head.domain = opt->domain;
+    head.budget_ms = opt->budget_ms;
+    head.max_lines = opt->max_lines;
+    head.priority = opt->priority;
+    if (opt->deadline_ms)
+      head.deadline = tv_shm_deadline(opt->deadline_ms);
+    head.session = opt->session;
+  }
+  return exchange(c, &head, text, json, json_len);
+}
+
+int tv_shm_client_stats(tv_shm_client *c, char **json, size_t *json_len) {
+  tv_shm_slot head;
+
+  memset(&head, 0, sizeof(head));
+  head.kind = TV_SHM_KIND_STATS;
+  return exchange(c, &head, NULL, json, json_len);
+}
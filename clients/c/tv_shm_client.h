@@ -0,0 +1,53 @@
+/*
+ * Reference C client for the engine's shared-memory transport
+ * (ticketverify --shm NAME). Layout and ring operations: tv/shm_ring.h.
+ */
+#ifndef TV_SHM_CLIENT_H
+#define TV_SHM_CLIENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tv/shm_ring.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct tv_shm_client tv_shm_client;
+
+typedef struct tv_shm_options {
+  uint8_t locale;     /* TV_LOCALE_* */
+  uint8_t domain;     /* TV_DOMAIN_* */
+  uint32_t budget_ms; /* 0 = unbounded */
+  uint32_t max_lines; /* 0 = engine default */
+  uint8_t priority;     /* TV_PRIORITY_* */
+  uint32_t deadline_ms; /* longest wait in the engine's queue, 0 = none */
+  uint64_t session;     /* successive frames of one receipt, 0 = none */
+} tv_shm_options;
+
+/* Attaches to segment `name`, waiting up to timeout_ms for the engine to
+ * create it. Returns NULL on failure (errno set). */
+tv_shm_client *tv_shm_client_open(const char *name, int timeout_ms);
+void tv_shm_client_close(tv_shm_client *c);
+
+/* Largest request the segment accepts, in bytes. */
+size_t tv_shm_client_max_request(const tv_shm_client *c);
+
+/* Sends one request and waits for its response. Returns the CLI exit code
+ * (0, 2 or 3) and stores the JSON document in a malloc'ed buffer in *json
+ * (not NUL-terminated, *json_len bytes; free() it). Returns -1 when the
+ * engine went away or the request is larger than the slot size. */
+int tv_shm_client_call(tv_shm_client *c, const char *text, size_t len,
+                       const tv_shm_options *opt, char **json,
+                       size_t *json_len);
+
+/* The engine's scheduling statistics (per-class queue-wait and service-time
+ * histograms) as a JSON document; same conventions as tv_shm_client_call. */
+int tv_shm_client_stats(tv_shm_client *c, char **json, size_t *json_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TV_SHM_CLIENT_H */
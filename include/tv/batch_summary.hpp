@@ -0,0 +1,63 @@
+#pragma once
+#include "tv/model.hpp"
+#include "tv/sketch.hpp"
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace tv {
+
+// Fleet-wide summary of a batch run, filled ticket by ticket so that the
+// run's outputs need not be kept or read again (--summary, with
+// --input-dir). Its memory does not grow with the number of tickets:
+//
+//   - distinct merchants: HyperLogLog;
+//   - top merchants, with their status mix: SpaceSaving;
+//   - total amounts: one DDSketch per currency (the first few currencies;
+//     later ones are only counted);
+//   - signals: how often each pair is present together, exactly.
+//
+// The merchant is its canonical name when the dictionary matched one, else
+// the value read. Fill one summary per thread and merge() them.
+class BatchSummary {
+public:
+  static constexpr std::size_t top_capacity = 1024; // merchants tracked
+  static constexpr std::size_t max_currencies = 8;
+
+  void add(const EngineOutput &out);
+  // A file that gave no ticket (unreadable, empty, engine error).
+  void add_skipped() { skipped_++; }
+  void merge(const BatchSummary &other);
+
+  std::uint64_t tickets() const { return tickets_; }
+  const HyperLogLog &merchants() const { return merchants_; }
+  const SpaceSaving &top_merchants() const { return top_; }
+  const std::map<std::string, DDSketch> &totals() const { return totals_; }
+
+  // Bytes held by the sketches.
+  std::size_t memory() const;
+
+  // One JSON document: {"tickets","skipped","status":{...},"merchants":
+  // {"distinct","distinct_error","without","top":[{"name","count","error",
+  // "status":{...}}, ...]},"totals":{"EUR":{"count","sum","min","max",
+  // "p50","p90","p99","relative_error"}, ...},"other_currencies",
+  // "signals":{"has_tva":{"has_tva","has_siret","has_card_keywords"},...},
+  // "memory_bytes"}. `top` lists the `top` largest merchants.
+  std::string to_json(std::size_t top = 20) const;
+
+private:
+  static constexpr std::size_t signals = 3; // has_tva, has_siret, has_card
+
+  std::uint64_t tickets_ = 0;
+  std::uint64_t skipped_ = 0;
+  std::array<std::uint64_t, 4> status_{}; // by Status
+  std::uint64_t without_merchant_ = 0;
+  HyperLogLog merchants_;
+  SpaceSaving top_{top_capacity};
+  std::map<std::string, DDSketch> totals_; // by currency
+  std::uint64_t other_currencies_ = 0;
+  std::array<std::array<std::uint64_t, signals>, signals> together_{};
+};
+
+} // namespace tv
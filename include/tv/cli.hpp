@@ -1,7 +1,9 @@
 #pragma once
 #include "tv/model.hpp"
+#include <cstdint>
 #include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace tv {
@@ -11,6 +13,31 @@ struct CliParseResult {
   bool show_help = false;
   bool show_version = false;
   std::optional<std::string> error; // if present => usage error
+
+  std::optional<std::string> zygote_socket; // --zygote PATH: serve requests
+  std::optional<std::string> via_zygote;    // --via-zygote PATH: forward
+  std::optional<std::string> shm_name;      // --shm NAME: serve over shm
+  std::uint32_t shm_workers = 1;            // --shm-workers N: server threads
+  std::uint32_t slow_ms = 100;              // --slow-ms N: flight recorder
+  std::optional<std::string> flight_dump;   // --flight-dump FILE: its dumps
+  // --near-duplicates FILE: index snapshot, with --shm only.
+  std::optional<std::string> near_duplicates;
+  std::optional<std::string> rules_path;    // --rules FILE: rule pack
+  std::optional<std::string> input_dir;     // --input-dir DIR: every file
+  std::string read_method = "auto";         // --read-method M: how
+  std::optional<std::string> summary;       // --summary FILE: its sketches
+  std::optional<std::string> columnar;      // --columnar FILE: its results
+
+  std::optional<std::string> shadow_rules;  // --shadow-rules FILE: candidate
+  double shadow_rate = 1.0;                 // --shadow-rate R: sampled share
+  std::optional<std::string> shadow_log;    // --shadow-log FILE: records
+
+  std::optional<std::string> registry_path; // --registry FILE: compiled
+  // --compile-registry CSV OUT: build OUT from CSV, then exit.
+  std::optional<std::pair<std::string, std::string>> compile_registry;
+  std::optional<std::string> merchants_path; // --merchants FILE: compiled
+  // --compile-merchants LIST OUT: build OUT from LIST, then exit.
+  std::optional<std::pair<std::string, std::string>> compile_merchants;
 };
 
 CliParseResult parse_args(const std::vector<std::string> &args);
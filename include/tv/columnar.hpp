@@ -0,0 +1,150 @@
+#pragma once
+#include "tv/mapped_file.hpp"
+#include "tv/model.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tv {
+
+// Columnar results of a batch run (--columnar FILE, with --input-dir), for
+// analytics that load a few fields of millions of tickets: one column per
+// field, so a reader decodes only the columns it asks for and skips the
+// others by their size.
+//
+// File layout (integers little-endian, varints LEB128):
+//
+//   file   := "TVCOL1\n\0" block* u32(0)
+//   block  := u32 rows (1 to max_block_rows), u32 columns, column{columns}
+//   column := u8 id (ColumnId), u8 encoding (Encoding), u32 size,
+//             byte[size]
+//
+// Each block holds up to block_rows rows and is self-contained: its
+// dictionaries are its own, so blocks can be read, dropped or split
+// independently. Encodings, by column:
+//
+//   Strings  file              per row: varint length, bytes
+//   Bits     has_*             1 bit per row, LSB first
+//   Packed   status            u8 width, then `width` bits per row
+//   Fixed16  confidence        u16 per row: round(confidence * 10000)
+//   Varint   total_cents,      presence Bits, then a zigzag varint per
+//            timing_*          present row
+//   Dict     error, merchant,  varint n, n x (varint length, bytes),
+//            currency          u8 width, `width` bits per row: 0 = absent,
+//                              i = the i-th string
+//   DictList warnings          varint n, n strings, u8 width, a varint
+//                              count per row, then `width` bits per code
+//                              (1-based)
+//
+// Tickets that gave no EngineOutput (empty or unreadable files) have status
+// "error" and their error code in `error`; every other column is absent or
+// zero for them.
+enum class ColumnId : std::uint8_t {
+  File,
+  Status,
+  Error,
+  Confidence,
+  Merchant,
+  TotalCents,
+  Currency,
+  HasTva,
+  HasSiret,
+  HasCardKeywords,
+  Warnings,
+  TimingTotalMs,
+  TimingParseMs,
+};
+inline constexpr std::size_t column_count = 13;
+
+enum class Encoding : std::uint8_t {
+  Strings,
+  Bits,
+  Packed,
+  Fixed16,
+  Varint,
+  Dict,
+  DictList,
+};
+
+// Largest block a reader accepts.
+inline constexpr std::size_t max_block_rows = 65536;
+
+// The rows of one block, the columns not read left empty.
+struct ColumnarBlock {
+  std::size_t rows = 0;
+  std::vector<std::string> file;
+  std::vector<Status> status;
+  std::vector<std::optional<std::string>> error;
+  std::vector<double> confidence;
+  std::vector<std::optional<std::string>> merchant;
+  std::vector<std::optional<std::int64_t>> total_cents;
+  std::vector<std::optional<std::string>> currency;
+  std::vector<bool> has_tva;
+  std::vector<bool> has_siret;
+  std::vector<bool> has_card_keywords;
+  std::vector<std::vector<std::string>> warnings;
+  std::vector<std::optional<std::int64_t>> timing_total_ms;
+  std::vector<std::optional<std::int64_t>> timing_parse_ms;
+};
+
+// Appends rows, writing a block every block_rows of them. Not thread-safe:
+// run_input_dir() adds each chunk's rows in name order once it is parsed.
+class ColumnarWriter {
+public:
+  static constexpr std::size_t block_rows = 4096;
+
+  // Creates or truncates `path`. Throws std::runtime_error.
+  explicit ColumnarWriter(const std::string &path);
+  ~ColumnarWriter();
+  ColumnarWriter(const ColumnarWriter &) = delete;
+  ColumnarWriter &operator=(const ColumnarWriter &) = delete;
+
+  // One ticket; `error_code` is used when `out` is null.
+  void add(std::string_view file, const EngineOutput *out,
+           std::string_view error_code = {});
+  // Writes the pending rows and the end marker, then closes the file.
+  // Throws std::runtime_error.
+  void finish();
+
+  std::size_t rows() const { return rows_; }
+  std::size_t bytes() const { return bytes_; }
+
+private:
+  void write_block();
+  void write(std::string_view data);
+
+  std::string path_;
+  int fd_ = -1;
+  ColumnarBlock pending_;
+  std::size_t rows_ = 0;
+  std::size_t bytes_ = 0;
+};
+
+// Reads a columnar file block by block (mapped, so an unread column costs
+// nothing but its header).
+class ColumnarReader {
+public:
+  // Throws std::runtime_error("columnar: <path>: <reason>").
+  explicit ColumnarReader(const std::string &path);
+
+  // Decodes the next block's columns in `columns` (bits by ColumnId) into
+  // *block; false at the end of the file. Throws std::runtime_error on a
+  // corrupt block.
+  bool next(ColumnarBlock *block, std::uint32_t columns = ~0u);
+
+private:
+  std::string path_;
+  MappedFile file_;
+  std::size_t at_ = 0;
+  bool done_ = false;
+};
+
+// A bit for ColumnarReader::next's mask.
+constexpr std::uint32_t column_bit(ColumnId c) {
+  return std::uint32_t{1} << static_cast<unsigned>(c);
+}
+
+} // namespace tv
@@ -0,0 +1,39 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace tv {
+
+// Cooperative time budget for one ticket. Long-running stages poll
+// expired() between bounded slices of work; once expired it stays expired.
+class Deadline {
+public:
+  Deadline() = default; // unbounded
+  explicit Deadline(std::uint32_t budget_ms) {
+    if (budget_ms > 0) {
+      at_ = std::chrono::steady_clock::now() +
+            std::chrono::milliseconds(budget_ms);
+      armed_ = true;
+    }
+  }
+
+  bool bounded() const { return armed_; }
+
+  bool expired() {
+    if (!expired_ && armed_ && std::chrono::steady_clock::now() >= at_)
+      expired_ = true;
+    return expired_;
+  }
+
+private:
+  std::chrono::steady_clock::time_point at_{};
+  bool armed_ = false;
+  bool expired_ = false;
+};
+
+// Work done between two deadline checks, in bytes of input. All stages are
+// linear, so this bounds the overshoot to well under a millisecond.
+inline constexpr std::size_t deadline_slice = 16 * 1024;
+
+} // namespace tv
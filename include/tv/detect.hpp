@@ -0,0 +1,24 @@
+#pragma once
+#include "tv/model.hpp"
+#include <cstddef>
+#include <string_view>
+
+namespace tv {
+
+struct Detection {
+  Locale locale = Locale::FrFR;
+  double locale_confidence = 0.0; // 0..1
+  Domain domain = Domain::Auto;   // Auto => no confident domain
+  double domain_confidence = 0.0; // 0..1
+};
+
+// Only the head of the ticket is scored: merchant header, address and the
+// first items carry the locale and domain cues.
+inline constexpr std::size_t detect_window = 512;
+
+// Locale and domain guess from the first detect_window bytes of normalized
+// text, using a precomputed model (keyword cues, character trigrams,
+// postcode/phone shapes). Without evidence the locale falls back to fr_FR.
+Detection detect_locale_domain(std::string_view normalized_text);
+
+} // namespace tv
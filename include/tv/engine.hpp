@@ -1,11 +1,191 @@
 #pragma once
+#include "tv/deadline.hpp"
+#include "tv/fingerprint.hpp"
 #include "tv/model.hpp"
+#include "tv/normalize.hpp"
+#include "tv/parse_company.hpp"
+#include "tv/parse_datetime.hpp"
+#include "tv/parse_items.hpp"
+#include "tv/parse_total.hpp"
+#include "tv/rule_pack.hpp"
+#include "tv/signals.hpp"
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
 #include <string_view>
+#include <unordered_map>
+#include <vector>
 
 namespace tv {
 
+class TaskPool;
+
 // Main pipeline (MVP stub inside for now).
 EngineOutput run(std::string_view ocr_text, const Options& opt);
 
-} // namespace tv
+// The prefix of `text` the CLI reads: up to the max_lines-th newline.
+std::string_view first_lines(std::string_view text, std::uint32_t max_lines);
+
+// From this size on, run() goes through the task graph on
+// TaskPool::shared() when that pool has workers.
+inline constexpr std::size_t parallel_min_bytes = 128 * 1024;
+
+// run() as a task graph on `pool`, whatever the input size: ingestion and
+// normalization per line-aligned chunk, then the extraction stages side by
+// side. The output is the serial one. A time budget still goes through
+// Session, serially.
+EngineOutput run(std::string_view ocr_text, const Options& opt, TaskPool& pool);
+
+// run() over many documents at once, for batch reprocessing of small
+// tickets: all of them are ingested and normalized into one packed buffer,
+// then each extractor only visits the lines where a KeywordPrefilter found
+// one of its keywords may start. Returns run()'s output for each document,
+// in order; with a time budget, the documents go through run() one by one.
+// The documents are then checked, in order, against the active
+// near-duplicate index (near_duplicate.hpp) when there is one, unless
+// near_duplicates is false (the caller checks them itself).
+std::vector<EngineOutput> run_batch(const std::vector<std::string_view>& docs,
+                                    const Options& opt,
+                                    bool near_duplicates = true);
+
+// A candidate rule pack evaluated next to the active one on the same
+// ingested, normalized and detected text (Session::begin with a shadow
+// pack): its output and what it cost on top of the primary evaluation.
+struct ShadowRun {
+  EngineOutput output;
+  std::chrono::nanoseconds shadow_time{}; // candidate scanners and extraction
+  std::chrono::nanoseconds total_time{};  // the whole ticket, both packs
+};
+
+// Incremental form of run(): begin(), feed() the text in chunks of any size
+// as it arrives, then finish(), which returns what run() would on the
+// concatenated chunks. Ingestion, normalization and the scanners (signals,
+// total, items, date, company id) advance chunk by chunk; only a bounded head of the
+// text (preview, detection, merchant header lines) and the span a scanner
+// is still matching are kept.
+// Options::budget_ms runs from the first chunk fed, so time spent waiting
+// for the input to arrive is not counted, and is polled between slices of
+// deadline_slice bytes.
+class Session {
+public:
+  void begin(const Options& opt);
+  // Also evaluates `shadow` (when not null) on the shared text; finish()
+  // still returns the active pack's output, shadow() the candidate's.
+  void begin(const Options& opt, std::shared_ptr<const RulePack> shadow);
+  void feed(std::string_view chunk);
+  EngineOutput finish();
+
+  // After finish(), for a session begun with a shadow pack.
+  const ShadowRun* shadow() const { return shadow_.get(); }
+
+private:
+  struct Shadow;
+
+  void parse_slice(std::string_view chunk);
+  void take(std::size_t from);
+  void advance(bool final);
+
+  Options opt_;
+  std::chrono::steady_clock::time_point t0_;
+  Deadline deadline_;
+  bool deadline_started_ = false;
+  bool skipped_ = false; // out of time: later input was not parsed
+  EngineOutput out_;
+
+  // raw input
+  std::uint32_t newlines_ = 0;
+  char last_ = '\n';
+  bool any_non_ws_ = false;
+  std::string carry_; // incomplete UTF-8 sequence at the end of a chunk
+  std::string scratch_;
+  std::size_t utf8_repairs_ = 0;
 
+  // normalized text
+  Normalizer normalizer_;
+  std::string text_;        // window still needed by the scanners
+  std::string head_;        // first detect_window bytes
+  std::string header_;      // what parse_merchant may look at, capped
+  std::size_t header_scan_ = 0;
+  std::size_t header_lines_ = 0;
+  bool header_done_ = false;
+  SimHasher fingerprint_;   // of all of it
+
+  std::shared_ptr<const RulePack> pack_; // active when the ticket began
+  const RuleSet* rules_ = nullptr; // set once locale/domain are resolved
+  std::optional<SignalScanner> signals_;
+  std::optional<TotalScanner> total_;
+  std::optional<ItemScanner> items_;
+  DateTimeScanner datetime_; // rule-independent
+  CompanyIdScanner company_; // same
+
+  // Candidate pack: its scanners follow the same text, then ShadowRun.
+  struct Shadow : ShadowRun {
+    std::shared_ptr<const RulePack> pack;
+    const RuleSet* rules = nullptr;
+    std::optional<SignalScanner> signals;
+    std::optional<TotalScanner> total;
+    std::optional<ItemScanner> items;
+  };
+  std::unique_ptr<Shadow> shadow_;
+};
+
+// Successive OCR texts of the same receipt, keyed by a client-supplied
+// session id (live camera OCR sends several, progressively better ones
+// within seconds). run() returns what tv::run() would, but extraction
+// resumes from the first line that differs from the previous frame: the
+// previous normalized text, its line index and the scanner state at each
+// line start are kept, and the merchant is reused when its header lines are
+// unchanged. A frame costs its text plus a checkpoint (a few hundred bytes)
+// per line: least recently used sessions are evicted once the frames take
+// more than max_bytes, the one just run excepted.
+class FrameCache {
+public:
+  explicit FrameCache(std::size_t max_bytes = 64 << 20)
+      : max_bytes_(max_bytes) {}
+
+  EngineOutput run(const std::string& session_id, std::string_view ocr_text,
+                   const Options& opt);
+  void erase(const std::string& session_id);
+  std::size_t size() const { return frames_.size(); }
+  // What the frames take, as counted against max_bytes.
+  std::size_t bytes() const { return bytes_; }
+
+  // Lines the last run() had to scan again (all of them for a new session).
+  std::size_t last_rescanned_lines() const { return last_rescanned_; }
+
+private:
+  struct Checkpoint {
+    SignalScanner signals;
+    TotalScanner total;
+    DateTimeScanner datetime;
+    CompanyIdScanner company;
+  };
+  struct Frame {
+    Locale locale_hint = Locale::Auto;
+    Domain domain_hint = Domain::Auto;
+    InputMeta detected; // detected_* fields only
+    std::shared_ptr<const RulePack> pack; // keeps `rules` alive
+    const RuleSet* rules = nullptr;
+
+    std::string text; // normalized
+    std::vector<std::size_t> line_starts;
+    std::vector<Checkpoint> checkpoints; // before each line, not final
+    std::size_t header_end = 0;          // merchant reads text[0, header_end)
+    Field<std::string> merchant;
+    std::uint64_t used = 0;
+    std::size_t bytes = 0; // as last counted
+  };
+
+  Frame& frame(const std::string& session_id);
+  void account(const std::string& session_id, Frame& f);
+
+  std::size_t max_bytes_;
+  std::size_t bytes_ = 0;
+  std::uint64_t tick_ = 0;
+  std::size_t last_rescanned_ = 0;
+  std::unordered_map<std::string, Frame> frames_;
+};
+
+} // namespace tv
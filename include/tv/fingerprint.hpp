@@ -0,0 +1,44 @@
+#pragma once
+#include <bit>
+#include <cstdint>
+#include <string_view>
+
+namespace tv {
+
+// Locality-sensitive fingerprint of a normalized ticket: a 64-bit SimHash
+// whose features are the words of the text (runs of ASCII letters and
+// digits, case folded, and of non-ASCII bytes). Re-photographing or
+// re-OCRing a receipt changes a few words, and so a few bits: two
+// fingerprints a few bits apart are likely the same receipt
+// (NearDuplicateIndex, near_duplicate.hpp). Line breaks and punctuation do
+// not count, so a different line wrapping gives the same fingerprint.
+//
+// Fed in chunks of any size (Session feeds what it normalizes); the state
+// is a few hundred bytes, no allocation.
+class SimHasher {
+public:
+  void feed(std::string_view normalized_text);
+  // 0 for a text without any word.
+  std::uint64_t finish();
+
+private:
+  void add_word();
+
+  std::int32_t weights_[64] = {};
+  std::uint64_t word_ = 0; // FNV-1a of the word being read
+  bool in_word_ = false;
+  bool any_ = false;
+};
+
+inline std::uint64_t simhash(std::string_view normalized_text) {
+  SimHasher h;
+  h.feed(normalized_text);
+  return h.finish();
+}
+
+// Bits that differ between two fingerprints.
+inline std::uint32_t fingerprint_distance(std::uint64_t a, std::uint64_t b) {
+  return static_cast<std::uint32_t>(std::popcount(a ^ b));
+}
+
+} // namespace tv
@@ -0,0 +1,114 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace tv {
+
+// What the flight recorder keeps of one served ticket.
+struct FlightRecord {
+  std::uint64_t id = 0;          // request id
+  std::uint64_t input_hash = 0;  // sketch_hash() of the request's bytes
+  std::uint64_t fingerprint = 0; // input.fingerprint, 0 when not run
+  std::int64_t finished_us = 0;  // wall clock, microseconds since the epoch
+  std::uint32_t bytes = 0;       // input size
+  std::uint32_t lines = 0;       // input.lines
+  // Stage durations: waiting in the queue, the engine run, the scoring
+  // within it (timing.score_ns), the JSON serialization.
+  std::uint32_t queue_us = 0;
+  std::uint32_t run_us = 0;
+  std::uint32_t score_ns = 0;
+  std::uint32_t json_us = 0;
+  std::uint8_t code = 0;       // exit code of the response
+  std::uint8_t status = 0;     // Status
+  std::uint16_t warnings = 0;  // how many
+  char first_warning[28] = {}; // code of the first one, NUL-terminated
+
+  // Time spent on this ticket itself, queue wait aside.
+  std::uint32_t service_us() const { return run_us + json_us; }
+};
+static_assert(sizeof(FlightRecord) % 8 == 0);
+
+// Where a dump went (stats_json reports it).
+struct FlightDump {
+  std::string path;
+  std::size_t records = 0;
+  std::size_t slow = 0;
+};
+
+// Recent tickets of a long-running server, kept to explain latency spikes
+// after the fact.
+//
+// One fixed-size ring per worker thread: each worker writes only its own
+// ring, so recording takes no lock, only a sequence number around the copy
+// (a seqlock). A dump taken while a worker overwrites a record skips that
+// one record. Tickets whose service time (FlightRecord::service_us: the
+// queue wait is the other tickets' doing) reaches the threshold also keep
+// their input in a side buffer bounded in bytes, oldest dropped first; that
+// one takes a lock, but only slow tickets reach it.
+class FlightRecorder {
+public:
+  static constexpr std::uint32_t default_records = 1024; // per worker
+  static constexpr std::size_t default_slow_bytes = 4u << 20;
+
+  // slow_us == 0 keeps no input.
+  FlightRecorder(std::uint32_t workers, std::uint32_t slow_us,
+                 std::uint32_t records = default_records,
+                 std::size_t slow_bytes = default_slow_bytes);
+
+  // By worker `worker` only. `input` is read only for a slow ticket.
+  void record(std::uint32_t worker, const FlightRecord &r,
+              std::string_view input);
+
+  // Everything, as one JSON document: {"pid","dumped_at_us","slow_us",
+  // "workers":[[record, ...] oldest first, ...],"slow":[record + "input"]}.
+  std::string dump_json() const { return render(nullptr); }
+
+  // dump_json() to `path`, replaced atomically. Throws std::runtime_error.
+  FlightDump dump(const std::string &path) const;
+
+private:
+  // The record as relaxed atomic words: a reader racing the writer gets
+  // a torn copy, which the sequence number rejects, never undefined
+  // behavior.
+  static constexpr std::size_t words = sizeof(FlightRecord) / 8;
+  struct Slot {
+    std::atomic<std::uint64_t> seq{0}; // odd while being written
+    std::atomic<std::uint64_t> record[words];
+  };
+  struct alignas(64) Ring {
+    std::unique_ptr<Slot[]> slots;
+    std::atomic<std::uint64_t> written{0};
+  };
+  struct Slow {
+    FlightRecord record;
+    std::string input;
+  };
+
+  std::string render(FlightDump *counts) const;
+
+  std::uint32_t slow_us_;
+  std::uint32_t records_;
+  std::size_t slow_bytes_;
+  std::unique_ptr<Ring[]> rings_;
+  std::uint32_t workers_;
+
+  mutable std::mutex slow_m_;
+  std::deque<Slow> slow_;
+  std::size_t slow_used_ = 0;
+};
+
+// Wall clock for FlightRecord::finished_us.
+inline std::int64_t flight_now_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+} // namespace tv
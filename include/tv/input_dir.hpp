@@ -0,0 +1,101 @@
+#pragma once
+#include "tv/model.hpp"
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace tv {
+
+class BatchSummary;
+class ColumnarWriter;
+
+// Bulk reprocessing of an archive stored as one small file per ticket,
+// where open/read/close, not parsing, is the cost.
+
+// How FileReader reads.
+enum class ReadMethod {
+  Auto,    // Uring when the kernel has it, else Threads
+  Uring,   // io_uring (Linux 5.6+): many openat/read/close in flight
+  Threads, // blocking reads on a few threads
+  Serial,  // one file after the other (the baseline)
+};
+
+const char *read_method_name(ReadMethod method);
+
+// A file's whole content, or errno (EFBIG past max_size).
+using OnFile =
+    std::function<void(std::size_t index, std::string &&text, int error)>;
+
+// Reads whole files relative to a directory descriptor.
+//
+// With io_uring, `depth` files are in flight at once: each takes an openat,
+// a read into a registered buffer (one per slot, pinned once), more reads
+// for a file larger than the buffer, and a close, submitted in batches with
+// one io_uring_enter per round of completions.
+class FileReader {
+public:
+  static constexpr std::size_t default_depth = 64;
+  static constexpr std::size_t buffer_size = 64 * 1024;
+
+  // Uring falls back to Threads when io_uring is unavailable or lacks an
+  // opcode.
+  explicit FileReader(ReadMethod method = ReadMethod::Auto,
+                      std::size_t max_size = 64 * 1024 * 1024,
+                      std::size_t depth = default_depth);
+  ~FileReader();
+  FileReader(const FileReader &) = delete;
+  FileReader &operator=(const FileReader &) = delete;
+
+  ReadMethod method() const { return method_; }
+
+  // Reads names[begin, end), calling on_file once per file in completion
+  // order: on this thread, or concurrently from the reader threads with
+  // Threads.
+  void read(int dir_fd, const std::vector<std::string> &names,
+            std::size_t begin, std::size_t end, const OnFile &on_file);
+
+private:
+  struct Ring;
+
+  void read_uring(int dir_fd, const std::vector<std::string> &names,
+                  std::size_t begin, std::size_t end, const OnFile &on_file);
+  void read_threads(int dir_fd, const std::vector<std::string> &names,
+                    std::size_t begin, std::size_t end,
+                    const OnFile &on_file);
+
+  ReadMethod method_;
+  std::size_t max_size_;
+  std::unique_ptr<Ring> ring_;
+};
+
+// The regular files of `dir`, sorted by name. Throws std::runtime_error.
+std::vector<std::string> list_input_dir(const std::string &dir);
+
+struct InputDirStats {
+  std::size_t files = 0;
+  std::size_t failed = 0; // unreadable or too large
+  std::size_t bytes = 0;
+  double seconds = 0.0;
+  ReadMethod method = ReadMethod::Auto;
+};
+
+// Runs every file of `dir` and writes one JSON document per line to out_fd,
+// in name order: the CLI's output for that file with a leading "file" key
+// (error documents included). Files are read in chunks; a chunk's tickets
+// go through run_batch() on the shared TaskPool as soon as each group of
+// them is read, and the chunk's output is written in one write(). With a
+// summary, every file is also added to it (one BatchSummary per parsing
+// thread, merged into *summary at the end); with a columnar writer, every
+// file is also added to it, in name order (the caller finish()es it).
+// Tickets are checked against the active near-duplicate index, when there
+// is one, in name order after each chunk is parsed.
+// Throws std::runtime_error when `dir` cannot be listed or out_fd written.
+InputDirStats run_input_dir(const std::string &dir, const Options &opt,
+                            int out_fd,
+                            ReadMethod method = ReadMethod::Auto,
+                            BatchSummary *summary = nullptr,
+                            ColumnarWriter *columnar = nullptr);
+
+} // namespace tv
@@ -1,11 +1,38 @@
 #pragma once
 #include "tv/model.hpp"
+#include "tv/scheduler.hpp"
+#include <cstddef>
 #include <string>
 
 namespace tv {
 
+struct FlightDump;
+struct ShadowRun;
+
 // Serialize EngineOutput as JSON string (single-line).
 std::string to_json_v1(const EngineOutput& out);
 
+// Same document, written into buf. Returns its full length; the output is
+// complete only when that is <= cap.
+std::size_t write_json_v1(const EngineOutput& out, char* buf, std::size_t cap);
+
+// Handcrafted error document: {"ok":false,"error":{code,message[,detail]}}.
+std::string error_json(const std::string& code, const std::string& message,
+                       const std::string* detail = nullptr);
+
+// Serving statistics: {"ok":true,"scheduler":{"queued":N,"classes":{
+// "interactive":{...},"bulk":{...}}}}, each class with its expired count and
+// its queue_wait_us / service_us histograms (count, mean, p50, p90, p99,
+// max, log2 buckets); with a flight recorder dump, "flight_recorder":{"path",
+// "records","slow"}.
+std::string stats_json(const SchedulerStats& stats, std::size_t queued,
+                       const FlightDump* dump = nullptr);
+
+// Shadow log record (single line): the rule versions, every result entry
+// that differs as {"field","old","new"[,"confidence_delta"]} (fields.* and
+// signals.* one by one), the overall confidence delta, and the cost:
+// {"cost_us":{"total","shadow"},"overhead":shadow / (total - shadow)}.
+std::string shadow_json(const EngineOutput& primary, const ShadowRun& shadow);
+
 } // namespace tv
 
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+
+namespace tv {
+
+// Read-only mapping of a whole file, for the offline-compiled lookup tables
+// (registry.hpp, merchant_dict.hpp): opening costs a system call or two
+// whatever the size, pages are faulted in by the lookups that touch them.
+class MappedFile {
+public:
+  // Throws std::runtime_error("<what>: <path>: <reason>").
+  MappedFile(const std::string &path, const char *what);
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile();
+
+  const unsigned char *data() const { return data_; }
+  std::size_t size() const { return size_; }
+
+private:
+  const unsigned char *data_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+// Writes `parts` one after the other to a new file next to `path` (created
+// with mkstemp, so never through a planted symlink), gives it `mode`, then
+// renames it over `path`: readers never see a partial file, and `path` is
+// left alone on error. Throws std::runtime_error("<what>: cannot write ...").
+void replace_file(const std::string &path, const char *what,
+                  std::initializer_list<std::string_view> parts,
+                  unsigned mode = 0644);
+
+// Writes `parts` to `fd` in one write(2), retried on a short write: the
+// CLI's stdout and stderr, so that it links no iostreams and pays none of
+// their setup at startup. Returns false on error, errno set.
+bool write_fd(int fd, std::initializer_list<std::string_view> parts);
+
+} // namespace tv
@@ -0,0 +1,99 @@
+#pragma once
+#include "tv/mapped_file.hpp"
+#include "tv/model.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace tv {
+
+// Dictionary keys are compared in this form: ASCII letters upper-cased,
+// Latin-1 accents folded ("É" -> "E"), every run of other characters one
+// space, at most merchant_key_max bytes. Writes into `out`, returns the
+// length.
+inline constexpr std::size_t merchant_key_max = 48;
+std::size_t merchant_key(std::string_view text, char (&out)[merchant_key_max]);
+
+// Edits (insertion, deletion, substitution, transposition of neighbours)
+// tolerated between a merchant and a dictionary key of `length` bytes: none
+// below 5, one up to 8, two beyond.
+inline std::uint32_t merchant_max_distance(std::size_t length) {
+  return length < 5 ? 0 : length <= 8 ? 1 : 2;
+}
+
+// A dictionary key matching a merchant read on a ticket.
+struct MerchantLookup {
+  std::string_view name; // canonical, as written in the dictionary source
+  std::string_view key;  // the name or alias that matched, in key form
+  std::uint32_t distance = 0;
+  bool ambiguous = false; // another name matches as closely
+};
+
+// Known merchant names and their aliases, compiled offline by
+// compile_merchant_dictionary into a file that is mapped, not read.
+//
+// Lookups are a SymSpell deletion index: every key is stored under each
+// string obtained by deleting up to merchant_max_distance bytes from it,
+// hashed into buckets of (fingerprint, key) postings. A merchant is looked
+// up under its own deletions; any key within the distance shares one of
+// them, so the candidates are the few keys in those buckets, checked with
+// a bounded edit distance. A 20-byte merchant costs about 200 bucket probes
+// whatever the size of the dictionary; the price is the file, about 300
+// postings (2.5 KB with the buckets) per 24-byte name.
+class MerchantDictionary {
+public:
+  // Throws std::runtime_error when the file is missing, truncated or not a
+  // dictionary of this version. Only the header is read: lookups bound
+  // every offset they follow, so a corrupt table matches nothing rather
+  // than reading out of the mapping.
+  static std::shared_ptr<const MerchantDictionary>
+  open(const std::string &path);
+
+  std::size_t names() const { return names_; }
+  std::size_t keys() const { return keys_; }
+
+  // Closest key to `merchant` within merchant_max_distance of its length;
+  // ties go to the key listed first.
+  std::optional<MerchantLookup> find(std::string_view merchant) const;
+
+private:
+  MerchantDictionary() = default;
+  std::string_view string(std::uint32_t off, std::uint32_t len) const;
+
+  std::unique_ptr<const MappedFile> file_;
+  std::uint64_t names_ = 0, keys_ = 0, buckets_ = 0, postings_count_ = 0;
+  const unsigned char *key_table_ = nullptr;  // Key[keys]
+  const unsigned char *name_table_ = nullptr; // Name[names]
+  const std::uint32_t *bucket_start_ = nullptr; // posting ranges
+  const unsigned char *postings_ = nullptr;      // Posting[postings]
+  const char *strings_ = nullptr;
+  std::uint64_t strings_size_ = 0;
+};
+
+// Compiles a merchant list into the file open() maps. One merchant per
+// line, its canonical name then its aliases, separated by ';':
+//
+//   CARREFOUR CITY;CARREFOUR CTY;CRF CITY
+//
+// Blank lines and lines starting with '#' are skipped. Returns the number
+// of names; throws std::runtime_error naming the offending line (a key
+// that normalizes to nothing, or to a key of another name), leaving
+// `out_path` alone.
+std::size_t compile_merchant_dictionary(const std::string &list_path,
+                                        const std::string &out_path);
+
+// The dictionary new tickets are canonicalized with; null (the default)
+// for none. Same atomic exchange as the active rule pack.
+std::shared_ptr<const MerchantDictionary> active_merchant_dictionary();
+void set_active_merchant_dictionary(
+    std::shared_ptr<const MerchantDictionary> dictionary);
+
+// Fills ticket.merchant_canonical from the dictionary when the heuristic
+// merchant matches one of its keys; ticket.merchant is left as read.
+void canonicalize_merchant(ParsedTicket &ticket,
+                           const MerchantDictionary &dictionary);
+
+} // namespace tv
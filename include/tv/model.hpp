@@ -8,7 +8,7 @@
 namespace tv {
 
 enum class Domain { Auto, Cafe, Resto };
-enum class Locale { Auto, FrFR };
+enum class Locale { Auto, FrFR, FrBE, FrCH, EsES };
 enum class OutputFormat { Json };
 
 struct Options {
@@ -18,6 +18,9 @@ struct Options {
   Domain domain = Domain::Auto;
   bool debug = false;
   std::uint32_t max_lines = 4000;
+  // Time budget per ticket in ms, 0 = unbounded. When exceeded the result
+  // holds what was decided so far, with a DEADLINE_EXCEEDED warning.
+  std::uint32_t budget_ms = 0;
 };
 
 enum class Status { Ok, Partial, Reject, Error };
@@ -65,10 +68,29 @@ struct Item {
   std::string source = "none";
 };
 
+// French company identifiers printed on the ticket, checksum-valid, and
+// what the company registry (--registry) has under them.
+struct Company {
+  std::string siren; // 9 digits
+  std::string siret; // 14 digits; empty when only the SIREN is printed
+  std::optional<std::string> name;       // registered business name
+  std::optional<std::string> trade_name; // enseigne
+  std::optional<std::string> naf;        // activity code, e.g. "56.10A"
+};
+
+// A known merchant name the heuristic merchant was matched to (merchant
+// dictionary, --merchants).
+struct MerchantMatch {
+  std::string name;           // canonical
+  std::uint32_t distance = 0; // edits between the two, in key form
+};
+
 struct ParsedTicket {
   Field<std::string> merchant;
+  Field<MerchantMatch> merchant_canonical; // merchant left as read
   Field<std::string> datetime_iso; // MVP: keep as ISO string
   Field<Money> total;
+  Field<Company> company;
 
   std::vector<Item> items;
   Signals signals;
@@ -76,21 +98,30 @@ struct ParsedTicket {
 };
 
 struct InputMeta {
-  std::string locale;   // "fr_FR" | "auto"
+  std::string locale;   // "fr_FR" | "fr_BE" | "fr_CH" | "es_ES" | "auto"
   std::string domain;   // "cafe" | "resto" | "auto"
   std::uint32_t chars = 0;
   std::uint32_t lines = 0;
   std::string hash;     // "sha256:..." (optional MVP)
+  std::uint64_t fingerprint = 0; // SimHash of the normalized text, 0 if blank
+
+  // Filled when locale/domain is "auto": the rule set the detector picked.
+  std::string detected_locale; // empty => not detected (hint given)
+  double locale_confidence = 0.0;
+  std::string detected_domain; // same; "auto" => generic rules kept
+  double domain_confidence = 0.0;
 };
 
 struct TimingMs {
   int total = 0;
   int parse = 0;
   int score = 0;
+  std::int64_t score_ns = 0; // the same stage exact: it takes nanoseconds
 };
 
 struct EngineOutput {
   std::string schema = "ticketverify.v1";
+  std::string rules_version = "builtin"; // rule pack the ticket ran with
   Status status = Status::Partial;
   double confidence = 0.0;
 
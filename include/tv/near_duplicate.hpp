@@ -0,0 +1,97 @@
+#pragma once
+#include "tv/model.hpp"
+#include "tv/score.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+namespace tv {
+
+// A ticket seen before whose fingerprint is close to the one looked up.
+struct NearDuplicate {
+  std::uint64_t ticket = 0;   // its number, in the order tickets were added
+  std::uint32_t distance = 0; // fingerprint_distance, 0 for the same text
+};
+
+// Fingerprints (fingerprint.hpp) of the tickets seen so far, answering
+// "was a near-duplicate of this one seen" for the long-running and batch
+// modes. Thread-safe: lookups share a lock, additions take it alone.
+//
+// LSH by pigeonhole: the 64 bits are cut into max_distance + 1 bands, and
+// two fingerprints at most max_distance bits apart agree on at least one
+// whole band. Each band is a table of buckets keyed by the band's bits
+// (20 of them at most), holding the fingerprints themselves: a lookup reads
+// one bucket per band sequentially and compares with popcount, never
+// touching memory per candidate. With 10 million tickets and the default
+// distance (5 bands of 12 or 13 bits) that is about 6,000 comparisons.
+// Memory: about 44 bytes per ticket.
+class NearDuplicateIndex {
+public:
+  static constexpr std::uint32_t default_max_distance = 4;
+  static constexpr std::uint32_t max_max_distance = 15;
+
+  // Throws std::invalid_argument past max_max_distance.
+  explicit NearDuplicateIndex(
+      std::uint32_t max_distance = default_max_distance);
+
+  std::uint32_t max_distance() const { return max_distance_; }
+  std::size_t size() const;
+
+  // Closest fingerprint within max_distance; ties go to the ticket added
+  // first.
+  std::optional<NearDuplicate> find(std::uint64_t fingerprint) const;
+
+  // Adds the fingerprint as the next ticket; returns its number.
+  std::uint64_t add(std::uint64_t fingerprint);
+
+  // find(), then add(), under one lock: of two near-duplicates submitted at
+  // the same time, the second always sees the first.
+  std::optional<NearDuplicate> find_and_add(std::uint64_t fingerprint);
+
+  // Snapshot for restarts: the fingerprints in ticket order, 8 bytes each;
+  // load() rebuilds the buckets. save() replaces `path` atomically; both
+  // throw std::runtime_error.
+  void save(const std::string &path) const;
+  static std::unique_ptr<NearDuplicateIndex> load(const std::string &path);
+
+private:
+  struct Band {
+    unsigned shift = 0, bits = 0, bucket_bits = 0;
+    std::vector<std::vector<std::uint64_t>> buckets;
+    // The band's low bucket_bits bits.
+    std::size_t bucket(std::uint64_t fingerprint) const {
+      return static_cast<std::size_t>(
+          fingerprint >> shift & ((std::uint64_t{1} << bucket_bits) - 1));
+    }
+  };
+
+  std::optional<NearDuplicate> find_locked(std::uint64_t fingerprint) const;
+  std::uint64_t add_locked(std::uint64_t fingerprint);
+  std::uint64_t ticket_of(std::uint64_t fingerprint) const;
+
+  std::uint32_t max_distance_;
+  std::vector<Band> bands_;
+  // Ticket numbers next to the fingerprints of the first band's buckets:
+  // only read for a match.
+  std::vector<std::vector<std::uint32_t>> tickets_;
+  std::uint64_t count_ = 0;
+  mutable std::shared_mutex m_;
+};
+
+// The index new tickets are checked against; null (the default) for none.
+// Same atomic exchange as the active rule pack.
+std::shared_ptr<NearDuplicateIndex> active_near_duplicates();
+void set_active_near_duplicates(std::shared_ptr<NearDuplicateIndex> index);
+
+// Looks up the ticket's fingerprint and adds it: NEAR_DUPLICATE warning
+// naming the earlier ticket when there is one, an ok ticket then partial
+// and scored again with `scoring`. Text without a fingerprint (blank input)
+// is neither looked up nor added.
+void check_near_duplicate(EngineOutput &out, NearDuplicateIndex &index,
+                          const Scoring &scoring);
+
+} // namespace tv
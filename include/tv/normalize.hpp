@@ -12,5 +12,30 @@ struct NormalizedText {
 
 NormalizedText normalize_ocr(std::string_view input);
 
-} // namespace tv
+// Streaming form of normalize_ocr: feed() appends the normalized form of a
+// chunk to `out`, holding back only what the next chunk may still change
+// (a whitespace run that could turn out to be trailing, half an NBSP).
+// feed(a) + feed(b) + finish() produce normalize_ocr(a + b).text.
+class Normalizer {
+public:
+  void feed(std::string_view chunk, std::string &out);
+  void finish(std::string &out);
+
+  // A normalizer picking up right after a byte that is not whitespace,
+  // '\r' or 0xC2, the point where feed() holds nothing back: text cut at
+  // such points normalizes piece by piece, only the last piece finished.
+  static Normalizer after_text();
+
+  // Names of the steps applied, as reported in NormalizedText::applied.
+  static std::vector<std::string> applied();
+
+private:
+  void emit(char c, std::string &out);
 
+  bool started_ = false;   // past the leading whitespace
+  bool in_space_ = false;  // inside a run of non-newline whitespace
+  std::string pending_ws_; // collapsed whitespace awaiting a non-space
+  bool pending_c2_ = false;
+};
+
+} // namespace tv
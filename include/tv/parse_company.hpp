@@ -0,0 +1,48 @@
+#pragma once
+#include "tv/model.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace tv {
+
+// Fills ticket.company with the SIRET (or, failing that, the SIREN) printed
+// after a "SIRET" or "SIREN" label, when its checksum holds, and sets
+// signals.has_siret for a SIRET. The registry fields are left to
+// resolve_company (registry.hpp).
+void parse_company(std::string_view normalized_text, ParsedTicket &ticket);
+
+// Luhn checksum of a SIREN (9 digits) or a SIRET (14 digits, its SIREN
+// valid too). La Poste establishments (SIREN 356000000) use their own rule:
+// the digit sum of the SIRET is a multiple of 5.
+bool valid_siren(std::string_view digits);
+bool valid_siret(std::string_view digits);
+
+// Incremental parse_company, same protocol as TotalScanner; no allocation,
+// the state is cheap to checkpoint. The number follows its label after at
+// most company_id_gap non-digits (": ", "N° ", a line break), either
+// contiguous or in groups split by one space or dot ("123 456 789 00012",
+// "123.456.789.00012"). The first label whose number passes the checksum
+// wins.
+class CompanyIdScanner {
+public:
+  std::size_t scan(std::string_view text, bool final);
+  void shift(std::size_t n) { pos_ -= std::min(pos_, n); }
+  bool done() const { return done_; }
+  void apply(ParsedTicket &ticket) const;
+
+  static constexpr std::size_t company_id_gap = 24;
+
+private:
+  // Reads the label at `p`; true when it carries a valid number.
+  bool read(std::string_view text, std::size_t p);
+
+  std::size_t pos_ = 0;
+  std::uint32_t line_ = 0; // index of the line holding pos_
+  char digits_[14] = {};
+  std::uint8_t length_ = 0; // 9 or 14 once found
+  bool done_ = false;
+};
+
+} // namespace tv
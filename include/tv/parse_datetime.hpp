@@ -0,0 +1,50 @@
+#pragma once
+#include "tv/model.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace tv {
+
+// Fills ticket.datetime_iso with the purchase timestamp, ISO-8601 without
+// a time zone ("2025-01-19T16:15:59", or "2025-01-19" without a time).
+void parse_datetime(std::string_view normalized_text, ParsedTicket &ticket);
+
+// Incremental parse_datetime, same protocol as TotalScanner. One forward
+// pass with a lookahead of a few bytes at the start of each number, no
+// allocation: the state is a handful of integers, cheap to checkpoint.
+//
+// The date is the first valid dd/mm/yyyy, dd/mm/yy or dd.mm.yyyy (day and
+// month of one or two digits, checked against the calendar, years
+// 1970-2099, two-digit years in 2000-2099). Its time is the first valid
+// HH:MM[:SS] or HHhMM on the same line, before or after the date, else on
+// the next line. Numbers glued to other digits never match.
+class DateTimeScanner {
+public:
+  std::size_t scan(std::string_view text, bool final);
+  void shift(std::size_t n) { pos_ -= std::min(pos_, n); }
+  bool done() const { return done_; }
+  void apply(ParsedTicket &ticket) const;
+
+private:
+  struct Time {
+    std::uint8_t hour = 0, minute = 0, second = 0;
+    bool valid = false;
+  };
+
+  // What the number starting at `p` is; returns where the scan goes on.
+  std::size_t number(std::string_view text, std::size_t p);
+  void end_line();
+
+  std::size_t pos_ = 0;
+  std::uint32_t line_ = 0; // index of the line holding pos_
+  std::uint16_t year_ = 0; // 0 until a date is found
+  std::uint8_t month_ = 0, day_ = 0;
+  std::uint32_t date_line_ = 0;
+  Time time_;      // the date's
+  Time line_time_; // first time on the current line, before any date
+  bool done_ = false;
+};
+
+} // namespace tv
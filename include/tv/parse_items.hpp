@@ -0,0 +1,49 @@
+#pragma once
+#include "tv/model.hpp"
+#include "tv/rules.hpp"
+#include "tv/scan.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+namespace tv {
+
+// Lines longer than this are neither items nor section boundaries.
+inline constexpr std::size_t item_line_max = 200;
+
+// Fills ticket.items, then checks them against ticket.total, which must
+// already be parsed (ITEMS_TOTAL_MISMATCH when they disagree).
+void parse_items(std::string_view normalized_text, ParsedTicket &ticket);
+void parse_items(std::string_view normalized_text, ParsedTicket &ticket,
+                 const RuleSet &rules);
+
+// Line items, one pass over the lines, same protocol as TotalScanner. A line
+// is an item when it ends with a price column (an amount with two decimals,
+// then optionally a currency marker and a one-letter VAT code) after a
+// label. The label may start with a quantity ("2 x", "2x", "2 *", "2 ") or
+// end with "qty x unit price". Each line is classified from its two ends
+// only; the item section ends at the first line holding a total label.
+// Lines with a card, tax or company id keyword are never items.
+class ItemScanner {
+public:
+  explicit ItemScanner(const RuleSet &rules);
+  std::size_t scan(std::string_view text, bool final);
+  void shift(std::size_t n) { pos_ -= std::min(pos_, n); }
+  bool done() const { return done_; }
+  // Fills ticket.items; see parse_items.
+  void apply(ParsedTicket &ticket) const;
+
+private:
+  void classify(std::string_view line);
+
+  const RuleSet *rules_;
+  PhraseScanner total_, card_, tax_, id_labels_;
+  std::vector<Item> items_;
+  std::size_t pos_ = 0;  // start of the next line
+  std::size_t line_ = 0; // its index
+  bool skip_line_ = false; // the current line is too long, up to its '\n'
+  bool done_ = false;
+};
+
+} // namespace tv
@@ -1,7 +1,17 @@
 #pragma once
 #include "tv/model.hpp"
+#include "tv/rules.hpp"
+#include <cstddef>
 #include <string_view>
 
 namespace tv {
+// Only the first merchant_header_lines non-empty lines can ever contribute
+// to the merchant, and only within the first merchant_header_bytes of the
+// text (a line cut there ends at the cut).
+inline constexpr std::size_t merchant_header_lines = 5;
+inline constexpr std::size_t merchant_header_bytes = 4096;
+
 void parse_merchant(std::string_view normalized_text, ParsedTicket &ticket);
+void parse_merchant(std::string_view normalized_text, ParsedTicket &ticket,
+                    const RuleSet &rules);
 }
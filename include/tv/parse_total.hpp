@@ -1,7 +1,36 @@
 #pragma once
 #include "tv/model.hpp"
+#include "tv/rules.hpp"
+#include "tv/scan.hpp"
+#include <algorithm>
+#include <optional>
 #include <string_view>
 
 namespace tv {
 void parse_total(std::string_view normalized_text, ParsedTicket &ticket);
+void parse_total(std::string_view normalized_text, ParsedTicket &ticket,
+                 const RuleSet &rules);
+
+// Incremental parse_total, same protocol as SignalScanner: scan() returns the
+// first position still needed, shift() reports dropped bytes.
+class TotalScanner {
+public:
+  explicit TotalScanner(const RuleSet &rules);
+
+  std::size_t scan(std::string_view text, bool final);
+  void shift(std::size_t n) { pos_ -= std::min(pos_, n); }
+
+  bool done() const { return done_; }
+  // Label starts restricted (PhraseScanner::limit_to).
+  void limit_to(const CandidateSpans *labels) { labels_.limit_to(labels); }
+  // Fills ticket.total once done.
+  void apply(ParsedTicket &ticket) const;
+
+private:
+  const RuleSet *rules_;
+  PhraseScanner labels_;
+  std::size_t pos_ = 0;
+  bool done_ = false;
+  std::optional<double> amount_;
+};
 } // namespace tv
@@ -0,0 +1,44 @@
+#pragma once
+#include "tv/rules.hpp"
+#include "tv/scan.hpp"
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace tv {
+
+// Lines of a normalized text where a phrase of each extractor table may
+// start, for PhraseScanner::limit_to.
+struct KeywordSpans {
+  CandidateSpans total;      // RuleSet::total_keywords
+  CandidateSpans card;       // RuleSet::card_keywords
+  CandidateSpans tax;        // RuleSet::tax_keywords
+  CandidateSpans company_id; // RuleSet::company_id_keywords
+};
+
+// Keyword prefilter of a rule set. A line is flagged for a table when one
+// of its positions holds the first two characters of one of the table's
+// phrases (ASCII case folded, any whitespace for a space). Every match
+// starts at such a position, so the scanners limited to the flagged lines
+// find what a full scan finds, even when the match runs past the end of
+// the line. Bytes are tested 16 at a time (SSE2 where available) against
+// the first characters; only the hits go through the two-character table,
+// which is hashed: a collision flags a line for nothing, never drops one.
+class KeywordPrefilter {
+public:
+  explicit KeywordPrefilter(const RuleSet &rules);
+
+  void scan(std::string_view text, KeywordSpans &out) const;
+
+private:
+  // Table bits (1 total, 2 card, 4 tax, 8 company id) by pair hash.
+  std::array<std::uint8_t, 4096> pairs_{};
+  std::array<bool, 256> first_{}; // by case-folded byte
+  std::vector<char> firsts_;      // the same, as a list
+  // Tables the filter cannot narrow down (a phrase shorter than two
+  // characters or starting with whitespace): the whole text is a span.
+  std::uint8_t unfiltered_ = 0;
+};
+
+} // namespace tv
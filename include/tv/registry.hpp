@@ -0,0 +1,80 @@
+#pragma once
+#include "tv/mapped_file.hpp"
+#include "tv/model.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace tv {
+
+// What the registry holds for a SIREN or a SIRET. The views point into the
+// mapped file and live as long as the registry.
+struct RegistryEntry {
+  std::string_view name;
+  std::string_view trade_name; // may be empty
+  std::string_view naf;
+};
+
+// Offline snapshot of the company registry, compiled by compile_registry
+// into a file that is mapped, not read: open() validates the header and
+// maps it, so it costs the same for a hundred entries or fifty million, and
+// pages are only faulted in by the lookups that touch them.
+//
+// The file holds a minimal perfect hash of the numbers (one 32-bit pilot
+// per key-sized bucket, one slot per entry, no empty slot), then the
+// strings. A lookup hashes the number, reads its bucket's pilot, then the
+// one slot that pilot designates and compares the stored number: at most
+// three cache lines, whatever the size. SIRET and SIREN keys are distinct;
+// find_siret falls back to the SIREN of the establishment.
+class CompanyRegistry {
+public:
+  // Throws std::runtime_error when the file is missing, truncated or not a
+  // registry of this version.
+  static std::shared_ptr<const CompanyRegistry> open(const std::string &path);
+
+  std::size_t size() const { return count_; }
+
+  // 14 and 9 ASCII digits respectively; anything else is not found.
+  std::optional<RegistryEntry> find_siret(std::string_view siret) const;
+  std::optional<RegistryEntry> find_siren(std::string_view siren) const;
+
+private:
+  CompanyRegistry() = default;
+  std::optional<RegistryEntry> find(std::uint64_t key) const;
+
+  std::unique_ptr<const MappedFile> file_;
+  std::uint64_t count_ = 0, buckets_ = 0, seed_ = 0;
+  const std::uint32_t *pilots_ = nullptr;
+  const unsigned char *slots_ = nullptr;
+  const char *strings_ = nullptr;
+  std::uint64_t strings_size_ = 0;
+};
+
+// Compiles a registry extract into the file open() maps. One entry per
+// line, fields separated by ';':
+//
+//   number;name;naf[;trade_name]
+//
+// where number is a SIREN (legal unit) or a SIRET (establishment) with a
+// valid checksum. Blank lines and lines starting with '#' are skipped.
+// Returns the number of entries; throws std::runtime_error naming the
+// offending line (duplicate numbers included), leaving `out_path` alone.
+std::size_t compile_registry(const std::string &csv_path,
+                             const std::string &out_path);
+
+// The registry new tickets are resolved against; null (the default) for
+// none. Same atomic exchange as the active rule pack.
+std::shared_ptr<const CompanyRegistry> active_registry();
+void set_active_registry(std::shared_ptr<const CompanyRegistry> registry);
+
+// Completes ticket.company from the registry (name, trade name, NAF code)
+// when its number is registered, and checks the merchant read from the
+// header (or its canonical form) against the registered names:
+// MERCHANT_REGISTRY_MISMATCH when they have no word of 3 letters or more in
+// common.
+void resolve_company(ParsedTicket &ticket, const CompanyRegistry &registry);
+
+} // namespace tv
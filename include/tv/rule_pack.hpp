@@ -0,0 +1,84 @@
+#pragma once
+#include "tv/model.hpp"
+#include "tv/rules.hpp"
+#include "tv/score.hpp"
+#include <array>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tv {
+
+// A versioned set of keyword tables and scoring weights, one RuleSet per
+// (locale, domain) pair. The built-in pack is the compile-time pipelines of
+// rules.hpp; a pack file (JSON) overrides any subset of them:
+//
+//   {
+//     "version": "2026-10-19.1",
+//     "scoring": {"bias": -3.0, "total": 3.0, "warnings": -1.5},
+//     "locales": {
+//       "fr_FR": {"total_keywords": ["TOTAL TTC", "TOTAL"],
+//                 "company_id_digits": 14, ...}
+//     },
+//     "domains": {"cafe": {"business_keywords": ["CAFE", "BAR"]}}
+//   }
+//
+// Locale entries take the RuleSet field names (merchant_blacklist,
+// total_keywords, currency_markers, currency, card_keywords, tax_keywords,
+// company_id_keywords, company_id_digits); domain entries ("any", "cafe",
+// "resto") take business_keywords. Scoring entries are "bias" and the
+// feature names of score.hpp. Missing entries keep the built-in value.
+// A pack is immutable once built.
+class RulePack {
+public:
+  static std::shared_ptr<const RulePack> builtin();
+
+  // Parses and compiles a pack; throws std::runtime_error naming the
+  // offending entry.
+  static std::shared_ptr<const RulePack> parse(std::string_view json_text);
+  static std::shared_ptr<const RulePack> load(const std::string &path);
+
+  const std::string &version() const { return version_; }
+  const Scoring &scoring() const { return scoring_; }
+  bool is_builtin() const { return builtin_; }
+
+  // Locale::Auto and Domain::Auto are never passed in: resolve them first.
+  const RuleSet &rules(Locale locale, Domain domain) const {
+    return *rules_[static_cast<std::size_t>(locale)]
+                  [static_cast<std::size_t>(domain)];
+  }
+
+private:
+  RulePack() = default;
+  Keywords own(const std::vector<std::string> &phrases);
+
+  std::string version_;
+  Scoring scoring_;
+  bool builtin_ = false;
+  std::array<std::array<const RuleSet *, 3>, 5> rules_{};
+
+  // Storage behind the RuleSet spans of a loaded pack (stable addresses).
+  std::deque<RuleSet> sets_;
+  std::deque<std::string> strings_;
+  std::deque<std::vector<std::string_view>> tables_;
+};
+
+// The pack new tickets use. Swapping is an atomic pointer exchange: a
+// ticket takes a reference when it starts and keeps its pack to the end,
+// so a swap never pauses or changes tickets in flight; the old pack is
+// freed with its last ticket.
+std::shared_ptr<const RulePack> active_rule_pack();
+void set_active_rule_pack(std::shared_ptr<const RulePack> pack);
+
+// Loads `path` and makes it active, remembering the path for reloads.
+// Throws like RulePack::load; the active pack is unchanged on error.
+void load_rule_pack(const std::string &path);
+
+// Long-running modes (zygote, shm) on SIGHUP: reloads the remembered pack
+// file. Returns false, with the reason in *error, when the file does not
+// compile (the active pack stays); true without a file to reload.
+bool reload_rule_pack(std::string *error);
+
+} // namespace tv
@@ -0,0 +1,148 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <span>
+#include <string_view>
+
+namespace tv {
+
+using Keywords = std::span<const std::string_view>;
+
+// Keyword tables consumed by the extractors. Phrases are matched
+// case-insensitively (ASCII); a space inside a phrase matches any run of
+// whitespace, newlines included.
+struct RuleSet {
+  // parse_merchant: header lines containing one of these are skipped
+  // (case-sensitive substring).
+  Keywords merchant_blacklist;
+  // parse_merchant: a short first line is only kept if it contains one of
+  // these (case-sensitive substring).
+  Keywords business_keywords;
+
+  // parse_total: amount labels, in priority order at a given position.
+  Keywords total_keywords;
+  // parse_total: optional currency marker between label and amount.
+  Keywords currency_markers;
+  std::string_view currency = "EUR";
+
+  // detect_signals: whole-word phrases.
+  Keywords card_keywords;
+  Keywords tax_keywords;
+  // detect_signals: label followed (after any non-digits) by exactly
+  // company_id_digits contiguous digits.
+  Keywords company_id_keywords;
+  std::size_t company_id_digits = 14;
+};
+
+// Compile-time traits. A pipeline is instantiated per (locale, domain) pair;
+// see Pipeline below and tv::run.
+namespace rules {
+
+struct FrFR {
+  static constexpr std::array<std::string_view, 12> merchant_blacklist = {
+      "MERCI", "TICKET", "CLIENT", "TOTAL",     "A PAYER", "NET",
+      "TVA",   "SIRET",  "CB",     "BIENVENUE", "BONJOUR", "AU REVOIR"};
+  static constexpr std::array<std::string_view, 4> total_keywords = {
+      "TOTAL TTC", "TOTAL", "NET A PAYER", "A PAYER"};
+  static constexpr std::array<std::string_view, 2> currency_markers = {
+      "€", "EUR"};
+  static constexpr std::string_view currency = "EUR";
+  static constexpr std::array<std::string_view, 5> card_keywords = {
+      "CB", "CARTE BANCAIRE", "VISA", "MASTERCARD", "AMEX"};
+  static constexpr std::array<std::string_view, 1> tax_keywords = {"TVA"};
+  static constexpr std::array<std::string_view, 1> company_id_keywords = {
+      "SIRET"};
+  static constexpr std::size_t company_id_digits = 14;
+};
+
+// Belgium: TVAC/HTVA labels, Bancontact, 10-digit BCE enterprise number.
+struct FrBE {
+  static constexpr std::array<std::string_view, 15> merchant_blacklist = {
+      "MERCI",   "TICKET",    "CLIENT",     "TOTAL", "A PAYER",
+      "NET",     "TVA",       "BCE",        "CB",    "BIENVENUE",
+      "BONJOUR", "AU REVOIR", "BANCONTACT", "HTVA",  "TVAC"};
+  static constexpr std::array<std::string_view, 5> total_keywords = {
+      "TOTAL TVAC", "TOTAL TTC", "TOTAL", "NET A PAYER", "A PAYER"};
+  static constexpr std::array<std::string_view, 2> currency_markers = {
+      "€", "EUR"};
+  static constexpr std::string_view currency = "EUR";
+  static constexpr std::array<std::string_view, 7> card_keywords = {
+      "BANCONTACT", "MAESTRO", "CB",  "CARTE BANCAIRE",
+      "VISA",       "MASTERCARD", "AMEX"};
+  static constexpr std::array<std::string_view, 2> tax_keywords = {"TVA",
+                                                                   "BTW"};
+  static constexpr std::array<std::string_view, 2> company_id_keywords = {
+      "BCE", "ENTREPRISE"};
+  static constexpr std::size_t company_id_digits = 10;
+};
+
+// Switzerland: amounts in CHF, MWST/TVA labels, 9-digit UID (CHE...).
+struct FrCH {
+  static constexpr std::array<std::string_view, 13> merchant_blacklist = {
+      "MERCI", "TICKET",    "CLIENT",  "TOTAL",    "A PAYER",
+      "NET",   "TVA",       "MWST",    "CHF",      "CB",
+      "BIENVENUE", "BONJOUR", "AU REVOIR"};
+  static constexpr std::array<std::string_view, 5> total_keywords = {
+      "TOTAL CHF", "TOTAL TTC", "TOTAL", "NET A PAYER", "A PAYER"};
+  static constexpr std::array<std::string_view, 3> currency_markers = {
+      "CHF", "FR.", "FR"};
+  static constexpr std::string_view currency = "CHF";
+  static constexpr std::array<std::string_view, 6> card_keywords = {
+      "CB", "CARTE BANCAIRE", "VISA", "MASTERCARD", "AMEX", "TWINT"};
+  static constexpr std::array<std::string_view, 2> tax_keywords = {"TVA",
+                                                                   "MWST"};
+  static constexpr std::array<std::string_view, 3> company_id_keywords = {
+      "CHE", "UID", "IDE"};
+  static constexpr std::size_t company_id_digits = 9;
+};
+
+// Spain: IVA, "TOTAL A PAGAR", 8-digit CIF/NIF body.
+struct EsES {
+  static constexpr std::array<std::string_view, 13> merchant_blacklist = {
+      "GRACIAS", "TICKET",  "CLIENTE", "TOTAL",      "A PAGAR",
+      "IVA",     "CIF",     "NIF",     "TARJETA",    "BIENVENIDO",
+      "FACTURA", "EFECTIVO", "SIMPLIFICADA"};
+  static constexpr std::array<std::string_view, 5> total_keywords = {
+      "TOTAL A PAGAR", "IMPORTE TOTAL", "TOTAL", "A PAGAR", "IMPORTE"};
+  static constexpr std::array<std::string_view, 2> currency_markers = {
+      "€", "EUR"};
+  static constexpr std::string_view currency = "EUR";
+  static constexpr std::array<std::string_view, 5> card_keywords = {
+      "TARJETA", "VISA", "MASTERCARD", "AMEX", "MAESTRO"};
+  static constexpr std::array<std::string_view, 1> tax_keywords = {"IVA"};
+  static constexpr std::array<std::string_view, 2> company_id_keywords = {
+      "CIF", "NIF"};
+  static constexpr std::size_t company_id_digits = 8;
+};
+
+// Short header lines accepted as the start of a merchant name. Substring
+// match, so "CAFETERIA" and "RESTAURANTE" are covered too.
+struct AnyDomain {
+  static constexpr std::array<std::string_view, 6> business_keywords = {
+      "CAFE", "CAFÉ", "BAR", "RESTO", "RESTAURANT", "BRASSERIE"};
+};
+
+struct Cafe {
+  static constexpr std::array<std::string_view, 4> business_keywords = {
+      "CAFE", "CAFÉ", "BAR", "BRASSERIE"};
+};
+
+struct Resto {
+  static constexpr std::array<std::string_view, 3> business_keywords = {
+      "RESTO", "RESTAURANT", "BRASSERIE"};
+};
+
+template <class L, class D> struct Pipeline {
+  static constexpr RuleSet rules = {
+      L::merchant_blacklist, D::business_keywords, L::total_keywords,
+      L::currency_markers,   L::currency,          L::card_keywords,
+      L::tax_keywords,       L::company_id_keywords, L::company_id_digits};
+};
+
+} // namespace rules
+
+// Rules used by the extractors when called without a RuleSet.
+inline constexpr const RuleSet &default_rules =
+    rules::Pipeline<rules::FrFR, rules::AnyDomain>::rules;
+
+} // namespace tv
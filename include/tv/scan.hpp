@@ -0,0 +1,111 @@
+#pragma once
+#include "tv/rules.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace tv {
+
+// Matching primitives for the keyword-driven extractors. Everything here
+// is a forward scan without backtracking; character classes follow the
+// "C" locale, like std::regex did before.
+
+inline bool is_ascii_space(char c) {
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+inline bool is_ascii_digit(char c) { return c >= '0' && c <= '9'; }
+
+inline char ascii_upper(char c) {
+  return (c >= 'a' && c <= 'z') ? static_cast<char>(c - 'a' + 'A') : c;
+}
+
+// regex \w
+inline bool is_word_char(char c) {
+  return is_ascii_digit(c) || c == '_' || (c >= 'a' && c <= 'z') ||
+         (c >= 'A' && c <= 'Z');
+}
+
+// regex \b at `pos`
+inline bool is_word_boundary(std::string_view text, std::size_t pos) {
+  bool before = pos > 0 && is_word_char(text[pos - 1]);
+  bool after = pos < text.size() && is_word_char(text[pos]);
+  return before != after;
+}
+
+// Streaming: when `text` is only a prefix of the document (final == false),
+// a matcher that runs into its end answers need_more instead of a verdict;
+// the caller retries from the same position once more text is available.
+inline constexpr std::size_t need_more = std::string_view::npos - 1;
+
+// End of `phrase` matched at `pos`, or npos. Case-insensitive for ASCII; a
+// space in the phrase matches one or more whitespace characters.
+std::size_t match_phrase(std::string_view text, std::size_t pos,
+                         std::string_view phrase, bool final = true);
+
+// [begin, end) of a text.
+struct TextSpan {
+  std::size_t begin = 0;
+  std::size_t end = 0;
+};
+
+// Sorted, disjoint spans of a text outside of which no phrase of a table
+// starts, as found by a prefilter (see prefilter.hpp).
+using CandidateSpans = std::vector<TextSpan>;
+
+struct PhraseMatch {
+  std::size_t begin = 0;
+  std::size_t end = 0;
+  std::size_t index = 0; // into the phrase table
+};
+
+// Candidate filter over a phrase table: the set of bytes a phrase can start
+// with, both cases.
+class PhraseScanner {
+public:
+  explicit PhraseScanner(Keywords phrases);
+
+  Keywords phrases() const { return phrases_; }
+
+  // Only look for phrases starting inside `spans` (not owned; null, the
+  // default, is the whole text).
+  void limit_to(const CandidateSpans *spans) { spans_ = spans; }
+
+  // First position >= pos where some phrase may start, or npos.
+  std::size_t next_candidate(std::string_view text, std::size_t pos) const {
+    if (spans_)
+      return next_candidate_in_spans(text, pos);
+    for (; pos < text.size(); pos++)
+      if (may_start(text[pos]))
+        return pos;
+    return std::string_view::npos;
+  }
+
+  // Leftmost match at or after `from`; at one position phrases are tried in
+  // table order. With whole_word, the match must sit between \b's.
+  std::optional<PhraseMatch> find(std::string_view text, std::size_t from,
+                                  bool whole_word) const;
+
+  // Same over a document prefix. Without a match, *resume is where the
+  // search must restart once more text arrives (npos with final).
+  std::optional<PhraseMatch> find(std::string_view text, std::size_t from,
+                                  bool whole_word, bool final,
+                                  std::size_t *resume) const;
+
+private:
+  bool may_start(char c) const {
+    auto u = static_cast<unsigned char>(c);
+    return first_[u >> 6] & (std::uint64_t{1} << (u & 63));
+  }
+  std::size_t next_candidate_in_spans(std::string_view text,
+                                      std::size_t pos) const;
+
+  Keywords phrases_;
+  std::array<std::uint64_t, 4> first_{};
+  const CandidateSpans *spans_ = nullptr;
+};
+
+} // namespace tv
@@ -0,0 +1,131 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace tv {
+
+// Request classes of the serving modes, most urgent first: interactive
+// checks (a user is waiting) are always served before bulk re-verification.
+enum class Priority : std::uint8_t { Interactive = 0, Bulk = 1 };
+inline constexpr std::size_t priority_classes = 2;
+
+const char *priority_name(Priority p);
+
+// Latency histogram in microseconds, log2 buckets: bucket 0 counts values
+// below 1 us, bucket i values in [2^(i-1), 2^i).
+struct LatencyHistogram {
+  static constexpr std::size_t buckets = 32;
+  std::array<std::uint64_t, buckets> counts{};
+  std::uint64_t count = 0;
+  std::uint64_t sum_us = 0;
+  std::uint64_t max_us = 0;
+
+  void add(std::chrono::steady_clock::duration d);
+  // Upper bound of the bucket holding the q-quantile (capped at max_us).
+  std::uint64_t quantile(double q) const;
+};
+
+struct ClassStats {
+  LatencyHistogram queue_wait; // arrival to start of service
+  LatencyHistogram service;    // start of service to response
+  std::uint64_t expired = 0;   // dropped, deadline passed while queued
+};
+
+using SchedulerStats = std::array<ClassStats, priority_classes>;
+
+// Requests waiting for a server thread. Classes are served in strict
+// priority order; within a class, earliest deadline first, requests without
+// a deadline after those with one, ties in arrival order. A request whose
+// deadline passed while it waited is still handed out, marked expired, so
+// that it can be answered without any work being done on it.
+template <class T> class Scheduler {
+public:
+  using clock = std::chrono::steady_clock;
+
+  struct Entry {
+    T item;
+    Priority priority = Priority::Interactive;
+    std::optional<clock::time_point> deadline;
+    clock::time_point arrived;
+    bool expired = false;
+  };
+
+  void push(T item, Priority priority,
+            std::optional<clock::time_point> deadline) {
+    std::lock_guard<std::mutex> lock(m_);
+    auto &heap = heaps_[static_cast<std::size_t>(priority)];
+    heap.push_back(
+        {Entry{std::move(item), priority, deadline, clock::now()}, seq_++});
+    std::push_heap(heap.begin(), heap.end(), later);
+    size_++;
+  }
+
+  // The next request, or nullopt when none is queued.
+  std::optional<Entry> pop() {
+    std::lock_guard<std::mutex> lock(m_);
+    for (auto &heap : heaps_) {
+      if (heap.empty())
+        continue;
+      std::pop_heap(heap.begin(), heap.end(), later);
+      Entry e = std::move(heap.back().entry);
+      heap.pop_back();
+      size_--;
+      auto now = clock::now();
+      auto &s = stats_[static_cast<std::size_t>(e.priority)];
+      if (e.deadline && *e.deadline <= now) {
+        e.expired = true;
+        s.expired++;
+      } else {
+        s.queue_wait.add(now - e.arrived);
+      }
+      return e;
+    }
+    return std::nullopt;
+  }
+
+  std::size_t size() const {
+    std::lock_guard<std::mutex> lock(m_);
+    return size_;
+  }
+
+  // Records the service time of an entry pop() returned.
+  void served(const Entry &e, clock::duration service) {
+    std::lock_guard<std::mutex> lock(m_);
+    stats_[static_cast<std::size_t>(e.priority)].service.add(service);
+  }
+
+  SchedulerStats stats() const {
+    std::lock_guard<std::mutex> lock(m_);
+    return stats_;
+  }
+
+private:
+  struct Node {
+    Entry entry;
+    std::uint64_t seq;
+  };
+
+  // Heap order: true when `a` is served after `b`.
+  static bool later(const Node &a, const Node &b) {
+    if (a.entry.deadline != b.entry.deadline) {
+      if (!a.entry.deadline || !b.entry.deadline)
+        return !a.entry.deadline;
+      return *a.entry.deadline > *b.entry.deadline;
+    }
+    return a.seq > b.seq;
+  }
+
+  mutable std::mutex m_;
+  std::array<std::vector<Node>, priority_classes> heaps_;
+  std::size_t size_ = 0;
+  std::uint64_t seq_ = 0;
+  SchedulerStats stats_;
+};
+
+} // namespace tv
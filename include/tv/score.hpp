@@ -0,0 +1,85 @@
+#pragma once
+#include "tv/model.hpp"
+#include <string_view>
+
+namespace tv {
+
+// Ticket confidence: a logistic model over what the extractors already
+// decided, never the text itself.
+//
+//   confidence = 1 / (1 + e^-z),  z = bias + sum of weight x feature
+//
+// Every feature is in [0, 1]; the weights are the built-in ones below or a
+// rule pack's "scoring" entry (rule_pack.hpp).
+
+// One value per feature: the features of a ticket, or their weights.
+struct ScoreTerms {
+  double total = 0.0;          // total confidence, 0 when none was found
+  double merchant = 0.0;       // merchant confidence
+  double merchant_known = 0.0; // merchant dictionary match confidence
+  double datetime = 0.0;       // datetime confidence
+  double company = 0.0;        // checksum-valid SIREN/SIRET confidence
+  double items = 0.0;          // mean item confidence (raised when they add
+                               // up to the total)
+  double tax = 0.0;            // signals.has_tva
+  double card = 0.0;           // signals.has_card_keywords
+  double lines = 0.0;          // min(lines, 8) / 8: a thin text scores lower
+  double amount = 0.0;         // total plausibility: 1 up to 1000, 0.5 up to
+                               // 10000, 0 above or when not positive
+  double minor_warnings = 0.0; // low-severity warnings, min(n, 4) / 4
+  double warnings = 0.0;       // medium and high ones, same
+};
+
+struct ScoreTerm {
+  std::string_view name; // key in a rule pack's "scoring" entry
+  double ScoreTerms::*member;
+};
+
+inline constexpr ScoreTerm score_terms[] = {
+    {"total", &ScoreTerms::total},
+    {"merchant", &ScoreTerms::merchant},
+    {"merchant_known", &ScoreTerms::merchant_known},
+    {"datetime", &ScoreTerms::datetime},
+    {"company", &ScoreTerms::company},
+    {"items", &ScoreTerms::items},
+    {"tax", &ScoreTerms::tax},
+    {"card", &ScoreTerms::card},
+    {"lines", &ScoreTerms::lines},
+    {"amount", &ScoreTerms::amount},
+    {"minor_warnings", &ScoreTerms::minor_warnings},
+    {"warnings", &ScoreTerms::warnings},
+};
+
+// Model weights. The defaults put a ticket with a total and a merchant
+// around 0.9, a total alone around 0.6, no total under 0.15.
+struct Scoring {
+  double bias = -3.0;
+  ScoreTerms weights = {
+      .total = 3.0,
+      .merchant = 1.5,
+      .merchant_known = 0.5,
+      .datetime = 0.5,
+      .company = 0.5,
+      .items = 0.5,
+      .tax = 0.25,
+      .card = 0.25,
+      .lines = 0.5,
+      .amount = 0.5,
+      .minor_warnings = -0.5,
+      .warnings = -1.5,
+  };
+};
+
+inline constexpr Scoring default_scoring{};
+
+// Features of a concluded ticket: its fields, signals, warnings and
+// input.lines.
+ScoreTerms score_features(const EngineOutput &out);
+
+double score(const ScoreTerms &features, const Scoring &scoring);
+
+// Sets out.confidence from the score model, adding its cost to
+// timing.score_ns (and timing.score). Called again whenever a warning is added afterwards.
+void score_ticket(EngineOutput &out, const Scoring &scoring);
+
+} // namespace tv
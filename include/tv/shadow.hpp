@@ -0,0 +1,31 @@
+#pragma once
+#include "tv/engine.hpp"
+#include "tv/rule_pack.hpp"
+#include <memory>
+#include <string_view>
+
+namespace tv {
+
+// Shadow evaluation of a candidate rule pack on live traffic: a sampled
+// ticket also runs the candidate on the shared preprocessing (see
+// Session::begin), the primary result is returned unchanged and one JSON
+// line (shadow_json) is appended to the shadow log.
+struct ShadowConfig {
+  std::shared_ptr<const RulePack> candidate; // null: shadowing off
+  double sample_rate = 1.0;                  // fraction of tickets, [0, 1]
+  int log_fd = 2;                            // stderr unless --shadow-log
+};
+
+// Process-wide, set once before serving (the zygote's children inherit it).
+void set_shadow(ShadowConfig cfg);
+
+// The candidate when this ticket is sampled, else null.
+std::shared_ptr<const RulePack> shadow_candidate();
+
+// Appends the record of one shadowed ticket to the log.
+void log_shadow(const EngineOutput &primary, const ShadowRun &shadow);
+
+// run(), shadowed when sampled.
+EngineOutput run_shadowed(std::string_view ocr_text, const Options &opt);
+
+} // namespace tv
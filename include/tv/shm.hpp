@@ -0,0 +1,93 @@
+#pragma once
+#include "tv/model.hpp"
+#include "tv/scheduler.hpp"
+#include "tv/shm_ring.h"
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace tv {
+
+// Shared-memory transport (layout and ring operations in tv/shm_ring.h).
+// Each request's OCR text is copied out of its slot, which is freed at once
+// so the client keeps writing while the request is queued; the JSON is
+// serialized into a per-thread buffer, then copied into a response slot. No
+// socket copy, no syscall per request while both sides are busy.
+struct ShmConfig {
+  std::uint32_t slot_count = 16;        // per ring, power of two
+  std::uint32_t slot_size = 64 * 1024;  // largest request or response
+  std::uint32_t workers = 1;            // server threads
+  // Flight recorder: tickets served in at least slow_ms keep their input
+  // (0: none); dumped to flight_dump (mode 0600), by default
+  // $XDG_RUNTIME_DIR/ticketverify-<pid>.flight.json, else not at all.
+  std::uint32_t slow_ms = 100;
+  std::string flight_dump;
+  // Frames kept for requests with a session id (FrameCache), all workers
+  // together.
+  std::size_t frame_cache_bytes = 64 << 20;
+};
+
+// Creates the POSIX shared-memory segment `name` (mode 0600) and serves its
+// client until SIGTERM or SIGINT, then removes it. Returns an exit code.
+// Requests are queued as they arrive and served by a Scheduler: interactive
+// before bulk, earliest deadline first within a class; one whose deadline
+// passed while queued is answered DEADLINE_EXPIRED (code 3) without being
+// run. A request with a session id is a new frame of that session's
+// receipt and goes through a FrameCache (engine.hpp), without the shadow
+// pack. Tickets without a session id are checked against the active
+// near-duplicate index, when there is one. The last tickets of every thread are kept in a
+// FlightRecorder (flight_recorder.hpp), dumped on SIGUSR1 and on a
+// TV_SHM_KIND_STATS request, which returns stats_json() with the dump.
+int serve_shm(const std::string &name, const ShmConfig &cfg = {},
+              bool debug = false);
+
+// Client for a segment served by serve_shm; the C reference client in
+// clients/c/ does the same in C.
+class ShmClient {
+public:
+  ShmClient() = default;
+  ~ShmClient();
+  ShmClient(const ShmClient &) = delete;
+  ShmClient &operator=(const ShmClient &) = delete;
+
+  // Attaches to the segment, waiting up to timeout_ms for the engine to
+  // create it. Fails when another live client is attached.
+  bool open(const std::string &name, int timeout_ms = 1000);
+  void close();
+
+  // One request: returns the CLI exit code with the JSON document (success
+  // or error) in *json, or -1 when the engine went away. deadline_ms > 0
+  // bounds the time the request may wait in the engine's queue; a non-zero
+  // session marks successive frames of one receipt. Threads may call
+  // concurrently: their requests are pipelined and each gets its own
+  // response.
+  int call(std::string_view text, const Options &opt, std::string *json,
+           Priority priority = Priority::Interactive,
+           std::uint32_t deadline_ms = 0, std::uint64_t session = 0);
+
+  // The engine's scheduling statistics (stats_json), same return values.
+  int stats(std::string *json);
+
+private:
+  int send(tv_shm_slot head, std::string_view payload, std::string *json);
+
+  struct Reply {
+    int code;
+    std::string json;
+  };
+
+  tv_shm_header *seg_ = nullptr;
+  std::size_t size_ = 0;
+  std::uint64_t next_id_ = 0;
+  std::mutex req_m_;  // producer side of the request ring, next_id_
+  std::mutex resp_m_; // consumer side of the response ring, waiting_
+  std::condition_variable replied_;
+  bool reading_ = false; // a caller is reading the response ring
+  std::unordered_map<std::uint64_t, std::optional<Reply>> waiting_;
+};
+
+} // namespace tv
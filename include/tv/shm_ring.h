@@ -0,0 +1,260 @@
+/*
+ * Shared-memory transport between a backend and the engine: the segment
+ * layout and the ring operations, in plain C so that clients in any
+ * language with a C FFI can use them as-is (see clients/c/).
+ *
+ * A segment holds two single-producer/single-consumer rings of fixed-size
+ * slots: requests (client -> engine) and responses (engine -> client). The
+ * engine creates the segment; exactly one client attaches to it. A side
+ * only sleeps, on a futex in the segment, after finding its ring idle, and
+ * the other side only issues a wake-up when it sees that flag set.
+ *
+ *   [tv_shm_header][request slots][response slots]
+ *
+ * Each slot is a tv_shm_slot followed by slot_size payload bytes: the OCR
+ * text in a request, the JSON document in a response. The engine takes
+ * requests off the ring as they arrive and serves them by priority class
+ * and deadline, so responses may come back in a different order; they carry
+ * the request id.
+ */
+#ifndef TV_SHM_RING_H
+#define TV_SHM_RING_H
+
+#include <linux/futex.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TV_SHM_MAGIC 0x48535654u /* "TVSH" */
+#define TV_SHM_VERSION 3u
+
+/* Request options; the values match tv::Locale and tv::Domain. */
+enum {
+  TV_LOCALE_AUTO = 0,
+  TV_LOCALE_FR_FR = 1,
+  TV_LOCALE_FR_BE = 2,
+  TV_LOCALE_FR_CH = 3,
+  TV_LOCALE_ES_ES = 4
+};
+enum { TV_DOMAIN_AUTO = 0, TV_DOMAIN_CAFE = 1, TV_DOMAIN_RESTO = 2 };
+
+/* Request classes, served in strict priority order (tv::Priority). */
+enum { TV_PRIORITY_INTERACTIVE = 0, TV_PRIORITY_BULK = 1 };
+
+/* What a request asks for: a ticket (the payload is its OCR text) or the
+ * engine's scheduling statistics (no payload; JSON in the response). */
+enum { TV_SHM_KIND_TICKET = 0, TV_SHM_KIND_STATS = 1 };
+
+typedef struct tv_shm_slot {
+  uint64_t id;        /* chosen by the client, echoed in the response */
+  uint32_t len;       /* payload bytes */
+  uint32_t code;      /* response: the CLI exit code (0, 2 or 3) */
+  uint8_t locale;     /* request options */
+  uint8_t domain;
+  uint8_t priority;   /* TV_PRIORITY_* */
+  uint8_t kind;       /* TV_SHM_KIND_* */
+  uint32_t budget_ms; /* 0 = unbounded */
+  uint32_t max_lines; /* 0 = engine default */
+  uint32_t deadline;  /* tv_shm_deadline(); 0 = none */
+  uint64_t session;   /* successive frames of one receipt; 0 = none */
+} tv_shm_slot;
+
+/* head and tail are free-running counters; each sits on its own cache line
+ * next to the idle flag of the side that waits on it. */
+typedef struct tv_shm_ring {
+  uint32_t head;          /* written by the producer */
+  uint32_t consumer_idle; /* consumer sleeps on head */
+  uint8_t pad0[56];
+  uint32_t tail;          /* written by the consumer */
+  uint32_t producer_idle; /* producer sleeps on tail */
+  uint8_t pad1[56];
+} tv_shm_ring;
+
+typedef struct tv_shm_header {
+  uint32_t magic; /* written last by the engine, once the segment is ready */
+  uint32_t version;
+  uint32_t slot_count; /* power of two */
+  uint32_t slot_size;  /* payload bytes per slot, multiple of 64 */
+  int32_t server_pid;
+  int32_t client_pid; /* the attached client, 0 when none */
+  uint8_t pad[40];
+  tv_shm_ring req;
+  tv_shm_ring resp;
+} tv_shm_header;
+
+/* The ring geometry the ring operations index slots with. Both sides can
+ * write the header: the engine keeps the geometry it created the segment
+ * with and passes that to the *_g functions, never re-reading the header's
+ * copy; a client may use the header's (tv_shm_header_geometry()). */
+typedef struct tv_shm_geometry {
+  uint32_t slot_count; /* power of two */
+  uint32_t slot_size;
+} tv_shm_geometry;
+
+static inline tv_shm_geometry tv_shm_header_geometry(const tv_shm_header *h) {
+  tv_shm_geometry g;
+  g.slot_count = h->slot_count;
+  g.slot_size = h->slot_size;
+  return g;
+}
+
+static inline size_t tv_shm_slot_stride(const tv_shm_header *h) {
+  return sizeof(tv_shm_slot) + h->slot_size;
+}
+
+static inline size_t tv_shm_segment_size(uint32_t slot_count,
+                                         uint32_t slot_size) {
+  return sizeof(tv_shm_header) +
+         2 * (size_t)slot_count * (sizeof(tv_shm_slot) + slot_size);
+}
+
+static inline tv_shm_slot *tv_shm_slot_at_g(tv_shm_header *h,
+                                            tv_shm_geometry g,
+                                            const tv_shm_ring *r,
+                                            uint32_t counter) {
+  size_t ring = (r == &h->resp) ? g.slot_count : 0;
+  size_t index = ring + (counter & (g.slot_count - 1));
+  return (tv_shm_slot *)((char *)(h + 1) +
+                         index * (sizeof(tv_shm_slot) + g.slot_size));
+}
+
+static inline tv_shm_slot *tv_shm_slot_at(tv_shm_header *h,
+                                          const tv_shm_ring *r,
+                                          uint32_t counter) {
+  return tv_shm_slot_at_g(h, tv_shm_header_geometry(h), r, counter);
+}
+
+static inline char *tv_shm_payload(tv_shm_slot *s) { return (char *)(s + 1); }
+
+/* Deadlines are CLOCK_MONOTONIC milliseconds, truncated to 32 bits and
+ * compared modulo 2^32: both sides run on the same machine, and a deadline
+ * is never more than 24 days away. */
+static inline uint32_t tv_shm_now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)((uint64_t)ts.tv_sec * 1000u +
+                    (uint64_t)ts.tv_nsec / 1000000u);
+}
+
+/* The slot deadline value for "within ms milliseconds from now". A request
+ * still queued past it is answered DEADLINE_EXPIRED without being run. */
+static inline uint32_t tv_shm_deadline(uint32_t ms) {
+  uint32_t d = tv_shm_now_ms() + ms;
+  return d ? d : 1; /* 0 means none */
+}
+
+/* Milliseconds left before a slot deadline, negative once it has passed. */
+static inline int32_t tv_shm_deadline_left(uint32_t deadline) {
+  return (int32_t)(deadline - tv_shm_now_ms());
+}
+
+static inline void tv_shm_futex_wait(uint32_t *word, uint32_t seen,
+                                     int timeout_ms) {
+  struct timespec ts = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+  syscall(SYS_futex, word, FUTEX_WAIT, seen, &ts, NULL, 0);
+}
+
+static inline void tv_shm_futex_wake(uint32_t *word) {
+  syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+/* Producer side. Returns the slot to fill, or NULL when the ring is full. */
+static inline tv_shm_slot *tv_shm_try_reserve_g(tv_shm_header *h,
+                                                tv_shm_geometry g,
+                                                tv_shm_ring *r) {
+  uint32_t head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+  uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+  if (head - tail >= g.slot_count)
+    return NULL;
+  return tv_shm_slot_at_g(h, g, r, head);
+}
+
+static inline tv_shm_slot *tv_shm_try_reserve(tv_shm_header *h,
+                                              tv_shm_ring *r) {
+  return tv_shm_try_reserve_g(h, tv_shm_header_geometry(h), r);
+}
+
+/* Makes the reserved slot visible to the consumer. */
+static inline void tv_shm_publish(tv_shm_ring *r) {
+  uint32_t head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+  /* seq_cst store, then seq_cst load of the flag: pairs with the
+   * consumer's flag store then head load, so no wake-up is lost. */
+  __atomic_store_n(&r->head, head + 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&r->consumer_idle, __ATOMIC_SEQ_CST))
+    tv_shm_futex_wake(&r->head);
+}
+
+/* Consumer side. Returns the oldest published slot, or NULL when empty. */
+static inline tv_shm_slot *tv_shm_try_peek_g(tv_shm_header *h,
+                                             tv_shm_geometry g,
+                                             tv_shm_ring *r) {
+  uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+  uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+  if (head == tail)
+    return NULL;
+  return tv_shm_slot_at_g(h, g, r, tail);
+}
+
+static inline tv_shm_slot *tv_shm_try_peek(tv_shm_header *h, tv_shm_ring *r) {
+  return tv_shm_try_peek_g(h, tv_shm_header_geometry(h), r);
+}
+
+/* Hands the peeked slot back to the producer. */
+static inline void tv_shm_release(tv_shm_ring *r) {
+  uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+  __atomic_store_n(&r->tail, tail + 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&r->producer_idle, __ATOMIC_SEQ_CST))
+    tv_shm_futex_wake(&r->tail);
+}
+
+/* Spins briefly, then sleeps until the ring has a slot to read or
+ * timeout_ms passes. Returns the slot or NULL. */
+static inline tv_shm_slot *tv_shm_wait_peek_g(tv_shm_header *h,
+                                              tv_shm_geometry g,
+                                              tv_shm_ring *r, int timeout_ms) {
+  tv_shm_slot *s;
+  int spin;
+  for (spin = 0; spin < 4096; spin++)
+    if ((s = tv_shm_try_peek_g(h, g, r)))
+      return s;
+  uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+  __atomic_store_n(&r->consumer_idle, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&r->head, __ATOMIC_SEQ_CST) == tail)
+    tv_shm_futex_wait(&r->head, tail, timeout_ms);
+  __atomic_store_n(&r->consumer_idle, 0, __ATOMIC_RELAXED);
+  return tv_shm_try_peek_g(h, g, r);
+}
+
+static inline tv_shm_slot *tv_shm_wait_peek(tv_shm_header *h, tv_shm_ring *r,
+                                            int timeout_ms) {
+  return tv_shm_wait_peek_g(h, tv_shm_header_geometry(h), r, timeout_ms);
+}
+
+/* Same for the producer: waits for a free slot. */
+static inline tv_shm_slot *tv_shm_wait_reserve_g(tv_shm_header *h,
+                                                 tv_shm_geometry g,
+                                                 tv_shm_ring *r,
+                                                 int timeout_ms) {
+  tv_shm_slot *s;
+  int spin;
+  for (spin = 0; spin < 4096; spin++)
+    if ((s = tv_shm_try_reserve_g(h, g, r)))
+      return s;
+  uint32_t head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+  __atomic_store_n(&r->producer_idle, 1, __ATOMIC_SEQ_CST);
+  uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_SEQ_CST);
+  if (head - tail >= g.slot_count)
+    tv_shm_futex_wait(&r->tail, tail, timeout_ms);
+  __atomic_store_n(&r->producer_idle, 0, __ATOMIC_RELAXED);
+  return tv_shm_try_reserve_g(h, g, r);
+}
+
+static inline tv_shm_slot *tv_shm_wait_reserve(tv_shm_header *h,
+                                               tv_shm_ring *r,
+                                               int timeout_ms) {
+  return tv_shm_wait_reserve_g(h, tv_shm_header_geometry(h), r, timeout_ms);
+}
+
+#endif /* TV_SHM_RING_H */
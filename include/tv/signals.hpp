@@ -1,7 +1,47 @@
 #pragma once
 #include "tv/model.hpp"
+#include "tv/rules.hpp"
+#include "tv/scan.hpp"
 #include <string_view>
 
 namespace tv {
 Signals detect_signals(std::string_view normalized_text);
-}
+Signals detect_signals(std::string_view normalized_text, const RuleSet &rules);
+
+// Incremental detect_signals. scan() is called with the text seen so far
+// (minus what was dropped, see shift) and returns the first position still
+// needed; final marks the end of the document.
+class SignalScanner {
+public:
+  explicit SignalScanner(const RuleSet &rules);
+
+  std::size_t scan(std::string_view text, bool final);
+  // The caller dropped the first n bytes of the text (one byte before the
+  // returned position is kept for \b).
+  void shift(std::size_t n);
+
+  // Phrase starts restricted per table (PhraseScanner::limit_to).
+  void limit_to(const CandidateSpans *card, const CandidateSpans *tax,
+                const CandidateSpans *company_id) {
+    card_.limit_to(card);
+    tax_.limit_to(tax);
+    id_labels_.limit_to(company_id);
+  }
+
+  const Signals &signals() const { return signals_; }
+  bool done() const { return card_done_ && tax_done_ && id_done_; }
+
+private:
+  void scan_company_id(std::string_view text, bool final);
+
+  const RuleSet *rules_;
+  PhraseScanner card_, tax_, id_labels_;
+  Signals signals_{};
+
+  bool card_done_ = false, tax_done_ = false, id_done_ = false;
+  std::size_t card_pos_ = 0, tax_pos_ = 0;
+  // Company id: label search position, or the digit run being checked.
+  std::size_t id_pos_ = 0;
+  bool id_in_gap_ = false; // label found, skipping to its digits
+};
+} // namespace tv
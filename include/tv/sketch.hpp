@@ -0,0 +1,127 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace tv {
+
+// Fixed-memory summaries of a stream, for batch runs too large to keep or
+// re-read their outputs. Each one is filled by one thread and merged with
+// the others' at the end: merging gives what a single sketch fed both
+// streams would hold, within the same error bounds.
+
+// 64-bit hash of a key for HyperLogLog (FNV-1a, then a splitmix64
+// finalizer so that every bit depends on every byte).
+std::uint64_t sketch_hash(std::string_view key);
+
+// Distinct count (Flajolet et al., with the small-range correction):
+// 2^precision one-byte registers, standard error 1.04 / sqrt(2^precision).
+class HyperLogLog {
+public:
+  static constexpr unsigned default_precision = 14; // 16 KiB, 0.8%
+
+  explicit HyperLogLog(unsigned precision = default_precision);
+
+  void add(std::uint64_t hash);
+  void merge(const HyperLogLog &other); // same precision
+  double estimate() const;
+  double standard_error() const;
+  std::size_t memory() const { return registers_.size(); }
+
+private:
+  unsigned precision_;
+  std::vector<std::uint8_t> registers_;
+};
+
+// Heavy hitters (Metwally et al., Space-Saving): `capacity` counters. A key
+// not counted yet takes over the smallest counter, inheriting its count as
+// its error, so count - error <= true count <= count for every key kept,
+// and any key seen more than n / capacity times is kept.
+//
+// Each counter also splits what it counted since its key took it into
+// `kinds` (the caller's categories, e.g. a status): lower bounds.
+class SpaceSaving {
+public:
+  static constexpr std::size_t kinds = 4;
+
+  struct Entry {
+    std::string key;
+    std::uint64_t count = 0;
+    std::uint64_t error = 0;
+    std::array<std::uint64_t, kinds> by_kind{};
+  };
+
+  explicit SpaceSaving(std::size_t capacity = 1024);
+
+  void add(std::string_view key, std::size_t kind);
+  // Mergeable summaries (Agarwal et al.): a key missing from one side is
+  // counted there as that side's smallest count, then only the `capacity`
+  // largest counters are kept.
+  void merge(const SpaceSaving &other);
+
+  // The `k` largest counters, largest first.
+  std::vector<Entry> top(std::size_t k) const;
+  std::size_t size() const { return heap_.size(); }
+  std::size_t memory() const;
+
+private:
+  // Smallest count that a key not kept may have.
+  std::uint64_t floor() const;
+  void sift_down(std::size_t i);
+  void sift_up(std::size_t i);
+  void swap_entries(std::size_t a, std::size_t b);
+  void rebuild(std::vector<Entry> entries);
+
+  std::size_t capacity_;
+  std::vector<Entry> heap_; // min-heap on count
+  std::unordered_map<std::string, std::size_t> at_; // key -> heap index
+};
+
+// Quantiles of positive values within a relative error (Masson et al.,
+// DDSketch): value v falls in bucket ceil(log_gamma v), gamma = (1 + a) /
+// (1 - a), and a bucket is reported as its midpoint, within a of every value
+// in it. Past max_buckets the lowest buckets are collapsed into one, so only
+// the lowest quantiles lose their guarantee. Values <= 0 are counted apart,
+// as 0.
+class DDSketch {
+public:
+  static constexpr double default_accuracy = 0.01;
+  static constexpr std::size_t default_max_buckets = 2048;
+
+  explicit DDSketch(double accuracy = default_accuracy,
+                    std::size_t max_buckets = default_max_buckets);
+
+  void add(double value);
+  void merge(const DDSketch &other); // same accuracy
+  // q in [0, 1]; 0 when empty.
+  double quantile(double q) const;
+
+  std::uint64_t count() const { return count_; }
+  double sum() const { return sum_; }
+  double min() const { return min_; }
+  double max() const { return max_; }
+  double accuracy() const { return accuracy_; }
+  std::size_t memory() const {
+    return buckets_.size() * sizeof(std::uint64_t);
+  }
+
+private:
+  int bucket(double value) const;
+  void add_count(int index, std::uint64_t n);
+
+  double accuracy_;
+  double gamma_;
+  double log_gamma_;
+  std::size_t max_buckets_;
+  int offset_ = 0; // index of buckets_[0]
+  std::vector<std::uint64_t> buckets_;
+  std::uint64_t zero_ = 0;
+  std::uint64_t count_ = 0;
+  double sum_ = 0.0, min_ = 0.0, max_ = 0.0;
+};
+
+} // namespace tv
@@ -0,0 +1,73 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tv {
+
+// Work-stealing pool for the stages of large tickets. Each worker owns a
+// deque: it pushes and pops its own tasks at the back and, when idle,
+// steals from the front of the others'. Tasks pushed from outside the pool
+// go to a shared deque that every worker steals from.
+class TaskPool {
+public:
+  explicit TaskPool(std::size_t workers);
+  ~TaskPool();
+  TaskPool(const TaskPool &) = delete;
+  TaskPool &operator=(const TaskPool &) = delete;
+
+  std::size_t workers() const { return threads_.size(); }
+
+  // Process-wide pool: one worker per extra hardware thread, at most 7.
+  static TaskPool &shared();
+
+private:
+  friend class TaskGroup;
+
+  struct Queue {
+    std::mutex m;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  void push(std::function<void()> task);
+  // Runs one queued task, own deque first; false when all are empty.
+  bool run_one();
+  void work(std::size_t index);
+
+  std::vector<std::unique_ptr<Queue>> queues_; // workers, then the shared one
+  std::vector<std::thread> threads_;
+  std::atomic<std::size_t> queued_{0};
+  std::mutex sleep_m_;
+  std::condition_variable wake_;
+  bool stop_ = false;
+};
+
+// Tasks of one graph stage. wait() runs queued tasks on the calling thread
+// instead of blocking, so groups nest and a pool without workers runs
+// everything inline, in submission order. The first exception thrown by a
+// task is rethrown by wait().
+class TaskGroup {
+public:
+  explicit TaskGroup(TaskPool &pool) : pool_(pool) {}
+  ~TaskGroup();
+  TaskGroup(const TaskGroup &) = delete;
+  TaskGroup &operator=(const TaskGroup &) = delete;
+
+  void run(std::function<void()> task);
+  void wait();
+
+private:
+  TaskPool &pool_;
+  std::atomic<std::size_t> pending_{0};
+  std::mutex error_m_;
+  std::exception_ptr error_;
+};
+
+} // namespace tv
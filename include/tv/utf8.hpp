@@ -0,0 +1,22 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace tv {
+
+// True if `s` is well-formed UTF-8 (no overlongs, surrogates or code points
+// above U+10FFFF). Vectorized on x86 (SSSE3, runtime-detected), scalar
+// elsewhere.
+bool validate_utf8(std::string_view s);
+
+// Copies `s` into `out`, replacing each maximal invalid subsequence with
+// U+FFFD. Returns the number of replacements (0 => out == s).
+std::size_t repair_utf8(std::string_view s, std::string &out);
+
+// Number of trailing bytes of `s` (0..3) that start a multi-byte sequence
+// cut short by the end of `s`. Streaming callers hold them back until the
+// next chunk, so repairs match those of the whole text.
+std::size_t utf8_incomplete_tail(std::string_view s);
+
+} // namespace tv
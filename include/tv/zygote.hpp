@@ -0,0 +1,33 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace tv {
+
+// Fork server ("zygote"): a parent process, warmed up once, that forks a
+// fresh child per request. The child gets the client's stdin/stdout/stderr
+// (passed over the Unix socket with SCM_RIGHTS) and runs the handler on the
+// client's arguments; its exit code goes back to the client. One process per
+// ticket, as with a plain spawn, without the exec/loading/init cost.
+//
+// Wire format, per connection: a request header {u32 magic, u32 size}, then
+// `size` bytes of NUL-terminated arguments, with the three descriptors
+// attached to the header; the reply is the child's exit status as an i32
+// (128 + signal when it was killed).
+using ZygoteHandler = std::function<int(const std::vector<std::string> &args)>;
+
+// Serves requests on `socket_path` (mode 0600, same-uid peers only) until
+// SIGTERM or SIGINT, then waits for running children. Returns an exit code.
+int serve_zygote(const std::string &socket_path, const ZygoteHandler &handler,
+                 bool debug = false);
+
+// Client side: runs `args` in a child of the zygote with the given
+// descriptors as its stdio. Returns the child's exit status, -1 when the
+// zygote cannot be reached (the descriptors untouched), -2 when it went
+// away after taking them (stdin may be partly read).
+int zygote_call(const std::string &socket_path,
+                const std::vector<std::string> &args, int in_fd = 0,
+                int out_fd = 1, int err_fd = 2);
+
+} // namespace tv
@@ -0,0 +1,124 @@
+#include "tv/batch_summary.hpp"
+
+#include <cmath>
+#include <nlohmann/json.hpp>
+
+namespace tv {
+
+using json = nlohmann::json;
+
+static const char *const signal_names[] = {"has_tva", "has_siret",
+                                           "has_card_keywords"};
+
+void BatchSummary::add(const EngineOutput &out) {
+  tickets_++;
+  status_[static_cast<std::size_t>(out.status)]++;
+
+  const ParsedTicket &t = out.ticket;
+  const std::string *merchant = t.merchant_canonical.value
+                                    ? &t.merchant_canonical.value->name
+                                    : t.merchant.value ? &*t.merchant.value
+                                                       : nullptr;
+  if (merchant) {
+    merchants_.add(sketch_hash(*merchant));
+    top_.add(*merchant, static_cast<std::size_t>(out.status));
+  } else {
+    without_merchant_++;
+  }
+
+  if (t.total.value) {
+    const Money &m = *t.total.value;
+    auto it = totals_.find(m.currency);
+    if (it == totals_.end() && totals_.size() < max_currencies)
+      it = totals_.emplace(m.currency, DDSketch()).first;
+    if (it != totals_.end())
+      it->second.add(m.value);
+    else
+      other_currencies_++;
+  }
+
+  const bool present[signals] = {t.signals.has_tva, t.signals.has_siret,
+                                 t.signals.has_card_keywords};
+  for (std::size_t a = 0; a < signals; a++)
+    if (present[a])
+      for (std::size_t b = 0; b < signals; b++)
+        together_[a][b] += present[b];
+}
+
+void BatchSummary::merge(const BatchSummary &other) {
+  tickets_ += other.tickets_;
+  skipped_ += other.skipped_;
+  for (std::size_t s = 0; s < status_.size(); s++)
+    status_[s] += other.status_[s];
+  without_merchant_ += other.without_merchant_;
+  merchants_.merge(other.merchants_);
+  top_.merge(other.top_);
+  other_currencies_ += other.other_currencies_;
+  for (const auto &[currency, sketch] : other.totals_) {
+    auto it = totals_.find(currency);
+    if (it == totals_.end() && totals_.size() < max_currencies)
+      it = totals_.emplace(currency, DDSketch()).first;
+    if (it != totals_.end())
+      it->second.merge(sketch);
+    else
+      other_currencies_ += sketch.count();
+  }
+  for (std::size_t a = 0; a < signals; a++)
+    for (std::size_t b = 0; b < signals; b++)
+      together_[a][b] += other.together_[a][b];
+}
+
+std::size_t BatchSummary::memory() const {
+  std::size_t bytes = sizeof *this + merchants_.memory() + top_.memory();
+  for (const auto &[currency, sketch] : totals_)
+    bytes += sketch.memory();
+  return bytes;
+}
+
+static json by_status(const std::uint64_t *counts) {
+  json j = json::object();
+  for (auto s : {Status::Ok, Status::Partial, Status::Reject, Status::Error})
+    j[status_to_string(s)] = counts[static_cast<std::size_t>(s)];
+  return j;
+}
+
+std::string BatchSummary::to_json(std::size_t top) const {
+  json merchants = {{"distinct", std::llround(merchants_.estimate())},
+                    {"distinct_error", merchants_.standard_error()},
+                    {"without", without_merchant_},
+                    {"top", json::array()}};
+  for (const auto &e : top_.top(top))
+    merchants["top"].push_back({{"name", e.key},
+                                {"count", e.count},
+                                {"error", e.error},
+                                {"status", by_status(e.by_kind.data())}});
+
+  json totals = json::object();
+  for (const auto &[currency, sketch] : totals_)
+    totals[currency] = {{"count", sketch.count()},
+                        {"sum", sketch.sum()},
+                        {"min", sketch.min()},
+                        {"max", sketch.max()},
+                        {"p50", sketch.quantile(0.5)},
+                        {"p90", sketch.quantile(0.9)},
+                        {"p99", sketch.quantile(0.99)},
+                        {"relative_error", sketch.accuracy()}};
+
+  json together = json::object();
+  for (std::size_t a = 0; a < signals; a++)
+    for (std::size_t b = 0; b < signals; b++)
+      together[signal_names[a]][signal_names[b]] = together_[a][b];
+
+  json doc = {{"tickets", tickets_},
+              {"skipped", skipped_},
+              {"status", by_status(status_.data())},
+              {"merchants", std::move(merchants)},
+              {"totals", std::move(totals)},
+              {"other_currencies", other_currencies_},
+              {"signals", std::move(together)},
+              {"memory_bytes", memory()}};
+  // Merchant names are OCR text.
+  return doc.dump(-1, ' ', false, json::error_handler_t::replace);
+}
+
+} // namespace tv
@@ -13,6 +13,12 @@ static std::optional<Locale> parse_locale(const std::string &s) {
     return Locale::Auto;
   if (s == "fr_FR")
     return Locale::FrFR;
+  if (s == "fr_BE")
+    return Locale::FrBE;
+  if (s == "fr_CH")
+    return Locale::FrCH;
+  if (s == "es_ES")
+    return Locale::EsES;
   return std::nullopt;
 }
 
@@ -119,6 +125,188 @@ CliParseResult parse_args(const std::vector<std::string> &args) {
       continue;
     }
 
+    if (a == "--budget-ms") {
+      auto v = need_value("--budget-ms");
+      if (!v)
+        break;
+      try {
+        int n = std::stoi(*v);
+        if (n < 0)
+          throw std::runtime_error("negative");
+        res.options.budget_ms = static_cast<std::uint32_t>(n);
+      } catch (...) {
+        res.error = "Invalid --budget-ms: " + *v;
+        break;
+      }
+      continue;
+    }
+
+    if (a == "--shm-workers") {
+      auto v = need_value("--shm-workers");
+      if (!v)
+        break;
+      try {
+        int n = std::stoi(*v);
+        if (n <= 0 || n > 64)
+          throw std::runtime_error("out of range");
+        res.shm_workers = static_cast<std::uint32_t>(n);
+      } catch (...) {
+        res.error = "Invalid --shm-workers: " + *v;
+        break;
+      }
+      continue;
+    }
+
+    if (a == "--slow-ms") {
+      auto v = need_value("--slow-ms");
+      if (!v)
+        break;
+      try {
+        int n = std::stoi(*v);
+        if (n < 0)
+          throw std::runtime_error("negative");
+        res.slow_ms = static_cast<std::uint32_t>(n);
+      } catch (...) {
+        res.error = "Invalid --slow-ms: " + *v;
+        break;
+      }
+      continue;
+    }
+
+    if (a == "--flight-dump") {
+      auto v = need_value("--flight-dump");
+      if (!v)
+        break;
+      res.flight_dump = *v;
+      continue;
+    }
+
+    if (a == "--near-duplicates") {
+      auto v = need_value("--near-duplicates");
+      if (!v)
+        break;
+      res.near_duplicates = *v;
+      continue;
+    }
+
+    if (a == "--input-dir") {
+      auto v = need_value("--input-dir");
+      if (!v)
+        break;
+      res.input_dir = *v;
+      continue;
+    }
+
+    if (a == "--read-method") {
+      auto v = need_value("--read-method");
+      if (!v)
+        break;
+      if (*v != "auto" && *v != "io_uring" && *v != "threads" &&
+          *v != "serial") {
+        res.error = "Invalid --read-method: " + *v;
+        break;
+      }
+      res.read_method = *v;
+      continue;
+    }
+
+    if (a == "--summary") {
+      auto v = need_value("--summary");
+      if (!v)
+        break;
+      res.summary = *v;
+      continue;
+    }
+
+    if (a == "--columnar") {
+      auto v = need_value("--columnar");
+      if (!v)
+        break;
+      res.columnar = *v;
+      continue;
+    }
+
+    if (a == "--rules") {
+      auto v = need_value("--rules");
+      if (!v)
+        break;
+      res.rules_path = *v;
+      continue;
+    }
+
+    if (a == "--registry") {
+      auto v = need_value("--registry");
+      if (!v)
+        break;
+      res.registry_path = *v;
+      continue;
+    }
+
+    if (a == "--compile-registry") {
+      auto csv = need_value("--compile-registry");
+      if (!csv)
+        break;
+      auto out = need_value("--compile-registry");
+      if (!out)
+        break;
+      res.compile_registry = std::pair{*csv, *out};
+      continue;
+    }
+
+    if (a == "--merchants") {
+      auto v = need_value("--merchants");
+      if (!v)
+        break;
+      res.merchants_path = *v;
+      continue;
+    }
+
+    if (a == "--compile-merchants") {
+      auto list = need_value("--compile-merchants");
+      if (!list)
+        break;
+      auto out = need_value("--compile-merchants");
+      if (!out)
+        break;
+      res.compile_merchants = std::pair{*list, *out};
+      continue;
+    }
+
+    if (a == "--shadow-rules" || a == "--shadow-log") {
+      auto v = need_value(a.c_str());
+      if (!v)
+        break;
+      (a == "--shadow-rules" ? res.shadow_rules : res.shadow_log) = *v;
+      continue;
+    }
+
+    if (a == "--shadow-rate") {
+      auto v = need_value("--shadow-rate");
+      if (!v)
+        break;
+      try {
+        std::size_t used = 0;
+        double r = std::stod(*v, &used);
+        if (used != v->size() || !(r >= 0.0 && r <= 1.0))
+          throw std::runtime_error("out of range");
+        res.shadow_rate = r;
+      } catch (...) {
+        res.error = "Invalid --shadow-rate: " + *v;
+        break;
+      }
+      continue;
+    }
+
+    if (a == "--zygote" || a == "--via-zygote" || a == "--shm") {
+      auto v = need_value(a.c_str());
+      if (!v)
+        break;
+      (a == "--zygote"       ? res.zygote_socket
+       : a == "--via-zygote" ? res.via_zygote
+                             : res.shm_name) = *v;
+      continue;
+    }
+
     // Unknown argument
     if (!a.empty() && a[0] == '-') {
       res.error = "Unknown argument: " + a;
@@ -128,6 +316,18 @@ CliParseResult parse_args(const std::vector<std::string> &args) {
       break;
     }
   }
+  // The index lives in the serving process, or for one directory run.
+  if (!res.error && res.near_duplicates && !res.shm_name && !res.input_dir)
+    res.error = "--near-duplicates requires --shm or --input-dir";
+  if (!res.error && res.flight_dump && !res.shm_name)
+    res.error = "--flight-dump requires --shm";
+  if (!res.error && res.input_dir &&
+      (res.shm_name || res.zygote_socket || res.via_zygote))
+    res.error = "--input-dir cannot be combined with --shm or --zygote";
+  if (!res.error && res.summary && !res.input_dir)
+    res.error = "--summary requires --input-dir";
+  if (!res.error && res.columnar && !res.input_dir)
+    res.error = "--columnar requires --input-dir";
 
   return res;
 }
@@ -140,11 +340,93 @@ std::string help_text() {
       << "Options:\n"
       << "  --schema v1              Output JSON schema version (default: v1)\n"
       << "  --format json            Output format (default: json)\n"
-      << "  --locale fr_FR|auto      Locale hint (default: auto)\n"
-      << "  --domain cafe|resto|auto Domain hint (default: auto)\n"
+      << "  --locale fr_FR|fr_BE|fr_CH|es_ES|auto\n"
+      << "                           Locale hint (default: auto = detected)\n"
+      << "  --domain cafe|resto|auto Domain hint (default: auto = detected)\n"
       << "  --max-lines N            Limit number of OCR lines read (default: "
          "4000)\n"
+      << "  --budget-ms N            Time budget per ticket, 0 = none "
+         "(default: 0)\n"
+      << "  --rules FILE             Rule pack (JSON) replacing the built-in "
+         "rules;\n"
+      << "                           reloaded on SIGHUP by --zygote and "
+         "--shm\n"
+      << "  --shadow-rules FILE      Also evaluate this candidate rule pack "
+         "on the\n"
+      << "                           same preprocessing; stdout keeps the "
+         "primary\n"
+      << "                           result\n"
+      << "  --shadow-rate R          Share of tickets shadowed, 0..1 "
+         "(default: 1)\n"
+      << "  --shadow-log FILE        Append one JSON diff record per shadowed "
+         "ticket\n"
+      << "                           (default: stderr)\n"
+      << "  --registry FILE          Company registry compiled by "
+         "--compile-registry:\n"
+      << "                           adds the registered name and NAF code "
+         "of the\n"
+      << "                           ticket's SIRET/SIREN\n"
+      << "  --compile-registry CSV OUT\n"
+      << "                           Compile a registry extract (lines "
+         "number;name;\n"
+      << "                           naf[;trade_name]) into OUT and exit\n"
+      << "  --merchants FILE         Merchant dictionary compiled by "
+         "--compile-merchants:\n"
+      << "                           adds the canonical name of the merchant "
+         "read,\n"
+      << "                           within a few OCR errors\n"
+      << "  --compile-merchants LIST OUT\n"
+      << "                           Compile a merchant list (lines "
+         "name;alias;...)\n"
+      << "                           into OUT and exit\n"
+      << "  --input-dir DIR          Run every file of DIR instead of stdin: "
+         "one JSON\n"
+      << "                           line per file, in name order, with a "
+         "\"file\" key\n"
+      << "  --read-method M          With --input-dir: "
+         "auto|io_uring|threads|serial\n"
+      << "                           (default: auto = io_uring when "
+         "available)\n"
+      << "  --summary FILE           With --input-dir: write a summary of the "
+         "run to FILE\n"
+      << "                           (distinct and top merchants, totals "
+         "quantiles,\n"
+      << "                           signals), in memory bounded whatever "
+         "the run size\n"
+      << "  --columnar FILE          With --input-dir: also write the "
+         "results to FILE\n"
+      << "                           in columns (format: "
+         "include/tv/columnar.hpp)\n"
       << "  --debug                  Verbose logs to stderr\n"
+      << "  --zygote PATH            Serve requests on a Unix socket, one "
+         "forked\n"
+      << "                           process per ticket\n"
+      << "  --via-zygote PATH        Run this invocation in a zygote child "
+         "(runs\n"
+      << "                           locally when the zygote is down)\n"
+      << "  --shm NAME               Serve one client over a shared-memory "
+         "ring\n"
+      << "                           segment (see include/tv/shm_ring.h)\n"
+      << "  --shm-workers N          Threads serving --shm requests, by "
+         "priority\n"
+      << "                           and deadline (default: 1)\n"
+      << "  --slow-ms N              With --shm: the flight recorder keeps "
+         "the input\n"
+      << "                           of tickets served in N ms or more "
+         "(default: 100,\n"
+      << "                           0: none)\n"
+      << "  --flight-dump FILE       With --shm: where SIGUSR1 and stats "
+         "requests dump\n"
+      << "                           the flight recorder, mode 0600 "
+         "(default:\n"
+      << "                           $XDG_RUNTIME_DIR/"
+         "ticketverify-<pid>.flight.json)\n"
+      << "  --near-duplicates FILE   With --shm or --input-dir: warn "
+         "NEAR_DUPLICATE when\n"
+      << "                           a ticket's text is close to an earlier "
+         "one; the index\n"
+      << "                           is loaded from FILE if present, saved "
+         "there on exit\n"
       << "  --version                Print version\n"
       << "  --help                   Print help\n";
   return oss.str();
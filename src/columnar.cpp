@@ -0,0 +1,579 @@
+#include "tv/columnar.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace tv {
+
+static constexpr char magic[8] = {'T', 'V', 'C', 'O', 'L', '1', '\n', '\0'};
+
+// ---- encoding ----
+
+namespace {
+
+void put_u32(std::string &out, std::uint32_t v) {
+  for (int i = 0; i < 4; i++)
+    out += static_cast<char>(v >> (8 * i));
+}
+
+void put_varint(std::string &out, std::uint64_t v) {
+  while (v >= 0x80) {
+    out += static_cast<char>(v | 0x80);
+    v >>= 7;
+  }
+  out += static_cast<char>(v);
+}
+
+std::uint64_t zigzag(std::int64_t v) {
+  return (static_cast<std::uint64_t>(v) << 1) ^
+         static_cast<std::uint64_t>(v >> 63);
+}
+
+void put_string(std::string &out, std::string_view s) {
+  put_varint(out, s.size());
+  out.append(s);
+}
+
+// `width` bits per value, LSB first.
+class BitWriter {
+public:
+  explicit BitWriter(std::string &out) : out_(out) {}
+  ~BitWriter() {
+    if (used_)
+      out_ += static_cast<char>(acc_);
+  }
+  void put(std::uint64_t v, unsigned width) {
+    for (unsigned b = 0; b < width; b++) {
+      acc_ |= ((v >> b) & 1u) << used_;
+      if (++used_ == 8) {
+        out_ += static_cast<char>(acc_);
+        acc_ = 0;
+        used_ = 0;
+      }
+    }
+  }
+
+private:
+  std::string &out_;
+  unsigned acc_ = 0, used_ = 0;
+};
+
+std::string encode_strings(const std::vector<std::string> &v) {
+  std::string out;
+  for (const auto &s : v)
+    put_string(out, s);
+  return out;
+}
+
+std::string encode_bits(const std::vector<bool> &v) {
+  std::string out;
+  {
+    BitWriter bits(out);
+    for (bool b : v)
+      bits.put(b, 1);
+  }
+  return out;
+}
+
+std::string encode_packed(const std::vector<Status> &v) {
+  unsigned max = 0;
+  for (Status s : v)
+    max = std::max(max, static_cast<unsigned>(s));
+  const auto width = static_cast<unsigned>(std::bit_width(max));
+  std::string out(1, static_cast<char>(width));
+  {
+    BitWriter bits(out);
+    for (Status s : v)
+      bits.put(static_cast<unsigned>(s), width);
+  }
+  return out;
+}
+
+std::string encode_fixed16(const std::vector<double> &v) {
+  std::string out;
+  for (double d : v) {
+    auto q = static_cast<std::uint16_t>(
+        std::lround(std::clamp(d, 0.0, 1.0) * 10000.0));
+    out += static_cast<char>(q);
+    out += static_cast<char>(q >> 8);
+  }
+  return out;
+}
+
+std::string encode_varint(const std::vector<std::optional<std::int64_t>> &v) {
+  std::string out;
+  {
+    BitWriter bits(out);
+    for (const auto &x : v)
+      bits.put(x.has_value(), 1);
+  }
+  for (const auto &x : v)
+    if (x)
+      put_varint(out, zigzag(*x));
+  return out;
+}
+
+// Dictionary of a block's strings in first-seen order; codes are 1-based.
+class Dictionary {
+public:
+  std::uint32_t code(const std::string &s) {
+    auto [it, added] = codes_.emplace(s, 0);
+    if (added) {
+      order_.push_back(&it->first);
+      it->second = static_cast<std::uint32_t>(order_.size());
+    }
+    return it->second;
+  }
+  unsigned width() const {
+    return static_cast<unsigned>(std::bit_width(order_.size()));
+  }
+  void write(std::string &out) const {
+    put_varint(out, order_.size());
+    for (const std::string *s : order_)
+      put_string(out, *s);
+    out += static_cast<char>(width());
+  }
+
+private:
+  std::unordered_map<std::string, std::uint32_t> codes_;
+  std::vector<const std::string *> order_;
+};
+
+std::string encode_dict(const std::vector<std::optional<std::string>> &v) {
+  Dictionary dict;
+  std::vector<std::uint32_t> codes;
+  for (const auto &s : v)
+    codes.push_back(s ? dict.code(*s) : 0);
+  std::string out;
+  dict.write(out);
+  {
+    BitWriter bits(out);
+    for (auto c : codes)
+      bits.put(c, dict.width());
+  }
+  return out;
+}
+
+std::string encode_dict_list(const std::vector<std::vector<std::string>> &v) {
+  Dictionary dict;
+  std::vector<std::uint32_t> codes;
+  for (const auto &row : v)
+    for (const auto &s : row)
+      codes.push_back(dict.code(s));
+  std::string out;
+  dict.write(out);
+  for (const auto &row : v)
+    put_varint(out, row.size());
+  {
+    BitWriter bits(out);
+    for (auto c : codes)
+      bits.put(c, dict.width());
+  }
+  return out;
+}
+
+} // namespace
+
+ColumnarWriter::ColumnarWriter(const std::string &path) : path_(path) {
+  fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_ < 0)
+    throw std::runtime_error("columnar: " + path + ": " +
+                             std::strerror(errno));
+  write(std::string_view(magic, sizeof magic));
+}
+
+ColumnarWriter::~ColumnarWriter() {
+  if (fd_ >= 0)
+    ::close(fd_);
+}
+
+void ColumnarWriter::write(std::string_view data) {
+  while (!data.empty()) {
+    ssize_t n = ::write(fd_, data.data(), data.size());
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      throw std::runtime_error("columnar: " + path_ + ": " +
+                               std::strerror(errno));
+    data.remove_prefix(static_cast<std::size_t>(n));
+    bytes_ += static_cast<std::size_t>(n);
+  }
+}
+
+void ColumnarWriter::add(std::string_view file, const EngineOutput *out,
+                         std::string_view error_code) {
+  ColumnarBlock &b = pending_;
+  b.rows++;
+  b.file.emplace_back(file);
+  if (!out) {
+    b.status.push_back(Status::Error);
+    b.error.emplace_back(std::string(error_code));
+    b.confidence.push_back(0.0);
+    b.merchant.emplace_back();
+    b.total_cents.emplace_back();
+    b.currency.emplace_back();
+    b.has_tva.push_back(false);
+    b.has_siret.push_back(false);
+    b.has_card_keywords.push_back(false);
+    b.warnings.emplace_back();
+    b.timing_total_ms.emplace_back();
+    b.timing_parse_ms.emplace_back();
+  } else {
+    const ParsedTicket &t = out->ticket;
+    b.status.push_back(out->status);
+    b.error.emplace_back();
+    b.confidence.push_back(out->confidence);
+    b.merchant.push_back(t.merchant.value);
+    if (t.total.value) {
+      b.total_cents.emplace_back(std::llround(t.total.value->value * 100.0));
+      b.currency.emplace_back(t.total.value->currency);
+    } else {
+      b.total_cents.emplace_back();
+      b.currency.emplace_back();
+    }
+    b.has_tva.push_back(t.signals.has_tva);
+    b.has_siret.push_back(t.signals.has_siret);
+    b.has_card_keywords.push_back(t.signals.has_card_keywords);
+    std::vector<std::string> codes;
+    for (const auto &w : t.warnings)
+      codes.push_back(w.code);
+    b.warnings.push_back(std::move(codes));
+    b.timing_total_ms.emplace_back(out->timing.total);
+    b.timing_parse_ms.emplace_back(out->timing.parse);
+  }
+  rows_++;
+  if (b.rows == block_rows)
+    write_block();
+}
+
+void ColumnarWriter::write_block() {
+  const ColumnarBlock &b = pending_;
+  std::string out;
+  put_u32(out, static_cast<std::uint32_t>(b.rows));
+  put_u32(out, column_count);
+  auto column = [&](ColumnId id, Encoding e, const std::string &data) {
+    out += static_cast<char>(id);
+    out += static_cast<char>(e);
+    put_u32(out, static_cast<std::uint32_t>(data.size()));
+    out += data;
+  };
+  column(ColumnId::File, Encoding::Strings, encode_strings(b.file));
+  column(ColumnId::Status, Encoding::Packed, encode_packed(b.status));
+  column(ColumnId::Error, Encoding::Dict, encode_dict(b.error));
+  column(ColumnId::Confidence, Encoding::Fixed16,
+         encode_fixed16(b.confidence));
+  column(ColumnId::Merchant, Encoding::Dict, encode_dict(b.merchant));
+  column(ColumnId::TotalCents, Encoding::Varint, encode_varint(b.total_cents));
+  column(ColumnId::Currency, Encoding::Dict, encode_dict(b.currency));
+  column(ColumnId::HasTva, Encoding::Bits, encode_bits(b.has_tva));
+  column(ColumnId::HasSiret, Encoding::Bits, encode_bits(b.has_siret));
+  column(ColumnId::HasCardKeywords, Encoding::Bits,
+         encode_bits(b.has_card_keywords));
+  column(ColumnId::Warnings, Encoding::DictList, encode_dict_list(b.warnings));
+  column(ColumnId::TimingTotalMs, Encoding::Varint,
+         encode_varint(b.timing_total_ms));
+  column(ColumnId::TimingParseMs, Encoding::Varint,
+         encode_varint(b.timing_parse_ms));
+  write(out);
+  pending_ = ColumnarBlock{};
+}
+
+void ColumnarWriter::finish() {
+  if (fd_ < 0)
+    return;
+  if (pending_.rows > 0)
+    write_block();
+  std::string end;
+  put_u32(end, 0);
+  write(end);
+  int fd = fd_;
+  fd_ = -1;
+  if (::close(fd) != 0)
+    throw std::runtime_error("columnar: " + path_ + ": " +
+                             std::strerror(errno));
+}
+
+// ---- decoding ----
+
+namespace {
+
+struct Corrupt {};
+
+// Bounds-checked reads over one column (or the block headers).
+class Cursor {
+public:
+  Cursor(const unsigned char *p, const unsigned char *end)
+      : p_(p), end_(end) {}
+
+  std::size_t left() const { return static_cast<std::size_t>(end_ - p_); }
+  const unsigned char *at() const { return p_; }
+
+  const unsigned char *take(std::size_t n) {
+    if (n > left())
+      throw Corrupt{};
+    const unsigned char *p = p_;
+    p_ += n;
+    return p;
+  }
+  std::uint8_t u8() { return *take(1); }
+  std::uint32_t u32() {
+    const unsigned char *p = take(4);
+    return p[0] | p[1] << 8 | p[2] << 16 | std::uint32_t{p[3]} << 24;
+  }
+  std::uint64_t varint() {
+    std::uint64_t v = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+      const std::uint8_t b = u8();
+      v |= std::uint64_t{b & 0x7Fu} << shift;
+      if (!(b & 0x80))
+        return v;
+    }
+    throw Corrupt{};
+  }
+  // A count of items taking at least `bits` bits each.
+  std::size_t count(unsigned bits = 8) {
+    const std::uint64_t n = varint();
+    if (n > left() * 8 / std::max(bits, 1u))
+      throw Corrupt{};
+    return static_cast<std::size_t>(n);
+  }
+  std::string string() {
+    const std::size_t n = count();
+    const unsigned char *p = take(n);
+    return std::string(reinterpret_cast<const char *>(p), n);
+  }
+
+private:
+  const unsigned char *p_, *end_;
+};
+
+class BitReader {
+public:
+  // `n` values of `width` bits, taken from the cursor.
+  BitReader(Cursor &c, std::size_t n, unsigned width)
+      : p_(c.take((n * width + 7) / 8)) {}
+  std::uint64_t get(unsigned width) {
+    std::uint64_t v = 0;
+    for (unsigned b = 0; b < width; b++, bit_++)
+      v |= std::uint64_t{(p_[bit_ / 8] >> (bit_ % 8)) & 1u} << b;
+    return v;
+  }
+
+private:
+  const unsigned char *p_;
+  std::size_t bit_ = 0;
+};
+
+std::int64_t unzigzag(std::uint64_t v) {
+  return static_cast<std::int64_t>(v >> 1) ^ -static_cast<std::int64_t>(v & 1);
+}
+
+std::vector<std::string> decode_strings(Cursor &c, std::size_t rows) {
+  std::vector<std::string> v;
+  v.reserve(rows);
+  for (std::size_t i = 0; i < rows; i++)
+    v.push_back(c.string());
+  return v;
+}
+
+std::vector<bool> decode_bits(Cursor &c, std::size_t rows) {
+  BitReader bits(c, rows, 1);
+  std::vector<bool> v(rows);
+  for (std::size_t i = 0; i < rows; i++)
+    v[i] = bits.get(1);
+  return v;
+}
+
+std::vector<Status> decode_packed(Cursor &c, std::size_t rows) {
+  const unsigned width = c.u8();
+  if (width > 2)
+    throw Corrupt{};
+  BitReader bits(c, rows, width);
+  std::vector<Status> v(rows);
+  for (std::size_t i = 0; i < rows; i++)
+    v[i] = static_cast<Status>(bits.get(width));
+  return v;
+}
+
+std::vector<double> decode_fixed16(Cursor &c, std::size_t rows) {
+  const unsigned char *p = c.take(2 * rows);
+  std::vector<double> v(rows);
+  for (std::size_t i = 0; i < rows; i++)
+    v[i] = (p[2 * i] | p[2 * i + 1] << 8) / 10000.0;
+  return v;
+}
+
+std::vector<std::optional<std::int64_t>> decode_varint(Cursor &c,
+                                                       std::size_t rows) {
+  std::vector<bool> present = decode_bits(c, rows);
+  std::vector<std::optional<std::int64_t>> v(rows);
+  for (std::size_t i = 0; i < rows; i++)
+    if (present[i])
+      v[i] = unzigzag(c.varint());
+  return v;
+}
+
+struct DictStrings {
+  std::vector<std::string> strings;
+  unsigned width = 0;
+
+  explicit DictStrings(Cursor &c) {
+    const std::size_t n = c.count();
+    strings.reserve(n);
+    for (std::size_t i = 0; i < n; i++)
+      strings.push_back(c.string());
+    width = c.u8();
+    if (width != static_cast<unsigned>(std::bit_width(n)))
+      throw Corrupt{};
+  }
+  const std::string &at(std::uint64_t code) const {
+    if (code == 0 || code > strings.size())
+      throw Corrupt{};
+    return strings[code - 1];
+  }
+};
+
+std::vector<std::optional<std::string>> decode_dict(Cursor &c,
+                                                    std::size_t rows) {
+  DictStrings dict(c);
+  BitReader bits(c, rows, dict.width);
+  std::vector<std::optional<std::string>> v(rows);
+  for (std::size_t i = 0; i < rows; i++)
+    if (auto code = bits.get(dict.width))
+      v[i] = dict.at(code);
+  return v;
+}
+
+std::vector<std::vector<std::string>> decode_dict_list(Cursor &c,
+                                                       std::size_t rows) {
+  DictStrings dict(c);
+  std::vector<std::size_t> counts(rows);
+  std::size_t total = 0;
+  for (auto &n : counts) {
+    n = c.count(dict.width);
+    total += n;
+  }
+  if (total > c.left() * 8 / std::max(dict.width, 1u))
+    throw Corrupt{};
+  BitReader bits(c, total, dict.width);
+  std::vector<std::vector<std::string>> v(rows);
+  for (std::size_t i = 0; i < rows; i++)
+    for (std::size_t k = 0; k < counts[i]; k++)
+      v[i].push_back(dict.at(bits.get(dict.width)));
+  return v;
+}
+
+} // namespace
+
+ColumnarReader::ColumnarReader(const std::string &path)
+    : path_(path), file_(path, "columnar") {
+  if (file_.size() < sizeof magic ||
+      std::memcmp(file_.data(), magic, sizeof magic) != 0)
+    throw std::runtime_error("columnar: " + path + ": not a columnar file");
+  // Read front to back, unlike the lookup tables.
+  ::madvise(const_cast<unsigned char *>(file_.data()), file_.size(),
+            MADV_SEQUENTIAL);
+  at_ = sizeof magic;
+}
+
+bool ColumnarReader::next(ColumnarBlock *block, std::uint32_t columns) {
+  if (done_)
+    return false;
+  Cursor c(file_.data() + at_, file_.data() + file_.size());
+  try {
+    const std::uint32_t rows = c.u32();
+    if (rows == 0) {
+      done_ = true;
+      return false;
+    }
+    if (rows > max_block_rows)
+      throw Corrupt{};
+    *block = ColumnarBlock{};
+    block->rows = rows;
+    const std::uint32_t n = c.u32();
+    for (std::uint32_t k = 0; k < n; k++) {
+      const std::uint8_t id = c.u8();
+      const auto encoding = static_cast<Encoding>(c.u8());
+      const std::uint32_t size = c.u32();
+      const unsigned char *data = c.take(size);
+      // Columns not asked for, or unknown to this reader, are skipped.
+      if (id >= column_count || !(columns & (std::uint32_t{1} << id)))
+        continue;
+      Cursor col(data, data + size);
+      auto expect = [&](Encoding e) {
+        if (encoding != e)
+          throw Corrupt{};
+      };
+      switch (static_cast<ColumnId>(id)) {
+      case ColumnId::File:
+        expect(Encoding::Strings);
+        block->file = decode_strings(col, rows);
+        break;
+      case ColumnId::Status:
+        expect(Encoding::Packed);
+        block->status = decode_packed(col, rows);
+        break;
+      case ColumnId::Error:
+        expect(Encoding::Dict);
+        block->error = decode_dict(col, rows);
+        break;
+      case ColumnId::Confidence:
+        expect(Encoding::Fixed16);
+        block->confidence = decode_fixed16(col, rows);
+        break;
+      case ColumnId::Merchant:
+        expect(Encoding::Dict);
+        block->merchant = decode_dict(col, rows);
+        break;
+      case ColumnId::TotalCents:
+        expect(Encoding::Varint);
+        block->total_cents = decode_varint(col, rows);
+        break;
+      case ColumnId::Currency:
+        expect(Encoding::Dict);
+        block->currency = decode_dict(col, rows);
+        break;
+      case ColumnId::HasTva:
+        expect(Encoding::Bits);
+        block->has_tva = decode_bits(col, rows);
+        break;
+      case ColumnId::HasSiret:
+        expect(Encoding::Bits);
+        block->has_siret = decode_bits(col, rows);
+        break;
+      case ColumnId::HasCardKeywords:
+        expect(Encoding::Bits);
+        block->has_card_keywords = decode_bits(col, rows);
+        break;
+      case ColumnId::Warnings:
+        expect(Encoding::DictList);
+        block->warnings = decode_dict_list(col, rows);
+        break;
+      case ColumnId::TimingTotalMs:
+        expect(Encoding::Varint);
+        block->timing_total_ms = decode_varint(col, rows);
+        break;
+      case ColumnId::TimingParseMs:
+        expect(Encoding::Varint);
+        block->timing_parse_ms = decode_varint(col, rows);
+        break;
+      }
+    }
+  } catch (const Corrupt &) {
+    throw std::runtime_error("columnar: " + path_ + ": corrupt block at " +
+                             std::to_string(at_));
+  }
+  at_ = static_cast<std::size_t>(c.at() - file_.data());
+  return true;
+}
+
+} // namespace tv
@@ -0,0 +1,379 @@
+#include "tv/detect.hpp"
+#include "tv/scan.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+namespace tv {
+namespace {
+
+enum : std::size_t { FR, BE, CH, ES, N_LOCALES };
+
+struct LocaleCue {
+  std::string_view word; // uppercase, accents folded
+  std::array<float, N_LOCALES> w;
+};
+
+struct DomainCue {
+  std::string_view word;
+  float cafe;
+  float resto;
+};
+
+// Trigram over A-Z plus word boundary (0), code = a*27*27 + b*27 + c.
+struct TrigramCue {
+  std::uint16_t code;
+  float french; // > 0 leans French (fr_FR/fr_BE/fr_CH), < 0 Spanish
+};
+
+template <class T, std::size_t N>
+constexpr std::array<T, N> sorted_by_word(std::array<T, N> a) {
+  std::sort(a.begin(), a.end(),
+            [](const T &x, const T &y) { return x.word < y.word; });
+  return a;
+}
+
+constexpr std::uint16_t trigram(const char (&s)[4]) {
+  auto sym = [](char c) { return c == ' ' ? 0 : c - 'A' + 1; };
+  return static_cast<std::uint16_t>(sym(s[0]) * 27 * 27 + sym(s[1]) * 27 +
+                                    sym(s[2]));
+}
+
+constexpr auto locale_cues = sorted_by_word(std::to_array<LocaleCue>({
+    // fr_FR
+    {"SIRET", {3.0f, 0, 0, 0}},
+    {"SIREN", {3.0f, 0, 0, 0}},
+    {"TTC", {1.5f, 0.5f, 0.5f, 0}},
+    {"HT", {0.5f, 0.2f, 0.2f, 0}},
+    {"TVA", {1.0f, 1.0f, 1.0f, 0}},
+    {"CB", {1.0f, 0, 0, 0}},
+    {"BANCAIRE", {0.5f, 0.3f, 0.3f, 0}},
+    {"MERCI", {0.5f, 0.5f, 0.5f, 0}},
+    {"PAYER", {0.5f, 0.5f, 0.5f, 0}},
+    {"FRANCE", {3.0f, 0, 0, 0}},
+    {"PARIS", {1.5f, 0, 0, 0}},
+    {"RENNES", {1.5f, 0, 0, 0}},
+    {"LYON", {1.5f, 0, 0, 0}},
+    // fr_BE
+    {"TVAC", {0, 3.0f, 0, 0}},
+    {"HTVA", {0, 3.0f, 0, 0}},
+    {"BTW", {0, 2.5f, 0, 0}},
+    {"BANCONTACT", {0, 3.0f, 0, 0}},
+    {"BCE", {0, 2.0f, 0, 0}},
+    {"BELGIQUE", {0, 3.0f, 0, 0}},
+    {"BELGIE", {0, 3.0f, 0, 0}},
+    {"BRUXELLES", {0, 2.5f, 0, 0}},
+    {"LIEGE", {0, 2.0f, 0, 0}},
+    {"NAMUR", {0, 2.0f, 0, 0}},
+    // fr_CH
+    {"CHF", {0, 0, 3.0f, 0}},
+    {"MWST", {0, 0, 3.0f, 0}},
+    {"TWINT", {0, 0, 3.0f, 0}},
+    {"SUISSE", {0, 0, 3.0f, 0}},
+    {"SCHWEIZ", {0, 0, 3.0f, 0}},
+    {"CHE", {0, 0, 1.5f, 0}},
+    {"GENEVE", {0, 0, 2.5f, 0}},
+    {"LAUSANNE", {0, 0, 2.5f, 0}},
+    {"FRIBOURG", {0, 0, 2.0f, 0}},
+    // es_ES
+    {"IVA", {0, 0, 0, 3.0f}},
+    {"CIF", {0, 0, 0, 3.0f}},
+    {"NIF", {0, 0, 0, 2.5f}},
+    {"GRACIAS", {0, 0, 0, 3.0f}},
+    {"TARJETA", {0, 0, 0, 3.0f}},
+    {"EFECTIVO", {0, 0, 0, 3.0f}},
+    {"IMPORTE", {0, 0, 0, 2.0f}},
+    {"PAGAR", {0, 0, 0, 2.0f}},
+    {"FACTURA", {0, 0, 0, 2.0f}},
+    {"ESPANA", {0, 0, 0, 3.0f}},
+    {"MADRID", {0, 0, 0, 2.0f}},
+    {"BARCELONA", {0, 0, 0, 2.0f}},
+}));
+
+constexpr auto domain_cues = sorted_by_word(std::to_array<DomainCue>({
+    {"CAFE", 1.0f, 0},
+    {"CAFETERIA", 2.0f, 0},
+    {"BAR", 0.5f, 0.2f},
+    {"ESPRESSO", 2.0f, 0},
+    {"EXPRESSO", 2.0f, 0},
+    {"CAPPUCCINO", 2.0f, 0},
+    {"LATTE", 2.0f, 0},
+    {"MATCHA", 1.5f, 0},
+    {"CHOCOLAT", 1.5f, 0},
+    {"THE", 0.5f, 0},
+    {"CROISSANT", 1.5f, 0},
+    {"COOKIE", 1.5f, 0},
+    {"MUFFIN", 1.5f, 0},
+    {"CORTADO", 2.0f, 0},
+    {"RESTAURANT", 0, 2.0f},
+    {"RESTAURANTE", 0, 2.0f},
+    {"RESTO", 0, 1.5f},
+    {"BRASSERIE", 0.5f, 1.0f},
+    {"MENU", 0, 1.5f},
+    {"PLAT", 0, 1.5f},
+    {"ENTREE", 0, 1.5f},
+    {"DESSERT", 0, 1.0f},
+    {"FORMULE", 0, 1.5f},
+    {"COUVERT", 0, 1.5f},
+    {"COUVERTS", 0, 1.5f},
+    {"PIZZA", 0, 2.0f},
+    {"BURGER", 0, 1.5f},
+    {"BOUTEILLE", 0, 1.0f},
+    {"CARAFE", 0, 1.0f},
+    {"STEAK", 0, 1.5f},
+    {"FRITES", 0, 1.0f},
+    {"SALADE", 0, 1.0f},
+}));
+
+constexpr auto trigram_cues = [] {
+  auto a = std::to_array<TrigramCue>({
+      {trigram("EAU"), 0.8f},  {trigram("AUX"), 0.6f},
+      {trigram("OUR"), 0.5f},  {trigram("OIS"), 0.6f},
+      {trigram("AIS"), 0.5f},  {trigram("AIT"), 0.5f},
+      {trigram("EUR"), 0.5f},  {trigram("EUX"), 0.6f},
+      {trigram(" DU"), 0.6f},  {trigram("DU "), 0.4f},
+      {trigram(" LE"), 0.4f},  {trigram("LES"), 0.5f},
+      {trigram(" AU"), 0.4f},  {trigram("TTC"), 0.8f},
+      {trigram("IER"), 0.5f},  {trigram("ONS"), 0.4f},
+      {trigram(" EL"), -0.6f}, {trigram("EL "), -0.4f},
+      {trigram("LOS"), -0.7f}, {trigram("DEL"), -0.4f},
+      {trigram(" Y "), -0.6f}, {trigram("ADO"), -0.4f},
+      {trigram("IDO"), -0.4f}, {trigram("CIO"), -0.3f},
+      {trigram("OS "), -0.4f}, {trigram("IAS"), -0.5f},
+      {trigram("AGO"), -0.4f}, {trigram("ARJ"), -0.8f},
+      {trigram("DAD"), -0.7f}, {trigram("ADA"), -0.3f},
+  });
+  std::sort(a.begin(), a.end(), [](const TrigramCue &x, const TrigramCue &y) {
+    return x.code < y.code;
+  });
+  return a;
+}();
+
+// (first letter, length) pairs present in either cue table; words of any
+// other shape skip both binary searches.
+constexpr auto cue_shapes = [] {
+  std::array<std::uint32_t, 26> bits{};
+  auto add = [&](std::string_view w) {
+    bits[w[0] - 'A'] |= std::uint32_t{1} << w.size();
+  };
+  for (const auto &c : locale_cues)
+    add(c.word);
+  for (const auto &c : domain_cues)
+    add(c.word);
+  return bits;
+}();
+
+// One bit per trigram code: most trigrams carry no weight and are rejected
+// without searching the table.
+constexpr auto trigram_filter = [] {
+  std::array<std::uint64_t, (27 * 27 * 27 + 63) / 64> bits{};
+  for (const auto &t : trigram_cues)
+    bits[t.code / 64] |= std::uint64_t{1} << (t.code % 64);
+  return bits;
+}();
+
+// Latin-1 supplement letters (second byte of C3 xx, & 0x1F) folded to A-Z;
+// 0 for non-letters.
+constexpr char fold_c3[32] = {'A', 'A', 'A', 'A', 'A', 'A', 'A', 'C',
+                              'E', 'E', 'E', 'E', 'I', 'I', 'I', 'I',
+                              'D', 'N', 'O', 'O', 'O', 'O', 'O', 0,
+                              'O', 'U', 'U', 'U', 'U', 'Y', 0,   'S'};
+
+// Accent evidence, same index: French-only marks vs Spanish ones.
+constexpr float accent_french[32] = {0.4f, 0, 0.4f, 0, 0, 0, 0, 0.4f,
+                                     0.4f, 0, 0.4f, 0.4f, 0, 0, 0.4f, 0.4f,
+                                     0, 0, 0, 0, 0.4f, 0, 0, 0,
+                                     0, 0.4f, 0, 0.4f, 0, 0, 0, 0};
+constexpr float accent_spanish[32] = {0, 0.6f, 0, 0, 0, 0, 0, 0,
+                                      0, 0,    0, 0, 0, 0.6f, 0, 0,
+                                      0, 1.5f, 0, 0.6f, 0, 0, 0, 0,
+                                      0, 0,    0.6f, 0, 0, 0, 0, 0};
+
+template <class T, std::size_t N>
+const T *find_cue(const std::array<T, N> &cues, std::string_view word) {
+  auto it = std::lower_bound(
+      cues.begin(), cues.end(), word,
+      [](const T &c, std::string_view w) { return c.word < w; });
+  return (it != cues.end() && it->word == word) ? &*it : nullptr;
+}
+
+double round3(double x) { return std::round(x * 1000.0) / 1000.0; }
+
+// Softmax probability of the best score; returns its index.
+template <std::size_t N>
+std::size_t best_of(const std::array<double, N> &s, double *p) {
+  std::size_t best = 0;
+  for (std::size_t i = 1; i < N; i++)
+    if (s[i] > s[best])
+      best = i;
+  double sum = 0.0;
+  for (double x : s)
+    sum += std::exp(x - s[best]);
+  *p = round3(1.0 / sum);
+  return best;
+}
+
+class Scorer {
+public:
+  void letter(char up) {
+    if (len_ < word_.size())
+      word_[len_] = up;
+    len_++;
+    push_symbol(up - 'A' + 1);
+  }
+
+  void boundary() {
+    if (len_ > 0) {
+      end_word();
+      push_symbol(0);
+    }
+  }
+
+  void accent(unsigned idx) {
+    french_ += accent_french[idx];
+    spanish_ += accent_spanish[idx];
+  }
+
+  void add_locale(std::size_t l, double w) { locale_[l] += w; }
+
+  Detection result() {
+    boundary();
+    // Trigram and accent evidence is diffuse: cap it below a strong cue.
+    double lean = std::clamp(0.5 * trigrams_, -3.0, 3.0) +
+                  std::clamp(french_ - spanish_, -3.0, 3.0);
+    if (lean > 0) {
+      locale_[FR] += lean;
+      locale_[BE] += lean;
+      locale_[CH] += lean;
+    } else {
+      locale_[ES] -= lean;
+    }
+    locale_[FR] += 0.5; // prior: most traffic is fr_FR
+
+    Detection d;
+    static constexpr Locale locales[N_LOCALES] = {Locale::FrFR, Locale::FrBE,
+                                                  Locale::FrCH, Locale::EsES};
+    d.locale = locales[best_of(locale_, &d.locale_confidence)];
+
+    std::array<double, 3> dom = {1.5, cafe_, resto_}; // "none" baseline
+    double p = 0.0;
+    std::size_t best = best_of(dom, &p);
+    d.domain_confidence = p;
+    if (best == 1 && p >= 0.6)
+      d.domain = Domain::Cafe;
+    else if (best == 2 && p >= 0.6)
+      d.domain = Domain::Resto;
+    return d;
+  }
+
+private:
+  void end_word() {
+    if (len_ <= word_.size() &&
+        (cue_shapes[word_[0] - 'A'] >> len_ & 1)) {
+      std::string_view w(word_.data(), len_);
+      if (auto c = find_cue(locale_cues, w))
+        for (std::size_t l = 0; l < N_LOCALES; l++)
+          locale_[l] += c->w[l];
+      if (auto c = find_cue(domain_cues, w)) {
+        cafe_ += c->cafe;
+        resto_ += c->resto;
+      }
+    }
+    len_ = 0;
+  }
+
+  void push_symbol(int s) {
+    sym_[0] = sym_[1];
+    sym_[1] = sym_[2];
+    sym_[2] = s;
+    if (++n_sym_ < 3)
+      return;
+    auto code = static_cast<std::uint16_t>(sym_[0] * 27 * 27 +
+                                           sym_[1] * 27 + sym_[2]);
+    if (!(trigram_filter[code / 64] >> (code % 64) & 1))
+      return;
+    auto it = std::lower_bound(
+        trigram_cues.begin(), trigram_cues.end(), code,
+        [](const TrigramCue &c, std::uint16_t v) { return c.code < v; });
+    if (it != trigram_cues.end() && it->code == code)
+      trigrams_ += it->french;
+  }
+
+  std::array<char, 16> word_{};
+  std::size_t len_ = 0;
+  int sym_[3] = {0, 0, 0};
+  std::size_t n_sym_ = 1; // a leading boundary
+  double trigrams_ = 0.0;
+  double french_ = 0.0;
+  double spanish_ = 0.0;
+  std::array<double, N_LOCALES> locale_{};
+  double cafe_ = 0.0;
+  double resto_ = 0.0;
+};
+
+} // namespace
+
+Detection detect_locale_domain(std::string_view text) {
+  text = text.substr(0, std::min(text.size(), detect_window));
+  Scorer sc;
+
+  bool line_start = true;
+  for (std::size_t i = 0; i < text.size(); i++) {
+    char c = text[i];
+    auto u = static_cast<unsigned char>(c);
+
+    if (c >= 'A' && c <= 'Z') {
+      sc.letter(c);
+    } else if (c >= 'a' && c <= 'z') {
+      sc.letter(static_cast<char>(c - 'a' + 'A'));
+    } else if (u == 0xC3 && i + 1 < text.size()) {
+      unsigned idx = static_cast<unsigned char>(text[i + 1]) & 0x1F;
+      i++;
+      sc.accent(idx);
+      if (fold_c3[idx])
+        sc.letter(fold_c3[idx]);
+      else
+        sc.boundary();
+    } else if (is_ascii_digit(c)) {
+      sc.boundary();
+      std::size_t j = i;
+      while (j < text.size() && is_ascii_digit(text[j]))
+        j++;
+      // "35000 RENNES" / "1000 BRUXELLES" at the start of a line
+      if (line_start && j + 1 < text.size() && text[j] == ' ' &&
+          ((text[j + 1] >= 'A' && text[j + 1] <= 'Z') ||
+           (text[j + 1] >= 'a' && text[j + 1] <= 'z'))) {
+        if (j - i == 5) {
+          sc.add_locale(FR, 0.5);
+          sc.add_locale(ES, 0.5);
+        } else if (j - i == 4) {
+          sc.add_locale(BE, 0.75);
+          sc.add_locale(CH, 0.75);
+        }
+      }
+      i = j - 1;
+    } else if (c == '+' && i + 2 < text.size()) {
+      sc.boundary();
+      std::string_view cc = text.substr(i + 1, 2);
+      if (cc == "33")
+        sc.add_locale(FR, 2.0);
+      else if (cc == "32")
+        sc.add_locale(BE, 2.0);
+      else if (cc == "41")
+        sc.add_locale(CH, 2.0);
+      else if (cc == "34")
+        sc.add_locale(ES, 2.0);
+    } else {
+      sc.boundary();
+    }
+
+    if (c == '\n')
+      line_start = true;
+    else if (c != ' ')
+      line_start = false;
+  }
+  return sc.result();
+}
+
+} // namespace tv
@@ -1,13 +1,33 @@
 #include "tv/engine.hpp"
+#include "tv/detect.hpp"
+#include "tv/fingerprint.hpp"
+#include "tv/merchant_dict.hpp"
+#include "tv/near_duplicate.hpp"
 #include "tv/normalize.hpp"
+#include "tv/parse_company.hpp"
+#include "tv/parse_datetime.hpp"
+#include "tv/parse_items.hpp"
 #include "tv/parse_merchant.hpp"
 #include "tv/parse_total.hpp"
+#include "tv/prefilter.hpp"
+#include "tv/registry.hpp"
+#include "tv/rule_pack.hpp"
+#include "tv/rules.hpp"
+#include "tv/scan.hpp"
+#include "tv/score.hpp"
 #include "tv/signals.hpp"
+#include "tv/task_pool.hpp"
+#include "tv/utf8.hpp"
 #include "tv/version.hpp"
+#include <algorithm>
+#include <array>
 #include <cctype>
 #include <chrono>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace tv {
 
@@ -17,6 +37,12 @@ static std::string locale_to_string(Locale l) {
     return "auto";
   case Locale::FrFR:
     return "fr_FR";
+  case Locale::FrBE:
+    return "fr_BE";
+  case Locale::FrCH:
+    return "fr_CH";
+  case Locale::EsES:
+    return "es_ES";
   }
   return "auto";
 }
@@ -49,79 +75,857 @@ static std::uint32_t count_lines_limited(std::string_view s,
   return lines;
 }
 
+std::string_view first_lines(std::string_view text, std::uint32_t max_lines) {
+  std::size_t pos = 0;
+  for (std::uint32_t n = 0; n < max_lines; n++) {
+    pos = text.find('\n', pos);
+    if (pos == std::string_view::npos)
+      return text;
+    pos++;
+  }
+  return text.substr(0, pos);
+}
+
 static std::string preview(std::string_view s, std::size_t max_chars = 400) {
+  if (s.size() <= max_chars)
+    return std::string(s);
+  // cut on a UTF-8 character boundary
+  std::size_t cut = max_chars;
+  while (cut > 0 && (static_cast<unsigned char>(s[cut]) & 0xC0) == 0x80)
+    cut--;
   std::string out;
-  out.reserve((std::min)(s.size(), max_chars));
-  for (std::size_t i = 0; i < s.size() && i < max_chars; i++)
-    out.push_back(s[i]);
-  if (s.size() > max_chars)
-    out += "...";
+  out.reserve(cut + 3);
+  out.append(s.substr(0, cut));
+  out += "...";
   return out;
 }
 
-EngineOutput run(std::string_view ocr_text, const Options &opt) {
-  using clock = std::chrono::steady_clock;
-  auto t0 = clock::now();
-
-  EngineOutput out;
+static void describe_input(EngineOutput &out, const Options &opt) {
   out.schema = "ticketverify." + opt.schema;
-
   out.input.locale = locale_to_string(opt.locale);
   out.input.domain = domain_to_string(opt.domain);
-  out.input.chars = static_cast<std::uint32_t>(ocr_text.size());
-  out.input.lines = count_lines_limited(ocr_text, opt.max_lines);
-
-  // Guard: empty/whitespace input -> reject/invalid input handled by main (exit
-  // code 3)
-  bool any_non_ws = false;
-  for (char c : ocr_text) {
-    if (!std::isspace(static_cast<unsigned char>(c))) {
-      any_non_ws = true;
-      break;
-    }
-  }
-  if (!any_non_ws) {
-    out.status = Status::Reject;
-    out.confidence = 0.0;
-    out.normalized_text_preview = "";
-    out.normalization_applied = {"input_whitespace_only"};
-    out.timing.total = 0;
-    return out;
-  }
-  // normalizing oct text
+}
 
-  auto norm = normalize_ocr(ocr_text);
-  out.normalized_text_preview = preview(norm.text);
-  out.normalization_applied = norm.applied;
+// Guard: empty/whitespace input -> reject/invalid input handled by main (exit
+// code 3)
+static void reject_whitespace_only(EngineOutput &out) {
+  out.status = Status::Reject;
+  out.confidence = 0.0;
+  out.normalized_text_preview = "";
+  out.normalization_applied = {"input_whitespace_only"};
+  out.timing.total = 0;
+}
 
-  out.ticket.signals = detect_signals(norm.text);
+static void report_utf8_repairs(EngineOutput &out, std::size_t repairs) {
+  if (repairs == 0)
+    return;
+  out.normalization_applied.insert(out.normalization_applied.begin(),
+                                   "utf8_repair");
+  out.ticket.warnings.push_back(
+      {"UTF8_REPAIRED",
+       std::to_string(repairs) +
+           " invalid UTF-8 sequence(s) replaced with U+FFFD.",
+       "low"});
+}
 
-  // TOTAL parsing
-  parse_total(norm.text, out.ticket);
-  // MERCHANT parsing
-  parse_merchant(norm.text, out.ticket);
+// Rule selection: hints win, "auto" goes through the detector. Only the
+// first detect_window bytes of `normalized` are looked at.
+static std::pair<Locale, Domain> resolve_rules(const Options &opt,
+                                               std::string_view normalized,
+                                               InputMeta &meta) {
+  Locale locale = opt.locale;
+  Domain domain = opt.domain;
+  if (locale == Locale::Auto || domain == Domain::Auto) {
+    auto det = detect_locale_domain(normalized);
+    if (locale == Locale::Auto) {
+      locale = det.locale;
+      meta.detected_locale = locale_to_string(locale);
+      meta.locale_confidence = det.locale_confidence;
+    }
+    if (domain == Domain::Auto) {
+      domain = det.domain;
+      meta.detected_domain = domain_to_string(domain);
+      meta.domain_confidence = det.domain_confidence;
+    }
+  }
+  return {locale, domain};
+}
 
+static void conclude(EngineOutput &out, std::chrono::steady_clock::time_point t0,
+                     const Scoring &scoring) {
+  if (auto dictionary = active_merchant_dictionary())
+    canonicalize_merchant(out.ticket, *dictionary);
+  if (auto registry = active_registry())
+    resolve_company(out.ticket, *registry);
   const bool has_total = out.ticket.total.value.has_value();
   const bool has_merchant = out.ticket.merchant.value.has_value();
   if (has_total && has_merchant) {
     out.status = Status::Ok;
-    out.confidence = 0.80;
   } else if (has_total) {
     out.status = Status::Partial;
-    out.confidence = 0.65;
   } else {
     out.status = Status::Reject;
-    out.confidence = 0.15;
     out.ticket.warnings.push_back(
         {"TOTAL_NOT_FOUND", "No total amount found.", "medium"});
   }
-  auto t1 = clock::now();
+  out.timing.score = 0;
+  out.timing.score_ns = 0;
+  score_ticket(out, scoring);
+  auto t1 = std::chrono::steady_clock::now();
   out.timing.total =
       (int)std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0)
           .count();
   out.timing.parse = out.timing.total;
-  out.timing.score = 0;
+}
+
+// Scored again: the warning counts against the ticket.
+static void report_deadline(EngineOutput &out, std::uint32_t budget_ms,
+                            const Scoring &scoring) {
+  out.ticket.warnings.push_back(
+      {"DEADLINE_EXCEEDED",
+       "Time budget of " + std::to_string(budget_ms) +
+           " ms exceeded; only fields found so far are returned.",
+       "medium"});
+  if (out.status == Status::Ok)
+    out.status = Status::Partial;
+  score_ticket(out, scoring);
+}
+
+// Tables of a loaded rule pack, known at run time only.
+static void extract(std::string_view text, ParsedTicket &ticket,
+                    const RuleSet &rules) {
+  ticket.signals = detect_signals(text, rules);
+  parse_total(text, ticket, rules);
+  parse_merchant(text, ticket, rules);
+  parse_items(text, ticket, rules);
+  parse_datetime(text, ticket);
+  parse_company(text, ticket);
+}
+
+// Built-in pack: one instantiation per (locale, domain) traits pair, so
+// every keyword table an extractor scans is a compile-time constant of that
+// pair.
+template <class Traits>
+static void extract(std::string_view text, ParsedTicket &ticket) {
+  constexpr const RuleSet &rules = Traits::rules;
+  ticket.signals = detect_signals(text, rules);
+  parse_total(text, ticket, rules);
+  parse_merchant(text, ticket, rules);
+  parse_items(text, ticket, rules);
+  parse_datetime(text, ticket);
+  parse_company(text, ticket);
+}
+
+using ExtractFn = void (*)(std::string_view, ParsedTicket &);
+
+template <class L>
+static constexpr std::array<ExtractFn, 3> extract_row = {
+    &extract<rules::Pipeline<L, rules::AnyDomain>>,
+    &extract<rules::Pipeline<L, rules::Cafe>>,
+    &extract<rules::Pipeline<L, rules::Resto>>};
+
+// Indexed by [Locale][Domain]; Locale::Auto never reaches the table.
+static constexpr std::array<std::array<ExtractFn, 3>, 5> extractors = {
+    extract_row<rules::FrFR>, extract_row<rules::FrFR>,
+    extract_row<rules::FrBE>, extract_row<rules::FrCH>,
+    extract_row<rules::EsES>};
+
+// Input meta, ingestion and normalization, shared by run(), run_batch() and
+// FrameCache. Appends the normalized text to `text`; false for
+// whitespace-only input (`out` is then complete).
+static bool prepare(std::string_view ocr_text, const Options &opt,
+                    EngineOutput &out, std::string &text) {
+  describe_input(out, opt);
+  out.input.chars = static_cast<std::uint32_t>(ocr_text.size());
+  out.input.lines = count_lines_limited(ocr_text, opt.max_lines);
+
+  // Ingestion: from here on every stage sees valid UTF-8.
+  std::string repaired;
+  std::size_t utf8_repairs = 0;
+  if (!validate_utf8(ocr_text)) {
+    utf8_repairs = repair_utf8(ocr_text, repaired);
+    ocr_text = repaired;
+  }
+
+  bool any_non_ws = false;
+  for (char c : ocr_text) {
+    if (!std::isspace(static_cast<unsigned char>(c))) {
+      any_non_ws = true;
+      break;
+    }
+  }
+  if (!any_non_ws) {
+    reject_whitespace_only(out);
+    return false;
+  }
+  // normalizing oct text
+
+  std::size_t from = text.size();
+  Normalizer normalizer;
+  normalizer.feed(ocr_text, text);
+  normalizer.finish(text);
+  out.input.fingerprint = simhash(std::string_view(text).substr(from));
+  out.normalized_text_preview = preview(std::string_view(text).substr(from));
+  out.normalization_applied = Normalizer::applied();
+  report_utf8_repairs(out, utf8_repairs);
+  return true;
+}
+
+// ---- task graph ----
+
+// Normalization pieces for the task graph, of about `target` bytes: each
+// ends just before a '\n' that follows a byte Normalizer::after_text()
+// resumes from. '\n' also ends any UTF-8 sequence, so every piece repairs
+// the way the whole text would.
+static std::vector<std::string_view> line_chunks(std::string_view text,
+                                                 std::size_t target) {
+  auto resumable = [](char c) {
+    return !is_ascii_space(c) && static_cast<unsigned char>(c) != 0xC2;
+  };
+  std::vector<std::string_view> chunks;
+  std::size_t from = 0;
+  while (text.size() - from > target) {
+    std::size_t cut = from + target;
+    while (cut < text.size() &&
+           !(text[cut] == '\n' && resumable(text[cut - 1])))
+      cut++;
+    if (cut == text.size())
+      break;
+    chunks.push_back(text.substr(from, cut - from));
+    from = cut;
+  }
+  chunks.push_back(text.substr(from));
+  return chunks;
+}
+
+// prepare(), with ingestion and normalization spread over the pool.
+static std::optional<std::string> prepare(std::string_view ocr_text,
+                                          const Options &opt, EngineOutput &out,
+                                          TaskPool &pool) {
+  describe_input(out, opt);
+  out.input.chars = static_cast<std::uint32_t>(ocr_text.size());
+  out.input.lines = count_lines_limited(ocr_text, opt.max_lines);
+
+  // Invalid bytes repair to U+FFFD, never to whitespace: the raw text
+  // answers for the repaired one.
+  if (std::all_of(ocr_text.begin(), ocr_text.end(), [](char c) {
+        return std::isspace(static_cast<unsigned char>(c));
+      })) {
+    reject_whitespace_only(out);
+    return std::nullopt;
+  }
+
+  struct Piece {
+    std::string text;
+    std::size_t repairs = 0;
+  };
+  auto chunks = line_chunks(
+      ocr_text, std::max<std::size_t>(64 * 1024, ocr_text.size() /
+                                                     (4 * (pool.workers() + 1))));
+  std::vector<Piece> pieces(chunks.size());
+  {
+    TaskGroup stage(pool);
+    for (std::size_t i = 0; i < chunks.size(); i++)
+      stage.run([&, i] {
+        std::string_view chunk = chunks[i];
+        std::string repaired;
+        if (!validate_utf8(chunk)) {
+          pieces[i].repairs = repair_utf8(chunk, repaired);
+          chunk = repaired;
+        }
+        Normalizer n = i == 0 ? Normalizer() : Normalizer::after_text();
+        n.feed(chunk, pieces[i].text);
+        if (i + 1 == chunks.size())
+          n.finish(pieces[i].text);
+      });
+    stage.wait();
+  }
+
+  std::string text;
+  std::size_t utf8_repairs = 0;
+  std::size_t size = 0;
+  for (const auto &p : pieces)
+    size += p.text.size();
+  text.reserve(size);
+  for (const auto &p : pieces) {
+    text += p.text;
+    utf8_repairs += p.repairs;
+  }
 
+  out.input.fingerprint = simhash(text);
+  out.normalized_text_preview = preview(text);
+  out.normalization_applied = Normalizer::applied();
+  report_utf8_repairs(out, utf8_repairs);
+  return text;
+}
+
+// The extraction stages only read the text and each fill their own fields:
+// they run side by side on separate tickets, merged in the serial order.
+// Items are checked against the total once both are known.
+static void extract(std::string_view text, ParsedTicket &ticket,
+                    const RuleSet &rules, TaskPool &pool) {
+  ParsedTicket total, merchant;
+  ItemScanner items(rules);
+  DateTimeScanner datetime;
+  CompanyIdScanner company;
+  TaskGroup stage(pool);
+  stage.run([&] { parse_total(text, total, rules); });
+  stage.run([&] { parse_merchant(text, merchant, rules); });
+  stage.run([&] { items.scan(text, true); });
+  stage.run([&] { datetime.scan(text, true); });
+  stage.run([&] { company.scan(text, true); });
+  ticket.signals = detect_signals(text, rules);
+  stage.wait();
+
+  ticket.total = std::move(total.total);
+  ticket.merchant = std::move(merchant.merchant);
+  for (auto *part : {&total, &merchant})
+    for (auto &w : part->warnings)
+      ticket.warnings.push_back(std::move(w));
+  items.apply(ticket);
+  datetime.apply(ticket);
+  company.apply(ticket);
+}
+
+EngineOutput run(std::string_view ocr_text, const Options &opt,
+                 TaskPool &pool) {
+  if (opt.budget_ms > 0)
+    return run(ocr_text, opt);
+
+  auto t0 = std::chrono::steady_clock::now();
+  auto pack = active_rule_pack();
+
+  EngineOutput out;
+  out.rules_version = pack->version();
+  auto text = prepare(ocr_text, opt, out, pool);
+  if (!text)
+    return out;
+
+  auto [locale, domain] = resolve_rules(opt, *text, out.input);
+  extract(*text, out.ticket, pack->rules(locale, domain), pool);
+
+  conclude(out, t0, pack->scoring());
+  return out;
+}
+
+EngineOutput run(std::string_view ocr_text, const Options &opt) {
+  if (opt.budget_ms == 0 && ocr_text.size() >= parallel_min_bytes &&
+      TaskPool::shared().workers() > 0)
+    return run(ocr_text, opt, TaskPool::shared());
+
+  if (opt.budget_ms > 0) {
+    // The session polls the deadline between slices of input.
+    Session session;
+    session.begin(opt);
+    session.feed(ocr_text);
+    return session.finish();
+  }
+
+  auto t0 = std::chrono::steady_clock::now();
+  auto pack = active_rule_pack();
+
+  EngineOutput out;
+  out.rules_version = pack->version();
+  std::string text;
+  if (!prepare(ocr_text, opt, out, text))
+    return out;
+
+  auto [locale, domain] = resolve_rules(opt, text, out.input);
+  if (pack->is_builtin())
+    extractors[static_cast<std::size_t>(locale)]
+              [static_cast<std::size_t>(domain)](text, out.ticket);
+  else
+    extract(text, out.ticket, pack->rules(locale, domain));
+
+  conclude(out, t0, pack->scoring());
+  return out;
+}
+
+// ---- batch ----
+
+static void check_near_duplicates(std::vector<EngineOutput> &outs,
+                                  const Scoring &scoring) {
+  if (auto index = active_near_duplicates())
+    for (auto &out : outs)
+      check_near_duplicate(out, *index, scoring);
+}
+
+std::vector<EngineOutput> run_batch(const std::vector<std::string_view> &docs,
+                                    const Options &opt,
+                                    bool near_duplicates) {
+  std::vector<EngineOutput> outs(docs.size());
+  auto pack = active_rule_pack();
+  if (opt.budget_ms > 0) {
+    for (std::size_t i = 0; i < docs.size(); i++)
+      outs[i] = run(docs[i], opt);
+    if (near_duplicates)
+      check_near_duplicates(outs, pack->scoring());
+    return outs;
+  }
+
+  using clock = std::chrono::steady_clock;
+
+  // Ingestion and normalization of every document, packed into one buffer.
+  struct Packed {
+    std::size_t begin = 0, end = 0;
+    bool parse = false;      // not whitespace-only
+    clock::duration spent{}; // this document's share of the batch so far
+  };
+  std::vector<Packed> packed(docs.size());
+  std::string text;
+  std::size_t bytes = 0;
+  for (auto doc : docs)
+    bytes += doc.size();
+  text.reserve(bytes);
+  for (std::size_t i = 0; i < docs.size(); i++) {
+    auto t0 = clock::now();
+    outs[i].rules_version = pack->version();
+    packed[i].begin = text.size();
+    packed[i].parse = prepare(docs[i], opt, outs[i], text);
+    packed[i].end = text.size();
+    packed[i].spent = clock::now() - t0;
+  }
+
+  // Extraction, the scanners limited to the lines the prefilter of the
+  // document's rule set flags.
+  std::vector<std::pair<const RuleSet *, KeywordPrefilter>> filters;
+  KeywordSpans spans;
+  for (std::size_t i = 0; i < docs.size(); i++) {
+    if (!packed[i].parse)
+      continue;
+    auto t0 = clock::now() - packed[i].spent;
+    EngineOutput &out = outs[i];
+    auto doc = std::string_view(text).substr(packed[i].begin,
+                                             packed[i].end - packed[i].begin);
+
+    auto [locale, domain] = resolve_rules(opt, doc, out.input);
+    const RuleSet &rules = pack->rules(locale, domain);
+    auto f = std::find_if(filters.begin(), filters.end(),
+                          [&](const auto &p) { return p.first == &rules; });
+    if (f == filters.end())
+      f = filters.insert(f, {&rules, KeywordPrefilter(rules)});
+    f->second.scan(doc, spans);
+
+    SignalScanner signals(rules);
+    signals.limit_to(&spans.card, &spans.tax, &spans.company_id);
+    signals.scan(doc, true);
+    TotalScanner total(rules);
+    total.limit_to(&spans.total);
+    total.scan(doc, true);
+    out.ticket.signals = signals.signals();
+    total.apply(out.ticket);
+    parse_merchant(doc, out.ticket, rules);
+    parse_items(doc, out.ticket, rules);
+    parse_datetime(doc, out.ticket);
+    parse_company(doc, out.ticket);
+
+    conclude(out, t0, pack->scoring());
+  }
+  if (near_duplicates)
+    check_near_duplicates(outs, pack->scoring());
+  return outs;
+}
+
+// ---- Session ----
+
+static_assert(detect_window > 400, "head_ must also cover the preview");
+
+void Session::begin(const Options &opt) { begin(opt, nullptr); }
+
+void Session::begin(const Options &opt,
+                    std::shared_ptr<const RulePack> shadow) {
+  *this = Session{};
+  opt_ = opt;
+  t0_ = std::chrono::steady_clock::now();
+  pack_ = active_rule_pack();
+  out_.rules_version = pack_->version();
+  describe_input(out_, opt_);
+  if (shadow) {
+    shadow_ = std::make_unique<Shadow>();
+    shadow_->pack = std::move(shadow);
+  }
+}
+
+void Session::feed(std::string_view chunk) {
+  if (chunk.empty())
+    return;
+
+  // The budget runs from the first chunk: waiting for input is not work.
+  if (!deadline_started_) {
+    deadline_ = Deadline(opt_.budget_ms);
+    deadline_started_ = true;
+  }
+  out_.input.chars += static_cast<std::uint32_t>(chunk.size());
+  last_ = chunk.back();
+
+  // Parsing advances one bounded slice at a time, polling the deadline.
+  while (!chunk.empty()) {
+    if (!skipped_ && deadline_.expired())
+      skipped_ = true; // the rest of the input is only counted
+    auto n = skipped_ ? chunk.size() : std::min(chunk.size(), deadline_slice);
+    auto slice = chunk.substr(0, n);
+    chunk.remove_prefix(n);
+
+    auto nl = static_cast<std::size_t>(
+        std::count(slice.begin(), slice.end(), '\n'));
+    newlines_ = static_cast<std::uint32_t>(
+        std::min<std::size_t>(opt_.max_lines, newlines_ + nl));
+    for (std::size_t i = 0; i < slice.size() && !any_non_ws_; i++)
+      any_non_ws_ = !std::isspace(static_cast<unsigned char>(slice[i]));
+    if (!skipped_)
+      parse_slice(slice);
+  }
+}
+
+void Session::parse_slice(std::string_view chunk) {
+  // A multi-byte sequence cut by the chunk boundary waits for the next one.
+  std::string joined;
+  if (!carry_.empty()) {
+    joined = std::move(carry_);
+    joined.append(chunk);
+    chunk = joined;
+  }
+  std::size_t tail = utf8_incomplete_tail(chunk);
+  carry_.assign(chunk.substr(chunk.size() - tail));
+  chunk.remove_suffix(tail);
+
+  std::size_t from = text_.size();
+  if (validate_utf8(chunk)) {
+    normalizer_.feed(chunk, text_);
+  } else {
+    utf8_repairs_ += repair_utf8(chunk, scratch_);
+    normalizer_.feed(scratch_, text_);
+  }
+  take(from);
+  advance(false);
+}
+
+// Feeds newly normalized text (text_ from `from` on) to the fingerprint and
+// copies it into the head and the merchant header.
+void Session::take(std::size_t from) {
+  std::string_view added = std::string_view(text_).substr(from);
+  fingerprint_.feed(added);
+
+  if (head_.size() < detect_window)
+    head_.append(added.substr(0, detect_window - head_.size()));
+
+  if (header_done_)
+    return;
+  header_.append(added.substr(0, merchant_header_bytes - header_.size()));
+  // Complete, non-blank lines: parse_merchant never looks past
+  // merchant_header_lines of them.
+  for (std::size_t nl;
+       (nl = header_.find('\n', header_scan_)) != std::string::npos;
+       header_scan_ = nl + 1) {
+    auto line =
+        std::string_view(header_).substr(header_scan_, nl - header_scan_);
+    if (line.find_first_not_of(" \t") == std::string_view::npos)
+      continue;
+    if (++header_lines_ == merchant_header_lines) {
+      header_.resize(nl + 1);
+      header_done_ = true;
+      break;
+    }
+  }
+  if (header_.size() == merchant_header_bytes)
+    header_done_ = true;
+}
+
+void Session::advance(bool final) {
+  if (!rules_) {
+    // Rules depend on the detector, which reads the head of the text.
+    if (head_.size() < detect_window && !final)
+      return;
+    auto [locale, domain] = resolve_rules(opt_, head_, out_.input);
+    rules_ = &pack_->rules(locale, domain);
+    signals_.emplace(*rules_);
+    total_.emplace(*rules_);
+    items_.emplace(*rules_);
+    if (shadow_) {
+      shadow_->rules = &shadow_->pack->rules(locale, domain);
+      shadow_->signals.emplace(*shadow_->rules);
+      shadow_->total.emplace(*shadow_->rules);
+      shadow_->items.emplace(*shadow_->rules);
+    }
+  }
+
+  std::size_t need =
+      std::min({signals_->scan(text_, final), total_->scan(text_, final),
+                items_->scan(text_, final), datetime_.scan(text_, final),
+                company_.scan(text_, final)});
+  if (shadow_) {
+    auto s0 = std::chrono::steady_clock::now();
+    need = std::min({need, shadow_->signals->scan(text_, final),
+                     shadow_->total->scan(text_, final),
+                     shadow_->items->scan(text_, final)});
+    shadow_->shadow_time += std::chrono::steady_clock::now() - s0;
+  }
+  // Keep one byte before the resume point for \b.
+  std::size_t drop = need > 0 ? need - 1 : 0;
+  if (drop > 0) {
+    text_.erase(0, drop);
+    signals_->shift(drop);
+    total_->shift(drop);
+    items_->shift(drop);
+    datetime_.shift(drop);
+    company_.shift(drop);
+    if (shadow_) {
+      shadow_->signals->shift(drop);
+      shadow_->total->shift(drop);
+      shadow_->items->shift(drop);
+    }
+  }
+}
+
+EngineOutput Session::finish() {
+  out_.input.lines = newlines_;
+  if (newlines_ < opt_.max_lines && out_.input.chars > 0 && last_ != '\n')
+    out_.input.lines++; // count last line if non-empty
+
+  if (!any_non_ws_) {
+    reject_whitespace_only(out_);
+    if (shadow_) {
+      shadow_->output = out_;
+      shadow_->output.rules_version = shadow_->pack->version();
+    }
+    return std::move(out_);
+  }
+
+  if (!skipped_) {
+    std::size_t from = text_.size();
+    if (!carry_.empty()) {
+      utf8_repairs_ += repair_utf8(carry_, scratch_);
+      normalizer_.feed(scratch_, text_);
+    }
+    normalizer_.finish(text_);
+    take(from);
+    advance(true);
+  }
+
+  out_.input.fingerprint = fingerprint_.finish();
+  out_.normalized_text_preview = preview(head_);
+  out_.normalization_applied = Normalizer::applied();
+  report_utf8_repairs(out_, utf8_repairs_);
+
+  // The timestamp does not depend on the rules: the shadow output shares it.
+  datetime_.apply(out_.ticket);
+
+  if (shadow_) {
+    // Everything so far is shared; only the extraction differs.
+    auto s0 = std::chrono::steady_clock::now();
+    EngineOutput &s = shadow_->output;
+    s = out_;
+    s.rules_version = shadow_->pack->version();
+    if (shadow_->signals) {
+      s.ticket.signals = shadow_->signals->signals();
+      shadow_->total->apply(s.ticket);
+    }
+    if (shadow_->rules && (!skipped_ || header_done_))
+      parse_merchant(header_, s.ticket, *shadow_->rules);
+    if (shadow_->items)
+      shadow_->items->apply(s.ticket);
+    company_.apply(s.ticket);
+    conclude(s, t0_, shadow_->pack->scoring());
+    if (skipped_)
+      report_deadline(s, opt_.budget_ms, shadow_->pack->scoring());
+    shadow_->shadow_time += std::chrono::steady_clock::now() - s0;
+  }
+
+  // Out of time, only what the scanners already decided is reported.
+  if (signals_) {
+    out_.ticket.signals = signals_->signals();
+    total_->apply(out_.ticket);
+  }
+  if (rules_ && (!skipped_ || header_done_))
+    parse_merchant(header_, out_.ticket, *rules_);
+  if (items_)
+    items_->apply(out_.ticket);
+  company_.apply(out_.ticket);
+
+  conclude(out_, t0_, pack_->scoring());
+  if (skipped_)
+    report_deadline(out_, opt_.budget_ms, pack_->scoring());
+  if (shadow_)
+    shadow_->total_time = std::chrono::steady_clock::now() - t0_;
+  return std::move(out_);
+}
+
+// ---- FrameCache ----
+
+FrameCache::Frame &FrameCache::frame(const std::string &session_id) {
+  auto &f = frames_[session_id];
+  f.used = ++tick_;
+  return f;
+}
+
+void FrameCache::erase(const std::string &session_id) {
+  auto it = frames_.find(session_id);
+  if (it == frames_.end())
+    return;
+  bytes_ -= it->second.bytes;
+  frames_.erase(it);
+}
+
+// Recounts `f` after a run, then evicts the least recently used other
+// frames while the total is over max_bytes_.
+void FrameCache::account(const std::string &session_id, Frame &f) {
+  bytes_ -= f.bytes;
+  f.bytes = sizeof(Frame) + session_id.capacity() + f.text.capacity() +
+            f.line_starts.capacity() * sizeof(std::size_t) +
+            f.checkpoints.capacity() * sizeof(Checkpoint) +
+            (f.merchant.value ? f.merchant.value->capacity() : 0);
+  bytes_ += f.bytes;
+  while (bytes_ > max_bytes_ && frames_.size() > 1) {
+    auto lru = frames_.end();
+    for (auto i = frames_.begin(); i != frames_.end(); ++i)
+      if (&i->second != &f &&
+          (lru == frames_.end() || i->second.used < lru->second.used))
+        lru = i;
+    bytes_ -= lru->second.bytes;
+    frames_.erase(lru);
+  }
+}
+
+// End of the text parse_merchant depends on: the line holding the last
+// header line it may read, or merchant_header_bytes, or npos while the
+// header is still incomplete.
+static std::size_t merchant_header_end(std::string_view text) {
+  const std::size_t cut = text.size() >= merchant_header_bytes
+                              ? merchant_header_bytes
+                              : std::string_view::npos;
+  text = text.substr(0, merchant_header_bytes);
+  std::size_t lines = 0;
+  std::size_t pos = 0;
+  while (pos < text.size()) {
+    auto nl = text.find('\n', pos);
+    auto end = nl == std::string_view::npos ? text.size() : nl;
+    auto line = text.substr(pos, end - pos);
+    if (line.find_first_not_of(" \t") != std::string_view::npos &&
+        ++lines == merchant_header_lines)
+      return nl == std::string_view::npos ? cut : nl + 1;
+    if (nl == std::string_view::npos)
+      break;
+    pos = nl + 1;
+  }
+  return cut;
+}
+
+EngineOutput FrameCache::run(const std::string &session_id,
+                             std::string_view ocr_text, const Options &opt) {
+  auto t0 = std::chrono::steady_clock::now();
+  auto pack = active_rule_pack();
+
+  EngineOutput out;
+  out.rules_version = pack->version();
+  std::string prepared;
+  if (!prepare(ocr_text, opt, out, prepared))
+    return out;
+  std::string_view text = prepared;
+
+  Frame &f = frame(session_id);
+
+  std::vector<std::size_t> starts{0};
+  for (std::size_t i = 0; i < text.size(); i++)
+    if (text[i] == '\n' && i + 1 < text.size())
+      starts.push_back(i + 1);
+
+  // Leading lines identical to the previous frame, '\n' included.
+  auto line = [](std::string_view t, const std::vector<std::size_t> &st,
+                 std::size_t i) {
+    auto end = i + 1 < st.size() ? st[i + 1] : t.size();
+    return t.substr(st[i], end - st[i]);
+  };
+  // A new rule pack invalidates every frame.
+  const bool same_hints = f.rules && f.pack == pack &&
+                          f.locale_hint == opt.locale &&
+                          f.domain_hint == opt.domain;
+  std::size_t same = 0;
+  if (same_hints)
+    while (same < starts.size() && same < f.line_starts.size() &&
+           line(text, starts, same) == line(f.text, f.line_starts, same))
+      same++;
+  const std::size_t changed =
+      same < starts.size() ? starts[same] : text.size();
+
+  // Rules: the detector only reads the head of the text.
+  const RuleSet *rules = f.rules;
+  if (same_hints && changed >= detect_window) {
+    out.input.detected_locale = f.detected.detected_locale;
+    out.input.locale_confidence = f.detected.locale_confidence;
+    out.input.detected_domain = f.detected.detected_domain;
+    out.input.domain_confidence = f.detected.domain_confidence;
+  } else {
+    auto [locale, domain] = resolve_rules(opt, text, out.input);
+    rules = &pack->rules(locale, domain);
+  }
+  const bool reuse = same_hints && rules == f.rules;
+
+  // Signals and total: resume from the checkpoint of the first changed line.
+  std::size_t first = 0;
+  if (reuse)
+    first = std::min({same, starts.size() - 1, f.checkpoints.size() - 1});
+  Checkpoint cp = first > 0 ? f.checkpoints[first]
+                            : Checkpoint{SignalScanner(*rules),
+                                         TotalScanner(*rules), {}, {}};
+  Deadline deadline(opt.budget_ms);
+  bool out_of_time = false;
+  f.checkpoints.resize(first, cp);
+  for (std::size_t i = first; i < starts.size(); i++) {
+    if (i > first &&
+        !(cp.signals.done() && cp.total.done() && cp.datetime.done() &&
+          cp.company.done())) {
+      if (deadline.expired()) {
+        out_of_time = true;
+        break;
+      }
+      cp.signals.scan(text.substr(0, starts[i]), false);
+      cp.total.scan(text.substr(0, starts[i]), false);
+      cp.datetime.scan(text.substr(0, starts[i]), false);
+      cp.company.scan(text.substr(0, starts[i]), false);
+    }
+    f.checkpoints.push_back(cp);
+  }
+  if (!out_of_time) {
+    cp.signals.scan(text, true);
+    cp.total.scan(text, true);
+    cp.datetime.scan(text, true);
+    cp.company.scan(text, true);
+  }
+  last_rescanned_ = starts.size() - first;
+
+  out.ticket.signals = cp.signals.signals();
+  cp.total.apply(out.ticket);
+  cp.datetime.apply(out.ticket);
+  cp.company.apply(out.ticket);
+
+  if (reuse && f.header_end <= changed) {
+    out.ticket.merchant = f.merchant;
+  } else {
+    parse_merchant(text, out.ticket, *rules);
+    f.header_end = merchant_header_end(text);
+  }
+  // Items: one linear pass, like the normalization before it; a checkpoint
+  // per line would copy the items found so far each time.
+  if (!out_of_time)
+    parse_items(text, out.ticket, *rules);
+
+  f.locale_hint = opt.locale;
+  f.domain_hint = opt.domain;
+  f.detected = out.input;
+  f.pack = pack;
+  f.rules = rules;
+  f.text.assign(text);
+  f.line_starts = std::move(starts);
+  f.merchant = out.ticket.merchant;
+
+  conclude(out, t0, pack->scoring());
+  if (out_of_time) {
+    // Checkpoints stop short of the last lines: start over next time.
+    erase(session_id);
+    report_deadline(out, opt.budget_ms, pack->scoring());
+  } else {
+    account(session_id, f);
+  }
   return out;
 }
 
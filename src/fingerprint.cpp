@@ -0,0 +1,51 @@
+#include "tv/fingerprint.hpp"
+#include "tv/scan.hpp"
+
+namespace tv {
+
+static std::uint64_t mix(std::uint64_t x) { // splitmix64 finalizer
+  x ^= x >> 30;
+  x *= 0xBF58476D1CE4E5B9ull;
+  x ^= x >> 27;
+  x *= 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+}
+
+void SimHasher::feed(std::string_view text) {
+  for (char c : text) {
+    const bool word = (is_word_char(c) && c != '_') ||
+                      static_cast<unsigned char>(c) >= 0x80;
+    if (!word) {
+      if (in_word_)
+        add_word();
+      continue;
+    }
+    if (!in_word_)
+      word_ = 0xCBF29CE484222325ull; // FNV-1a
+    in_word_ = true;
+    word_ = (word_ ^ static_cast<unsigned char>(ascii_upper(c))) *
+            0x100000001B3ull;
+  }
+}
+
+void SimHasher::add_word() {
+  const std::uint64_t h = mix(word_);
+  for (int b = 0; b < 64; b++)
+    weights_[b] += static_cast<std::int32_t>((h >> b) & 1) * 2 - 1;
+  in_word_ = false;
+  any_ = true;
+}
+
+std::uint64_t SimHasher::finish() {
+  if (in_word_)
+    add_word();
+  if (!any_)
+    return 0;
+  std::uint64_t f = 0;
+  for (int b = 0; b < 64; b++)
+    if (weights_[b] > 0)
+      f |= std::uint64_t{1} << b;
+  return f;
+}
+
+} // namespace tv
@@ -0,0 +1,138 @@
+#include "tv/flight_recorder.hpp"
+#include "tv/mapped_file.hpp"
+#include "tv/model.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <nlohmann/json.hpp>
+#include <type_traits>
+
+#include <unistd.h>
+
+namespace tv {
+
+using json = nlohmann::json;
+
+static_assert(std::is_trivially_copyable_v<FlightRecord>);
+
+FlightRecorder::FlightRecorder(std::uint32_t workers, std::uint32_t slow_us,
+                               std::uint32_t records, std::size_t slow_bytes)
+    : slow_us_(slow_us), records_(records ? records : 1),
+      slow_bytes_(slow_bytes), rings_(new Ring[workers ? workers : 1]),
+      workers_(workers ? workers : 1) {
+  for (std::uint32_t w = 0; w < workers_; w++)
+    rings_[w].slots.reset(new Slot[records_]);
+}
+
+void FlightRecorder::record(std::uint32_t worker, const FlightRecord &r,
+                            std::string_view input) {
+  Ring &ring = rings_[worker];
+  const std::uint64_t n = ring.written.load(std::memory_order_relaxed);
+  Slot &slot = ring.slots[n % records_];
+  std::uint64_t words_of[words];
+  std::memcpy(words_of, &r, sizeof r);
+
+  const std::uint64_t seq = slot.seq.load(std::memory_order_relaxed);
+  slot.seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  for (std::size_t i = 0; i < words; i++)
+    slot.record[i].store(words_of[i], std::memory_order_relaxed);
+  slot.seq.store(seq + 2, std::memory_order_release);
+  ring.written.store(n + 1, std::memory_order_release);
+
+  if (slow_us_ == 0 || r.service_us() < slow_us_)
+    return;
+  Slow kept{r, std::string(input.substr(0, slow_bytes_))};
+  std::lock_guard<std::mutex> lock(slow_m_);
+  slow_used_ += kept.input.size();
+  slow_.push_back(std::move(kept));
+  while (slow_used_ > slow_bytes_) {
+    slow_used_ -= slow_.front().input.size();
+    slow_.pop_front();
+  }
+}
+
+static json record_json(const FlightRecord &r) {
+  json j = {{"id", r.id},
+            {"finished_us", r.finished_us},
+            {"bytes", r.bytes},
+            {"lines", r.lines},
+            {"stages_us",
+             {{"queue", r.queue_us},
+              {"run", r.run_us},
+              {"score", r.score_ns / 1000.0},
+              {"json", r.json_us}}},
+            {"service_us", r.service_us()},
+            {"code", r.code},
+            {"status", status_to_string(static_cast<Status>(r.status))},
+            {"warnings", r.warnings}};
+  char hex[17];
+  std::snprintf(hex, sizeof hex, "%016llx",
+                static_cast<unsigned long long>(r.input_hash));
+  j["input_hash"] = hex;
+  if (r.fingerprint != 0) {
+    std::snprintf(hex, sizeof hex, "%016llx",
+                  static_cast<unsigned long long>(r.fingerprint));
+    j["fingerprint"] = std::string("simhash:") + hex;
+  }
+  if (r.first_warning[0] != '\0')
+    j["first_warning"] = std::string(
+        r.first_warning, strnlen(r.first_warning, sizeof r.first_warning));
+  return j;
+}
+
+std::string FlightRecorder::render(FlightDump *counts) const {
+  json workers = json::array();
+  for (std::uint32_t w = 0; w < workers_; w++) {
+    const Ring &ring = rings_[w];
+    const std::uint64_t end = ring.written.load(std::memory_order_acquire);
+    const std::uint64_t begin = end > records_ ? end - records_ : 0;
+    json records = json::array();
+    for (std::uint64_t n = begin; n < end; n++) {
+      const Slot &slot = ring.slots[n % records_];
+      const std::uint64_t seq = slot.seq.load(std::memory_order_acquire);
+      std::uint64_t words_of[words];
+      for (std::size_t i = 0; i < words; i++)
+        words_of[i] = slot.record[i].load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (seq % 2 != 0 || slot.seq.load(std::memory_order_relaxed) != seq)
+        continue; // being overwritten
+      FlightRecord r;
+      std::memcpy(&r, words_of, sizeof r);
+      records.push_back(record_json(r));
+    }
+    if (counts)
+      counts->records += records.size();
+    workers.push_back(std::move(records));
+  }
+
+  json slow = json::array();
+  {
+    std::lock_guard<std::mutex> lock(slow_m_);
+    for (const auto &s : slow_) {
+      json j = record_json(s.record);
+      j["input"] = s.input;
+      slow.push_back(std::move(j));
+    }
+  }
+  if (counts)
+    counts->slow = slow.size();
+  json doc = {{"pid", static_cast<std::int64_t>(::getpid())},
+              {"dumped_at_us", flight_now_us()},
+              {"slow_us", slow_us_},
+              {"workers", std::move(workers)},
+              {"slow", std::move(slow)}};
+  // Retained inputs are raw client bytes.
+  return doc.dump(-1, ' ', false, json::error_handler_t::replace);
+}
+
+FlightDump FlightRecorder::dump(const std::string &path) const {
+  FlightDump d;
+  d.path = path;
+  std::string doc = render(&d);
+  // Slow tickets' inputs are receipts: readable by the owner only.
+  replace_file(path, "flight recorder", {doc, "\n"}, 0600);
+  return d;
+}
+
+} // namespace tv
@@ -0,0 +1,627 @@
+#include "tv/input_dir.hpp"
+#include "tv/batch_summary.hpp"
+#include "tv/columnar.hpp"
+#include "tv/engine.hpp"
+#include "tv/json.hpp"
+#include "tv/near_duplicate.hpp"
+#include "tv/rule_pack.hpp"
+#include "tv/scan.hpp"
+#include "tv/task_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#define TV_HAVE_IO_URING 1
+#endif
+
+namespace tv {
+
+const char *read_method_name(ReadMethod method) {
+  switch (method) {
+  case ReadMethod::Auto:
+    return "auto";
+  case ReadMethod::Uring:
+    return "io_uring";
+  case ReadMethod::Threads:
+    return "threads";
+  case ReadMethod::Serial:
+    return "serial";
+  }
+  return "auto";
+}
+
+// Reads the whole of `name` into *text; 0 or errno.
+static int read_file(int dir_fd, const std::string &name, std::size_t max_size,
+                     std::string *text) {
+  int fd = ::openat(dir_fd, name.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return errno;
+  int error = 0;
+  char buf[FileReader::buffer_size];
+  for (;;) {
+    ssize_t n = ::read(fd, buf, sizeof buf);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0) {
+      error = errno;
+      break;
+    }
+    if (n == 0)
+      break;
+    if (text->size() + static_cast<std::size_t>(n) > max_size) {
+      error = EFBIG;
+      break;
+    }
+    text->append(buf, static_cast<std::size_t>(n));
+  }
+  ::close(fd);
+  return error;
+}
+
+// ---- io_uring ----
+
+#ifdef TV_HAVE_IO_URING
+
+// A raw io_uring (no liburing): the mapped submission and completion
+// rings, and one registered buffer per slot.
+struct FileReader::Ring {
+  struct Slot {
+    std::size_t index = 0; // file being read
+    int fd = -1;
+    std::string text;      // read so far
+  };
+
+  int fd = -1;
+  unsigned entries = 0;
+  void *sq_ptr = MAP_FAILED, *cq_ptr = MAP_FAILED, *sqe_ptr = MAP_FAILED;
+  std::size_t sq_len = 0, cq_len = 0, sqe_len = 0;
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  io_uring_sqe *sqes;
+  io_uring_cqe *cqes;
+  unsigned queued = 0; // prepared, not yet submitted
+
+  std::unique_ptr<char[]> buffers;
+  std::vector<Slot> slots;
+
+  ~Ring() {
+    if (sqe_ptr != MAP_FAILED)
+      ::munmap(sqe_ptr, sqe_len);
+    if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr)
+      ::munmap(cq_ptr, cq_len);
+    if (sq_ptr != MAP_FAILED)
+      ::munmap(sq_ptr, sq_len);
+    if (fd >= 0)
+      ::close(fd);
+  }
+
+  // False when io_uring, or one of the opcodes used, is not available.
+  bool setup(std::size_t depth) {
+    // Each slot has one operation in flight, plus the closes it left
+    // behind: twice the slots bounds them.
+    io_uring_params p{};
+    fd = static_cast<int>(::syscall(__NR_io_uring_setup,
+                                    static_cast<unsigned>(2 * depth), &p));
+    if (fd < 0)
+      return false;
+    entries = p.sq_entries;
+
+    sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_len = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    const bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single)
+      sq_len = cq_len = std::max(sq_len, cq_len);
+    sq_ptr = ::mmap(nullptr, sq_len, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq_ptr == MAP_FAILED)
+      return false;
+    cq_ptr = single ? sq_ptr
+                    : ::mmap(nullptr, cq_len, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (cq_ptr == MAP_FAILED)
+      return false;
+    sqe_len = p.sq_entries * sizeof(io_uring_sqe);
+    sqe_ptr = ::mmap(nullptr, sqe_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqe_ptr == MAP_FAILED)
+      return false;
+
+    auto *sq = static_cast<char *>(sq_ptr);
+    sq_head = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+    sq_mask = reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+    auto *cq = static_cast<char *>(cq_ptr);
+    cq_head = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+    sqes = static_cast<io_uring_sqe *>(sqe_ptr);
+
+    if (!supports({IORING_OP_OPENAT, IORING_OP_READ_FIXED, IORING_OP_CLOSE}))
+      return false;
+
+    slots.resize(depth);
+    buffers.reset(new char[depth * buffer_size]);
+    std::vector<iovec> iov(depth);
+    for (std::size_t i = 0; i < depth; i++)
+      iov[i] = {buffers.get() + i * buffer_size, buffer_size};
+    return ::syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS,
+                     iov.data(), static_cast<unsigned>(depth)) == 0;
+  }
+
+  bool supports(std::initializer_list<unsigned> ops) {
+    constexpr unsigned n = 64;
+    std::vector<char> mem(sizeof(io_uring_probe) +
+                          n * sizeof(io_uring_probe_op));
+    auto *probe = reinterpret_cast<io_uring_probe *>(mem.data());
+    if (::syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe,
+                  n) != 0)
+      return false;
+    for (unsigned op : ops)
+      if (op > probe->last_op ||
+          !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+        return false;
+    return true;
+  }
+
+  char *buffer(std::size_t slot) {
+    return buffers.get() + slot * buffer_size;
+  }
+
+  // A zeroed submission entry, queued for the next enter().
+  io_uring_sqe *prepare(std::uint8_t opcode, std::uint64_t user_data) {
+    const unsigned tail = *sq_tail + queued;
+    const unsigned i = tail & *sq_mask;
+    io_uring_sqe *sqe = &sqes[i];
+    std::memset(sqe, 0, sizeof *sqe);
+    sqe->opcode = opcode;
+    sqe->user_data = user_data;
+    sq_array[i] = i;
+    queued++;
+    return sqe;
+  }
+
+  // Submits what was prepared and waits for at least one completion.
+  void enter() {
+    __atomic_store_n(sq_tail, *sq_tail + queued, __ATOMIC_RELEASE);
+    unsigned to_submit = queued;
+    queued = 0;
+    for (;;) {
+      long r = ::syscall(__NR_io_uring_enter, fd, to_submit, 1u,
+                         IORING_ENTER_GETEVENTS, nullptr, 0);
+      if (r >= 0) {
+        to_submit -= std::min(to_submit, static_cast<unsigned>(r));
+        if (to_submit == 0)
+          return;
+        continue;
+      }
+      if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        throw std::runtime_error(std::string("io_uring_enter: ") +
+                                 std::strerror(errno));
+    }
+  }
+};
+
+// user_data: the slot, and for a close the bit below (the slot is free
+// again by then).
+static constexpr std::uint64_t close_tag = std::uint64_t{1} << 63;
+
+void FileReader::read_uring(int dir_fd, const std::vector<std::string> &names,
+                            std::size_t begin, std::size_t end,
+                            const OnFile &on_file) {
+  Ring &r = *ring_;
+  std::vector<std::size_t> free_slots;
+  for (std::size_t s = r.slots.size(); s-- > 0;)
+    free_slots.push_back(s);
+  std::size_t next = begin;
+  unsigned in_flight = 0; // operations, closes included
+
+  auto read_more = [&](std::size_t s) {
+    Ring::Slot &slot = r.slots[s];
+    io_uring_sqe *sqe = r.prepare(IORING_OP_READ_FIXED, s);
+    sqe->fd = slot.fd;
+    sqe->addr = reinterpret_cast<std::uint64_t>(r.buffer(s));
+    sqe->len = buffer_size;
+    sqe->off = slot.text.size();
+    sqe->buf_index = static_cast<std::uint16_t>(s);
+    in_flight++;
+  };
+  auto finish = [&](std::size_t s, int error) {
+    Ring::Slot &slot = r.slots[s];
+    if (slot.fd >= 0) {
+      r.prepare(IORING_OP_CLOSE, close_tag | s)->fd = slot.fd;
+      in_flight++;
+      slot.fd = -1;
+    }
+    on_file(slot.index, error ? std::string() : std::move(slot.text), error);
+    slot.text.clear();
+    free_slots.push_back(s);
+  };
+
+  while (next < end || in_flight > 0) {
+    // A free slot opens the next file when the ring has room for its
+    // operation and, later, its close.
+    while (next < end && !free_slots.empty() && in_flight + 2 <= r.entries) {
+      const std::size_t s = free_slots.back();
+      free_slots.pop_back();
+      r.slots[s].index = next;
+      io_uring_sqe *sqe = r.prepare(IORING_OP_OPENAT, s);
+      sqe->fd = dir_fd;
+      sqe->addr = reinterpret_cast<std::uint64_t>(names[next].c_str());
+      sqe->open_flags = O_RDONLY | O_CLOEXEC;
+      in_flight++;
+      next++;
+    }
+
+    r.enter();
+
+    unsigned head = *r.cq_head;
+    const unsigned tail = __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+      const io_uring_cqe &cqe = r.cqes[head & *r.cq_mask];
+      const std::uint64_t data = cqe.user_data;
+      const int res = cqe.res;
+      in_flight--;
+      if (data & close_tag)
+        continue;
+      const auto s = static_cast<std::size_t>(data);
+      Ring::Slot &slot = r.slots[s];
+      if (res < 0) {
+        finish(s, -res);
+      } else if (slot.fd < 0) { // opened
+        slot.fd = res;
+        read_more(s);
+      } else if (slot.text.size() + static_cast<std::size_t>(res) >
+                 max_size_) {
+        finish(s, EFBIG);
+      } else {
+        slot.text.append(r.buffer(s), static_cast<std::size_t>(res));
+        // A short read is the end of a regular file.
+        if (static_cast<std::size_t>(res) < buffer_size)
+          finish(s, 0);
+        else
+          read_more(s);
+      }
+    }
+    __atomic_store_n(r.cq_head, head, __ATOMIC_RELEASE);
+  }
+}
+
+#else
+
+struct FileReader::Ring {
+  bool setup(std::size_t) { return false; }
+};
+
+void FileReader::read_uring(int, const std::vector<std::string> &,
+                            std::size_t, std::size_t, const OnFile &) {}
+
+#endif
+
+FileReader::FileReader(ReadMethod method, std::size_t max_size,
+                       std::size_t depth)
+    : method_(method), max_size_(max_size) {
+  if (method_ == ReadMethod::Auto || method_ == ReadMethod::Uring) {
+    ring_ = std::make_unique<Ring>();
+    if (!ring_->setup(std::clamp<std::size_t>(depth, 1, 1024))) {
+      ring_.reset();
+      method_ = ReadMethod::Threads;
+    } else {
+      method_ = ReadMethod::Uring;
+    }
+  }
+}
+
+FileReader::~FileReader() = default;
+
+void FileReader::read(int dir_fd, const std::vector<std::string> &names,
+                      std::size_t begin, std::size_t end,
+                      const OnFile &on_file) {
+  end = std::min(end, names.size());
+  switch (method_) {
+  case ReadMethod::Uring:
+    read_uring(dir_fd, names, begin, end, on_file);
+    return;
+  case ReadMethod::Threads:
+    read_threads(dir_fd, names, begin, end, on_file);
+    return;
+  default:
+    for (std::size_t i = begin; i < end; i++) {
+      std::string text;
+      int error = read_file(dir_fd, names[i], max_size_, &text);
+      on_file(i, error ? std::string() : std::move(text), error);
+    }
+  }
+}
+
+// Blocking reads spread over a few threads: the files of an archive are
+// mostly in the page cache or on a device that serves several requests at
+// once, so more threads than cores keeps it busy.
+void FileReader::read_threads(int dir_fd, const std::vector<std::string> &names,
+                              std::size_t begin, std::size_t end,
+                              const OnFile &on_file) {
+  constexpr std::size_t threads = 8;
+  std::atomic<std::size_t> next{begin};
+  auto work = [&] {
+    for (std::size_t i; (i = next.fetch_add(1)) < end;) {
+      std::string text;
+      int error = read_file(dir_fd, names[i], max_size_, &text);
+      on_file(i, error ? std::string() : std::move(text), error);
+    }
+  };
+  std::vector<std::thread> pool;
+  for (std::size_t t = 1; t < std::min(threads, end - begin); t++)
+    pool.emplace_back(work);
+  work();
+  for (auto &t : pool)
+    t.join();
+}
+
+std::vector<std::string> list_input_dir(const std::string &dir) {
+  DIR *d = ::opendir(dir.c_str());
+  if (!d)
+    throw std::runtime_error("input dir: " + dir + ": " +
+                             std::strerror(errno));
+  std::vector<std::string> names;
+  while (dirent *e = ::readdir(d)) {
+    bool regular = e->d_type == DT_REG;
+    if (e->d_type == DT_UNKNOWN) {
+      struct stat st;
+      regular = ::fstatat(::dirfd(d), e->d_name, &st, 0) == 0 &&
+                S_ISREG(st.st_mode);
+    }
+    if (regular)
+      names.emplace_back(e->d_name);
+  }
+  ::closedir(d);
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+// ---- pipeline ----
+
+namespace {
+
+constexpr std::size_t group_size = 64;   // tickets per run_batch()
+constexpr std::size_t chunk_size = 4096; // files read before writing
+
+// The error code of a file that gave no ticket, else null.
+const char *error_code(int error, const EngineOutput *out) {
+  if (error == EFBIG)
+    return "INPUT_TOO_LARGE";
+  if (error)
+    return "INPUT_UNREADABLE";
+  if (!out)
+    return "INPUT_EMPTY";
+  if (out->status == Status::Error)
+    return "INTERNAL";
+  return nullptr;
+}
+
+// The document of one file, as the CLI would print it, with its name first.
+std::string document(const std::string &name, int error,
+                     const EngineOutput *out) {
+  std::string doc;
+  if (error == EFBIG) {
+    doc = error_json("INPUT_TOO_LARGE", "file exceeds max size");
+  } else if (error) {
+    std::string detail = std::strerror(error);
+    doc = error_json("INPUT_UNREADABLE", "cannot read file", &detail);
+  } else if (!out) {
+    doc = error_json("INPUT_EMPTY", "file is empty");
+  } else if (out->status == Status::Error) {
+    doc = error_json("INTERNAL", "engine error");
+  } else {
+    doc = to_json_v1(*out);
+  }
+  std::string line = "{\"file\":";
+  line += nlohmann::json(name).dump(
+      -1, ' ', false, nlohmann::json::error_handler_t::replace);
+  line += ',';
+  line.append(doc, 1);
+  line += '\n';
+  return line;
+}
+
+bool blank(std::string_view text) {
+  for (char c : text)
+    if (!is_ascii_space(c))
+      return false;
+  return true;
+}
+
+void write_all(int fd, std::string_view data) {
+  while (!data.empty()) {
+    ssize_t n = ::write(fd, data.data(), data.size());
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      throw std::runtime_error(std::string("input dir: write: ") +
+                               std::strerror(errno));
+    data.remove_prefix(static_cast<std::size_t>(n));
+  }
+}
+
+} // namespace
+
+// Summaries for the parsing tasks: one per task running at a time, so at
+// most one per thread, taken and given back around each group.
+class SummaryPool {
+public:
+  std::unique_ptr<BatchSummary> take() {
+    std::lock_guard<std::mutex> lock(m_);
+    if (idle_.empty())
+      return std::make_unique<BatchSummary>();
+    auto s = std::move(idle_.back());
+    idle_.pop_back();
+    return s;
+  }
+  void give_back(std::unique_ptr<BatchSummary> s) {
+    std::lock_guard<std::mutex> lock(m_);
+    idle_.push_back(std::move(s));
+  }
+  void merge_into(BatchSummary &total) {
+    for (const auto &s : idle_)
+      total.merge(*s);
+  }
+
+private:
+  std::mutex m_;
+  std::vector<std::unique_ptr<BatchSummary>> idle_;
+};
+
+InputDirStats run_input_dir(const std::string &dir, const Options &opt,
+                            int out_fd, ReadMethod method,
+                            BatchSummary *summary, ColumnarWriter *columnar) {
+  auto t0 = std::chrono::steady_clock::now();
+  const std::vector<std::string> names = list_input_dir(dir);
+  int dir_fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd < 0)
+    throw std::runtime_error("input dir: " + dir + ": " +
+                             std::strerror(errno));
+  struct DirCloser {
+    int fd;
+    ~DirCloser() { ::close(fd); }
+  } closer{dir_fd};
+
+  FileReader reader(method);
+  InputDirStats stats;
+  stats.method = reader.method();
+  stats.files = names.size();
+
+  std::vector<std::string> texts(chunk_size);
+  std::vector<int> errors(chunk_size);
+  std::vector<std::string> lines(chunk_size);
+  // Checked serially, in name order, once the chunk is parsed, and scored
+  // again with the rules' weights when flagged.
+  const auto index = active_near_duplicates();
+  const auto pack = active_rule_pack();
+  // Kept until the chunk is written, for the columnar writer and the
+  // near-duplicate index only.
+  std::vector<std::optional<EngineOutput>> outputs(
+      columnar || index ? chunk_size : 0);
+  std::unique_ptr<std::atomic<std::size_t>[]> left(
+      new std::atomic<std::size_t>[chunk_size / group_size]);
+  std::atomic<std::size_t> bytes{0};
+  SummaryPool summaries;
+
+  for (std::size_t base = 0; base < names.size(); base += chunk_size) {
+    const std::size_t n = std::min(chunk_size, names.size() - base);
+    const std::size_t groups = (n + group_size - 1) / group_size;
+    for (std::size_t g = 0; g < groups; g++)
+      left[g] = std::min(group_size, n - g * group_size);
+
+    // A group's tickets are parsed as soon as its last file is read.
+    auto parse = [&](std::size_t g) {
+      const std::size_t first = g * group_size;
+      const std::size_t last = std::min(n, first + group_size);
+      std::vector<std::string_view> docs;
+      std::vector<std::size_t> at;
+      for (std::size_t i = first; i < last; i++)
+        if (!errors[i]) {
+          std::string_view text = first_lines(texts[i], opt.max_lines);
+          if (!blank(text)) {
+            docs.push_back(text);
+            at.push_back(i);
+          }
+        }
+      // Near-duplicates are checked by the serial pass below, in name order.
+      auto outs = run_batch(docs, opt, false);
+      auto s = summary ? summaries.take() : nullptr;
+      std::size_t k = 0;
+      for (std::size_t i = first; i < last; i++) {
+        const EngineOutput *out =
+            k < at.size() && at[k] == i ? &outs[k++] : nullptr;
+        texts[i] = std::string();
+        if (index) { // finished by the serial pass below
+          if (out)
+            outputs[i] = std::move(outs[k - 1]);
+          continue;
+        }
+        lines[i] = document(names[base + i], errors[i], out);
+        const bool ticket = out && out->status != Status::Error;
+        if (s && ticket)
+          s->add(*out);
+        else if (s)
+          s->add_skipped();
+        if (columnar && out)
+          outputs[i] = std::move(outs[k - 1]);
+      }
+      if (s)
+        summaries.give_back(std::move(s));
+    };
+    TaskGroup parsers(TaskPool::shared());
+    reader.read(dir_fd, names, base, base + n,
+                [&](std::size_t index, std::string &&text, int error) {
+                  const std::size_t i = index - base;
+                  bytes += text.size();
+                  texts[i] = std::move(text);
+                  errors[i] = error;
+                  if (left[i / group_size].fetch_sub(1) == 1)
+                    parsers.run([&, g = i / group_size] { parse(g); });
+                });
+    parsers.wait();
+
+    // Whatever order the groups ran in, the index sees the tickets in name
+    // order, as a serial run would.
+    if (index)
+      for (std::size_t i = 0; i < n; i++) {
+        EngineOutput *o = outputs[i] ? &*outputs[i] : nullptr;
+        if (o)
+          check_near_duplicate(*o, *index, pack->scoring());
+        lines[i] = document(names[base + i], errors[i], o);
+        if (summary && o && o->status != Status::Error)
+          summary->add(*o);
+        else if (summary)
+          summary->add_skipped();
+      }
+
+    std::string out;
+    for (std::size_t i = 0; i < n; i++) {
+      if (errors[i])
+        stats.failed++;
+      out += lines[i];
+      if (outputs.empty())
+        continue;
+      const EngineOutput *o = outputs[i] ? &*outputs[i] : nullptr;
+      if (columnar) {
+        if (const char *code = error_code(errors[i], o))
+          columnar->add(names[base + i], nullptr, code);
+        else
+          columnar->add(names[base + i], o);
+      }
+      outputs[i].reset();
+    }
+    write_all(out_fd, out);
+  }
+  if (summary)
+    summaries.merge_into(*summary);
+  stats.bytes = bytes;
+  stats.seconds = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - t0)
+                      .count();
+  return stats;
+}
+
+} // namespace tv
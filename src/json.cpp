@@ -1,5 +1,15 @@
 #include "tv/json.hpp"
+#include "tv/engine.hpp"
+#include "tv/flight_recorder.hpp"
+#include "tv/utf8.hpp"
 #include "tv/version.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
 #include <nlohmann/json.hpp>
 
 namespace tv {
@@ -25,13 +35,35 @@ static json field_money(const Field<Money> &f) {
   return j;
 }
 
-std::string to_json_v1(const EngineOutput &out) {
+static json field_company(const Field<Company> &f) {
+  json j = json::object();
+  if (f.value) {
+    json v = {{"siren", f.value->siren}};
+    if (!f.value->siret.empty())
+      v["siret"] = f.value->siret;
+    if (f.value->name)
+      v["name"] = *f.value->name;
+    if (f.value->trade_name)
+      v["trade_name"] = *f.value->trade_name;
+    if (f.value->naf)
+      v["naf"] = *f.value->naf;
+    j["value"] = v;
+  }
+  j["confidence"] = f.confidence;
+  j["source"] = f.source;
+  return j;
+}
+
+static json build_v1(const EngineOutput &out) {
   auto v = version_info();
 
   json j;
   j["schema"] = out.schema;
 
-  j["engine"] = {{"name", v.name}, {"version", v.version}, {"build", v.build}};
+  j["engine"] = {{"name", v.name},
+                 {"version", v.version},
+                 {"build", v.build},
+                 {"rules", out.rules_version}};
 
   j["input"] = {{"locale", out.input.locale},
                 {"domain", out.input.domain},
@@ -39,6 +71,25 @@ std::string to_json_v1(const EngineOutput &out) {
                 {"lines", out.input.lines}};
   if (!out.input.hash.empty())
     j["input"]["hash"] = out.input.hash;
+  if (out.input.fingerprint != 0) {
+    char hex[17];
+    std::snprintf(hex, sizeof hex, "%016llx",
+                  static_cast<unsigned long long>(out.input.fingerprint));
+    j["input"]["fingerprint"] = std::string("simhash:") + hex;
+  }
+  if (!out.input.detected_locale.empty() ||
+      !out.input.detected_domain.empty()) {
+    auto &d = j["input"]["detected"];
+    d = json::object();
+    if (!out.input.detected_locale.empty()) {
+      d["locale"] = out.input.detected_locale;
+      d["locale_confidence"] = out.input.locale_confidence;
+    }
+    if (!out.input.detected_domain.empty()) {
+      d["domain"] = out.input.detected_domain;
+      d["domain_confidence"] = out.input.domain_confidence;
+    }
+  }
 
   json result;
   result["status"] = status_to_string(out.status);
@@ -47,6 +98,11 @@ std::string to_json_v1(const EngineOutput &out) {
   json fields = json::object();
   if (out.ticket.merchant.value || out.ticket.merchant.confidence > 0.0) {
     fields["merchant"] = field_string(out.ticket.merchant);
+    if (const auto &c = out.ticket.merchant_canonical; c.value)
+      fields["merchant"]["canonical"] = {{"value", c.value->name},
+                                         {"distance", c.value->distance},
+                                         {"confidence", c.confidence},
+                                         {"source", c.source}};
   }
   if (out.ticket.datetime_iso.value ||
       out.ticket.datetime_iso.confidence > 0.0) {
@@ -55,6 +111,9 @@ std::string to_json_v1(const EngineOutput &out) {
   if (out.ticket.total.value || out.ticket.total.confidence > 0.0) {
     fields["total"] = field_money(out.ticket.total);
   }
+  if (out.ticket.company.value) {
+    fields["company"] = field_company(out.ticket.company);
+  }
 
   result["fields"] = fields;
 
@@ -100,16 +159,205 @@ std::string to_json_v1(const EngineOutput &out) {
 
   j["timing_ms"] = {{"total", out.timing.total},
                     {"parse", out.timing.parse},
-                    {"score", out.timing.score}};
+                    {"score", out.timing.score},
+                    {"score_ns", out.timing.score_ns}};
 
   if (out.error_message) {
     j["error"] = {{"message", *out.error_message}};
   }
 
+  return j;
+}
+
+// tv::run repairs the input at ingestion, so every string here is already
+// valid UTF-8; `replace` only guards callers that build EngineOutput by hand
+// (prevents exit=3 for bad bytes)
+static constexpr auto on_bad_utf8 = nlohmann::json::error_handler_t::replace;
+
+std::string to_json_v1(const EngineOutput &out) {
   // Single-line JSON
-  // IMPORTANT: replace invalid UTF-8 instead of throwing (prevents exit=3 for
-  // bad OCR bytes)
-  return j.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+  return build_v1(out).dump(-1, ' ', false, on_bad_utf8);
+}
+
+namespace {
+
+// Serializer output into a caller's buffer; past the end it only counts.
+class BoundedOutput : public nlohmann::detail::output_adapter_protocol<char> {
+public:
+  BoundedOutput(char *buf, std::size_t cap) : buf_(buf), cap_(cap) {}
+
+  void write_character(char c) override {
+    if (n_ < cap_)
+      buf_[n_] = c;
+    n_++;
+  }
+  void write_characters(const char *s, std::size_t len) override {
+    if (n_ < cap_)
+      std::memcpy(buf_ + n_, s, std::min(len, cap_ - n_));
+    n_ += len;
+  }
+  std::size_t size() const { return n_; }
+
+private:
+  char *buf_;
+  std::size_t cap_;
+  std::size_t n_ = 0;
+};
+
+} // namespace
+
+std::size_t write_json_v1(const EngineOutput &out, char *buf,
+                          std::size_t cap) {
+  auto sink = std::make_shared<BoundedOutput>(buf, cap);
+  nlohmann::detail::serializer<json> s(sink, ' ', on_bad_utf8);
+  s.dump(build_v1(out), false, false, 0);
+  return sink->size();
+}
+
+static void escape_into(std::string &out, const std::string &s) {
+  for (unsigned char c : s) {
+    switch (c) {
+    case '\\':
+      out += "\\\\";
+      break;
+    case '"':
+      out += "\\\"";
+      break;
+    case '\n':
+      out += "\\n";
+      break;
+    case '\r':
+      out += "\\r";
+      break;
+    case '\t':
+      out += "\\t";
+      break;
+    default:
+      out += c < 0x20 ? ' ' : static_cast<char>(c);
+    }
+  }
+}
+
+std::string error_json(const std::string &code, const std::string &message,
+                       const std::string *detail) {
+  std::string out = "{\"ok\":false,\"error\":{\"code\":\"";
+  escape_into(out, code);
+  out += "\",\"message\":\"";
+  escape_into(out, message);
+  out += "\"";
+  if (detail && !detail->empty()) {
+    // detail may carry input bytes: keep the error JSON valid UTF-8
+    std::string d;
+    repair_utf8(*detail, d);
+    out += ",\"detail\":\"";
+    escape_into(out, d);
+    out += "\"";
+  }
+  out += "}}";
+  return out;
+}
+
+static json histogram_json(const LatencyHistogram &h) {
+  json buckets = json::array();
+  std::size_t used = h.buckets;
+  while (used > 0 && h.counts[used - 1] == 0)
+    used--;
+  for (std::size_t i = 0; i < used; i++)
+    buckets.push_back(h.counts[i]);
+  return {{"count", h.count},
+          {"mean", h.count ? h.sum_us / h.count : 0},
+          {"p50", h.quantile(0.50)},
+          {"p90", h.quantile(0.90)},
+          {"p99", h.quantile(0.99)},
+          {"max", h.max_us},
+          {"buckets", std::move(buckets)}};
+}
+
+std::string stats_json(const SchedulerStats &stats, std::size_t queued,
+                       const FlightDump *dump) {
+  json classes = json::object();
+  for (std::size_t c = 0; c < stats.size(); c++)
+    classes[priority_name(static_cast<Priority>(c))] = {
+        {"expired", stats[c].expired},
+        {"queue_wait_us", histogram_json(stats[c].queue_wait)},
+        {"service_us", histogram_json(stats[c].service)}};
+  json doc = {{"ok", true},
+              {"scheduler", {{"queued", queued}, {"classes", classes}}}};
+  if (dump)
+    doc["flight_recorder"] = {{"path", dump->path},
+                              {"records", dump->records},
+                              {"slow", dump->slow}};
+  return doc.dump();
+}
+
+static double confidence_of(const json *v) {
+  if (v && v->is_object() && v->contains("confidence"))
+    return (*v)["confidence"].get<double>();
+  if (v && v->is_number())
+    return v->get<double>();
+  return 0.0;
+}
+
+// Appends a diff entry when the two values (null: absent) differ.
+static void diff_entry(json &diffs, const std::string &field, const json *old,
+                       const json *now) {
+  if (old && now && *old == *now)
+    return;
+  json d = {{"field", field},
+            {"old", old ? *old : json(nullptr)},
+            {"new", now ? *now : json(nullptr)}};
+  bool scored = (old && (old->is_object() || old->is_number())) ||
+                (now && (now->is_object() || now->is_number()));
+  if (scored)
+    d["confidence_delta"] = confidence_of(now) - confidence_of(old);
+  diffs.push_back(std::move(d));
+}
+
+static const json *member(const json &obj, const std::string &key) {
+  auto it = obj.find(key);
+  return it == obj.end() ? nullptr : &*it;
+}
+
+std::string shadow_json(const EngineOutput &primary, const ShadowRun &shadow) {
+  const json a = build_v1(primary)["result"];
+  const json b = build_v1(shadow.output)["result"];
+
+  json diffs = json::array();
+  std::vector<std::string> keys;
+  for (const json *r : {&a, &b})
+    for (auto it = r->begin(); it != r->end(); ++it)
+      if (std::find(keys.begin(), keys.end(), it.key()) == keys.end())
+        keys.push_back(it.key());
+  for (const auto &key : keys) {
+    const json *old = member(a, key), *now = member(b, key);
+    if (key != "fields" && key != "signals") {
+      diff_entry(diffs, key, old, now);
+      continue;
+    }
+    // One entry per field or signal.
+    std::vector<std::string> sub;
+    for (const json *r : {old, now})
+      if (r)
+        for (auto it = r->begin(); it != r->end(); ++it)
+          if (std::find(sub.begin(), sub.end(), it.key()) == sub.end())
+            sub.push_back(it.key());
+    for (const auto &k : sub)
+      diff_entry(diffs, key + "." + k, old ? member(*old, k) : nullptr,
+                 now ? member(*now, k) : nullptr);
+  }
+
+  using us = std::chrono::duration<double, std::micro>;
+  double total = us(shadow.total_time).count();
+  double extra = us(shadow.shadow_time).count();
+  json doc = {
+      {"primary_rules", primary.rules_version},
+      {"shadow_rules", shadow.output.rules_version},
+      {"chars", primary.input.chars},
+      {"confidence_delta", shadow.output.confidence - primary.confidence},
+      {"diffs", std::move(diffs)},
+      {"cost_us", {{"total", total}, {"shadow", extra}}},
+      {"overhead", total > extra ? extra / (total - extra) : 0.0}};
+  return doc.dump(-1, ' ', false, on_bad_utf8);
 }
 
 } // namespace tv
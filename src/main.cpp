@@ -1,255 +1,523 @@
+#include "tv/batch_summary.hpp"
 #include "tv/cli.hpp"
+#include "tv/columnar.hpp"
 #include "tv/engine.hpp"
+#include "tv/input_dir.hpp"
 #include "tv/json.hpp"
+#include "tv/mapped_file.hpp"
+#include "tv/merchant_dict.hpp"
+#include "tv/near_duplicate.hpp"
+#include "tv/registry.hpp"
+#include "tv/rule_pack.hpp"
+#include "tv/shadow.hpp"
+#include "tv/shm.hpp"
+#include "tv/zygote.hpp"
 
 #include <cctype>
-#include <iostream>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <initializer_list>
 #include <iterator>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
-// ---- Small helper: make a string "safe-ish" for JSON detail fields ----
-// If bytes are not valid UTF-8, we replace them with '?'.
-// This avoids nlohmann/json throwing if we ever decide to put detail into json.
-static std::string sanitize_utf8_lossy(const std::string &s) {
-  std::string out;
-  out.reserve(s.size());
+#include <fcntl.h>
+#include <unistd.h>
 
-  const unsigned char *p = reinterpret_cast<const unsigned char *>(s.data());
-  const size_t n = s.size();
+// stdout and stderr are written with write(2): no iostreams, whose static
+// setup every one-ticket process would otherwise pay before main.
+static void print_out(std::initializer_list<std::string_view> parts) {
+  tv::write_fd(STDOUT_FILENO, parts);
+}
 
-  size_t i = 0;
-  while (i < n) {
-    unsigned char c = p[i];
+static void print_err(std::initializer_list<std::string_view> parts) {
+  tv::write_fd(STDERR_FILENO, parts);
+}
 
-    // ASCII
-    if (c < 0x80) {
-      out.push_back(static_cast<char>(c));
-      i++;
-      continue;
-    }
+static void print_json_error(const std::string &code,
+                             const std::string &message,
+                             const std::string *detail = nullptr) {
+  print_out({tv::error_json(code, message, detail)});
+}
 
-    // 2-byte
-    if ((c & 0xE0) == 0xC0) {
-      if (i + 1 < n && (p[i + 1] & 0xC0) == 0x80) {
-        out.append(reinterpret_cast<const char *>(p + i), 2);
-        i += 2;
-      } else {
-        out.push_back('?');
-        i++;
-      }
-      continue;
-    }
+// When each step of a one-ticket run ended, CLOCK_MONOTONIC nanoseconds;
+// --debug prints them for tv_bench_startup, which sets them against the
+// time it spawned the process.
+enum Phase {
+  PhaseMain,
+  PhaseArgs,
+  PhaseInput,
+  PhaseEngine,
+  PhaseJson,
+  PhaseWrite,
+  phase_count
+};
+static std::uint64_t phase_ns[phase_count];
+
+static void mark(Phase phase) {
+  timespec ts{};
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  phase_ns[phase] = static_cast<std::uint64_t>(ts.tv_sec) * 1000000000u +
+                    static_cast<std::uint64_t>(ts.tv_nsec);
+}
+
+static void print_phases() {
+  static constexpr const char *names[phase_count] = {
+      "main", "args", "input", "engine", "json", "write"};
+  std::string line = "[debug] startup ns:";
+  for (int p = 0; p < phase_count; p++)
+    line += std::string(" ") + names[p] + " " + std::to_string(phase_ns[p]);
+  print_err({line, "\n"});
+}
 
-    // 3-byte
-    if ((c & 0xF0) == 0xE0) {
-      if (i + 2 < n && (p[i + 1] & 0xC0) == 0x80 && (p[i + 2] & 0xC0) == 0x80) {
-        out.append(reinterpret_cast<const char *>(p + i), 3);
-        i += 3;
-      } else {
-        out.push_back('?');
-        i++;
+static std::vector<std::string> collect_args(int argc, char **argv) {
+  std::vector<std::string> a;
+  a.reserve((argc > 1) ? (argc - 1) : 0);
+  for (int i = 1; i < argc; i++)
+    a.emplace_back(argv[i]);
+  return a;
+}
+
+// Feeds stdin to the session as it is read, up to max_lines lines. Sets
+// *too_large past max_bytes; returns whether any non-whitespace byte was
+// seen.
+static bool feed_stdin_limited(tv::Session &session, std::uint32_t max_lines,
+                               std::size_t max_bytes, bool *truncated_lines,
+                               bool *too_large) {
+  *truncated_lines = false;
+  *too_large = false;
+
+  std::size_t total = 0;
+  std::uint32_t lines = 0;
+  bool any_non_ws = false;
+  char buf[65536];
+  bool eof = false;
+
+  while (!eof) {
+    // Whole buffers, as std::cin.read did: a caller writing a few pages
+    // past max_lines still sees them all read, not a broken pipe.
+    std::size_t n = 0;
+    while (n < sizeof(buf)) {
+      ssize_t got = ::read(STDIN_FILENO, buf + n, sizeof(buf) - n);
+      if (got < 0 && errno == EINTR)
+        continue;
+      if (got <= 0) {
+        eof = true;
+        break;
       }
-      continue;
+      n += static_cast<std::size_t>(got);
     }
+    if (n == 0)
+      break;
 
-    // 4-byte
-    if ((c & 0xF8) == 0xF0) {
-      if (i + 3 < n && (p[i + 1] & 0xC0) == 0x80 && (p[i + 2] & 0xC0) == 0x80 &&
-          (p[i + 3] & 0xC0) == 0x80) {
-        out.append(reinterpret_cast<const char *>(p + i), 4);
-        i += 4;
-      } else {
-        out.push_back('?');
-        i++;
+    for (std::size_t i = 0; i < n; i++) {
+      if (buf[i] == '\n' && ++lines >= max_lines) {
+        *truncated_lines = true;
+        n = i + 1;
+        break;
       }
-      continue;
     }
+    if (total + n > max_bytes) {
+      *too_large = true;
+      return any_non_ws;
+    }
+    total += n;
+    for (std::size_t i = 0; i < n && !any_non_ws; i++)
+      any_non_ws = !std::isspace(static_cast<unsigned char>(buf[i]));
 
-    // invalid leading byte
-    out.push_back('?');
-    i++;
+    session.feed(std::string_view(buf, n));
+    if (*truncated_lines)
+      break;
   }
+  return any_non_ws;
+}
 
-  return out;
+// Activates --rules FILE. On error, prints the error JSON and returns false.
+static bool apply_rule_pack(const tv::CliParseResult &parsed) {
+  if (!parsed.rules_path)
+    return true;
+  try {
+    tv::load_rule_pack(*parsed.rules_path);
+    return true;
+  } catch (const std::exception &e) {
+    if (parsed.options.debug)
+      print_err({"[debug] ", e.what(), "\n"});
+    std::string detail = e.what();
+    print_json_error("RULES_INVALID", "rule pack rejected", &detail);
+    print_out({"\n"});
+    return false;
+  }
 }
 
-// Minimal JSON escape for our handcrafted error JSON.
-static std::string json_escape(const std::string &s) {
-  std::string out;
-  out.reserve(s.size() + 8);
-  for (unsigned char c : s) {
-    switch (c) {
-    case '\\':
-      out += "\\\\";
-      break;
-    case '"':
-      out += "\\\"";
-      break;
-    case '\n':
-      out += "\\n";
-      break;
-    case '\r':
-      out += "\\r";
-      break;
-    case '\t':
-      out += "\\t";
-      break;
-    default:
-      if (c < 0x20) {
-        out += ' ';
-      } else {
-        out += static_cast<char>(c);
-      }
+// Activates --shadow-rules FILE (with --shadow-rate, --shadow-log). On
+// error, prints the error JSON and returns false.
+static bool apply_shadow(const tv::CliParseResult &parsed) {
+  if (!parsed.shadow_rules)
+    return true;
+  tv::ShadowConfig cfg;
+  cfg.sample_rate = parsed.shadow_rate;
+  try {
+    cfg.candidate = tv::RulePack::load(*parsed.shadow_rules);
+  } catch (const std::exception &e) {
+    std::string detail = e.what();
+    print_json_error("RULES_INVALID", "shadow rule pack rejected", &detail);
+    print_out({"\n"});
+    return false;
+  }
+  if (parsed.shadow_log) {
+    cfg.log_fd = ::open(parsed.shadow_log->c_str(),
+                        O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (cfg.log_fd < 0) {
+      std::string detail = *parsed.shadow_log + ": " + std::strerror(errno);
+      print_json_error("ARGS_INVALID", "cannot open shadow log", &detail);
+      print_out({"\n"});
+      return false;
     }
   }
-  return out;
+  tv::set_shadow(std::move(cfg));
+  return true;
 }
 
-static void print_json_error(const std::string &code,
-                             const std::string &message,
-                             const std::string *detail = nullptr) {
-  std::cout << "{\"ok\":false,\"error\":{\"code\":\"" << json_escape(code)
-            << "\",\"message\":\"" << json_escape(message) << "\"";
-  if (detail && !detail->empty()) {
-    std::string d = sanitize_utf8_lossy(*detail);
-    std::cout << ",\"detail\":\"" << json_escape(d) << "\"";
+// Activates --registry FILE. On error, prints the error JSON and returns
+// false.
+static bool apply_registry(const tv::CliParseResult &parsed) {
+  if (!parsed.registry_path)
+    return true;
+  try {
+    tv::set_active_registry(tv::CompanyRegistry::open(*parsed.registry_path));
+    return true;
+  } catch (const std::exception &e) {
+    std::string detail = e.what();
+    print_json_error("REGISTRY_INVALID", "company registry rejected", &detail);
+    print_out({"\n"});
+    return false;
   }
-  std::cout << "}}";
 }
 
-static std::vector<std::string> collect_args(int argc, char **argv) {
-  std::vector<std::string> a;
-  a.reserve((argc > 1) ? (argc - 1) : 0);
-  for (int i = 1; i < argc; i++)
-    a.emplace_back(argv[i]);
-  return a;
+// --compile-registry CSV OUT. Returns the exit code.
+static int compile_registry(const tv::CliParseResult &parsed) {
+  const auto &[csv, out] = *parsed.compile_registry;
+  try {
+    auto n = tv::compile_registry(csv, out);
+    if (parsed.options.debug)
+      print_err({"[debug] ", std::to_string(n),
+                 " registry entries written to ", out, "\n"});
+    return 0;
+  } catch (const std::exception &e) {
+    std::string detail = e.what();
+    print_json_error("REGISTRY_INVALID", "registry extract rejected", &detail);
+    print_out({"\n"});
+    return 2;
+  }
 }
 
-static std::string read_stdin_limited(std::uint32_t max_lines,
-                                      std::size_t max_bytes,
-                                      bool *truncated_lines, bool *too_large) {
-  *truncated_lines = false;
-  *too_large = false;
-
-  std::string input;
-  input.reserve(4096);
+// Activates --merchants FILE. On error, prints the error JSON and returns
+// false.
+static bool apply_merchants(const tv::CliParseResult &parsed) {
+  if (!parsed.merchants_path)
+    return true;
+  try {
+    tv::set_active_merchant_dictionary(
+        tv::MerchantDictionary::open(*parsed.merchants_path));
+    return true;
+  } catch (const std::exception &e) {
+    std::string detail = e.what();
+    print_json_error("MERCHANTS_INVALID", "merchant dictionary rejected",
+                     &detail);
+    print_out({"\n"});
+    return false;
+  }
+}
 
-  std::uint32_t lines = 0;
-  char buf[4096];
+// --compile-merchants LIST OUT. Returns the exit code.
+static int compile_merchants(const tv::CliParseResult &parsed) {
+  const auto &[list, out] = *parsed.compile_merchants;
+  try {
+    auto n = tv::compile_merchant_dictionary(list, out);
+    if (parsed.options.debug)
+      print_err({"[debug] ", std::to_string(n), " merchants written to ",
+                 out, "\n"});
+    return 0;
+  } catch (const std::exception &e) {
+    std::string detail = e.what();
+    print_json_error("MERCHANTS_INVALID", "merchant list rejected", &detail);
+    print_out({"\n"});
+    return 2;
+  }
+}
 
-  while (std::cin.good()) {
-    std::cin.read(buf, sizeof(buf));
-    std::streamsize got = std::cin.gcount();
-    if (got <= 0)
-      break;
+// Activates --near-duplicates FILE: its snapshot, or an empty index when
+// the file does not exist yet. On error, prints the error JSON and returns
+// false.
+static bool apply_near_duplicates(const tv::CliParseResult &parsed) {
+  if (!parsed.near_duplicates)
+    return true;
+  try {
+    std::shared_ptr<tv::NearDuplicateIndex> index;
+    if (::access(parsed.near_duplicates->c_str(), F_OK) == 0)
+      index = tv::NearDuplicateIndex::load(*parsed.near_duplicates);
+    else
+      index = std::make_shared<tv::NearDuplicateIndex>();
+    if (parsed.options.debug)
+      print_err({"[debug] near-duplicate index: ",
+                 std::to_string(index->size()), " tickets\n"});
+    tv::set_active_near_duplicates(std::move(index));
+    return true;
+  } catch (const std::exception &e) {
+    std::string detail = e.what();
+    print_json_error("NEAR_DUPLICATES_INVALID",
+                     "near-duplicate index rejected", &detail);
+    print_out({"\n"});
+    return false;
+  }
+}
 
-    for (std::streamsize i = 0; i < got; i++) {
-      if (input.size() >= max_bytes) {
-        *too_large = true;
-        return input;
-      }
-      char c = buf[i];
-      input.push_back(c);
-
-      if (c == '\n') {
-        lines++;
-        if (lines >= max_lines) {
-          *truncated_lines = true;
-          return input;
-        }
-      }
-    }
+// Writes the active near-duplicate index back to --near-duplicates FILE.
+static void save_near_duplicates(const tv::CliParseResult &parsed) {
+  auto index = tv::active_near_duplicates();
+  if (!parsed.near_duplicates || !index)
+    return;
+  try {
+    index->save(*parsed.near_duplicates);
+  } catch (const std::exception &e) {
+    print_err({"[near-duplicates] ", e.what(), "\n"});
   }
-  return input;
 }
 
-int main(int argc, char **argv) {
-  auto args = collect_args(argc, argv);
-  auto parsed = tv::parse_args(args);
+// --input-dir: one JSON line per file on stdout.
+static int run_input_dir(const tv::CliParseResult &parsed) {
+  const std::string &m = parsed.read_method;
+  const auto method = m == "io_uring"  ? tv::ReadMethod::Uring
+                      : m == "threads" ? tv::ReadMethod::Threads
+                      : m == "serial"  ? tv::ReadMethod::Serial
+                                       : tv::ReadMethod::Auto;
+  try {
+    tv::BatchSummary summary;
+    std::optional<tv::ColumnarWriter> columnar;
+    if (parsed.columnar)
+      columnar.emplace(*parsed.columnar);
+    auto stats = tv::run_input_dir(*parsed.input_dir, parsed.options,
+                                   STDOUT_FILENO, method,
+                                   parsed.summary ? &summary : nullptr,
+                                   columnar ? &*columnar : nullptr);
+    if (columnar)
+      columnar->finish();
+    if (parsed.summary)
+      tv::replace_file(*parsed.summary, "summary", {summary.to_json(), "\n"});
+    if (parsed.options.debug)
+      print_err(
+          {"[debug] input dir: ", std::to_string(stats.files), " files (",
+           std::to_string(stats.failed), " unreadable), ",
+           std::to_string(stats.bytes), " bytes in ",
+           std::to_string(stats.seconds), " s, ",
+           std::to_string(stats.seconds > 0 ? stats.files / stats.seconds
+                                            : 0.0),
+           " files/s, ", tv::read_method_name(stats.method), "\n"});
+    if (parsed.options.debug && columnar)
+      print_err({"[debug] columnar: ", std::to_string(columnar->rows()),
+                 " rows, ", std::to_string(columnar->bytes()), " bytes\n"});
+    return 0;
+  } catch (const std::exception &e) {
+    std::string detail = e.what();
+    print_json_error("INPUT_DIR_INVALID", "cannot run input dir", &detail);
+    return 2;
+  }
+}
 
+// One invocation: stdin -> JSON on stdout. Returns the exit code.
+static int run_cli(const tv::CliParseResult &parsed) {
   if (parsed.show_help) {
-    std::cerr << tv::help_text() << "\n";
+    print_err({tv::help_text(), "\n"});
     return 0;
   }
   if (parsed.show_version) {
-    std::cerr << tv::version_text() << "\n";
+    print_err({tv::version_text(), "\n"});
     return 0;
   }
   if (parsed.error) {
     if (parsed.options.debug) {
-      std::cerr << "[debug] arg error: " << *parsed.error << "\n";
+      print_err({"[debug] arg error: ", *parsed.error, "\n"});
     }
     print_json_error("ARGS_INVALID", *parsed.error);
     return 2;
   }
+  if (parsed.compile_registry)
+    return compile_registry(parsed);
+  if (parsed.compile_merchants)
+    return compile_merchants(parsed);
+  if (!apply_rule_pack(parsed) || !apply_shadow(parsed) ||
+      !apply_registry(parsed) || !apply_merchants(parsed))
+    return 2;
+  if (parsed.input_dir) {
+    if (!apply_near_duplicates(parsed))
+      return 2;
+    int code = run_input_dir(parsed);
+    save_near_duplicates(parsed);
+    return code;
+  }
 
   bool truncated = false;
   bool too_large = false;
-  constexpr std::size_t MAX_BYTES = 2 * 1024 * 1024; // 2MB MVP
+  // Input is parsed while it is read and not kept whole, so the cap only
+  // bounds the work per ticket.
+  constexpr std::size_t MAX_BYTES = 64 * 1024 * 1024;
 
-  std::string ocr_text = read_stdin_limited(parsed.options.max_lines, MAX_BYTES,
-                                            &truncated, &too_large);
-
-  auto is_all_ws = [](const std::string &s) {
-    for (unsigned char c : s)
-      if (!std::isspace(c))
-        return false;
-    return true;
-  };
+  tv::Session session;
+  session.begin(parsed.options, tv::shadow_candidate());
+  bool has_text = feed_stdin_limited(session, parsed.options.max_lines,
+                                     MAX_BYTES, &truncated, &too_large);
+  mark(PhaseInput);
 
   if (too_large) {
     if (parsed.options.debug)
-      std::cerr << "[debug] input too large (max_bytes=" << MAX_BYTES << ")\n";
+      print_err({"[debug] input too large (max_bytes=",
+                 std::to_string(MAX_BYTES), ")\n"});
     print_json_error("INPUT_TOO_LARGE", "stdin exceeds max size");
     return 2;
   }
 
-  if (ocr_text.empty() || is_all_ws(ocr_text)) {
+  if (!has_text) {
     if (parsed.options.debug)
-      std::cerr << "[debug] empty/whitespace input\n";
+      print_err({"[debug] empty/whitespace input\n"});
     print_json_error("INPUT_EMPTY", "stdin is empty");
     return 2;
   }
 
   if (parsed.options.debug && truncated) {
-    std::cerr << "[debug] input truncated to max_lines="
-              << parsed.options.max_lines << "\n";
+    print_err({"[debug] input truncated to max_lines=",
+               std::to_string(parsed.options.max_lines), "\n"});
   }
 
   try {
-    auto out = tv::run(ocr_text, parsed.options);
+    auto out = session.finish();
 
     if (out.status == tv::Status::Error) {
       if (parsed.options.debug)
-        std::cerr << "[debug] engine returned Status::Error\n";
+        print_err({"[debug] engine returned Status::Error\n"});
       print_json_error("INTERNAL", "engine error");
       return 3;
     }
 
-    std::cout << tv::to_json_v1(out) << "\n";
+    mark(PhaseEngine);
+    std::string json = tv::to_json_v1(out);
+    mark(PhaseJson);
+    print_out({json, "\n"});
+    mark(PhaseWrite);
+    if (session.shadow())
+      tv::log_shadow(out, *session.shadow());
+    if (parsed.options.debug)
+      print_phases();
     return 0;
 
   } catch (const std::exception &e) {
     if (parsed.options.debug) {
-      std::cerr << "[debug] exception: " << e.what() << "\n";
-      std::cerr << "[ticketverify] exception: " << e.what() << "\n";
+      print_err({"[debug] exception: ", e.what(), "\n"});
+      print_err({"[ticketverify] exception: ", e.what(), "\n"});
     }
     // IMPORTANT: print only ONE JSON on stdout
     std::string detail = e.what();
     print_json_error("INTERNAL", "unexpected error", &detail);
-    std::cout << "\n";
+    print_out({"\n"});
     return 3;
 
   } catch (...) {
     if (parsed.options.debug) {
-      std::cerr << "[debug] unknown exception\n";
-      std::cerr << "[ticketverify] unknown exception\n";
+      print_err({"[debug] unknown exception\n"});
+      print_err({"[ticketverify] unknown exception\n"});
     }
     // IMPORTANT: print only ONE JSON on stdout
     std::string detail = "unknown";
     print_json_error("INTERNAL", "unexpected error", &detail);
-    std::cout << "\n";
+    print_out({"\n"});
     return 3;
   }
 }
+
+// Builds what the first ticket would otherwise pay for (static tables, the
+// per-locale/domain pipelines, allocator arenas, JSON writer) and touches
+// the code pages, so the zygote's children and the shm server start warm.
+static void warm_up() {
+  static const char *const sample =
+      "CAFE DE LA PLACE\n12 RUE DU PORT\nSIRET 732 829 320 00017\n"
+      "2 CAFE 3,00\nTOTAL TTC 4,00 \xE2\x82\xAC\nCB CARTE BANCAIRE\n";
+  for (auto locale : {tv::Locale::Auto, tv::Locale::FrFR, tv::Locale::FrBE,
+                      tv::Locale::FrCH, tv::Locale::EsES}) {
+    for (auto domain : {tv::Domain::Auto, tv::Domain::Cafe, tv::Domain::Resto}) {
+      tv::Options opt;
+      opt.locale = locale;
+      opt.domain = domain;
+      (void)tv::to_json_v1(tv::run(sample, opt));
+    }
+  }
+}
+
+// Zygote child: parses the forwarded arguments and runs them as a normal
+// invocation on the client's stdio.
+static int handle_zygote_request(const std::vector<std::string> &args) {
+  auto parsed = tv::parse_args(args);
+  if (!parsed.error &&
+      (parsed.zygote_socket || parsed.via_zygote || parsed.shm_name))
+    parsed.error = "Zygote flags cannot be forwarded";
+  return run_cli(parsed);
+}
+
+// The forwarded arguments: all but --via-zygote PATH.
+static std::vector<std::string>
+without_via_zygote(const std::vector<std::string> &args) {
+  std::vector<std::string> out;
+  for (std::size_t i = 0; i < args.size(); i++) {
+    if (args[i] == "--via-zygote") {
+      i++;
+      continue;
+    }
+    out.push_back(args[i]);
+  }
+  return out;
+}
+
+int main(int argc, char **argv) {
+  mark(PhaseMain);
+  auto args = collect_args(argc, argv);
+  auto parsed = tv::parse_args(args);
+  mark(PhaseArgs);
+
+  if (!parsed.error && !parsed.show_help && !parsed.show_version) {
+    if (parsed.zygote_socket || parsed.shm_name) {
+      // Loaded once, before the warm-up; SIGHUP reloads it.
+      if (!apply_rule_pack(parsed) || !apply_shadow(parsed) ||
+          !apply_registry(parsed) || !apply_merchants(parsed))
+        return 2;
+      warm_up();
+      if (parsed.zygote_socket)
+        return tv::serve_zygote(*parsed.zygote_socket, handle_zygote_request,
+                                parsed.options.debug);
+      if (!apply_near_duplicates(parsed))
+        return 2;
+      tv::ShmConfig shm;
+      shm.workers = parsed.shm_workers;
+      shm.slow_ms = parsed.slow_ms;
+      if (parsed.flight_dump)
+        shm.flight_dump = *parsed.flight_dump;
+      int code = tv::serve_shm(*parsed.shm_name, shm, parsed.options.debug);
+      save_near_duplicates(parsed);
+      return code;
+    }
+    if (parsed.via_zygote) {
+      int code = tv::zygote_call(*parsed.via_zygote, without_via_zygote(args));
+      if (code >= 0)
+        return code;
+      if (code == -2) { // a local run would see a truncated ticket
+        print_json_error("INTERNAL", "zygote lost during the request");
+        print_out({"\n"});
+        return 3;
+      }
+      if (parsed.options.debug)
+        print_err({"[debug] zygote unreachable, running locally\n"});
+    }
+  }
+  return run_cli(parsed);
+}
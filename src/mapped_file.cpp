@@ -0,0 +1,87 @@
+#include "tv/mapped_file.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace tv {
+
+MappedFile::MappedFile(const std::string &path, const char *what) {
+  auto fail = [&](const char *why) {
+    return std::runtime_error(std::string(what) + ": " + path + ": " + why);
+  };
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw fail(std::strerror(errno));
+  struct stat st {};
+  if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+    ::close(fd);
+    throw fail("truncated");
+  }
+  size_ = static_cast<std::size_t>(st.st_size);
+  void *map = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED)
+    throw fail(std::strerror(errno));
+  // Lookups touch a few random pages each: no read-ahead.
+  ::madvise(map, size_, MADV_RANDOM);
+  data_ = static_cast<const unsigned char *>(map);
+}
+
+MappedFile::~MappedFile() {
+  ::munmap(const_cast<unsigned char *>(data_), size_);
+}
+
+void replace_file(const std::string &path, const char *what,
+                  std::initializer_list<std::string_view> parts,
+                  unsigned mode) {
+  std::string tmp = path + ".XXXXXX";
+  auto fail = [&](const std::string &target) {
+    return std::runtime_error(std::string(what) + ": cannot write " + target +
+                              ": " + std::strerror(errno));
+  };
+  // O_EXCL, mode 0600 until written.
+  int fd = ::mkostemp(tmp.data(), O_CLOEXEC);
+  if (fd < 0)
+    throw fail(path);
+  bool ok = true;
+  for (auto part : parts)
+    ok = ok && write_fd(fd, {part});
+  ok = ok && ::fchmod(fd, mode) == 0;
+  ok = ::close(fd) == 0 && ok;
+  if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+    auto error = fail(ok ? path : tmp);
+    std::remove(tmp.c_str());
+    throw error;
+  }
+}
+
+bool write_fd(int fd, std::initializer_list<std::string_view> parts) {
+  std::string joined;
+  std::string_view data;
+  if (parts.size() == 1) {
+    data = *parts.begin();
+  } else {
+    for (auto part : parts)
+      joined += part;
+    data = joined;
+  }
+  while (!data.empty()) {
+    ssize_t n = ::write(fd, data.data(), data.size());
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      return false;
+    data.remove_prefix(static_cast<std::size_t>(n));
+  }
+  return true;
+}
+
+} // namespace tv
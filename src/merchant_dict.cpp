@@ -0,0 +1,468 @@
+#include "tv/merchant_dict.hpp"
+#include "tv/scan.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+namespace tv {
+
+namespace {
+
+constexpr char MAGIC[8] = {'T', 'V', 'M', 'E', 'R', 'C', 'H', 'D'};
+constexpr std::uint32_t VERSION = 1;
+
+struct FileHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t key_max; // merchant_key_max the file was built with
+  std::uint64_t names;
+  std::uint64_t keys;
+  std::uint64_t buckets; // a power of two
+  std::uint64_t postings;
+  std::uint64_t keys_off;     // Key[keys]
+  std::uint64_t names_off;    // Name[names]
+  std::uint64_t buckets_off;  // uint32_t[buckets + 1], posting ranges
+  std::uint64_t postings_off; // Posting[postings]
+  std::uint64_t strings_off;
+  std::uint64_t strings_size;
+};
+
+struct Key {
+  std::uint32_t text_off;
+  std::uint32_t text_len;
+  std::uint32_t name;
+};
+
+struct Name {
+  std::uint32_t off;
+  std::uint32_t len;
+};
+
+struct Posting {
+  std::uint32_t fingerprint; // high half of the deletion's hash
+  std::uint32_t key;
+};
+
+static_assert(sizeof(Key) == 12 && sizeof(Name) == 8 && sizeof(Posting) == 8,
+              "tables are read in place");
+
+std::uint64_t mix(std::uint64_t x) { // splitmix64 finalizer
+  x ^= x >> 30;
+  x *= 0xBF58476D1CE4E5B9ull;
+  x ^= x >> 27;
+  x *= 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+}
+
+// Polynomial hash, so that the hash of `s` without one or two of its bytes
+// comes from prefix hashes in O(1) instead of rehashing the rest.
+constexpr std::uint64_t K = 0x9E3779B97F4A7C15ull;
+
+// Hashes of `s` and of every string made by deleting up to `distance` (at
+// most 2) of its bytes. Deleting either of two equal neighbours gives the
+// same string: such repeats are reported again.
+void deletion_hashes(std::string_view s, std::uint32_t distance,
+                     std::vector<std::uint64_t> &out) {
+  const std::size_t n = s.size();
+  std::uint64_t prefix[merchant_key_max + 1], power[merchant_key_max + 1];
+  prefix[0] = 0;
+  power[0] = 1;
+  for (std::size_t i = 0; i < n; i++) {
+    prefix[i + 1] = prefix[i] * K + static_cast<unsigned char>(s[i]) + 1;
+    power[i + 1] = power[i] * K;
+  }
+  auto part = [&](std::size_t a, std::size_t b) { // hash of s[a, b)
+    return prefix[b] - prefix[a] * power[b - a];
+  };
+  out.clear();
+  out.push_back(mix(prefix[n]));
+  if (distance >= 1)
+    for (std::size_t i = 0; i < n; i++)
+      out.push_back(mix(part(0, i) * power[n - 1 - i] + part(i + 1, n)));
+  if (distance >= 2)
+    for (std::size_t i = 0; i < n; i++)
+      for (std::size_t j = i + 1; j < n; j++)
+        out.push_back(mix(part(0, i) * power[n - 2 - i] +
+                          part(i + 1, j) * power[n - 1 - j] +
+                          part(j + 1, n)));
+}
+
+// deletion_hashes without the repeats, for the postings of a key.
+void unique_deletion_hashes(std::string_view s, std::uint32_t distance,
+                            std::vector<std::uint64_t> &out) {
+  deletion_hashes(s, distance, out);
+  std::sort(out.begin(), out.end());
+  out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+// Optimal string alignment distance, or max + 1 once it is exceeded. Only
+// the diagonal band |i - j| <= max can stay within `max`: cells outside it
+// are never computed, the two bordering it hold max + 1.
+std::uint32_t bounded_distance(std::string_view a, std::string_view b,
+                               std::uint32_t max) {
+  const std::size_t n = a.size(), m = b.size();
+  if ((n > m ? n - m : m - n) > max)
+    return max + 1;
+  std::uint32_t rows[3][merchant_key_max + 2];
+  std::uint32_t *before = rows[0], *prev = rows[1], *cur = rows[2];
+  for (std::size_t j = 0; j <= m; j++)
+    prev[j] = static_cast<std::uint32_t>(j);
+  for (std::size_t i = 1; i <= n; i++) {
+    const std::size_t lo = i > max ? i - max : 1;
+    const std::size_t hi = std::min(m, i + max);
+    cur[lo - 1] = lo == 1 ? static_cast<std::uint32_t>(i) : max + 1;
+    std::uint32_t best = max + 1;
+    for (std::size_t j = lo; j <= hi; j++) {
+      std::uint32_t cost = a[i - 1] == b[j - 1] ? 0 : 1;
+      std::uint32_t d =
+          std::min({prev[j] + 1, cur[j - 1] + 1, prev[j - 1] + cost});
+      if (i > 1 && j > 1 && a[i - 1] == b[j - 2] && a[i - 2] == b[j - 1])
+        d = std::min(d, before[j - 2] + 1);
+      cur[j] = d;
+      best = std::min(best, d);
+    }
+    if (hi < m)
+      cur[hi + 1] = max + 1;
+    if (best > max)
+      return max + 1;
+    std::uint32_t *t = before;
+    before = prev;
+    prev = cur;
+    cur = t;
+  }
+  return std::min(prev[m], max + 1);
+}
+
+std::string_view trim(std::string_view s) {
+  while (!s.empty() && is_ascii_space(s.front()))
+    s.remove_prefix(1);
+  while (!s.empty() && is_ascii_space(s.back()))
+    s.remove_suffix(1);
+  return s;
+}
+
+[[noreturn]] void invalid(std::size_t line, const std::string &why) {
+  throw std::runtime_error("merchant dictionary: line " +
+                           std::to_string(line) + ": " + why);
+}
+
+template <class T> std::string_view bytes(const std::vector<T> &v) {
+  return std::string_view(reinterpret_cast<const char *>(v.data()),
+                          v.size() * sizeof(T));
+}
+
+} // namespace
+
+std::size_t merchant_key(std::string_view text,
+                         char (&out)[merchant_key_max]) {
+  // Second byte of U+00C0..U+00FF (0xC3 0x80..0xBF), upper and lower case.
+  static constexpr char latin1[] = "AAAAAAACEEEEIIIIDNOOOOO OUUUUY S";
+  std::size_t n = 0;
+  bool space = false;
+  auto put = [&](char c) {
+    if (c == ' ') {
+      space = n > 0;
+      return;
+    }
+    if (space && n < merchant_key_max)
+      out[n++] = ' ';
+    space = false;
+    if (n < merchant_key_max)
+      out[n++] = c;
+  };
+  for (std::size_t i = 0; i < text.size() && n < merchant_key_max; i++) {
+    const auto c = static_cast<unsigned char>(text[i]);
+    if (is_ascii_digit(text[i]) || (c >= 'A' && c <= 'Z')) {
+      put(text[i]);
+    } else if (c >= 'a' && c <= 'z') {
+      put(ascii_upper(text[i]));
+    } else if (c == 0xC3 && i + 1 < text.size() &&
+               (static_cast<unsigned char>(text[i + 1]) & 0xC0) == 0x80) {
+      put(latin1[static_cast<unsigned char>(text[++i]) & 0x1F]);
+    } else if (c == 0xC5 && i + 1 < text.size() &&
+               (text[i + 1] == '\x92' || text[i + 1] == '\x93')) {
+      put('O'); // Œ œ
+      put('E');
+      i++;
+    } else {
+      put(' ');
+    }
+  }
+  while (n > 0 && out[n - 1] == ' ')
+    n--;
+  return n;
+}
+
+// ---- compile ----
+
+std::size_t compile_merchant_dictionary(const std::string &list_path,
+                                        const std::string &out_path) {
+  std::ifstream in(list_path, std::ios::binary);
+  if (!in)
+    throw std::runtime_error("merchant dictionary: cannot read " + list_path);
+
+  std::vector<Key> keys;
+  std::vector<Name> names;
+  std::vector<std::uint32_t> name_lines;
+  std::string strings;
+  std::unordered_map<std::string, std::uint32_t> key_names;
+  std::string raw;
+  for (std::size_t line = 1; std::getline(in, raw); line++) {
+    std::string_view rest = trim(raw);
+    if (rest.empty() || rest.front() == '#')
+      continue;
+    const auto name = static_cast<std::uint32_t>(names.size());
+    bool first = true;
+    while (true) {
+      auto semi = rest.find(';');
+      auto field = trim(rest.substr(0, semi));
+      char key[merchant_key_max];
+      std::size_t len = merchant_key(field, key);
+      if (len == 0)
+        invalid(line, "'" + std::string(field) + "' has no letter or digit");
+      if (first) {
+        names.push_back({static_cast<std::uint32_t>(strings.size()),
+                         static_cast<std::uint32_t>(field.size())});
+        name_lines.push_back(static_cast<std::uint32_t>(line));
+        strings.append(field);
+        first = false;
+      }
+      auto [it, added] = key_names.emplace(std::string(key, len), name);
+      if (added) {
+        keys.push_back({static_cast<std::uint32_t>(strings.size()),
+                        static_cast<std::uint32_t>(len), name});
+        strings.append(key, len);
+      } else if (it->second != name) {
+        invalid(line, "'" + std::string(field) + "' is already a key of line " +
+                          std::to_string(name_lines[it->second]));
+      }
+      if (semi == std::string_view::npos)
+        break;
+      rest.remove_prefix(semi + 1);
+    }
+    if (strings.size() > 0xFFFFFFFFu)
+      invalid(line, "dictionary larger than 4 GB");
+  }
+  key_names = {};
+
+  auto key_text = [&](const Key &k) {
+    return std::string_view(strings).substr(k.text_off, k.text_len);
+  };
+  // Size the buckets from the count before repeats are dropped: about two
+  // postings per bucket.
+  std::uint64_t bound = 0;
+  for (const auto &k : keys)
+    bound += 1 + k.text_len + k.text_len * (k.text_len - 1) / 2;
+  FileHeader h{};
+  std::memcpy(h.magic, MAGIC, sizeof MAGIC);
+  h.version = VERSION;
+  h.key_max = merchant_key_max;
+  h.names = names.size();
+  h.keys = keys.size();
+  h.buckets = 1;
+  while (h.buckets * 2 <= bound)
+    h.buckets *= 2;
+
+  // Postings grouped by bucket: count, prefix sums, fill.
+  std::vector<std::uint64_t> deletions;
+  std::vector<std::uint32_t> start(h.buckets + 1, 0);
+  for (const auto &k : keys) {
+    unique_deletion_hashes(key_text(k), merchant_max_distance(k.text_len),
+                           deletions);
+    for (auto d : deletions)
+      start[(d & (h.buckets - 1)) + 1]++;
+    h.postings += deletions.size();
+    if (h.postings > 0xFFFFFFFFu)
+      throw std::runtime_error("merchant dictionary: too many keys");
+  }
+  for (std::uint64_t b = 0; b < h.buckets; b++)
+    start[b + 1] += start[b];
+  std::vector<Posting> postings(h.postings);
+  {
+    std::vector<std::uint32_t> fill(start.begin(), start.end() - 1);
+    for (std::uint32_t i = 0; i < keys.size(); i++) {
+      unique_deletion_hashes(key_text(keys[i]),
+                             merchant_max_distance(keys[i].text_len),
+                             deletions);
+      for (auto d : deletions)
+        postings[fill[d & (h.buckets - 1)]++] = {
+            static_cast<std::uint32_t>(d >> 32), i};
+    }
+  }
+
+  h.keys_off = sizeof h;
+  h.names_off = h.keys_off + keys.size() * sizeof(Key);
+  h.buckets_off = h.names_off + names.size() * sizeof(Name);
+  h.postings_off = h.buckets_off + start.size() * sizeof(std::uint32_t);
+  h.strings_off = h.postings_off + postings.size() * sizeof(Posting);
+  h.strings_size = strings.size();
+  replace_file(out_path, "merchant dictionary",
+               {std::string_view(reinterpret_cast<const char *>(&h), sizeof h),
+                bytes(keys), bytes(names), bytes(start), bytes(postings),
+                strings});
+  return names.size();
+}
+
+// ---- open / lookup ----
+
+std::shared_ptr<const MerchantDictionary>
+MerchantDictionary::open(const std::string &path) {
+  auto fail = [&](const std::string &why) {
+    return std::runtime_error("merchant dictionary: " + path + ": " + why);
+  };
+  std::shared_ptr<MerchantDictionary> d(new MerchantDictionary);
+  d->file_ = std::make_unique<MappedFile>(path, "merchant dictionary");
+  const std::uint64_t size = d->file_->size();
+  if (size < sizeof(FileHeader))
+    throw fail("truncated");
+
+  FileHeader h;
+  std::memcpy(&h, d->file_->data(), sizeof h);
+  if (std::memcmp(h.magic, MAGIC, sizeof MAGIC) != 0)
+    throw fail("not a compiled merchant dictionary");
+  if (h.version != VERSION || h.key_max != merchant_key_max)
+    throw fail("unsupported merchant dictionary version");
+  // Each table where the previous one ends, as compile writes them.
+  auto table = [&](std::uint64_t off, std::uint64_t count, std::size_t item,
+                   std::uint64_t next) {
+    return off <= size && count <= (size - off) / item &&
+           off + count * item == next;
+  };
+  const bool fits =
+      h.buckets >= 1 && (h.buckets & (h.buckets - 1)) == 0 &&
+      h.keys_off == sizeof h &&
+      table(h.keys_off, h.keys, sizeof(Key), h.names_off) &&
+      table(h.names_off, h.names, sizeof(Name), h.buckets_off) &&
+      h.buckets < size &&
+      table(h.buckets_off, h.buckets + 1, sizeof(std::uint32_t),
+            h.postings_off) &&
+      table(h.postings_off, h.postings, sizeof(Posting), h.strings_off) &&
+      h.strings_off <= size && h.strings_size == size - h.strings_off;
+  if (!fits)
+    throw fail("truncated");
+
+  const unsigned char *base = d->file_->data();
+  d->names_ = h.names;
+  d->keys_ = h.keys;
+  d->buckets_ = h.buckets;
+  d->postings_count_ = h.postings;
+  d->key_table_ = base + h.keys_off;
+  d->name_table_ = base + h.names_off;
+  d->bucket_start_ =
+      reinterpret_cast<const std::uint32_t *>(base + h.buckets_off);
+  d->postings_ = base + h.postings_off;
+  d->strings_ = reinterpret_cast<const char *>(base + h.strings_off);
+  d->strings_size_ = h.strings_size;
+  return d;
+}
+
+std::string_view MerchantDictionary::string(std::uint32_t off,
+                                            std::uint32_t len) const {
+  if (off > strings_size_ || strings_size_ - off < len)
+    return {}; // corrupt table: matches nothing
+  return std::string_view(strings_ + off, len);
+}
+
+std::optional<MerchantLookup>
+MerchantDictionary::find(std::string_view merchant) const {
+  char buf[merchant_key_max];
+  const std::string_view query(buf, merchant_key(merchant, buf));
+  if (query.empty() || keys_ == 0)
+    return std::nullopt;
+
+  // A few hundred deletions, each a bucket then its postings somewhere in
+  // the file: prefetch every bucket before reading any, then every posting
+  // range, so the cache misses overlap instead of queueing.
+  thread_local std::vector<std::uint64_t> deletions;
+  thread_local std::vector<std::uint32_t> found;
+  deletion_hashes(query, merchant_max_distance(query.size()), deletions);
+  for (auto d : deletions)
+    __builtin_prefetch(bucket_start_ + (d & (buckets_ - 1)));
+  for (auto d : deletions) {
+    const std::uint64_t p = bucket_start_[d & (buckets_ - 1)];
+    __builtin_prefetch(postings_ + p * sizeof(Posting));
+  }
+  // Keys sharing a deletion with the merchant.
+  found.clear();
+  for (auto d : deletions) {
+    const std::uint64_t b = d & (buckets_ - 1);
+    const auto fingerprint = static_cast<std::uint32_t>(d >> 32);
+    const std::uint64_t end = std::min<std::uint64_t>(bucket_start_[b + 1],
+                                                      postings_count_);
+    for (std::uint64_t p = bucket_start_[b]; p < end; p++) {
+      Posting posting;
+      std::memcpy(&posting, postings_ + p * sizeof posting, sizeof posting);
+      if (posting.fingerprint == fingerprint && posting.key < keys_)
+        found.push_back(posting.key);
+    }
+  }
+  std::sort(found.begin(), found.end());
+  found.erase(std::unique(found.begin(), found.end()), found.end());
+
+  Key best{};
+  std::uint32_t best_distance = merchant_max_distance(merchant_key_max) + 1;
+  bool ambiguous = false;
+  for (std::uint32_t id : found) { // in dictionary order
+    Key k;
+    std::memcpy(&k, key_table_ + id * sizeof k, sizeof k);
+    auto text = string(k.text_off, k.text_len);
+    if (text.empty() || k.name >= names_)
+      continue;
+    auto max = merchant_max_distance(std::min(query.size(), text.size()));
+    auto distance = bounded_distance(query, text, max);
+    if (distance > max || distance > best_distance)
+      continue;
+    if (distance == best_distance) {
+      ambiguous = ambiguous || k.name != best.name;
+      continue;
+    }
+    best = k;
+    best_distance = distance;
+    ambiguous = false;
+  }
+  if (best_distance > merchant_max_distance(merchant_key_max))
+    return std::nullopt;
+  Name n;
+  std::memcpy(&n, name_table_ + best.name * sizeof n, sizeof n);
+  return MerchantLookup{string(n.off, n.len),
+                        string(best.text_off, best.text_len), best_distance,
+                        ambiguous};
+}
+
+// ---- active dictionary ----
+
+static std::atomic<std::shared_ptr<const MerchantDictionary>> &active() {
+  static std::atomic<std::shared_ptr<const MerchantDictionary>> dictionary;
+  return dictionary;
+}
+
+std::shared_ptr<const MerchantDictionary> active_merchant_dictionary() {
+  return active().load(std::memory_order_acquire);
+}
+
+void set_active_merchant_dictionary(
+    std::shared_ptr<const MerchantDictionary> dictionary) {
+  active().store(std::move(dictionary), std::memory_order_release);
+}
+
+void canonicalize_merchant(ParsedTicket &ticket,
+                           const MerchantDictionary &dictionary) {
+  if (!ticket.merchant.value)
+    return;
+  auto match = dictionary.find(*ticket.merchant.value);
+  if (!match)
+    return;
+  static constexpr double by_distance[] = {0.95, 0.85, 0.7};
+  ticket.merchant_canonical.value =
+      MerchantMatch{std::string(match->name), match->distance};
+  ticket.merchant_canonical.confidence =
+      by_distance[match->distance] - (match->ambiguous ? 0.2 : 0.0);
+  ticket.merchant_canonical.source = "dictionary:" + std::string(match->key);
+}
+
+} // namespace tv
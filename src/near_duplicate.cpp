@@ -0,0 +1,199 @@
+#include "tv/near_duplicate.hpp"
+#include "tv/fingerprint.hpp"
+#include "tv/mapped_file.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+
+namespace tv {
+
+namespace {
+
+constexpr char MAGIC[8] = {'T', 'V', 'N', 'E', 'A', 'R', 'D', 'P'};
+constexpr std::uint32_t VERSION = 1;
+
+struct SnapshotHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t max_distance;
+  std::uint64_t count; // then count fingerprints, in ticket order
+};
+
+constexpr unsigned max_bucket_bits = 20;
+
+} // namespace
+
+NearDuplicateIndex::NearDuplicateIndex(std::uint32_t max_distance)
+    : max_distance_(max_distance) {
+  if (max_distance > max_max_distance)
+    throw std::invalid_argument("near-duplicate distance above " +
+                                std::to_string(max_max_distance));
+  const unsigned n = max_distance + 1;
+  unsigned shift = 0;
+  bands_.resize(n);
+  for (unsigned i = 0; i < n; i++) {
+    Band &b = bands_[i];
+    b.shift = shift;
+    b.bits = 64 / n + (i < 64 % n ? 1 : 0);
+    b.bucket_bits = std::min(b.bits, max_bucket_bits);
+    b.buckets.resize(std::size_t{1} << b.bucket_bits);
+    shift += b.bits;
+  }
+  tickets_.resize(bands_[0].buckets.size());
+}
+
+std::size_t NearDuplicateIndex::size() const {
+  std::shared_lock lock(m_);
+  return static_cast<std::size_t>(count_);
+}
+
+std::optional<NearDuplicate>
+NearDuplicateIndex::find(std::uint64_t fingerprint) const {
+  std::shared_lock lock(m_);
+  return find_locked(fingerprint);
+}
+
+std::uint64_t NearDuplicateIndex::add(std::uint64_t fingerprint) {
+  std::unique_lock lock(m_);
+  return add_locked(fingerprint);
+}
+
+std::optional<NearDuplicate>
+NearDuplicateIndex::find_and_add(std::uint64_t fingerprint) {
+  std::unique_lock lock(m_);
+  auto found = find_locked(fingerprint);
+  add_locked(fingerprint);
+  return found;
+}
+
+std::optional<NearDuplicate>
+NearDuplicateIndex::find_locked(std::uint64_t fingerprint) const {
+  std::uint32_t best = max_distance_ + 1;
+  std::uint64_t best_ticket = 0;
+  for (const Band &band : bands_)
+    for (std::uint64_t other : band.buckets[band.bucket(fingerprint)]) {
+      const std::uint32_t d = fingerprint_distance(fingerprint, other);
+      if (d > best)
+        continue;
+      // A fingerprint sharing several bands is met again: same ticket.
+      const std::uint64_t ticket = ticket_of(other);
+      if (d < best || ticket < best_ticket) {
+        best = d;
+        best_ticket = ticket;
+      }
+    }
+  if (best > max_distance_)
+    return std::nullopt;
+  return NearDuplicate{best_ticket, best};
+}
+
+// First ticket added with exactly this fingerprint (there is one).
+std::uint64_t NearDuplicateIndex::ticket_of(std::uint64_t fingerprint) const {
+  const Band &band = bands_[0];
+  const std::size_t b = band.bucket(fingerprint);
+  const auto &fps = band.buckets[b];
+  auto it = std::find(fps.begin(), fps.end(), fingerprint);
+  return tickets_[b][static_cast<std::size_t>(it - fps.begin())];
+}
+
+std::uint64_t NearDuplicateIndex::add_locked(std::uint64_t fingerprint) {
+  if (count_ > 0xFFFFFFFFu)
+    throw std::length_error("near-duplicate index full");
+  for (Band &band : bands_)
+    band.buckets[band.bucket(fingerprint)].push_back(fingerprint);
+  tickets_[bands_[0].bucket(fingerprint)].push_back(
+      static_cast<std::uint32_t>(count_));
+  return count_++;
+}
+
+void NearDuplicateIndex::save(const std::string &path) const {
+  std::vector<std::uint64_t> fps;
+  SnapshotHeader h{};
+  {
+    std::shared_lock lock(m_);
+    fps.resize(count_);
+    const Band &band = bands_[0];
+    for (std::size_t b = 0; b < band.buckets.size(); b++)
+      for (std::size_t i = 0; i < band.buckets[b].size(); i++)
+        fps[tickets_[b][i]] = band.buckets[b][i];
+    h.count = count_;
+  }
+  std::memcpy(h.magic, MAGIC, sizeof MAGIC);
+  h.version = VERSION;
+  h.max_distance = max_distance_;
+  replace_file(path, "near-duplicate index",
+               {std::string_view(reinterpret_cast<const char *>(&h), sizeof h),
+                std::string_view(reinterpret_cast<const char *>(fps.data()),
+                                 fps.size() * sizeof fps[0])});
+}
+
+std::unique_ptr<NearDuplicateIndex>
+NearDuplicateIndex::load(const std::string &path) {
+  auto fail = [&](const std::string &why) {
+    return std::runtime_error("near-duplicate index: " + path + ": " + why);
+  };
+  std::ifstream in(path, std::ios::binary);
+  if (!in)
+    throw fail("cannot read");
+  SnapshotHeader h;
+  if (!in.read(reinterpret_cast<char *>(&h), sizeof h))
+    throw fail("truncated");
+  if (std::memcmp(h.magic, MAGIC, sizeof MAGIC) != 0)
+    throw fail("not a near-duplicate index");
+  if (h.version != VERSION || h.max_distance > max_max_distance)
+    throw fail("unsupported near-duplicate index version");
+  auto index = std::make_unique<NearDuplicateIndex>(h.max_distance);
+  std::uint64_t buf[4096];
+  for (std::uint64_t left = h.count; left > 0;) {
+    const auto n = static_cast<std::size_t>(
+        std::min<std::uint64_t>(left, std::size(buf)));
+    if (!in.read(reinterpret_cast<char *>(buf), n * sizeof buf[0]))
+      throw fail("truncated");
+    for (std::size_t i = 0; i < n; i++)
+      index->add_locked(buf[i]);
+    left -= n;
+  }
+  if (in.peek() != std::ifstream::traits_type::eof())
+    throw fail("trailing bytes");
+  return index;
+}
+
+// ---- active index ----
+
+static std::atomic<std::shared_ptr<NearDuplicateIndex>> &active() {
+  static std::atomic<std::shared_ptr<NearDuplicateIndex>> index;
+  return index;
+}
+
+std::shared_ptr<NearDuplicateIndex> active_near_duplicates() {
+  return active().load(std::memory_order_acquire);
+}
+
+void set_active_near_duplicates(std::shared_ptr<NearDuplicateIndex> index) {
+  active().store(std::move(index), std::memory_order_release);
+}
+
+void check_near_duplicate(EngineOutput &out, NearDuplicateIndex &index,
+                          const Scoring &scoring) {
+  if (out.input.fingerprint == 0)
+    return;
+  auto found = index.find_and_add(out.input.fingerprint);
+  if (!found)
+    return;
+  out.ticket.warnings.push_back(
+      {"NEAR_DUPLICATE",
+       "Text close to ticket #" + std::to_string(found->ticket) +
+           " seen before (" + std::to_string(found->distance) +
+           " fingerprint bits apart).",
+       "medium"});
+  if (out.status == Status::Ok)
+    out.status = Status::Partial;
+  score_ticket(out, scoring);
+}
+
+} // namespace tv
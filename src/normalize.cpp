@@ -1,62 +1,134 @@
 #include "tv/normalize.hpp"
-#include <cctype>
+#include "tv/scan.hpp"
 
-namespace tv {
+#include <bit>
 
-static inline bool is_space(unsigned char c) { return std::isspace(c) != 0; }
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-NormalizedText normalize_ocr(std::string_view input) {
-  NormalizedText out;
+namespace tv {
 
-  // 1) Drop '\r' (CR) -> normalize newlines
-  std::string s;
-  s.reserve(input.size());
-  for (char ch : input) {
-    if (ch == '\r') continue;
-    s.push_back(ch);
-  }
-  out.applied.push_back("drop_cr");
+// isspace() in the "C" locale, inlined
+static inline bool is_space(unsigned char c) { return is_ascii_space(c); }
 
-  // 2) Trim (leading/trailing whitespace)
-  std::size_t start = 0;
-  while (start < s.size() && is_space((unsigned char)s[start])) start++;
+// First byte at or after `i` that is whitespace or 0xC2 (an NBSP lead), 16
+// bytes at a time where SSE2 is available.
+static std::size_t next_special(std::string_view s, std::size_t i) {
+#if defined(__SSE2__)
+  const __m128i tab = _mm_set1_epi8('\t'), four = _mm_set1_epi8(4),
+                space = _mm_set1_epi8(' '),
+                c2 = _mm_set1_epi8(static_cast<char>(0xC2));
+  for (; i + 16 <= s.size(); i += 16) {
+    __m128i v =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(s.data() + i));
+    // '\t'..'\r': (v - '\t') <= 4, unsigned.
+    __m128i off = _mm_sub_epi8(v, tab);
+    __m128i m = _mm_cmpeq_epi8(_mm_min_epu8(off, four), off);
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, space));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, c2));
+    if (auto bits = static_cast<unsigned>(_mm_movemask_epi8(m)))
+      return i + static_cast<std::size_t>(std::countr_zero(bits));
+  }
+#endif
+  while (i < s.size() && !is_space(static_cast<unsigned char>(s[i])) &&
+         static_cast<unsigned char>(s[i]) != 0xC2)
+    i++;
+  return i;
+}
 
-  std::size_t end = s.size();
-  while (end > start && is_space((unsigned char)s[end - 1])) end--;
+// Single pass over the input, in the order the steps are defined:
+//  1) drop '\r' (CR) -> normalize newlines
+//  2) trim leading/trailing whitespace
+//  3) collapse whitespace runs into single spaces, keeping '\n' as line
+//     separators
+//  4) replace NBSP (U+00A0, C2 A0) with a normal space (common in OCR/text
+//     copy). Matching the 0xA0 byte alone would also hit the tail of
+//     characters like 'à' (C3 A0).
 
-  s = s.substr(start, end - start);
-  out.applied.push_back("trim");
+// Step 4, applied to the output of step 3.
+void Normalizer::emit(char c, std::string &out) {
+  if (pending_c2_) {
+    pending_c2_ = false;
+    if ((unsigned char)c == 0xA0) {
+      out.push_back(' ');
+      return;
+    }
+    out.push_back('\xC2');
+  }
+  if ((unsigned char)c == 0xC2) {
+    pending_c2_ = true;
+    return;
+  }
+  out.push_back(c);
+}
 
-  // 3) Collapse whitespace runs into single spaces, but keep '\n' as line separators
-  std::string t;
-  t.reserve(s.size());
-  bool in_space = false;
+void Normalizer::feed(std::string_view chunk, std::string &out) {
+  out.reserve(out.size() + chunk.size());
+  std::size_t i = 0;
+  while (i < chunk.size()) {
+    // Fast path: a run of plain bytes between two non-space characters.
+    if (pending_ws_.empty() && !pending_c2_ && started_) {
+      std::size_t j = next_special(chunk, i);
+      if (j > i) {
+        out.append(chunk.data() + i, j - i);
+        in_space_ = false;
+        i = j;
+        continue;
+      }
+    }
 
-  for (char ch : s) {
-    if (ch == '\n') {
-      in_space = false;
-      t.push_back('\n');
+    char ch = chunk[i++];
+    if (ch == '\r')
       continue;
-    }
     if (is_space((unsigned char)ch)) {
-      if (!in_space) t.push_back(' ');
-      in_space = true;
-    } else {
-      in_space = false;
-      t.push_back(ch);
+      if (!started_)
+        continue;
+      // A whitespace run is only known to be inner once a non-space
+      // follows it.
+      if (ch == '\n') {
+        in_space_ = false;
+        pending_ws_.push_back('\n');
+      } else if (!in_space_) {
+        in_space_ = true;
+        pending_ws_.push_back(' ');
+      }
+      continue;
     }
+    started_ = true;
+    in_space_ = false;
+    for (char w : pending_ws_)
+      emit(w, out);
+    pending_ws_.clear();
+    emit(ch, out);
   }
-  out.applied.push_back("collapse_spaces");
+}
 
-  // 4) Replace NBSP (0xA0) with normal space (common in OCR/text copy)
-  for (char& ch : t) {
-    if ((unsigned char)ch == 0xA0) ch = ' ';
+void Normalizer::finish(std::string &out) {
+  pending_ws_.clear(); // trailing whitespace
+  if (pending_c2_) {
+    pending_c2_ = false;
+    out.push_back('\xC2');
   }
-  out.applied.push_back("nbsp_to_space");
+}
+
+Normalizer Normalizer::after_text() {
+  Normalizer n;
+  n.started_ = true;
+  return n;
+}
 
-  out.text = std::move(t);
+std::vector<std::string> Normalizer::applied() {
+  return {"drop_cr", "trim", "collapse_spaces", "nbsp_to_space"};
+}
+
+NormalizedText normalize_ocr(std::string_view input) {
+  NormalizedText out;
+  Normalizer n;
+  n.feed(input, out.text);
+  n.finish(out.text);
+  out.applied = Normalizer::applied();
   return out;
 }
 
 } // namespace tv
-
@@ -0,0 +1,136 @@
+#include "tv/parse_company.hpp"
+#include "tv/scan.hpp"
+#include <string>
+
+namespace tv {
+
+namespace {
+
+// Label, gap, 14 digits with a separator between each, and the byte after.
+constexpr std::size_t LOOKAHEAD =
+    5 + CompanyIdScanner::company_id_gap + 2 * 14;
+
+bool all_digits(std::string_view s) {
+  return std::all_of(s.begin(), s.end(), is_ascii_digit);
+}
+
+bool luhn(std::string_view digits) {
+  int sum = 0;
+  for (std::size_t i = 0; i < digits.size(); i++) {
+    int d = digits[digits.size() - 1 - i] - '0';
+    if (i % 2 == 1) {
+      d *= 2;
+      if (d > 9)
+        d -= 9;
+    }
+    sum += d;
+  }
+  return sum % 10 == 0;
+}
+
+} // namespace
+
+bool valid_siren(std::string_view digits) {
+  return digits.size() == 9 && all_digits(digits) && luhn(digits);
+}
+
+bool valid_siret(std::string_view digits) {
+  if (digits.size() != 14 || !all_digits(digits))
+    return false;
+  if (digits.substr(0, 9) == "356000000") {
+    int sum = 0;
+    for (char c : digits)
+      sum += c - '0';
+    return sum % 5 == 0;
+  }
+  return luhn(digits) && luhn(digits.substr(0, 9));
+}
+
+bool CompanyIdScanner::read(std::string_view text, std::size_t p) {
+  static constexpr std::string_view stem = "SIRE";
+  if (text.size() - p < 5)
+    return false;
+  for (std::size_t k = 0; k < stem.size(); k++)
+    if (ascii_upper(text[p + k]) != stem[k])
+      return false;
+  const char last = ascii_upper(text[p + 4]);
+  std::size_t q = p + 5;
+  if ((last != 'T' && last != 'N') ||
+      (q < text.size() && is_word_char(text[q]) && !is_ascii_digit(text[q])))
+    return false;
+
+  const std::size_t gap_end = std::min(text.size(), q + company_id_gap);
+  while (q < gap_end && !is_ascii_digit(text[q]))
+    q++;
+  if (q == gap_end)
+    return false;
+
+  // Digit groups, up to the SIRET's 14 digits. A group ending on the 9th
+  // digit may close a SIREN followed by something else.
+  std::size_t n = 0;
+  bool siren_group = false;
+  for (;;) {
+    for (; q < text.size() && is_ascii_digit(text[q]); q++, n++)
+      if (n < sizeof digits_)
+        digits_[n] = text[q];
+    if (n >= 14)
+      break;
+    siren_group = siren_group || n == 9;
+    if (q + 1 < text.size() && (text[q] == ' ' || text[q] == '.') &&
+        is_ascii_digit(text[q + 1])) {
+      q++;
+      continue;
+    }
+    break;
+  }
+
+  if (n == 14 && valid_siret(std::string_view(digits_, 14)))
+    length_ = 14;
+  else if ((n == 9 || siren_group) && valid_siren(std::string_view(digits_, 9)))
+    length_ = 9;
+  return length_ != 0;
+}
+
+std::size_t CompanyIdScanner::scan(std::string_view text, bool final) {
+  while (!done_ && pos_ < text.size()) {
+    char c = text[pos_];
+    if (c == '\n') {
+      line_++;
+      pos_++;
+    } else if (ascii_upper(c) != 'S' ||
+               (pos_ > 0 && is_word_char(text[pos_ - 1]))) {
+      pos_++;
+    } else if (!final && text.size() - pos_ < LOOKAHEAD) {
+      return pos_;
+    } else if (read(text, pos_)) {
+      done_ = true;
+    } else {
+      pos_++;
+    }
+  }
+  if (final)
+    done_ = true;
+  return done_ ? text.size() : pos_;
+}
+
+void CompanyIdScanner::apply(ParsedTicket &ticket) const {
+  if (length_ == 0)
+    return;
+  Company c;
+  c.siren.assign(digits_, 9);
+  if (length_ == 14) {
+    c.siret.assign(digits_, 14);
+    ticket.signals.has_siret = true;
+  }
+  ticket.company.value = std::move(c);
+  ticket.company.confidence = 0.8;
+  ticket.company.source = "line:" + std::to_string(line_ + 1);
+}
+
+void parse_company(std::string_view text, ParsedTicket &ticket) {
+  CompanyIdScanner sc;
+  sc.scan(text, true);
+  sc.apply(ticket);
+}
+
+} // namespace tv
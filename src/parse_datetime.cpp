@@ -0,0 +1,165 @@
+#include "tv/parse_datetime.hpp"
+#include "tv/scan.hpp"
+#include <string>
+
+namespace tv {
+
+namespace {
+
+// Longest form, "dd/mm/yyyy", and the byte after it.
+constexpr std::size_t LOOKAHEAD = 11;
+
+bool digit_at(std::string_view s, std::size_t i) {
+  return i < s.size() && is_ascii_digit(s[i]);
+}
+
+// Value of the (at most `max`) digits at `i`; returns how many there are.
+std::size_t digits(std::string_view s, std::size_t i, std::size_t max,
+                   int &value) {
+  std::size_t n = 0;
+  value = 0;
+  while (n < max && digit_at(s, i + n)) {
+    value = value * 10 + (s[i + n] - '0');
+    n++;
+  }
+  return n;
+}
+
+int days_in_month(int year, int month) {
+  static constexpr int days[] = {31, 28, 31, 30, 31, 30,
+                                 31, 31, 30, 31, 30, 31};
+  bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+  return month == 2 && leap ? 29 : days[month - 1];
+}
+
+} // namespace
+
+std::size_t DateTimeScanner::number(std::string_view text, std::size_t p) {
+  int lead = 0;
+  std::size_t q = p + digits(text, p, 2, lead);
+  if (digit_at(text, q)) { // longer run: neither a day nor an hour
+    while (digit_at(text, q))
+      q++;
+    return q;
+  }
+  if (q + 1 >= text.size())
+    return q;
+
+  const char sep = text[q];
+  if (sep == '/' || sep == '.') {
+    int month = 0, year = 0;
+    std::size_t r = q + 1 + digits(text, q + 1, 2, month);
+    if (r == q + 1 || digit_at(text, r) || r >= text.size() || text[r] != sep)
+      return q;
+    std::size_t y = digits(text, r + 1, 4, year);
+    std::size_t e = r + 1 + y;
+    if (digit_at(text, e) || !(y == 4 || (y == 2 && sep == '/')))
+      return q;
+    if (y == 2)
+      year += 2000;
+    if (year < 1970 || year > 2099 || month < 1 || month > 12 || lead < 1 ||
+        lead > days_in_month(year, month))
+      return q;
+    if (year_ == 0) {
+      year_ = static_cast<std::uint16_t>(year);
+      month_ = static_cast<std::uint8_t>(month);
+      day_ = static_cast<std::uint8_t>(lead);
+      date_line_ = line_;
+      if (line_time_.valid) {
+        time_ = line_time_;
+        done_ = true;
+      }
+    }
+    return e;
+  }
+
+  if (sep == ':' || sep == 'h' || sep == 'H') {
+    int minute = 0, second = 0;
+    std::size_t e = q + 1;
+    if (digits(text, e, 2, minute) != 2 || digit_at(text, e + 2) ||
+        lead > 23 || minute > 59)
+      return q;
+    e += 2;
+    Time t;
+    t.hour = static_cast<std::uint8_t>(lead);
+    t.minute = static_cast<std::uint8_t>(minute);
+    t.valid = true;
+    if (sep == ':' && e < text.size() && text[e] == ':' &&
+        digits(text, e + 1, 2, second) == 2 && !digit_at(text, e + 3) &&
+        second <= 59) {
+      t.second = static_cast<std::uint8_t>(second);
+      e += 3;
+    }
+    if (year_ != 0) {
+      time_ = t; // the date waits for no other
+      done_ = true;
+    } else if (!line_time_.valid) {
+      line_time_ = t;
+    }
+    return e;
+  }
+  return q;
+}
+
+void DateTimeScanner::end_line() {
+  line_++;
+  line_time_ = {};
+  if (year_ != 0 && line_ > date_line_ + 1)
+    done_ = true; // no time on the date's line or the next
+}
+
+std::size_t DateTimeScanner::scan(std::string_view text, bool final) {
+  while (!done_ && pos_ < text.size()) {
+    char c = text[pos_];
+    if (c == '\n') {
+      end_line();
+      pos_++;
+    } else if (!is_ascii_digit(c) ||
+               (pos_ > 0 && is_ascii_digit(text[pos_ - 1]))) {
+      pos_++;
+    } else if (!final && text.size() - pos_ < LOOKAHEAD) {
+      return pos_;
+    } else {
+      pos_ = number(text, pos_);
+    }
+  }
+  if (final)
+    done_ = true;
+  return done_ ? text.size() : pos_;
+}
+
+void DateTimeScanner::apply(ParsedTicket &ticket) const {
+  if (year_ == 0)
+    return;
+  char buf[19];
+  auto put = [&](std::size_t at, int v, int width) {
+    for (int k = width - 1; k >= 0; k--, v /= 10)
+      buf[at + k] = static_cast<char>('0' + v % 10);
+  };
+  put(0, year_, 4);
+  buf[4] = '-';
+  put(5, month_, 2);
+  buf[7] = '-';
+  put(8, day_, 2);
+  std::size_t len = 10;
+  if (time_.valid) {
+    buf[10] = 'T';
+    put(11, time_.hour, 2);
+    buf[13] = ':';
+    put(14, time_.minute, 2);
+    buf[16] = ':';
+    put(17, time_.second, 2);
+    len = 19;
+  }
+  ticket.datetime_iso.value = std::string(buf, len);
+  ticket.datetime_iso.confidence = time_.valid ? 0.9 : 0.7;
+  ticket.datetime_iso.source = "line:" + std::to_string(date_line_ + 1);
+}
+
+void parse_datetime(std::string_view text, ParsedTicket &ticket) {
+  DateTimeScanner sc;
+  sc.scan(text, true);
+  sc.apply(ticket);
+}
+
+} // namespace tv
@@ -0,0 +1,244 @@
+#include "tv/parse_items.hpp"
+#include <cmath>
+#include <cstdio>
+#include <optional>
+#include <string>
+
+namespace tv {
+
+namespace {
+
+struct Amount {
+  std::size_t begin = 0; // in the line
+  double value = 0.0;
+};
+
+bool is_ascii_alpha(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+std::string_view trim_right(std::string_view s) {
+  while (!s.empty() && s.back() == ' ')
+    s.remove_suffix(1);
+  return s;
+}
+
+std::string_view trim(std::string_view s) {
+  while (!s.empty() && s.front() == ' ')
+    s.remove_prefix(1);
+  return trim_right(s);
+}
+
+bool ends_with_nocase(std::string_view s, std::string_view suffix) {
+  if (suffix.empty() || suffix.size() > s.size())
+    return false;
+  auto tail = s.substr(s.size() - suffix.size());
+  for (std::size_t i = 0; i < suffix.size(); i++)
+    if (ascii_upper(tail[i]) != ascii_upper(suffix[i]))
+      return false;
+  return true;
+}
+
+// Amount with exactly two decimals ending `s`: [-]d{1,7}[.,]dd, preceded by
+// a space or the start of `s`.
+std::optional<Amount> amount_before(std::string_view s) {
+  std::size_t e = s.size();
+  if (e < 4 || !is_ascii_digit(s[e - 1]) || !is_ascii_digit(s[e - 2]) ||
+      (s[e - 3] != ',' && s[e - 3] != '.'))
+    return std::nullopt;
+  std::size_t b = e - 3;
+  while (b > 0 && e - 3 - b < 7 && is_ascii_digit(s[b - 1]))
+    b--;
+  if (b == e - 3)
+    return std::nullopt;
+  if (b > 0 && is_ascii_digit(s[b - 1]))
+    return std::nullopt; // more than 7 integer digits: not a price
+  Amount a;
+  for (std::size_t i = b; i < e - 3; i++)
+    a.value = a.value * 10 + (s[i] - '0');
+  a.value += ((s[e - 2] - '0') * 10 + (s[e - 1] - '0')) / 100.0;
+  if (b > 0 && s[b - 1] == '-') {
+    a.value = -a.value;
+    b--;
+  }
+  if (b > 0 && s[b - 1] != ' ')
+    return std::nullopt;
+  a.begin = b;
+  return a;
+}
+
+// Leading quantity: "2 x ", "2x ", "2 * " or "2 " before a letter. Returns
+// the quantity and moves `label` past it.
+std::optional<int> quantity_prefix(std::string_view &label) {
+  std::size_t i = 0;
+  int qty = 0;
+  while (i < label.size() && i < 3 && is_ascii_digit(label[i]))
+    qty = qty * 10 + (label[i++] - '0');
+  if (i == 0 || qty == 0 || (i < label.size() && is_ascii_digit(label[i])))
+    return std::nullopt;
+  std::size_t j = i;
+  while (j < label.size() && label[j] == ' ')
+    j++;
+  if (j < label.size() &&
+      (label[j] == 'x' || label[j] == 'X' || label[j] == '*') &&
+      j + 1 < label.size() && label[j + 1] == ' ') {
+    label = trim(label.substr(j + 2));
+    return qty;
+  }
+  if (j > i && i <= 2 && j < label.size() &&
+      (is_ascii_alpha(label[j]) || static_cast<unsigned char>(label[j]) >= 0xC0)) {
+    label = label.substr(j);
+    return qty;
+  }
+  return std::nullopt;
+}
+
+// Trailing "qty x unit price" of a label; moves `label` before it.
+std::optional<std::pair<int, double>> unit_suffix(std::string_view &label) {
+  auto unit = amount_before(label);
+  if (!unit || unit->begin < 2 || unit->value <= 0)
+    return std::nullopt;
+  auto rest = trim_right(label.substr(0, unit->begin));
+  if (rest.size() < 3 ||
+      (rest.back() != 'x' && rest.back() != 'X' && rest.back() != '*') ||
+      rest[rest.size() - 2] != ' ')
+    return std::nullopt;
+  rest = trim_right(rest.substr(0, rest.size() - 2));
+  std::size_t b = rest.size();
+  int qty = 0, scale = 1;
+  while (b > 0 && rest.size() - b < 3 && is_ascii_digit(rest[b - 1])) {
+    qty += (rest[b - 1] - '0') * scale;
+    scale *= 10;
+    b--;
+  }
+  if (b == rest.size() || qty == 0 || (b > 0 && rest[b - 1] != ' '))
+    return std::nullopt;
+  label = trim_right(rest.substr(0, b));
+  return std::pair{qty, unit->value};
+}
+
+std::string format_amount(double v) {
+  char buf[32];
+  std::snprintf(buf, sizeof buf, "%.2f", v);
+  return buf;
+}
+
+} // namespace
+
+ItemScanner::ItemScanner(const RuleSet &rules)
+    : rules_(&rules), total_(rules.total_keywords), card_(rules.card_keywords),
+      tax_(rules.tax_keywords), id_labels_(rules.company_id_keywords) {}
+
+void ItemScanner::classify(std::string_view line) {
+  if (total_.find(line, 0, true)) {
+    done_ = true; // end of the item section
+    return;
+  }
+
+  // Price column, from the right: [code] [currency] amount.
+  auto rest = trim(line);
+  if (rest.size() >= 2 && is_ascii_alpha(rest.back()) &&
+      rest[rest.size() - 2] == ' ')
+    rest = trim_right(rest.substr(0, rest.size() - 2));
+  for (auto marker : rules_->currency_markers)
+    if (ends_with_nocase(rest, marker)) {
+      rest = trim_right(rest.substr(0, rest.size() - marker.size()));
+      break;
+    }
+  auto price = amount_before(rest);
+  if (!price || price->begin == 0)
+    return;
+  auto label = trim(rest.substr(0, price->begin));
+
+  if (card_.find(line, 0, true) || tax_.find(line, 0, true) ||
+      id_labels_.find(line, 0, true))
+    return;
+
+  Item item;
+  item.total = price->value;
+  auto qty = quantity_prefix(label);
+  auto unit = unit_suffix(label);
+  int letters = 0;
+  for (char c : label)
+    letters += is_ascii_alpha(c) || static_cast<unsigned char>(c) >= 0xC0;
+  if (letters < 2)
+    return;
+
+  item.label = std::string(label);
+  item.confidence = 0.6;
+  if (unit) {
+    item.qty = unit->first;
+    item.unit_price = unit->second;
+    bool agrees = std::abs(unit->first * unit->second - price->value) < 0.005;
+    if (qty && *qty != unit->first)
+      agrees = false;
+    item.confidence = agrees ? 0.8 : 0.4;
+  } else if (qty) {
+    item.qty = *qty;
+    item.unit_price = price->value / *qty;
+  } else {
+    item.unit_price = price->value;
+  }
+  item.source = "line:" + std::to_string(line_ + 1);
+  items_.push_back(std::move(item));
+}
+
+std::size_t ItemScanner::scan(std::string_view text, bool final) {
+  while (!done_) {
+    auto nl = text.find('\n', pos_);
+    std::size_t end = nl == std::string_view::npos ? text.size() : nl;
+    if (!skip_line_ && end - pos_ > item_line_max)
+      skip_line_ = true;
+    if (nl == std::string_view::npos && !final) {
+      if (skip_line_)
+        pos_ = text.size(); // nothing of it is needed
+      return pos_;
+    }
+    if (!skip_line_)
+      classify(text.substr(pos_, end - pos_));
+    skip_line_ = false;
+    line_++;
+    if (nl == std::string_view::npos)
+      done_ = true;
+    else
+      pos_ = nl + 1;
+  }
+  pos_ = text.size();
+  return pos_;
+}
+
+void ItemScanner::apply(ParsedTicket &ticket) const {
+  if (items_.empty())
+    return;
+  ticket.items = items_;
+  if (!ticket.total.value)
+    return;
+
+  double sum = 0.0;
+  for (const auto &item : items_)
+    sum += item.total.value_or(0.0);
+  const double total = ticket.total.value->value;
+  if (std::abs(sum - total) < 0.005) {
+    for (auto &item : ticket.items)
+      item.confidence = std::min(0.95, item.confidence + 0.15);
+    return;
+  }
+  ticket.warnings.push_back(
+      {"ITEMS_TOTAL_MISMATCH",
+       "Items sum to " + format_amount(sum) + ", total is " +
+           format_amount(total) + ".",
+       "low"});
+}
+
+void parse_items(std::string_view text, ParsedTicket &ticket,
+                 const RuleSet &rules) {
+  ItemScanner sc(rules);
+  sc.scan(text, true);
+  sc.apply(ticket);
+}
+
+void parse_items(std::string_view text, ParsedTicket &ticket) {
+  parse_items(text, ticket, default_rules);
+}
+
+} // namespace tv
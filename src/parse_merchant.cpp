@@ -1,186 +1,181 @@
 #include "tv/parse_merchant.hpp"
 #include <algorithm>
+#include <array>
 #include <cctype>
 #include <string>
-#include <vector>
 
 namespace tv {
 
-static bool has_lower(const std::string &s) {
-  for (char c : s)
-    if (std::islower((unsigned char)c))
-      return true;
-  return false;
-}
+// The header is indexed into a fixed array of views.
+static constexpr std::size_t MAX_LINES = merchant_header_lines;
+
+// Per-line features, computed once per header line.
+struct HeaderLine {
+  std::string_view text; // trimmed view into the input
+  int letters = 0;
+  int digits = 0;
+  bool lower = false;
+  bool generic = false;
+};
 
-static std::string trim(const std::string &s) {
+static std::string_view trim(std::string_view s) {
   auto b = s.find_first_not_of(" \t");
-  if (b == std::string::npos)
+  if (b == std::string_view::npos)
     return {};
   auto e = s.find_last_not_of(" \t");
   return s.substr(b, e - b + 1);
 }
 
-static bool has_digit(const std::string &s) {
-  for (char c : s)
-    if (std::isdigit((unsigned char)c))
+static bool contains_any(std::string_view line, Keywords words) {
+  for (auto w : words) {
+    if (line.find(w) != std::string_view::npos)
       return true;
+  }
   return false;
 }
 
-static std::string normalize_spaces(const std::string &s) {
-  std::string out;
-  bool prev_space = false;
-  for (char c : s) {
-    if (std::isspace((unsigned char)c)) {
-      if (!prev_space)
-        out.push_back(' ');
-      prev_space = true;
-    } else {
-      out.push_back(c);
-      prev_space = false;
+static HeaderLine scan_line(std::string_view line, Keywords blacklist) {
+  HeaderLine h;
+  h.text = line;
+  for (char c : line) {
+    unsigned char u = static_cast<unsigned char>(c);
+    if (std::isalpha(u)) {
+      h.letters++;
+      if (std::islower(u))
+        h.lower = true;
+    } else if (std::isdigit(u)) {
+      h.digits++;
     }
   }
-  return trim(out);
+  h.generic = contains_any(line, blacklist);
+  return h;
 }
 
-static bool is_generic_line(const std::string &line) {
-  static const std::vector<std::string> blacklist = {
-      "MERCI", "TICKET", "CLIENT", "TOTAL",     "A PAYER", "NET",
-      "TVA",   "SIRET",  "CB",     "BIENVENUE", "BONJOUR", "AU REVOIR"};
-  for (const auto &w : blacklist) {
-    if (line.find(w) != std::string::npos)
-      return true;
-  }
-  return false;
-}
-
-static double letter_ratio(const std::string &s) {
-  int letters = 0, digits = 0;
-  for (char c : s) {
-    if (std::isalpha((unsigned char)c))
-      letters++;
-    else if (std::isdigit((unsigned char)c))
-      digits++;
-  }
+static double letter_ratio(int letters, int digits) {
   int total = letters + digits;
   if (total == 0)
     return 0.0;
   return static_cast<double>(letters) / total;
 }
 
-// Accept a short first line only if it looks like a business keyword
-// to avoid picking cities like "RENNES".
-static bool is_business_keyword_shortline(const std::string &line) {
-  // keep it tiny (MVP), enough for your real ticket
-  static const std::vector<std::string> keywords = {
-      "CAFE", "CAFÉ", "BAR", "RESTO", "RESTAURANT", "BRASSERIE"};
-  for (const auto &k : keywords) {
-    if (line.find(k) != std::string::npos)
-      return true;
+// A line that may follow the first line of a candidate (merge or short-line
+// continuation).
+static bool is_continuation(const HeaderLine &h) {
+  return !h.generic && h.digits == 0 && h.text.size() >= 3 &&
+         letter_ratio(h.letters, h.digits) >= 0.8 &&
+         !h.lower; // stop slogans like "café de quartier"
+}
+
+// Appends `s` collapsing whitespace runs to a single space; leading spaces
+// are dropped, the caller pops a trailing one.
+static void append_collapsed(std::string &out, std::string_view s) {
+  for (char c : s) {
+    if (std::isspace(static_cast<unsigned char>(c))) {
+      if (!out.empty() && out.back() != ' ')
+        out.push_back(' ');
+    } else {
+      out.push_back(c);
+    }
   }
-  return false;
 }
 
-void parse_merchant(std::string_view text, ParsedTicket &ticket) {
-  std::vector<std::string> lines;
+void parse_merchant(std::string_view text, ParsedTicket &ticket,
+                    const RuleSet &rules) {
+  text = text.substr(0, merchant_header_bytes);
+  std::array<HeaderLine, MAX_LINES> lines;
+  std::size_t n_lines = 0;
   {
-    std::string cur;
-    for (char c : text) {
-      if (c == '\n') {
-        auto t = trim(cur);
-        if (!t.empty())
-          lines.push_back(t);
-        cur.clear();
-      } else {
-        cur.push_back(c);
-      }
+    std::size_t pos = 0;
+    while (pos <= text.size() && n_lines < MAX_LINES) {
+      auto nl = text.find('\n', pos);
+      auto end = (nl == std::string_view::npos) ? text.size() : nl;
+      auto t = trim(text.substr(pos, end - pos));
+      if (!t.empty())
+        lines[n_lines++] = scan_line(t, rules.merchant_blacklist);
+      if (nl == std::string_view::npos)
+        break;
+      pos = nl + 1;
     }
-    auto t = trim(cur);
-    if (!t.empty())
-      lines.push_back(t);
   }
 
-  const size_t MAX_LINES = 5;
-  std::string merged;
+  // Best candidate as a range of header lines [best_first, best_first +
+  // best_count).
+  std::size_t best_first = 0;
+  std::size_t best_count = 0;
   double best_score = 0.0;
 
-  for (size_t i = 0; i < lines.size() && i < MAX_LINES; ++i) {
+  for (std::size_t i = 0; i < n_lines; ++i) {
     const auto &line = lines[i];
 
-    if (is_generic_line(line))
+    if (line.generic)
       continue;
-    if (has_digit(line))
+    if (line.digits > 0)
       continue;
 
-    double score = letter_ratio(line);
+    double score = letter_ratio(line.letters, line.digits);
     if (score < 0.8)
       continue;
 
-    const bool short_line = line.size() < 8;
+    const bool short_line = line.text.size() < 8;
 
     // Default rule: ignore short lines (avoid cities like "RENNES")
     // Exception: accept short line only if it is a business keyword AND
     // it can be merged with the next line.
     if (short_line) {
-      if (!is_business_keyword_shortline(line))
-        continue;
-      if (i + 1 >= lines.size() || (i + 1) >= MAX_LINES)
-        continue;
-
-      const auto &next = lines[i + 1];
-      if (is_generic_line(next))
-        continue;
-      if (has_digit(next))
+      if (!contains_any(line.text, rules.business_keywords))
         continue;
-      if (next.size() < 3)
+      if (i + 1 >= n_lines)
         continue;
-      if (letter_ratio(next) < 0.8)
+      if (!is_continuation(lines[i + 1]))
         continue;
-      if (has_lower(next))
-        continue; // stop slogans like "café de quartier"
     }
 
-    // start candidate from this line
-    std::string candidate = line;
-
     // merge next consecutive plausible lines (max 2 lines total)
-    int merged_lines = 1;
-    for (size_t j = i + 1; j < lines.size() && j < MAX_LINES; ++j) {
-      if (merged_lines >= 2)
-        break;
-
-      const auto &next = lines[j];
-      if (is_generic_line(next))
-        break;
-      if (has_digit(next))
-        break;
-      if (next.size() < 3)
-        break;
-      if (letter_ratio(next) < 0.8)
-        break;
-      if (has_lower(next))
-        break; // don't merge slogans / mixed-case lines
-
-      candidate += " ";
-      candidate += next;
-      merged_lines++;
+    std::size_t count = 1;
+    int letters = line.letters;
+    int digits = line.digits;
+    if (i + 1 < n_lines && is_continuation(lines[i + 1])) {
+      letters += lines[i + 1].letters;
+      digits += lines[i + 1].digits;
+      count = 2;
     }
 
-    candidate = normalize_spaces(candidate);
-    double cand_score = letter_ratio(candidate);
-
+    double cand_score = letter_ratio(letters, digits);
     if (cand_score > best_score) {
       best_score = cand_score;
-      merged = candidate;
+      best_first = i;
+      best_count = count;
     }
   }
 
+  if (best_count == 0)
+    return;
+
+  // Materialize the winning span only.
+  std::string merged;
+  {
+    std::size_t cap = 0;
+    for (std::size_t k = 0; k < best_count; ++k)
+      cap += lines[best_first + k].text.size() + 1;
+    merged.reserve(cap);
+  }
+  for (std::size_t k = 0; k < best_count; ++k) {
+    if (k > 0)
+      append_collapsed(merged, " ");
+    append_collapsed(merged, lines[best_first + k].text);
+  }
+  if (!merged.empty() && merged.back() == ' ')
+    merged.pop_back();
+
   if (!merged.empty()) {
-    ticket.merchant.value = merged;
+    ticket.merchant.value = std::move(merged);
     ticket.merchant.confidence = std::min(0.95, 0.6 + best_score * 0.35);
     ticket.merchant.source = "heuristic:merged_header_lines";
   }
 }
 
+void parse_merchant(std::string_view text, ParsedTicket &ticket) {
+  parse_merchant(text, ticket, default_rules);
+}
+
 } // namespace tv
@@ -1,10 +1,10 @@
 #include "tv/parse_total.hpp"
-#include <regex>
+#include <algorithm>
 #include <string>
 
 namespace tv {
 
-static std::optional<double> parse_amount(const std::string &s) {
+static std::optional<double> parse_amount(std::string_view s) {
   std::string x;
   x.reserve(s.size());
   for (char c : s) {
@@ -31,27 +31,139 @@ static std::optional<double> parse_amount(const std::string &s) {
   }
 }
 
-void parse_total(std::string_view text, ParsedTicket &ticket) {
-  static const std::regex re(
-      R"((TOTAL(\s+TTC)?|NET\s+A\s+PAYER|A\s+PAYER)\s*[:\-]?\s*(?:€|EUR)?\s*([0-9]{1,3}(?:[ .][0-9]{3})*(?:[.,][0-9]{1,2})?))",
-      std::regex::icase);
-
-  using It = std::string_view::const_iterator;
-  std::match_results<It> m;
-
-  if (std::regex_search(text.begin(), text.end(), m, re)) {
-    std::string amount_str = m[3].str();
-    auto amount = parse_amount(amount_str);
-    if (amount) {
-      Money money;
-      money.value = *amount;
-      money.currency = "EUR";
-
-      ticket.total.value = money;
-      ticket.total.confidence = 0.85;
-      ticket.total.source = "regex:TOTAL";
+static std::size_t skip_spaces(std::string_view text, std::size_t i) {
+  while (i < text.size() && is_ascii_space(text[i]))
+    i++;
+  return i;
+}
+
+static bool digits_at(std::string_view text, std::size_t i, std::size_t n) {
+  if (i + n > text.size())
+    return false;
+  for (std::size_t k = 0; k < n; k++)
+    if (!is_ascii_digit(text[i + k]))
+      return false;
+  return true;
+}
+
+// Amount starting at a digit: 1-3 digits, then " ddd"/".ddd" groups, then
+// an optional ",d"/".dd" decimal part. Returns its end.
+static std::size_t amount_end(std::string_view text, std::size_t i) {
+  std::size_t lead = 0;
+  while (lead < 3 && i < text.size() && is_ascii_digit(text[i])) {
+    i++;
+    lead++;
+  }
+  while (i < text.size() && (text[i] == ' ' || text[i] == '.') &&
+         digits_at(text, i + 1, 3))
+    i += 4;
+  if (i < text.size() && (text[i] == '.' || text[i] == ',') &&
+      digits_at(text, i + 1, 1)) {
+    i += 2;
+    if (i < text.size() && is_ascii_digit(text[i]))
+      i++;
+  }
+  return i;
+}
+
+// Longest lookahead amount_end() may need past the amount it returns.
+static constexpr std::size_t AMOUNT_LOOKAHEAD = 4;
+
+// What may follow an amount label: [:-], a currency marker, then the
+// amount, with optional whitespace in between. Returns the amount; with
+// final == false, *more is set when the text ends too early to tell.
+static std::optional<std::string_view> match_amount(std::string_view text,
+                                                    std::size_t i,
+                                                    const RuleSet &rules,
+                                                    bool final, bool *more) {
+  *more = false;
+  auto open = [&](std::size_t at) { return !final && at >= text.size(); };
+  auto pending = [&] {
+    *more = true;
+    return std::nullopt;
+  };
+
+  i = skip_spaces(text, i);
+  if (open(i))
+    return pending();
+  if (i < text.size() && (text[i] == ':' || text[i] == '-'))
+    i++;
+  i = skip_spaces(text, i);
+  for (auto marker : rules.currency_markers) {
+    auto e = match_phrase(text, i, marker, final);
+    if (e == need_more)
+      return pending();
+    if (e != std::string_view::npos) {
+      i = e;
+      break;
     }
   }
+  i = skip_spaces(text, i);
+  if (open(i))
+    return pending();
+  if (i >= text.size() || !is_ascii_digit(text[i]))
+    return std::nullopt;
+  auto e = amount_end(text, i);
+  if (open(e + AMOUNT_LOOKAHEAD))
+    return pending();
+  return text.substr(i, e - i);
+}
+
+TotalScanner::TotalScanner(const RuleSet &rules)
+    : rules_(&rules), labels_(rules.total_keywords) {}
+
+// Leftmost label followed by an amount; at one position, labels are tried
+// in table order ("TOTAL TTC" before "TOTAL").
+std::size_t TotalScanner::scan(std::string_view text, bool final) {
+  if (done_)
+    return text.size();
+  for (std::size_t pos = labels_.next_candidate(text, pos_);
+       pos != std::string_view::npos;
+       pos = labels_.next_candidate(text, pos + 1)) {
+    for (auto label : labels_.phrases()) {
+      auto end = match_phrase(text, pos, label, final);
+      bool more = end == need_more;
+      std::optional<std::string_view> amount_str;
+      if (!more && end != std::string_view::npos)
+        amount_str = match_amount(text, end, *rules_, final, &more);
+      if (more) {
+        pos_ = pos;
+        return pos_;
+      }
+      if (!amount_str)
+        continue;
+
+      amount_ = parse_amount(*amount_str);
+      done_ = true;
+      return text.size();
+    }
+  }
+  pos_ = text.size();
+  done_ = final;
+  return pos_;
+}
+
+void TotalScanner::apply(ParsedTicket &ticket) const {
+  if (!amount_)
+    return;
+  Money money;
+  money.value = *amount_;
+  money.currency = std::string(rules_->currency);
+
+  ticket.total.value = money;
+  ticket.total.confidence = 0.85;
+  ticket.total.source = "regex:TOTAL"; // kept for output compatibility
+}
+
+void parse_total(std::string_view text, ParsedTicket &ticket,
+                 const RuleSet &rules) {
+  TotalScanner sc(rules);
+  sc.scan(text, true);
+  sc.apply(ticket);
+}
+
+void parse_total(std::string_view text, ParsedTicket &ticket) {
+  parse_total(text, ticket, default_rules);
 }
 
 } // namespace tv
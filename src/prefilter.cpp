@@ -0,0 +1,107 @@
+#include "tv/prefilter.hpp"
+
+#include <algorithm>
+#include <bit>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace tv {
+
+// Whitespace stands for itself in a phrase only through ' ' (any run of
+// whitespace), so all of it folds to ' '.
+static char fold(char c) { return is_ascii_space(c) ? ' ' : ascii_upper(c); }
+
+// Index into a table of `size` entries, a power of two.
+static std::size_t pair_hash(char a, char b, std::size_t size) {
+  auto h = static_cast<std::size_t>(static_cast<unsigned char>(fold(a))) * 31 +
+           static_cast<unsigned char>(fold(b));
+  return h & (size - 1);
+}
+
+KeywordPrefilter::KeywordPrefilter(const RuleSet &rules) {
+  const Keywords tables[] = {rules.total_keywords, rules.card_keywords,
+                             rules.tax_keywords, rules.company_id_keywords};
+  for (std::size_t t = 0; t < 4; t++) {
+    auto bit = static_cast<std::uint8_t>(1u << t);
+    for (auto phrase : tables[t]) {
+      if (phrase.size() < 2 || is_ascii_space(phrase[0])) {
+        unfiltered_ |= bit;
+        continue;
+      }
+      pairs_[pair_hash(phrase[0], phrase[1], pairs_.size())] |= bit;
+      char c = fold(phrase[0]);
+      if (!first_[static_cast<unsigned char>(c)]) {
+        first_[static_cast<unsigned char>(c)] = true;
+        firsts_.push_back(c);
+      }
+    }
+  }
+}
+
+void KeywordPrefilter::scan(std::string_view text, KeywordSpans &out) const {
+  CandidateSpans *spans[] = {&out.total, &out.card, &out.tax,
+                             &out.company_id};
+  for (auto *s : spans)
+    s->clear();
+
+  std::size_t line = 0; // start of the current line
+  std::uint8_t flags = 0;
+  auto end_line = [&](std::size_t end) {
+    for (std::size_t t = 0; t < 4; t++) {
+      if (!(flags & (1u << t)))
+        continue;
+      auto &s = *spans[t];
+      if (!s.empty() && s.back().end == line)
+        s.back().end = end;
+      else
+        s.push_back({line, end});
+    }
+    flags = 0;
+    line = end;
+  };
+  // A '\n' or a byte some phrase starts with.
+  auto visit = [&](std::size_t p) {
+    if (text[p] == '\n')
+      end_line(p + 1);
+    else if (p + 1 < text.size())
+      flags |= pairs_[pair_hash(text[p], text[p + 1], pairs_.size())];
+  };
+
+  std::size_t i = 0;
+#if defined(__SSE2__)
+  if (firsts_.size() <= 16) {
+    __m128i firsts[16];
+    for (std::size_t k = 0; k < firsts_.size(); k++)
+      firsts[k] = _mm_set1_epi8(firsts_[k]);
+    const __m128i a = _mm_set1_epi8('a'), z = _mm_set1_epi8('z' - 'a'),
+                  bit5 = _mm_set1_epi8(0x20), nl = _mm_set1_epi8('\n');
+    for (; i + 16 <= text.size(); i += 16) {
+      __m128i v =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(text.data() + i));
+      // 'a'..'z' to upper case: (v - 'a') <= 25, unsigned.
+      __m128i off = _mm_sub_epi8(v, a);
+      __m128i lower = _mm_cmpeq_epi8(_mm_min_epu8(off, z), off);
+      __m128i up = _mm_sub_epi8(v, _mm_and_si128(lower, bit5));
+      __m128i hit = _mm_cmpeq_epi8(v, nl);
+      for (std::size_t k = 0; k < firsts_.size(); k++)
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(up, firsts[k]));
+      for (auto bits = static_cast<unsigned>(_mm_movemask_epi8(hit)); bits;
+           bits &= bits - 1)
+        visit(i + static_cast<std::size_t>(std::countr_zero(bits)));
+    }
+  }
+#endif
+  for (; i < text.size(); i++)
+    if (text[i] == '\n' || first_[static_cast<unsigned char>(fold(text[i]))])
+      visit(i);
+  if (line < text.size())
+    end_line(text.size());
+
+  for (std::size_t t = 0; t < 4; t++)
+    if (unfiltered_ & (1u << t))
+      *spans[t] = {{0, text.size()}};
+}
+
+} // namespace tv
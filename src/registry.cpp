@@ -0,0 +1,422 @@
+#include "tv/registry.hpp"
+#include "tv/parse_company.hpp"
+#include "tv/scan.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace tv {
+
+namespace {
+
+constexpr char MAGIC[8] = {'T', 'V', 'R', 'E', 'G', 'I', 'S', 'T'};
+constexpr std::uint32_t VERSION = 1;
+// Pilots with this bit set hold the slot of a one-key bucket directly.
+constexpr std::uint32_t DIRECT = 0x80000000u;
+// Keeps SIRET keys apart from SIREN ones (both fit in 47 bits).
+constexpr std::uint64_t SIRET_BIT = std::uint64_t{1} << 62;
+
+struct FileHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t slot_size;
+  std::uint64_t count;
+  std::uint64_t buckets;
+  std::uint64_t seed;
+  std::uint64_t pilots_off; // uint32_t[buckets]
+  std::uint64_t slots_off;  // Slot[count]
+  std::uint64_t strings_off;
+  std::uint64_t strings_size;
+};
+
+struct Slot {
+  std::uint64_t key;
+  std::uint64_t name_off; // into the strings; the trade name follows
+  std::uint16_t name_len;
+  std::uint16_t trade_len;
+  char naf[6]; // NUL-padded
+  char reserved[6];
+};
+static_assert(sizeof(Slot) == 32, "slots are read in place");
+
+std::uint64_t mix(std::uint64_t x) { // splitmix64 finalizer
+  x ^= x >> 30;
+  x *= 0xBF58476D1CE4E5B9ull;
+  x ^= x >> 27;
+  x *= 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+}
+
+// [0, n) from a 64-bit hash, without a division.
+std::uint64_t range(std::uint64_t h, std::uint64_t n) {
+  return static_cast<std::uint64_t>((static_cast<unsigned __int128>(h) * n) >>
+                                    64);
+}
+
+std::uint64_t slot_of(std::uint64_t h, std::uint32_t pilot, std::uint64_t n) {
+  return range(mix(h ^ (pilot * 0x9E3779B97F4A7C15ull)), n);
+}
+
+std::uint64_t key_of(std::string_view digits) {
+  std::uint64_t v = 0;
+  for (char c : digits)
+    v = v * 10 + static_cast<std::uint64_t>(c - '0');
+  return digits.size() == 14 ? v | SIRET_BIT : v;
+}
+
+std::string_view trim(std::string_view s) {
+  while (!s.empty() && is_ascii_space(s.front()))
+    s.remove_prefix(1);
+  while (!s.empty() && is_ascii_space(s.back()))
+    s.remove_suffix(1);
+  return s;
+}
+
+[[noreturn]] void invalid(std::size_t line, const std::string &why) {
+  throw std::runtime_error("registry: line " + std::to_string(line) + ": " +
+                           why);
+}
+
+// Pilot per bucket such that every key lands in its own slot: buckets of
+// two keys or more are placed largest first, each trying pilots until all
+// its keys hit free slots; one-key buckets then take the free slots left.
+// With one bucket per key, a third of the slots are still free for the
+// last multi-key buckets, so a pilot is found within a few tries. False
+// when some bucket needs too many (a new seed is then tried).
+bool place(const std::vector<Slot> &entries, std::uint64_t seed,
+           std::vector<std::uint32_t> &pilots,
+           std::vector<std::uint32_t> &slot_index) {
+  const std::uint64_t n = entries.size();
+  const std::uint64_t buckets = pilots.size();
+
+  std::vector<std::uint32_t> start(buckets + 1, 0);
+  for (const auto &e : entries)
+    start[range(mix(e.key ^ seed), buckets) + 1]++;
+  std::size_t largest = 0;
+  for (std::uint64_t b = 0; b < buckets; b++) {
+    largest = std::max<std::size_t>(largest, start[b + 1]);
+    start[b + 1] += start[b];
+  }
+  std::vector<std::uint32_t> members(n);
+  {
+    std::vector<std::uint32_t> fill(start.begin(), start.end() - 1);
+    for (std::uint32_t i = 0; i < n; i++)
+      members[fill[range(mix(entries[i].key ^ seed), buckets)]++] = i;
+  }
+  // Buckets by decreasing size.
+  std::vector<std::vector<std::uint32_t>> by_size(largest + 1);
+  for (std::uint32_t b = 0; b < buckets; b++)
+    by_size[start[b + 1] - start[b]].push_back(b);
+
+  std::vector<bool> taken(n, false);
+  std::vector<std::uint64_t> tried;
+  for (std::size_t size = largest; size >= 2; size--) {
+    for (std::uint32_t b : by_size[size]) {
+      const std::uint32_t *m = members.data() + start[b];
+      std::uint32_t pilot = 0;
+      for (;; pilot++) {
+        if (pilot == (1u << 20))
+          return false;
+        tried.clear();
+        bool ok = true;
+        for (std::size_t k = 0; k < size && ok; k++) {
+          auto s = slot_of(mix(entries[m[k]].key ^ seed), pilot, n);
+          ok = !taken[s] &&
+               std::find(tried.begin(), tried.end(), s) == tried.end();
+          tried.push_back(s);
+        }
+        if (ok)
+          break;
+      }
+      pilots[b] = pilot;
+      for (std::size_t k = 0; k < size; k++) {
+        taken[tried[k]] = true;
+        slot_index[m[k]] = static_cast<std::uint32_t>(tried[k]);
+      }
+    }
+  }
+  std::uint64_t free_slot = 0;
+  if (largest >= 1)
+    for (std::uint32_t b : by_size[1]) {
+      while (taken[free_slot])
+        free_slot++;
+      taken[free_slot] = true;
+      pilots[b] = DIRECT | static_cast<std::uint32_t>(free_slot);
+      slot_index[members[start[b]]] = static_cast<std::uint32_t>(free_slot);
+    }
+  return true;
+}
+
+} // namespace
+
+// ---- compile ----
+
+std::size_t compile_registry(const std::string &csv_path,
+                             const std::string &out_path) {
+  std::ifstream in(csv_path, std::ios::binary);
+  if (!in)
+    throw std::runtime_error("registry: cannot read " + csv_path);
+
+  std::vector<Slot> entries;
+  std::vector<std::uint32_t> lines; // for duplicate reports
+  std::string strings;
+  std::string raw;
+  for (std::size_t line = 1; std::getline(in, raw); line++) {
+    std::string_view rest = trim(raw);
+    if (rest.empty() || rest.front() == '#')
+      continue;
+    std::string_view fields[4];
+    std::size_t count = 0;
+    while (count < 4) {
+      auto semi = count < 3 ? rest.find(';') : std::string_view::npos;
+      fields[count++] = trim(rest.substr(0, semi));
+      if (semi == std::string_view::npos)
+        break;
+      rest.remove_prefix(semi + 1);
+    }
+    if (count < 3)
+      invalid(line, "expected number;name;naf[;trade_name]");
+    auto number = fields[0], name = fields[1], naf = fields[2],
+         trade = fields[3];
+    if (!(number.size() == 9 ? valid_siren(number) : valid_siret(number)))
+      invalid(line, "invalid SIREN/SIRET '" + std::string(number) + "'");
+    if (name.empty() || name.size() > 0xFFFF || trade.size() > 0xFFFF)
+      invalid(line, "name empty or longer than 65535 bytes");
+    if (naf.size() > sizeof(Slot::naf))
+      invalid(line, "NAF code longer than 6 bytes");
+    if (entries.size() == DIRECT - 1)
+      invalid(line, "too many entries");
+
+    Slot s{};
+    s.key = key_of(number);
+    s.name_off = strings.size();
+    s.name_len = static_cast<std::uint16_t>(name.size());
+    s.trade_len = static_cast<std::uint16_t>(trade.size());
+    std::memcpy(s.naf, naf.data(), naf.size());
+    strings.append(name).append(trade);
+    entries.push_back(s);
+    lines.push_back(static_cast<std::uint32_t>(line));
+  }
+
+  // Equal keys could never be told apart by a pilot: reject them first.
+  {
+    std::vector<std::uint32_t> order(entries.size());
+    for (std::uint32_t i = 0; i < order.size(); i++)
+      order[i] = i;
+    std::sort(order.begin(), order.end(), [&](auto a, auto b) {
+      return entries[a].key != entries[b].key ? entries[a].key < entries[b].key
+                                              : a < b;
+    });
+    for (std::size_t i = 1; i < order.size(); i++)
+      if (entries[order[i]].key == entries[order[i - 1]].key)
+        invalid(lines[order[i]], "duplicate of line " +
+                                     std::to_string(lines[order[i - 1]]));
+  }
+  lines = {};
+
+  FileHeader h{};
+  std::memcpy(h.magic, MAGIC, sizeof MAGIC);
+  h.version = VERSION;
+  h.slot_size = sizeof(Slot);
+  h.count = entries.size();
+  h.buckets = std::max<std::uint64_t>(1, entries.size());
+  h.seed = 0x5EEDull;
+  std::vector<std::uint32_t> pilots(h.buckets, 0);
+  std::vector<std::uint32_t> slot_index(entries.size());
+  while (!place(entries, h.seed, pilots, slot_index))
+    h.seed = mix(h.seed + 1);
+
+  h.pilots_off = sizeof h;
+  h.slots_off = (h.pilots_off + h.buckets * sizeof(std::uint32_t) + 7) & ~7ull;
+  h.strings_off = h.slots_off + h.count * sizeof(Slot);
+  h.strings_size = strings.size();
+
+  std::vector<Slot> table(entries.size());
+  for (std::size_t i = 0; i < entries.size(); i++)
+    table[slot_index[i]] = entries[i];
+
+  static const char pad[8] = {};
+  auto bytes = [](const auto &v) {
+    return std::string_view(reinterpret_cast<const char *>(v.data()),
+                            v.size() * sizeof v[0]);
+  };
+  replace_file(out_path, "registry",
+               {std::string_view(reinterpret_cast<const char *>(&h), sizeof h),
+                bytes(pilots),
+                std::string_view(pad, h.slots_off - h.pilots_off -
+                                          h.buckets * sizeof(std::uint32_t)),
+                bytes(table), strings});
+  return entries.size();
+}
+
+// ---- open / lookup ----
+
+std::shared_ptr<const CompanyRegistry>
+CompanyRegistry::open(const std::string &path) {
+  auto fail = [&](const std::string &why) -> std::runtime_error {
+    return std::runtime_error("registry: " + path + ": " + why);
+  };
+  std::shared_ptr<CompanyRegistry> r(new CompanyRegistry);
+  r->file_ = std::make_unique<MappedFile>(path, "registry");
+  const std::uint64_t size = r->file_->size();
+  if (size < sizeof(FileHeader))
+    throw fail("truncated");
+
+  FileHeader h;
+  std::memcpy(&h, r->file_->data(), sizeof h);
+  if (std::memcmp(h.magic, MAGIC, sizeof MAGIC) != 0)
+    throw fail("not a compiled registry");
+  if (h.version != VERSION || h.slot_size != sizeof(Slot))
+    throw fail("unsupported registry version");
+  const bool fits =
+      h.buckets >= 1 && h.count < DIRECT && h.buckets <= size / 4 &&
+      h.pilots_off >= sizeof h && h.pilots_off % 4 == 0 &&
+      h.pilots_off + h.buckets * 4 <= h.slots_off && h.slots_off % 8 == 0 &&
+      h.slots_off <= size && h.count <= (size - h.slots_off) / sizeof(Slot) &&
+      h.slots_off + h.count * sizeof(Slot) <= h.strings_off &&
+      h.strings_off <= size && h.strings_size == size - h.strings_off;
+  if (!fits)
+    throw fail("truncated");
+
+  const unsigned char *base = r->file_->data();
+  r->count_ = h.count;
+  r->buckets_ = h.buckets;
+  r->seed_ = h.seed;
+  r->pilots_ = reinterpret_cast<const std::uint32_t *>(base + h.pilots_off);
+  r->slots_ = base + h.slots_off;
+  r->strings_ = reinterpret_cast<const char *>(base + h.strings_off);
+  r->strings_size_ = h.strings_size;
+  return r;
+}
+
+std::optional<RegistryEntry> CompanyRegistry::find(std::uint64_t key) const {
+  if (count_ == 0)
+    return std::nullopt;
+  const std::uint64_t h = mix(key ^ seed_);
+  const std::uint32_t pilot = pilots_[range(h, buckets_)];
+  const std::uint64_t index =
+      pilot & DIRECT ? pilot & ~DIRECT : slot_of(h, pilot, count_);
+  if (index >= count_)
+    return std::nullopt;
+  Slot s;
+  std::memcpy(&s, slots_ + index * sizeof(Slot), sizeof s);
+  if (s.key != key || s.name_off > strings_size_ ||
+      strings_size_ - s.name_off < std::uint64_t{s.name_len} + s.trade_len)
+    return std::nullopt;
+  RegistryEntry e;
+  e.name = std::string_view(strings_ + s.name_off, s.name_len);
+  e.trade_name = std::string_view(strings_ + s.name_off + s.name_len,
+                                  s.trade_len);
+  const char *stored =
+      reinterpret_cast<const char *>(slots_) + index * sizeof(Slot);
+  e.naf = std::string_view(stored + offsetof(Slot, naf),
+                           strnlen(s.naf, sizeof s.naf));
+  return e;
+}
+
+std::optional<RegistryEntry>
+CompanyRegistry::find_siret(std::string_view siret) const {
+  if (siret.size() != 14 ||
+      !std::all_of(siret.begin(), siret.end(), is_ascii_digit))
+    return std::nullopt;
+  if (auto e = find(key_of(siret)))
+    return e;
+  return find(key_of(siret.substr(0, 9)));
+}
+
+std::optional<RegistryEntry>
+CompanyRegistry::find_siren(std::string_view siren) const {
+  if (siren.size() != 9 ||
+      !std::all_of(siren.begin(), siren.end(), is_ascii_digit))
+    return std::nullopt;
+  return find(key_of(siren));
+}
+
+// ---- active registry ----
+
+static std::atomic<std::shared_ptr<const CompanyRegistry>> &active() {
+  static std::atomic<std::shared_ptr<const CompanyRegistry>> registry;
+  return registry;
+}
+
+std::shared_ptr<const CompanyRegistry> active_registry() {
+  return active().load(std::memory_order_acquire);
+}
+
+void set_active_registry(std::shared_ptr<const CompanyRegistry> registry) {
+  active().store(std::move(registry), std::memory_order_release);
+}
+
+// ---- resolution ----
+
+namespace {
+
+// Words of 3 letters or more, ASCII case-folded; bytes of multi-byte
+// characters count as letters.
+bool shares_word(std::string_view a, std::string_view b) {
+  auto is_letter = [](char c) {
+    return is_word_char(c) || static_cast<unsigned char>(c) >= 0x80;
+  };
+  auto words = [&](std::string_view s, auto &&fn) {
+    for (std::size_t i = 0; i < s.size();) {
+      std::size_t j = i;
+      while (j < s.size() && is_letter(s[j]))
+        j++;
+      if (j - i >= 3 && fn(s.substr(i, j - i)))
+        return true;
+      i = j + 1;
+    }
+    return false;
+  };
+  auto same = [](std::string_view x, std::string_view y) {
+    if (x.size() != y.size())
+      return false;
+    for (std::size_t i = 0; i < x.size(); i++)
+      if (ascii_upper(x[i]) != ascii_upper(y[i]))
+        return false;
+    return true;
+  };
+  return words(a, [&](std::string_view wa) {
+    return words(b, [&](std::string_view wb) { return same(wa, wb); });
+  });
+}
+
+} // namespace
+
+void resolve_company(ParsedTicket &ticket, const CompanyRegistry &registry) {
+  if (!ticket.company.value)
+    return;
+  Company &c = *ticket.company.value;
+  auto e = c.siret.empty() ? registry.find_siren(c.siren)
+                           : registry.find_siret(c.siret);
+  if (!e)
+    return;
+  c.name = std::string(e->name);
+  if (!e->trade_name.empty())
+    c.trade_name = std::string(e->trade_name);
+  if (!e->naf.empty())
+    c.naf = std::string(e->naf);
+  ticket.company.confidence = 0.95;
+
+  if (!ticket.merchant.value)
+    return;
+  for (std::string_view merchant :
+       {std::string_view(*ticket.merchant.value),
+        ticket.merchant_canonical.value
+            ? std::string_view(ticket.merchant_canonical.value->name)
+            : std::string_view()})
+    if (shares_word(merchant, e->name) || shares_word(merchant, e->trade_name))
+      return;
+  ticket.warnings.push_back(
+      {"MERCHANT_REGISTRY_MISMATCH",
+       "Merchant differs from the registered name \"" + std::string(e->name) +
+           "\".",
+       "low"});
+}
+
+} // namespace tv
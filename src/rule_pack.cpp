@@ -0,0 +1,244 @@
+#include "tv/rule_pack.hpp"
+
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <sstream>
+#include <stdexcept>
+
+namespace tv {
+
+using nlohmann::json;
+
+// The compile-time pipelines, indexed by [Locale][Domain]; the Auto row is
+// the fr_FR one.
+template <class L>
+static constexpr std::array<const RuleSet *, 3> rule_row = {
+    &rules::Pipeline<L, rules::AnyDomain>::rules,
+    &rules::Pipeline<L, rules::Cafe>::rules,
+    &rules::Pipeline<L, rules::Resto>::rules};
+
+static constexpr std::array<std::array<const RuleSet *, 3>, 5> builtin_sets = {
+    rule_row<rules::FrFR>, rule_row<rules::FrFR>, rule_row<rules::FrBE>,
+    rule_row<rules::FrCH>, rule_row<rules::EsES>};
+
+static constexpr std::array<const char *, 5> locale_keys = {
+    nullptr, "fr_FR", "fr_BE", "fr_CH", "es_ES"};
+static constexpr std::array<const char *, 3> domain_keys = {"any", "cafe",
+                                                            "resto"};
+
+std::shared_ptr<const RulePack> RulePack::builtin() {
+  static const std::shared_ptr<const RulePack> pack = [] {
+    std::shared_ptr<RulePack> p(new RulePack);
+    p->version_ = "builtin";
+    p->builtin_ = true;
+    p->rules_ = builtin_sets;
+    return p;
+  }();
+  return pack;
+}
+
+Keywords RulePack::own(const std::vector<std::string> &phrases) {
+  auto &table = tables_.emplace_back();
+  for (const auto &p : phrases)
+    table.push_back(strings_.emplace_back(p));
+  return table;
+}
+
+// ---- parsing ----
+
+[[noreturn]] static void invalid(const std::string &where,
+                                 const std::string &why) {
+  throw std::runtime_error("rule pack: " + where + ": " + why);
+}
+
+static std::vector<std::string> phrase_list(const json &v,
+                                            const std::string &where) {
+  if (!v.is_array())
+    invalid(where, "expected an array of strings");
+  std::vector<std::string> out;
+  for (const auto &e : v) {
+    if (!e.is_string() || e.get_ref<const std::string &>().empty())
+      invalid(where, "expected non-empty strings");
+    out.push_back(e.get<std::string>());
+  }
+  return out;
+}
+
+static double weight(const json &v, const std::string &where) {
+  if (!v.is_number() || !(std::abs(v.get<double>()) <= 50.0))
+    invalid(where, "expected a number in [-50, 50]");
+  return v.get<double>();
+}
+
+std::shared_ptr<const RulePack> RulePack::parse(std::string_view json_text) {
+  json doc = json::parse(json_text.begin(), json_text.end(), nullptr, false);
+  if (doc.is_discarded() || !doc.is_object())
+    invalid("document", "not a JSON object");
+
+  std::shared_ptr<RulePack> p(new RulePack);
+
+  auto version = doc.find("version");
+  if (version == doc.end() || !version->is_string() ||
+      version->get_ref<const std::string &>().empty())
+    invalid("version", "expected a non-empty string");
+  p->version_ = version->get<std::string>();
+
+  for (auto it = doc.begin(); it != doc.end(); ++it)
+    if (it.key() != "version" && it.key() != "scoring" &&
+        it.key() != "locales" && it.key() != "domains")
+      invalid(it.key(), "unknown entry");
+
+  if (auto s = doc.find("scoring"); s != doc.end()) {
+    if (!s->is_object())
+      invalid("scoring", "expected an object");
+    for (auto it = s->begin(); it != s->end(); ++it) {
+      double *field = it.key() == "bias" ? &p->scoring_.bias : nullptr;
+      for (const auto &term : score_terms)
+        if (it.key() == term.name)
+          field = &(p->scoring_.weights.*term.member);
+      if (!field)
+        invalid("scoring." + it.key(), "unknown entry");
+      *field = weight(it.value(), "scoring." + it.key());
+    }
+  }
+
+  // Per-locale RuleSets (business_keywords set below), built-in first.
+  std::array<RuleSet, 5> locale_sets;
+  for (std::size_t l = 0; l < locale_sets.size(); l++)
+    locale_sets[l] = *builtin_sets[l][0];
+  std::array<Keywords, 3> business;
+  for (std::size_t d = 0; d < business.size(); d++)
+    business[d] = builtin_sets[1][d]->business_keywords;
+
+  const json no_entries = json::object();
+  auto section = [&](const char *name) -> const json & {
+    auto s = doc.find(name);
+    if (s == doc.end())
+      return no_entries;
+    if (!s->is_object())
+      invalid(name, "expected an object");
+    return *s;
+  };
+
+  const json &locales = section("locales");
+  for (auto it = locales.begin(); it != locales.end(); ++it) {
+    std::size_t l = 1;
+    while (l < locale_keys.size() && it.key() != locale_keys[l])
+      l++;
+    std::string where = "locales." + it.key();
+    if (l == locale_keys.size())
+      invalid(where, "unknown locale");
+    if (!it->is_object())
+      invalid(where, "expected an object");
+
+    RuleSet &rs = locale_sets[l];
+    for (auto f = it->begin(); f != it->end(); ++f) {
+      std::string at = where + "." + f.key();
+      const std::string &k = f.key();
+      if (k == "merchant_blacklist")
+        rs.merchant_blacklist = p->own(phrase_list(*f, at));
+      else if (k == "total_keywords")
+        rs.total_keywords = p->own(phrase_list(*f, at));
+      else if (k == "currency_markers")
+        rs.currency_markers = p->own(phrase_list(*f, at));
+      else if (k == "card_keywords")
+        rs.card_keywords = p->own(phrase_list(*f, at));
+      else if (k == "tax_keywords")
+        rs.tax_keywords = p->own(phrase_list(*f, at));
+      else if (k == "company_id_keywords")
+        rs.company_id_keywords = p->own(phrase_list(*f, at));
+      else if (k == "currency") {
+        if (!f->is_string() || f->get_ref<const std::string &>().empty())
+          invalid(at, "expected a non-empty string");
+        rs.currency = p->strings_.emplace_back(f->get<std::string>());
+      } else if (k == "company_id_digits") {
+        if (!f->is_number_unsigned() || f->get<std::size_t>() == 0 ||
+            f->get<std::size_t>() > 32)
+          invalid(at, "expected an integer in [1, 32]");
+        rs.company_id_digits = f->get<std::size_t>();
+      } else {
+        invalid(at, "unknown entry");
+      }
+    }
+  }
+  locale_sets[0] = locale_sets[1]; // Auto resolves like fr_FR
+
+  const json &domains = section("domains");
+  for (auto it = domains.begin(); it != domains.end(); ++it) {
+    std::size_t d = 0;
+    while (d < domain_keys.size() && it.key() != domain_keys[d])
+      d++;
+    std::string where = "domains." + it.key();
+    if (d == domain_keys.size())
+      invalid(where, "unknown domain");
+    if (!it->is_object())
+      invalid(where, "expected an object");
+    for (auto f = it->begin(); f != it->end(); ++f) {
+      if (f.key() != "business_keywords")
+        invalid(where + "." + f.key(), "unknown entry");
+      business[d] = p->own(phrase_list(*f, where + "." + f.key()));
+    }
+  }
+
+  for (std::size_t l = 0; l < locale_sets.size(); l++)
+    for (std::size_t d = 0; d < business.size(); d++) {
+      RuleSet &rs = p->sets_.emplace_back(locale_sets[l]);
+      rs.business_keywords = business[d];
+      p->rules_[l][d] = &rs;
+    }
+  return p;
+}
+
+std::shared_ptr<const RulePack> RulePack::load(const std::string &path) {
+  std::ifstream f(path, std::ios::binary);
+  if (!f)
+    throw std::runtime_error("rule pack: cannot read " + path);
+  std::stringstream ss;
+  ss << f.rdbuf();
+  return parse(ss.str());
+}
+
+// ---- active pack ----
+
+static std::atomic<std::shared_ptr<const RulePack>> &active() {
+  static std::atomic<std::shared_ptr<const RulePack>> pack{
+      RulePack::builtin()};
+  return pack;
+}
+
+static std::mutex pack_path_mutex;
+static std::string pack_path; // file behind the active pack, if any
+
+std::shared_ptr<const RulePack> active_rule_pack() {
+  return active().load(std::memory_order_acquire);
+}
+
+void set_active_rule_pack(std::shared_ptr<const RulePack> pack) {
+  active().store(pack ? std::move(pack) : RulePack::builtin(),
+                 std::memory_order_release);
+}
+
+void load_rule_pack(const std::string &path) {
+  auto pack = RulePack::load(path);
+  std::lock_guard<std::mutex> lock(pack_path_mutex);
+  pack_path = path;
+  set_active_rule_pack(std::move(pack));
+}
+
+bool reload_rule_pack(std::string *error) {
+  std::lock_guard<std::mutex> lock(pack_path_mutex);
+  if (pack_path.empty())
+    return true;
+  try {
+    set_active_rule_pack(RulePack::load(pack_path));
+    return true;
+  } catch (const std::exception &e) {
+    *error = e.what();
+    return false;
+  }
+}
+
+} // namespace tv
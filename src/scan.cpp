@@ -0,0 +1,95 @@
+#include "tv/scan.hpp"
+#include <algorithm>
+
+namespace tv {
+
+std::size_t match_phrase(std::string_view text, std::size_t pos,
+                         std::string_view phrase, bool final) {
+  const std::size_t at_end = final ? std::string_view::npos : need_more;
+  std::size_t i = pos;
+  for (char pc : phrase) {
+    if (i >= text.size())
+      return at_end;
+    if (pc == ' ') {
+      if (!is_ascii_space(text[i]))
+        return std::string_view::npos;
+      while (i < text.size() && is_ascii_space(text[i]))
+        i++;
+      if (i >= text.size() && !final)
+        return need_more; // the run may go on
+      continue;
+    }
+    if (ascii_upper(text[i]) != ascii_upper(pc))
+      return std::string_view::npos;
+    i++;
+  }
+  return i;
+}
+
+PhraseScanner::PhraseScanner(Keywords phrases) : phrases_(phrases) {
+  for (auto p : phrases_) {
+    if (p.empty())
+      continue;
+    for (char c : {p[0], ascii_upper(p[0]),
+                   static_cast<char>(p[0] >= 'A' && p[0] <= 'Z'
+                                         ? p[0] - 'A' + 'a'
+                                         : p[0])}) {
+      auto u = static_cast<unsigned char>(c);
+      first_[u >> 6] |= std::uint64_t{1} << (u & 63);
+    }
+  }
+}
+
+std::size_t PhraseScanner::next_candidate_in_spans(std::string_view text,
+                                                  std::size_t pos) const {
+  auto span = std::upper_bound(
+      spans_->begin(), spans_->end(), pos,
+      [](std::size_t p, const TextSpan &s) { return p < s.end; });
+  for (; span != spans_->end(); ++span) {
+    std::size_t end = std::min(span->end, text.size());
+    for (std::size_t p = std::max(pos, span->begin); p < end; p++)
+      if (may_start(text[p]))
+        return p;
+  }
+  return std::string_view::npos;
+}
+
+std::optional<PhraseMatch> PhraseScanner::find(std::string_view text,
+                                               std::size_t from,
+                                               bool whole_word) const {
+  std::size_t resume = 0;
+  return find(text, from, whole_word, true, &resume);
+}
+
+std::optional<PhraseMatch> PhraseScanner::find(std::string_view text,
+                                               std::size_t from,
+                                               bool whole_word, bool final,
+                                               std::size_t *resume) const {
+  *resume = std::string_view::npos;
+  for (std::size_t pos = next_candidate(text, from);
+       pos != std::string_view::npos; pos = next_candidate(text, pos + 1)) {
+    if (whole_word && !is_word_boundary(text, pos))
+      continue;
+    for (std::size_t k = 0; k < phrases_.size(); k++) {
+      auto end = match_phrase(text, pos, phrases_[k], final);
+      if (end == need_more) {
+        *resume = pos; // undecided: no later match can be the leftmost
+        return std::nullopt;
+      }
+      if (end == std::string_view::npos)
+        continue;
+      if (whole_word && end >= text.size() && !final) {
+        *resume = pos; // \b depends on the next character
+        return std::nullopt;
+      }
+      if (whole_word && !is_word_boundary(text, end))
+        continue;
+      return PhraseMatch{pos, end, k};
+    }
+  }
+  if (!final)
+    *resume = text.size();
+  return std::nullopt;
+}
+
+} // namespace tv
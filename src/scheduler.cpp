@@ -0,0 +1,33 @@
+#include "tv/scheduler.hpp"
+
+#include <bit>
+
+namespace tv {
+
+const char *priority_name(Priority p) {
+  return p == Priority::Bulk ? "bulk" : "interactive";
+}
+
+void LatencyHistogram::add(std::chrono::steady_clock::duration d) {
+  auto us = static_cast<std::uint64_t>(std::max<std::int64_t>(
+      0, std::chrono::duration_cast<std::chrono::microseconds>(d).count()));
+  counts[std::min<std::size_t>(std::bit_width(us), buckets - 1)]++;
+  count++;
+  sum_us += us;
+  max_us = std::max(max_us, us);
+}
+
+std::uint64_t LatencyHistogram::quantile(double q) const {
+  if (count == 0)
+    return 0;
+  auto rank = static_cast<std::uint64_t>(q * static_cast<double>(count));
+  std::uint64_t seen = 0;
+  for (std::size_t i = 0; i < buckets; i++) {
+    seen += counts[i];
+    if (seen > rank || seen == count)
+      return std::min<std::uint64_t>(max_us, (std::uint64_t{1} << i));
+  }
+  return max_us;
+}
+
+} // namespace tv
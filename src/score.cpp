@@ -0,0 +1,58 @@
+#include "tv/score.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace tv {
+
+template <typename T> static double confidence_of(const Field<T> &f) {
+  return f.value ? f.confidence : 0.0;
+}
+
+ScoreTerms score_features(const EngineOutput &out) {
+  const ParsedTicket &t = out.ticket;
+  ScoreTerms f;
+  f.total = confidence_of(t.total);
+  f.merchant = confidence_of(t.merchant);
+  f.merchant_known = confidence_of(t.merchant_canonical);
+  f.datetime = confidence_of(t.datetime_iso);
+  f.company = confidence_of(t.company);
+  if (!t.items.empty()) {
+    double sum = 0.0;
+    for (const auto &item : t.items)
+      sum += item.confidence;
+    f.items = sum / static_cast<double>(t.items.size());
+  }
+  f.tax = t.signals.has_tva ? 1.0 : 0.0;
+  f.card = t.signals.has_card_keywords ? 1.0 : 0.0;
+  f.lines = std::min(out.input.lines, 8u) / 8.0;
+  if (t.total.value) {
+    const double v = t.total.value->value;
+    f.amount = v <= 0.0 ? 0.0 : v <= 1000.0 ? 1.0 : v <= 10000.0 ? 0.5 : 0.0;
+  }
+  int minor = 0, major = 0;
+  for (const auto &w : t.warnings)
+    (w.severity == "low" ? minor : major)++;
+  f.minor_warnings = std::min(minor, 4) / 4.0;
+  f.warnings = std::min(major, 4) / 4.0;
+  return f;
+}
+
+double score(const ScoreTerms &features, const Scoring &scoring) {
+  double z = scoring.bias;
+  for (const auto &term : score_terms)
+    z += scoring.weights.*term.member * features.*term.member;
+  return 1.0 / (1.0 + std::exp(-z));
+}
+
+void score_ticket(EngineOutput &out, const Scoring &scoring) {
+  auto t0 = std::chrono::steady_clock::now();
+  out.confidence = score(score_features(out), scoring);
+  out.timing.score_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now() - t0)
+                             .count();
+  out.timing.score = static_cast<int>(out.timing.score_ns / 1000000);
+}
+
+} // namespace tv
@@ -0,0 +1,69 @@
+#include "tv/shadow.hpp"
+#include "tv/json.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+
+#include <unistd.h>
+
+namespace tv {
+
+static ShadowConfig shadow_cfg;
+
+void set_shadow(ShadowConfig cfg) { shadow_cfg = std::move(cfg); }
+
+// splitmix64 over the clock, the pid and a counter: the zygote's children
+// start from the same memory, so a seeded generator would sample alike.
+static double uniform01() {
+  static std::atomic<std::uint64_t> counter{0};
+  std::uint64_t x =
+      static_cast<std::uint64_t>(
+          std::chrono::steady_clock::now().time_since_epoch().count()) ^
+      (static_cast<std::uint64_t>(::getpid()) << 32) ^
+      (counter.fetch_add(1, std::memory_order_relaxed) * 0x9E3779B97F4A7C15ull);
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+  x ^= x >> 31;
+  return static_cast<double>(x >> 11) * 0x1.0p-53;
+}
+
+std::shared_ptr<const RulePack> shadow_candidate() {
+  if (!shadow_cfg.candidate || shadow_cfg.sample_rate <= 0.0)
+    return nullptr;
+  if (shadow_cfg.sample_rate < 1.0 && uniform01() >= shadow_cfg.sample_rate)
+    return nullptr;
+  return shadow_cfg.candidate;
+}
+
+void log_shadow(const EngineOutput &primary, const ShadowRun &shadow) {
+  std::string line = shadow_json(primary, shadow);
+  line += '\n';
+  // One write per record: O_APPEND keeps concurrent writers' lines whole.
+  const char *p = line.data();
+  std::size_t left = line.size();
+  while (left > 0) {
+    ssize_t n = ::write(shadow_cfg.log_fd, p, left);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return; // the side channel never fails a ticket
+    p += n;
+    left -= static_cast<std::size_t>(n);
+  }
+}
+
+EngineOutput run_shadowed(std::string_view ocr_text, const Options &opt) {
+  auto candidate = shadow_candidate();
+  if (!candidate)
+    return run(ocr_text, opt);
+  Session session;
+  session.begin(opt, std::move(candidate));
+  session.feed(ocr_text);
+  auto out = session.finish();
+  log_shadow(out, *session.shadow());
+  return out;
+}
+
+} // namespace tv
@@ -0,0 +1,604 @@
+#include "tv/shm.hpp"
+#include "tv/engine.hpp"
+#include "tv/flight_recorder.hpp"
+#include "tv/json.hpp"
+#include "tv/mapped_file.hpp"
+#include "tv/near_duplicate.hpp"
+#include "tv/rule_pack.hpp"
+#include "tv/scan.hpp"
+#include "tv/scheduler.hpp"
+#include "tv/shadow.hpp"
+#include "tv/sketch.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace tv {
+
+static_assert(sizeof(tv_shm_slot) == 40);
+static_assert(sizeof(tv_shm_ring) == 128);
+static_assert(sizeof(tv_shm_header) == 64 + 2 * sizeof(tv_shm_ring));
+static_assert(TV_LOCALE_ES_ES == static_cast<int>(Locale::EsES));
+static_assert(TV_DOMAIN_RESTO == static_cast<int>(Domain::Resto));
+
+// How long a side sleeps before checking that its peer is still there.
+static constexpr int idle_poll_ms = 100;
+
+static std::string segment_name(const std::string &name) {
+  return (!name.empty() && name[0] == '/') ? name : "/" + name;
+}
+
+static bool process_alive(std::int32_t pid) {
+  return pid > 0 && (::kill(pid, 0) == 0 || errno != ESRCH);
+}
+
+// ---- server ----
+
+static std::atomic<bool> shm_stop{false};
+static std::atomic<bool> shm_reload{false};
+static std::atomic<bool> shm_dump{false};
+static void on_signal(int sig) {
+  (sig == SIGHUP ? shm_reload : sig == SIGUSR1 ? shm_dump : shm_stop) = true;
+}
+
+// Copies a whole document into the response buffer, truncated to cap.
+static std::uint32_t put(std::uint32_t code, const std::string &doc, char *buf,
+                         std::uint32_t cap, std::uint32_t *len) {
+  *len = static_cast<std::uint32_t>(std::min<std::size_t>(doc.size(), cap));
+  std::memcpy(buf, doc.data(), *len);
+  return code;
+}
+
+static std::uint32_t micros_since(std::chrono::steady_clock::time_point t0) {
+  return static_cast<std::uint32_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - t0)
+          .count());
+}
+
+// What the flight recorder keeps of a ticket that ran.
+static void describe(const EngineOutput &out, FlightRecord &rec) {
+  rec.fingerprint = out.input.fingerprint;
+  rec.lines = out.input.lines;
+  rec.status = static_cast<std::uint8_t>(out.status);
+  rec.score_ns = static_cast<std::uint32_t>(
+      std::min<std::int64_t>(out.timing.score_ns, UINT32_MAX));
+  rec.warnings = static_cast<std::uint16_t>(
+      std::min<std::size_t>(out.ticket.warnings.size(), 0xFFFF));
+  if (!out.ticket.warnings.empty()) {
+    const std::string &code = out.ticket.warnings.front().code;
+    std::memcpy(rec.first_warning, code.data(),
+                std::min(code.size(), sizeof rec.first_warning - 1));
+  }
+}
+
+namespace {
+
+// The FrameCache of session requests, split into shards by session id so
+// that threads serving different sessions rarely wait on each other.
+class SessionFrames {
+public:
+  SessionFrames(std::size_t shards, std::size_t bytes) {
+    for (std::size_t i = 0; i < shards; i++)
+      shards_.push_back(std::make_unique<Shard>(bytes / shards));
+  }
+
+  EngineOutput run(std::uint64_t session, std::string_view text,
+                   const Options &opt) {
+    Shard &s = *shards_[session % shards_.size()];
+    std::lock_guard<std::mutex> lock(s.m);
+    return s.cache.run(std::to_string(session), text, opt);
+  }
+
+private:
+  struct Shard {
+    explicit Shard(std::size_t bytes) : cache(bytes) {}
+    std::mutex m;
+    FrameCache cache;
+  };
+  std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+} // namespace
+
+// Runs one request and writes the response document, filling the stage
+// timings and outcome of `rec`. Returns the exit code the CLI would have
+// returned.
+static std::uint32_t handle(const tv_shm_slot &req, std::string_view text,
+                            SessionFrames &frames, char *buf,
+                            std::uint32_t cap, std::uint32_t *len,
+                            FlightRecord &rec) {
+  auto fail = [&](std::uint32_t code, const std::string &doc) {
+    return put(code, doc, buf, cap, len);
+  };
+
+  Options opt;
+  if (req.locale <= TV_LOCALE_ES_ES)
+    opt.locale = static_cast<Locale>(req.locale);
+  if (req.domain <= TV_DOMAIN_RESTO)
+    opt.domain = static_cast<Domain>(req.domain);
+  opt.budget_ms = req.budget_ms;
+  if (req.max_lines > 0)
+    opt.max_lines = req.max_lines;
+  text = first_lines(text, opt.max_lines);
+
+  bool blank = true;
+  for (char c : text)
+    if (!is_ascii_space(static_cast<unsigned char>(c))) {
+      blank = false;
+      break;
+    }
+  if (blank)
+    return fail(2, error_json("INPUT_EMPTY", "stdin is empty"));
+
+  try {
+    auto t0 = std::chrono::steady_clock::now();
+    auto out = req.session ? frames.run(req.session, text, opt)
+                           : run_shadowed(text, opt);
+    if (out.status == Status::Error)
+      return fail(3, error_json("INTERNAL", "engine error"));
+    // The frames of a session are one receipt: checking them would flag
+    // each against the previous one and fill the index with near-copies.
+    if (auto index = active_near_duplicates(); index && !req.session)
+      check_near_duplicate(out, *index, active_rule_pack()->scoring());
+    rec.run_us = micros_since(t0);
+    describe(out, rec);
+    t0 = std::chrono::steady_clock::now();
+    std::size_t n = write_json_v1(out, buf, cap);
+    rec.json_us = micros_since(t0);
+    if (n > cap)
+      return fail(3, error_json("RESPONSE_TOO_LARGE",
+                                "response exceeds slot size"));
+    *len = static_cast<std::uint32_t>(n);
+    return 0;
+  } catch (const std::exception &e) {
+    std::string detail = e.what();
+    return fail(3, error_json("INTERNAL", "unexpected error", &detail));
+  }
+}
+
+namespace {
+
+// A request copied out of its slot, so that the ring can take the next ones
+// while it waits for a server thread.
+struct Job {
+  tv_shm_slot req;
+  std::string text;
+};
+
+class ShmServer {
+public:
+  ShmServer(tv_shm_header *h, const ShmConfig &cfg, std::string dump_path,
+            bool debug)
+      : h_(h), geometry_{cfg.slot_count, cfg.slot_size}, debug_(debug),
+        capacity_(4 * std::size_t{cfg.slot_count}),
+        frames_(cfg.workers, cfg.frame_cache_bytes),
+        recorder_(cfg.workers, cfg.slow_ms * 1000),
+        dump_path_(std::move(dump_path)) {}
+
+  // Run by every server thread, numbered from 0, until SIGTERM or SIGINT.
+  void work(std::uint32_t worker);
+
+private:
+  void drain(std::vector<std::uint64_t> &stats);
+  void answer_stats(std::uint64_t id);
+  void serve(std::uint32_t worker, Scheduler<Job>::Entry &e, char *buf);
+  std::optional<FlightDump> dump();
+  void respond(std::uint64_t id, std::uint32_t code, const char *doc,
+               std::uint32_t len);
+
+  tv_shm_header *h_;
+  // The geometry the segment was created with. The client can write the
+  // header, so slots are located and payloads bounded with this copy only.
+  tv_shm_geometry geometry_;
+  bool debug_;
+  std::size_t capacity_; // queued requests before the ring is left to fill
+  Scheduler<Job> queue_;
+  SessionFrames frames_;
+  FlightRecorder recorder_;
+  std::string dump_path_;
+  std::mutex ring_m_; // consumer side of the request ring
+  std::mutex resp_m_; // producer side of the response ring
+  std::mutex dump_m_; // one dump file written at a time
+};
+
+// Idle threads line up on ring_m_; the one holding it takes in what the
+// client published and sleeps on the ring when nothing is queued. A single
+// thread thus serves without any hand-off. Flight recorder dumps write a
+// file: they run after ring_m_ is released, the recorder being seqlocked.
+void ShmServer::work(std::uint32_t worker) {
+  std::vector<char> buf(geometry_.slot_size);
+  std::vector<std::uint64_t> stats; // ids of statistics requests
+  while (!shm_stop) {
+    std::optional<Scheduler<Job>::Entry> job;
+    bool dump_now = false;
+    stats.clear();
+    {
+      std::lock_guard<std::mutex> ring(ring_m_);
+      if (shm_reload.exchange(false)) {
+        // Tickets already running keep the pack they started with.
+        std::string error;
+        if (!reload_rule_pack(&error))
+          write_fd(STDERR_FILENO, {"[shm] ", error, "\n"});
+        else if (debug_)
+          write_fd(STDERR_FILENO,
+                   {"[shm] rules ", active_rule_pack()->version(), "\n"});
+      }
+      dump_now = shm_dump.exchange(false);
+      drain(stats);
+      job = queue_.pop();
+      if (!job && !dump_now && stats.empty()) {
+        tv_shm_wait_peek_g(h_, geometry_, &h_->req, idle_poll_ms);
+        continue;
+      }
+    }
+    if (dump_now)
+      dump();
+    for (auto id : stats)
+      answer_stats(id);
+    if (job)
+      serve(worker, *job, buf.data());
+  }
+}
+
+// The flight recorder to dump_path_, when there is one; failures are
+// logged, the server goes on.
+std::optional<FlightDump> ShmServer::dump() {
+  if (dump_path_.empty()) {
+    write_fd(STDERR_FILENO, {"[shm] flight recorder: no --flight-dump and "
+                             "no XDG_RUNTIME_DIR, not dumped\n"});
+    return std::nullopt;
+  }
+  std::lock_guard<std::mutex> lock(dump_m_);
+  try {
+    auto d = recorder_.dump(dump_path_);
+    if (debug_)
+      write_fd(STDERR_FILENO,
+               {"[shm] flight recorder: ", std::to_string(d.records),
+                " tickets, ", std::to_string(d.slow), " slow, in ", d.path,
+                "\n"});
+    return d;
+  } catch (const std::exception &e) {
+    write_fd(STDERR_FILENO, {"[shm] ", e.what(), "\n"});
+    return std::nullopt;
+  }
+}
+
+// Moves the requests the client published into the queue, freeing their
+// slots. The ids of statistics requests go to `stats`, for the caller to
+// answer once it has released ring_m_.
+void ShmServer::drain(std::vector<std::uint64_t> &stats) {
+  tv_shm_slot *slot;
+  while (queue_.size() < capacity_ &&
+         (slot = tv_shm_try_peek_g(h_, geometry_, &h_->req))) {
+    Job job;
+    job.req = *slot;
+    // The client owns the slot header: bound it before use.
+    job.req.len = std::min(job.req.len, geometry_.slot_size);
+    if (job.req.kind == TV_SHM_KIND_TICKET)
+      job.text.assign(tv_shm_payload(slot), job.req.len);
+    tv_shm_release(&h_->req);
+
+    if (job.req.kind == TV_SHM_KIND_STATS) {
+      stats.push_back(job.req.id);
+      continue;
+    }
+    if (job.req.kind != TV_SHM_KIND_TICKET) {
+      std::string doc = error_json("UNKNOWN_REQUEST", "unknown request kind");
+      respond(job.req.id, 2, doc.data(),
+              static_cast<std::uint32_t>(
+                  std::min<std::size_t>(doc.size(), geometry_.slot_size)));
+      continue;
+    }
+
+    std::optional<Scheduler<Job>::clock::time_point> deadline;
+    if (job.req.deadline != 0)
+      deadline = Scheduler<Job>::clock::now() +
+                 std::chrono::milliseconds(
+                     tv_shm_deadline_left(job.req.deadline));
+    Priority priority = job.req.priority == TV_PRIORITY_INTERACTIVE
+                            ? Priority::Interactive
+                            : Priority::Bulk;
+    queue_.push(std::move(job), priority, deadline);
+  }
+}
+
+// The scheduling statistics with a fresh flight recorder dump.
+void ShmServer::answer_stats(std::uint64_t id) {
+  auto d = dump();
+  std::string doc =
+      stats_json(queue_.stats(), queue_.size(), d ? &*d : nullptr);
+  respond(id, 0, doc.data(),
+          static_cast<std::uint32_t>(
+              std::min<std::size_t>(doc.size(), geometry_.slot_size)));
+}
+
+void ShmServer::serve(std::uint32_t worker, Scheduler<Job>::Entry &e,
+                      char *buf) {
+  auto start = Scheduler<Job>::clock::now();
+  FlightRecord rec;
+  rec.id = e.item.req.id;
+  rec.input_hash = sketch_hash(e.item.text);
+  rec.bytes = e.item.req.len;
+  rec.queue_us = static_cast<std::uint32_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(start - e.arrived)
+          .count());
+  rec.status = static_cast<std::uint8_t>(Status::Error); // unless it runs
+  std::uint32_t len = 0;
+  std::uint32_t code =
+      e.expired
+          ? put(3,
+                error_json("DEADLINE_EXPIRED",
+                           "deadline passed before the request was served"),
+                buf, geometry_.slot_size, &len)
+          : handle(e.item.req, e.item.text, frames_, buf, geometry_.slot_size,
+                   &len, rec);
+  respond(e.item.req.id, code, buf, len);
+  if (!e.expired)
+    queue_.served(e, Scheduler<Job>::clock::now() - start);
+  rec.code = static_cast<std::uint8_t>(code);
+  rec.finished_us = flight_now_us();
+  recorder_.record(worker, rec, e.item.text);
+}
+
+void ShmServer::respond(std::uint64_t id, std::uint32_t code, const char *doc,
+                        std::uint32_t len) {
+  std::lock_guard<std::mutex> lock(resp_m_);
+  tv_shm_slot *resp;
+  while (!(resp = tv_shm_wait_reserve_g(h_, geometry_, &h_->resp,
+                                        idle_poll_ms)))
+    if (shm_stop ||
+        !process_alive(__atomic_load_n(&h_->client_pid, __ATOMIC_ACQUIRE)))
+      return; // client gone with a full response ring: drop the response
+  resp->id = id;
+  resp->code = code;
+  resp->len = len;
+  std::memcpy(tv_shm_payload(resp), doc, len);
+  tv_shm_publish(&h_->resp);
+}
+
+} // namespace
+
+int serve_shm(const std::string &name, const ShmConfig &cfg, bool debug) {
+  if (cfg.slot_count == 0 || (cfg.slot_count & (cfg.slot_count - 1)) != 0 ||
+      cfg.slot_size < 4096 || cfg.slot_size % 64 != 0 || cfg.workers == 0) {
+    write_fd(STDERR_FILENO, {"[shm] invalid ring geometry\n"});
+    return 2;
+  }
+  std::string path = segment_name(name);
+  std::size_t size = tv_shm_segment_size(cfg.slot_count, cfg.slot_size);
+
+  ::shm_unlink(path.c_str()); // stale segment from a previous run
+  int fd = ::shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0 || ::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+    write_fd(STDERR_FILENO,
+             {"[shm] cannot create ", path, ": ", std::strerror(errno), "\n"});
+    if (fd >= 0) {
+      ::close(fd);
+      ::shm_unlink(path.c_str());
+    }
+    return 2;
+  }
+  void *mem = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mem == MAP_FAILED) {
+    ::shm_unlink(path.c_str());
+    return 2;
+  }
+
+  auto *h = static_cast<tv_shm_header *>(mem);
+  h->version = TV_SHM_VERSION;
+  h->slot_count = cfg.slot_count;
+  h->slot_size = cfg.slot_size;
+  h->server_pid = static_cast<std::int32_t>(::getpid());
+  __atomic_store_n(&h->magic, TV_SHM_MAGIC, __ATOMIC_RELEASE);
+
+  shm_stop = false;
+  shm_reload = false;
+  shm_dump = false;
+  struct sigaction sa{};
+  sa.sa_handler = on_signal;
+  sigemptyset(&sa.sa_mask);
+  ::sigaction(SIGTERM, &sa, nullptr); // no SA_RESTART: wakes the futex
+  ::sigaction(SIGINT, &sa, nullptr);
+  ::sigaction(SIGHUP, &sa, nullptr);
+  ::sigaction(SIGUSR1, &sa, nullptr);
+
+  if (debug)
+    write_fd(STDERR_FILENO,
+             {"[shm] serving ", path, " (", std::to_string(cfg.slot_count),
+              " x ", std::to_string(cfg.slot_size), " bytes, ",
+              std::to_string(cfg.workers), " thread(s))\n"});
+
+  {
+    // Slow tickets keep their text: by default, only in the user's private
+    // runtime directory.
+    std::string dump_path = cfg.flight_dump;
+    const char *runtime_dir = std::getenv("XDG_RUNTIME_DIR");
+    if (dump_path.empty() && runtime_dir && *runtime_dir)
+      dump_path = std::string(runtime_dir) + "/ticketverify-" +
+                  std::to_string(::getpid()) + ".flight.json";
+    ShmServer server(h, cfg, std::move(dump_path), debug);
+    std::vector<std::thread> threads;
+    for (std::uint32_t i = 1; i < cfg.workers; i++)
+      threads.emplace_back([&server, i] { server.work(i); });
+    server.work(0);
+    for (auto &t : threads)
+      t.join();
+  }
+
+  if (debug)
+    write_fd(STDERR_FILENO, {"[shm] stopping\n"});
+  std::signal(SIGTERM, SIG_DFL);
+  std::signal(SIGINT, SIG_DFL);
+  std::signal(SIGHUP, SIG_DFL);
+  std::signal(SIGUSR1, SIG_DFL);
+  __atomic_store_n(&h->magic, 0u, __ATOMIC_RELEASE);
+  ::munmap(mem, size);
+  ::shm_unlink(path.c_str());
+  return 0;
+}
+
+// ---- client ----
+
+ShmClient::~ShmClient() { close(); }
+
+void ShmClient::close() {
+  if (!seg_)
+    return;
+  std::int32_t self = static_cast<std::int32_t>(::getpid());
+  __atomic_compare_exchange_n(&seg_->client_pid, &self, 0, false,
+                              __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+  ::munmap(seg_, size_);
+  seg_ = nullptr;
+}
+
+bool ShmClient::open(const std::string &name, int timeout_ms) {
+  close();
+  std::string path = segment_name(name);
+  for (int waited = 0;; waited += 5) {
+    int fd = ::shm_open(path.c_str(), O_RDWR, 0);
+    struct stat st;
+    if (fd >= 0 && ::fstat(fd, &st) == 0 &&
+        static_cast<std::size_t>(st.st_size) >= sizeof(tv_shm_header)) {
+      size_ = static_cast<std::size_t>(st.st_size);
+      void *mem =
+          ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      ::close(fd);
+      if (mem == MAP_FAILED)
+        return false;
+      auto *h = static_cast<tv_shm_header *>(mem);
+      if (__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) == TV_SHM_MAGIC) {
+        if (h->version != TV_SHM_VERSION ||
+            tv_shm_segment_size(h->slot_count, h->slot_size) != size_) {
+          ::munmap(mem, size_);
+          return false;
+        }
+        // Single client: take the segment over only from a dead one.
+        std::int32_t self = static_cast<std::int32_t>(::getpid());
+        std::int32_t owner = __atomic_load_n(&h->client_pid, __ATOMIC_ACQUIRE);
+        if ((owner != 0 && process_alive(owner)) ||
+            !__atomic_compare_exchange_n(&h->client_pid, &owner, self, false,
+                                         __ATOMIC_ACQ_REL,
+                                         __ATOMIC_RELAXED)) {
+          ::munmap(mem, size_);
+          return false;
+        }
+        seg_ = h;
+        next_id_ = static_cast<std::uint64_t>(self) << 32;
+        return true;
+      }
+      ::munmap(mem, size_);
+    } else if (fd >= 0) {
+      ::close(fd);
+    }
+    if (waited >= timeout_ms)
+      return false;
+    ::usleep(5000);
+  }
+}
+
+int ShmClient::call(std::string_view text, const Options &opt,
+                    std::string *json, Priority priority,
+                    std::uint32_t deadline_ms, std::uint64_t session) {
+  if (!seg_)
+    return -1;
+  if (text.size() > seg_->slot_size) {
+    *json = error_json("INPUT_TOO_LARGE", "stdin exceeds max size");
+    return 2;
+  }
+  tv_shm_slot head{};
+  head.len = static_cast<std::uint32_t>(text.size());
+  head.locale = static_cast<std::uint8_t>(opt.locale);
+  head.domain = static_cast<std::uint8_t>(opt.domain);
+  head.priority = static_cast<std::uint8_t>(priority);
+  head.kind = TV_SHM_KIND_TICKET;
+  head.budget_ms = opt.budget_ms;
+  head.max_lines = opt.max_lines;
+  head.deadline = deadline_ms ? tv_shm_deadline(deadline_ms) : 0;
+  head.session = session;
+  return send(head, text, json);
+}
+
+int ShmClient::stats(std::string *json) {
+  if (!seg_)
+    return -1;
+  tv_shm_slot head{};
+  head.kind = TV_SHM_KIND_STATS;
+  return send(head, {}, json);
+}
+
+int ShmClient::send(tv_shm_slot head, std::string_view payload,
+                    std::string *json) {
+  std::uint64_t id;
+  {
+    std::lock_guard<std::mutex> lock(req_m_);
+    tv_shm_slot *req;
+    while (!(req = tv_shm_wait_reserve(seg_, &seg_->req, idle_poll_ms)))
+      if (!process_alive(seg_->server_pid))
+        return -1;
+    id = head.id = ++next_id_;
+    {
+      // Registered before the engine can see the request.
+      std::lock_guard<std::mutex> wait(resp_m_);
+      waiting_[id];
+    }
+    *req = head;
+    std::memcpy(tv_shm_payload(req), payload.data(), payload.size());
+    tv_shm_publish(&seg_->req);
+  }
+
+  // One caller at a time reads the response ring and hands each response
+  // to its caller.
+  std::unique_lock<std::mutex> lock(resp_m_);
+  for (;;) {
+    auto mine = waiting_.find(id);
+    if (mine->second) {
+      Reply reply = std::move(*mine->second);
+      waiting_.erase(mine);
+      *json = std::move(reply.json);
+      return reply.code;
+    }
+    if (reading_) {
+      replied_.wait(lock);
+      continue;
+    }
+    reading_ = true;
+    lock.unlock();
+    tv_shm_slot *resp = tv_shm_wait_peek(seg_, &seg_->resp, idle_poll_ms);
+    bool gone = !resp && !process_alive(seg_->server_pid);
+    lock.lock();
+    reading_ = false;
+    if (resp) {
+      // Not waited for: left over from a previous client.
+      if (auto to = waiting_.find(resp->id); to != waiting_.end())
+        to->second = Reply{static_cast<int>(resp->code),
+                           std::string(tv_shm_payload(resp),
+                                       std::min(resp->len, seg_->slot_size))};
+      tv_shm_release(&seg_->resp);
+    }
+    replied_.notify_all();
+    if (gone) {
+      waiting_.erase(id);
+      return -1;
+    }
+  }
+}
+
+} // namespace tv
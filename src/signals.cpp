@@ -1,30 +1,100 @@
 #include "tv/signals.hpp"
-#include <regex>
+#include <algorithm>
 
 namespace tv {
 
-Signals detect_signals(std::string_view text) {
-  Signals s{};
-
-  // SIRET: 14 digits (often grouped, but OCR here is contiguous)
-  static const std::regex re_siret(R"(\bSIRET\b[^0-9]*([0-9]{14})\b)",
-                                   std::regex::icase);
-  std::cmatch m;
-  if (std::regex_search(text.begin(), text.end(), m, re_siret)) {
-    s.has_siret = true;
-  }
-  static const std::regex re_card(
-      R"(\b(CB|CARTE\s+BANCAIRE|VISA|MASTERCARD|AMEX)\b)", std::regex::icase);
+SignalScanner::SignalScanner(const RuleSet &rules)
+    : rules_(&rules), card_(rules.card_keywords), tax_(rules.tax_keywords),
+      id_labels_(rules.company_id_keywords) {}
 
-  if (std::regex_search(text.begin(), text.end(), re_card)) {
-    s.has_card_keywords = true;
-  }
-  static const std::regex re_tva(R"(\bTVA\b\.?)", std::regex::icase);
-  if (std::regex_search(text.begin(), text.end(), re_tva)) {
-    s.has_tva = true;
+// Company id label followed, after any non-digits, by exactly `digits`
+// contiguous digits (OCR here is contiguous). Labels have no digits, so every
+// label found before the next digit run shares its verdict: after a label
+// the search moves on to that run.
+void SignalScanner::scan_company_id(std::string_view text, bool final) {
+  while (!id_done_) {
+    if (!id_in_gap_) {
+      std::size_t resume = 0;
+      auto m = id_labels_.find(text, id_pos_, true, final, &resume);
+      if (!m) {
+        if (final)
+          id_done_ = true;
+        else
+          id_pos_ = resume;
+        return;
+      }
+      id_pos_ = m->end;
+      id_in_gap_ = true;
+    }
+
+    std::size_t q = id_pos_;
+    while (q < text.size() && !is_ascii_digit(text[q]))
+      q++;
+    id_pos_ = q;
+    if (q >= text.size()) {
+      if (final)
+        id_done_ = true; // no digits left at all
+      return;
+    }
+
+    std::size_t e = q;
+    while (e < text.size() && e - q < rules_->company_id_digits &&
+           is_ascii_digit(text[e]))
+      e++;
+    if (e >= text.size() && !final)
+      return; // run or \b still open
+    if (e - q == rules_->company_id_digits && is_word_boundary(text, e)) {
+      signals_.has_siret = true;
+      id_done_ = true;
+      return;
+    }
+    id_in_gap_ = false; // next label, from this run on
   }
+}
+
+std::size_t SignalScanner::scan(std::string_view text, bool final) {
+  auto phrase = [&](const PhraseScanner &sc, std::size_t &pos, bool &done,
+                    bool &flag) {
+    if (done)
+      return;
+    std::size_t resume = 0;
+    if (sc.find(text, pos, true, final, &resume)) {
+      flag = true;
+      done = true;
+    } else if (final) {
+      done = true;
+    } else {
+      pos = resume;
+    }
+  };
+  phrase(card_, card_pos_, card_done_, signals_.has_card_keywords);
+  phrase(tax_, tax_pos_, tax_done_, signals_.has_tva);
+  scan_company_id(text, final);
 
-  return s;
+  std::size_t need = text.size();
+  if (!card_done_)
+    need = std::min(need, card_pos_);
+  if (!tax_done_)
+    need = std::min(need, tax_pos_);
+  if (!id_done_)
+    need = std::min(need, id_pos_);
+  return need;
+}
+
+void SignalScanner::shift(std::size_t n) {
+  card_pos_ -= std::min(card_pos_, n);
+  tax_pos_ -= std::min(tax_pos_, n);
+  id_pos_ -= std::min(id_pos_, n);
+}
+
+Signals detect_signals(std::string_view text, const RuleSet &rules) {
+  SignalScanner sc(rules);
+  sc.scan(text, true);
+  return sc.signals();
+}
+
+Signals detect_signals(std::string_view text) {
+  return detect_signals(text, default_rules);
 }
 
 } // namespace tv
@@ -0,0 +1,276 @@
+#include "tv/sketch.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <stdexcept>
+
+namespace tv {
+
+std::uint64_t sketch_hash(std::string_view key) {
+  std::uint64_t h = 0xCBF29CE484222325ull; // FNV-1a
+  for (char c : key)
+    h = (h ^ static_cast<unsigned char>(c)) * 0x100000001B3ull;
+  h ^= h >> 30; // splitmix64 finalizer
+  h *= 0xBF58476D1CE4E5B9ull;
+  h ^= h >> 27;
+  h *= 0x94D049BB133111EBull;
+  return h ^ (h >> 31);
+}
+
+// ---- HyperLogLog ----
+
+HyperLogLog::HyperLogLog(unsigned precision)
+    : precision_(std::clamp(precision, 4u, 18u)),
+      registers_(std::size_t{1} << precision_) {}
+
+void HyperLogLog::add(std::uint64_t hash) {
+  const std::size_t index = hash >> (64 - precision_);
+  // The rank of the first 1 in what is left, bounded by a guard bit.
+  const std::uint64_t rest =
+      (hash << precision_) | (std::uint64_t{1} << (precision_ - 1));
+  const auto rank = static_cast<std::uint8_t>(std::countl_zero(rest) + 1);
+  registers_[index] = std::max(registers_[index], rank);
+}
+
+void HyperLogLog::merge(const HyperLogLog &other) {
+  if (other.precision_ != precision_)
+    throw std::invalid_argument("HyperLogLog::merge: precision differs");
+  for (std::size_t i = 0; i < registers_.size(); i++)
+    registers_[i] = std::max(registers_[i], other.registers_[i]);
+}
+
+double HyperLogLog::estimate() const {
+  const double m = static_cast<double>(registers_.size());
+  double sum = 0.0;
+  std::size_t zeros = 0;
+  for (std::uint8_t r : registers_) {
+    sum += std::ldexp(1.0, -r);
+    zeros += r == 0;
+  }
+  const double alpha = 0.7213 / (1.0 + 1.079 / m);
+  const double e = alpha * m * m / sum;
+  // Few keys: most registers still empty, linear counting is closer.
+  if (e <= 2.5 * m && zeros > 0)
+    return m * std::log(m / static_cast<double>(zeros));
+  return e;
+}
+
+double HyperLogLog::standard_error() const {
+  return 1.04 / std::sqrt(static_cast<double>(registers_.size()));
+}
+
+// ---- SpaceSaving ----
+
+SpaceSaving::SpaceSaving(std::size_t capacity)
+    : capacity_(capacity ? capacity : 1) {
+  heap_.reserve(capacity_);
+  at_.reserve(capacity_);
+}
+
+void SpaceSaving::swap_entries(std::size_t a, std::size_t b) {
+  std::swap(heap_[a], heap_[b]);
+  at_[heap_[a].key] = a;
+  at_[heap_[b].key] = b;
+}
+
+void SpaceSaving::sift_down(std::size_t i) {
+  for (;;) {
+    std::size_t least = i;
+    for (std::size_t c = 2 * i + 1; c <= 2 * i + 2 && c < heap_.size(); c++)
+      if (heap_[c].count < heap_[least].count)
+        least = c;
+    if (least == i)
+      return;
+    swap_entries(i, least);
+    i = least;
+  }
+}
+
+void SpaceSaving::sift_up(std::size_t i) {
+  while (i > 0 && heap_[i].count < heap_[(i - 1) / 2].count) {
+    swap_entries(i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+}
+
+void SpaceSaving::add(std::string_view key, std::size_t kind) {
+  kind = std::min(kind, kinds - 1);
+  std::string k(key);
+  auto it = at_.find(k);
+  if (it != at_.end()) {
+    Entry &e = heap_[it->second];
+    e.count++;
+    e.by_kind[kind]++;
+    sift_down(it->second);
+    return;
+  }
+  if (heap_.size() < capacity_) {
+    Entry e;
+    e.key = k;
+    e.count = 1;
+    e.by_kind[kind] = 1;
+    heap_.push_back(std::move(e));
+    at_.emplace(std::move(k), heap_.size() - 1);
+    sift_up(heap_.size() - 1);
+    return;
+  }
+  // Takes over the smallest counter.
+  Entry &least = heap_.front();
+  at_.erase(least.key);
+  least.key = k;
+  least.error = least.count;
+  least.count++;
+  least.by_kind = {};
+  least.by_kind[kind] = 1;
+  at_.emplace(std::move(k), 0);
+  sift_down(0);
+}
+
+std::uint64_t SpaceSaving::floor() const {
+  return heap_.size() < capacity_ ? 0 : heap_.front().count;
+}
+
+void SpaceSaving::rebuild(std::vector<Entry> entries) {
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry &a, const Entry &b) {
+              return a.count != b.count ? a.count > b.count : a.key < b.key;
+            });
+  if (entries.size() > capacity_)
+    entries.resize(capacity_);
+  // Sorted descending: reversed, it is a min-heap already.
+  std::reverse(entries.begin(), entries.end());
+  heap_ = std::move(entries);
+  at_.clear();
+  for (std::size_t i = 0; i < heap_.size(); i++)
+    at_[heap_[i].key] = i;
+}
+
+void SpaceSaving::merge(const SpaceSaving &other) {
+  const std::uint64_t mine = floor(), theirs = other.floor();
+  std::vector<Entry> entries = heap_;
+  for (auto &e : entries) {
+    auto it = other.at_.find(e.key);
+    if (it == other.at_.end()) {
+      e.count += theirs;
+      e.error += theirs;
+      continue;
+    }
+    const Entry &o = other.heap_[it->second];
+    e.count += o.count;
+    e.error += o.error;
+    for (std::size_t k = 0; k < kinds; k++)
+      e.by_kind[k] += o.by_kind[k];
+  }
+  for (const auto &o : other.heap_)
+    if (!at_.count(o.key)) {
+      Entry e = o;
+      e.count += mine;
+      e.error += mine;
+      entries.push_back(std::move(e));
+    }
+  rebuild(std::move(entries));
+}
+
+std::vector<SpaceSaving::Entry> SpaceSaving::top(std::size_t k) const {
+  std::vector<Entry> entries = heap_;
+  k = std::min(k, entries.size());
+  std::partial_sort(entries.begin(), entries.begin() + k, entries.end(),
+                    [](const Entry &a, const Entry &b) {
+                      return a.count != b.count ? a.count > b.count
+                                                : a.key < b.key;
+                    });
+  entries.resize(k);
+  return entries;
+}
+
+std::size_t SpaceSaving::memory() const {
+  // Each key twice (entry and index), plus a hash node.
+  std::size_t bytes = 0;
+  for (const auto &e : heap_)
+    bytes += sizeof(Entry) + 2 * e.key.size() + sizeof(std::string) + 32;
+  return bytes;
+}
+
+// ---- DDSketch ----
+
+DDSketch::DDSketch(double accuracy, std::size_t max_buckets)
+    : accuracy_(std::clamp(accuracy, 1e-4, 0.5)),
+      gamma_((1.0 + accuracy_) / (1.0 - accuracy_)),
+      log_gamma_(std::log(gamma_)),
+      max_buckets_(std::max<std::size_t>(max_buckets, 2)) {}
+
+int DDSketch::bucket(double value) const {
+  return static_cast<int>(std::ceil(std::log(value) / log_gamma_));
+}
+
+void DDSketch::add(double value) {
+  if (!std::isfinite(value))
+    return;
+  min_ = count_ == 0 ? value : std::min(min_, value);
+  max_ = count_ == 0 ? value : std::max(max_, value);
+  count_++;
+  sum_ += value;
+  if (value <= 0.0)
+    zero_++;
+  else
+    add_count(bucket(value), 1);
+}
+
+// Widens the bucket range to take `index` when needed; past max_buckets
+// the range keeps its top and what falls below goes to the lowest bucket.
+void DDSketch::add_count(int index, std::uint64_t n) {
+  if (buckets_.empty()) {
+    offset_ = index;
+    buckets_.assign(1, 0);
+  }
+  const int top = offset_ + static_cast<int>(buckets_.size()) - 1;
+  if (index < offset_ || index > top) {
+    const int hi = std::max(top, index);
+    const int lo = std::max(std::min(offset_, index),
+                            hi - static_cast<int>(max_buckets_) + 1);
+    std::vector<std::uint64_t> wider(static_cast<std::size_t>(hi - lo + 1));
+    for (std::size_t i = 0; i < buckets_.size(); i++)
+      wider[static_cast<std::size_t>(
+          std::max(offset_ + static_cast<int>(i), lo) - lo)] += buckets_[i];
+    buckets_ = std::move(wider);
+    offset_ = lo;
+  }
+  buckets_[static_cast<std::size_t>(std::max(index, offset_) - offset_)] += n;
+}
+
+void DDSketch::merge(const DDSketch &other) {
+  if (other.gamma_ != gamma_)
+    throw std::invalid_argument("DDSketch::merge: accuracy differs");
+  if (other.count_ == 0)
+    return;
+  min_ = count_ == 0 ? other.min_ : std::min(min_, other.min_);
+  max_ = count_ == 0 ? other.max_ : std::max(max_, other.max_);
+  count_ += other.count_;
+  sum_ += other.sum_;
+  zero_ += other.zero_;
+  for (std::size_t i = 0; i < other.buckets_.size(); i++)
+    if (other.buckets_[i])
+      add_count(other.offset_ + static_cast<int>(i), other.buckets_[i]);
+}
+
+double DDSketch::quantile(double q) const {
+  if (count_ == 0)
+    return 0.0;
+  const double rank =
+      std::clamp(q, 0.0, 1.0) * static_cast<double>(count_ - 1);
+  std::uint64_t seen = zero_;
+  if (static_cast<double>(seen) > rank)
+    return std::min(0.0, max_);
+  for (std::size_t i = 0; i < buckets_.size(); i++) {
+    seen += buckets_[i];
+    if (static_cast<double>(seen) > rank) {
+      const int index = offset_ + static_cast<int>(i);
+      const double v = 2.0 * std::pow(gamma_, index) / (gamma_ + 1.0);
+      return std::clamp(v, min_, max_);
+    }
+  }
+  return max_;
+}
+
+} // namespace tv
@@ -0,0 +1,123 @@
+#include "tv/task_pool.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace tv {
+
+// The pool and deque index of the worker running on this thread, if any.
+static thread_local const TaskPool *this_pool = nullptr;
+static thread_local std::size_t this_index = 0;
+
+TaskPool::TaskPool(std::size_t workers) {
+  for (std::size_t i = 0; i <= workers; i++)
+    queues_.push_back(std::make_unique<Queue>());
+  for (std::size_t i = 0; i < workers; i++)
+    threads_.emplace_back([this, i] { work(i); });
+}
+
+TaskPool::~TaskPool() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_m_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (auto &t : threads_)
+    t.join();
+}
+
+TaskPool &TaskPool::shared() {
+  static TaskPool pool([] {
+    unsigned hw = std::thread::hardware_concurrency();
+    return std::min<std::size_t>(hw > 1 ? hw - 1 : 0, 7);
+  }());
+  return pool;
+}
+
+void TaskPool::push(std::function<void()> task) {
+  std::size_t q = this_pool == this ? this_index : threads_.size();
+  {
+    std::lock_guard<std::mutex> lock(queues_[q]->m);
+    queues_[q]->tasks.push_back(std::move(task));
+  }
+  queued_.fetch_add(1, std::memory_order_release);
+  // Taking the lock orders this push before a worker's "nothing queued"
+  // check, so the notification cannot be lost.
+  { std::lock_guard<std::mutex> lock(sleep_m_); }
+  wake_.notify_one();
+}
+
+bool TaskPool::run_one() {
+  if (queued_.load(std::memory_order_acquire) == 0)
+    return false;
+  std::size_t own = this_pool == this ? this_index : threads_.size();
+  std::function<void()> task;
+  for (std::size_t k = 0; k < queues_.size() && !task; k++) {
+    std::size_t q = (own + k) % queues_.size();
+    std::lock_guard<std::mutex> lock(queues_[q]->m);
+    auto &tasks = queues_[q]->tasks;
+    if (tasks.empty())
+      continue;
+    if (k == 0 && own < threads_.size()) { // own deque: newest first
+      task = std::move(tasks.back());
+      tasks.pop_back();
+    } else {
+      task = std::move(tasks.front());
+      tasks.pop_front();
+    }
+  }
+  if (!task)
+    return false;
+  queued_.fetch_sub(1, std::memory_order_relaxed);
+  task();
+  return true;
+}
+
+void TaskPool::work(std::size_t index) {
+  this_pool = this;
+  this_index = index;
+  for (;;) {
+    if (run_one())
+      continue;
+    std::unique_lock<std::mutex> lock(sleep_m_);
+    wake_.wait(lock, [this] {
+      return stop_ || queued_.load(std::memory_order_acquire) > 0;
+    });
+    if (stop_)
+      return;
+  }
+}
+
+// ---- TaskGroup ----
+
+TaskGroup::~TaskGroup() {
+  // Tasks reference the group; never leave them running behind it.
+  while (pending_.load(std::memory_order_acquire) > 0)
+    if (!pool_.run_one())
+      std::this_thread::yield();
+}
+
+void TaskGroup::run(std::function<void()> task) {
+  pending_.fetch_add(1, std::memory_order_relaxed);
+  pool_.push([this, task = std::move(task)] {
+    try {
+      task();
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(error_m_);
+      if (!error_)
+        error_ = std::current_exception();
+    }
+    pending_.fetch_sub(1, std::memory_order_release);
+  });
+}
+
+void TaskGroup::wait() {
+  while (pending_.load(std::memory_order_acquire) > 0)
+    if (!pool_.run_one())
+      std::this_thread::yield();
+  std::lock_guard<std::mutex> lock(error_m_);
+  if (error_)
+    std::rethrow_exception(std::exchange(error_, nullptr));
+}
+
+} // namespace tv
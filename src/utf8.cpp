@@ -0,0 +1,276 @@
+#include "tv/utf8.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TV_UTF8_SSSE3 1
+#include <immintrin.h>
+#endif
+
+namespace tv {
+
+// Decodes the sequence at p. Returns its length (1..4) when valid, 0 when
+// invalid; in that case *bad is the length of the maximal invalid subpart
+// (Unicode "substitution of maximal subparts").
+static std::size_t decode_one(const unsigned char *p, std::size_t n,
+                              std::size_t *bad) {
+  unsigned char c = p[0];
+  if (c < 0x80)
+    return 1;
+
+  std::size_t need = 0;
+  unsigned char lo = 0x80, hi = 0xBF;
+  if (c >= 0xC2 && c <= 0xDF) {
+    need = 1;
+  } else if (c == 0xE0) {
+    need = 2;
+    lo = 0xA0;
+  } else if (c == 0xED) {
+    need = 2;
+    hi = 0x9F; // no surrogates
+  } else if (c >= 0xE1 && c <= 0xEF) {
+    need = 2;
+  } else if (c == 0xF0) {
+    need = 3;
+    lo = 0x90;
+  } else if (c == 0xF4) {
+    need = 3;
+    hi = 0x8F; // <= U+10FFFF
+  } else if (c >= 0xF1 && c <= 0xF3) {
+    need = 3;
+  } else {
+    *bad = 1;
+    return 0;
+  }
+
+  std::size_t i = 1;
+  for (; i <= need && i < n; i++) {
+    unsigned char b = p[i];
+    if (b < lo || b > hi)
+      break;
+    lo = 0x80;
+    hi = 0xBF;
+  }
+  if (i > need)
+    return need + 1;
+  *bad = i;
+  return 0;
+}
+
+static std::size_t valid_prefix_scalar(const unsigned char *p,
+                                       std::size_t n) {
+  std::size_t i = 0;
+  while (i < n) {
+    // ASCII runs, one word at a time
+    while (i + 8 <= n) {
+      std::uint64_t w;
+      std::memcpy(&w, p + i, 8);
+      if (w & 0x8080808080808080ull)
+        break;
+      i += 8;
+    }
+    if (i >= n)
+      break;
+    if (p[i] < 0x80) {
+      i++;
+      continue;
+    }
+    std::size_t bad = 0;
+    std::size_t len = decode_one(p + i, n - i, &bad);
+    if (len == 0)
+      return i;
+    i += len;
+  }
+  return n;
+}
+
+#ifdef TV_UTF8_SSSE3
+
+// Block validator after Keiser & Lemire, "Validating UTF-8 In Less Than One
+// Instruction Per Byte" (the simdutf "lookup" algorithm): three nibble
+// lookups classify every (previous byte, byte) pair, and a saturating
+// subtract checks that 3rd/4th bytes sit where a lead byte asked for them.
+namespace {
+constexpr char TOO_SHORT = 1 << 0;
+constexpr char TOO_LONG = 1 << 1;
+constexpr char OVERLONG_3 = 1 << 2;
+constexpr char TOO_LARGE = 1 << 3;
+constexpr char SURROGATE = 1 << 4;
+constexpr char OVERLONG_2 = 1 << 5;
+constexpr char TOO_LARGE_1000 = 1 << 6;
+constexpr char OVERLONG_4 = 1 << 6;
+constexpr char TWO_CONTS = static_cast<char>(1 << 7);
+constexpr char CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+} // namespace
+
+// Last position <= k where a sequence starts, so that [0, result) is made
+// of whole characters.
+static std::size_t char_boundary_before(const unsigned char *p,
+                                        std::size_t k) {
+  std::size_t lim = k >= 4 ? k - 4 : 0;
+  for (std::size_t j = k; j > lim; j--) {
+    if ((p[j - 1] & 0xC0) != 0x80)
+      return j - 1;
+  }
+  return lim;
+}
+
+#define TV_SSSE3 __attribute__((target("ssse3")))
+
+// Error bits for the 16 (previous byte, byte) pairs of a block; zero when
+// the block is valid given the 3 bytes that precede it.
+TV_SSSE3 static inline __m128i block_errors(__m128i in, __m128i prev) {
+  const __m128i byte_1_high = _mm_setr_epi8(
+      TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+      TOO_LONG, TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+      TOO_SHORT | OVERLONG_2, TOO_SHORT, TOO_SHORT | OVERLONG_3 | SURROGATE,
+      TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+  const __m128i byte_1_low = _mm_setr_epi8(
+      CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, CARRY | OVERLONG_2, CARRY,
+      CARRY, CARRY | TOO_LARGE, CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+      CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000);
+  const __m128i byte_2_high = _mm_setr_epi8(
+      TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+      TOO_SHORT, TOO_SHORT,
+      TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 |
+          OVERLONG_4,
+      TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+      TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+      TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE, TOO_SHORT,
+      TOO_SHORT, TOO_SHORT, TOO_SHORT);
+  const __m128i low_nibble = _mm_set1_epi8(0x0F);
+
+  __m128i prev1 = _mm_alignr_epi8(in, prev, 15);
+  __m128i sc = _mm_and_si128(
+      _mm_and_si128(
+          _mm_shuffle_epi8(byte_1_high,
+                           _mm_and_si128(_mm_srli_epi16(prev1, 4), low_nibble)),
+          _mm_shuffle_epi8(byte_1_low, _mm_and_si128(prev1, low_nibble))),
+      _mm_shuffle_epi8(byte_2_high,
+                       _mm_and_si128(_mm_srli_epi16(in, 4), low_nibble)));
+  __m128i prev2 = _mm_alignr_epi8(in, prev, 14);
+  __m128i prev3 = _mm_alignr_epi8(in, prev, 13);
+  __m128i is_third = _mm_subs_epu8(prev2, _mm_set1_epi8(0xE0 - 0x80));
+  __m128i is_fourth =
+      _mm_subs_epu8(prev3, _mm_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+  __m128i must23 = _mm_and_si128(_mm_or_si128(is_third, is_fourth),
+                                 _mm_set1_epi8(TWO_CONTS));
+  return _mm_xor_si128(must23, sc);
+}
+
+TV_SSSE3 static inline bool any_set(__m128i v) {
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) != 0xFFFF;
+}
+
+TV_SSSE3 static std::size_t valid_prefix_ssse3(const unsigned char *p,
+                                               std::size_t n) {
+  // A block ending in one of these bytes continues in the next block.
+  const __m128i max_complete =
+      _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                    static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1),
+                    static_cast<char>(0xC0 - 1));
+  const __m128i zero = _mm_setzero_si128();
+
+  __m128i prev = zero;
+  __m128i prev_incomplete = zero;
+  std::size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+    __m128i err;
+    if (_mm_movemask_epi8(in) == 0) {
+      err = prev_incomplete;
+    } else {
+      err = block_errors(in, prev);
+      prev_incomplete = _mm_subs_epu8(in, max_complete);
+    }
+    if (any_set(err))
+      return char_boundary_before(p, i);
+    prev = in;
+  }
+
+  if (i < n) {
+    // Zero padding is ASCII, so a truncated tail shows up as TOO_SHORT.
+    alignas(16) unsigned char buf[16] = {};
+    std::memcpy(buf, p + i, n - i);
+    __m128i in = _mm_load_si128(reinterpret_cast<const __m128i *>(buf));
+    if (any_set(block_errors(in, prev)))
+      return char_boundary_before(p, i);
+  } else if (any_set(prev_incomplete)) {
+    return char_boundary_before(p, n);
+  }
+  return n;
+}
+
+#undef TV_SSSE3
+
+static const bool has_ssse3 = (__builtin_cpu_init(),
+                                __builtin_cpu_supports("ssse3"));
+
+#endif
+
+// Length of a prefix of p made of valid whole characters. The vectorized
+// path may stop up to one block before the first error; callers locate the
+// error itself with decode_one.
+static std::size_t valid_prefix(const unsigned char *p, std::size_t n) {
+#ifdef TV_UTF8_SSSE3
+  if (has_ssse3)
+    return valid_prefix_ssse3(p, n);
+#endif
+  return valid_prefix_scalar(p, n);
+}
+
+bool validate_utf8(std::string_view s) {
+  auto p = reinterpret_cast<const unsigned char *>(s.data());
+  return valid_prefix(p, s.size()) == s.size();
+}
+
+std::size_t repair_utf8(std::string_view s, std::string &out) {
+  static constexpr std::string_view replacement = "\xEF\xBF\xBD"; // U+FFFD
+
+  auto p = reinterpret_cast<const unsigned char *>(s.data());
+  const std::size_t n = s.size();
+  out.clear();
+  out.reserve(n);
+
+  std::size_t repairs = 0;
+  std::size_t i = 0;
+  while (i < n) {
+    std::size_t v = i + valid_prefix(p + i, n - i);
+    std::size_t bad = 0;
+    while (v < n) {
+      std::size_t len = decode_one(p + v, n - v, &bad);
+      if (len == 0)
+        break;
+      v += len;
+    }
+    out.append(s.data() + i, v - i);
+    if (v >= n)
+      break;
+    out.append(replacement);
+    repairs++;
+    i = v + bad;
+  }
+  return repairs;
+}
+
+std::size_t utf8_incomplete_tail(std::string_view s) {
+  for (std::size_t k = 1; k <= 3 && k <= s.size(); k++) {
+    auto c = static_cast<unsigned char>(s[s.size() - k]);
+    if ((c & 0xC0) == 0x80)
+      continue; // continuation byte, keep looking for the lead
+    std::size_t len = (c >= 0xC2 && c <= 0xDF)   ? 2
+                      : (c >= 0xE0 && c <= 0xEF) ? 3
+                      : (c >= 0xF0 && c <= 0xF4) ? 4
+                                                 : 0;
+    return len > k ? k : 0;
+  }
+  return 0;
+}
+
+} // namespace tv
@@ -0,0 +1,385 @@
+#include "tv/zygote.hpp"
+#include "tv/mapped_file.hpp"
+#include "tv/rule_pack.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace tv {
+
+static constexpr std::uint32_t ZYGOTE_MAGIC = 0x315a5654; // "TVZ1"
+static constexpr std::uint32_t MAX_REQUEST = 64 * 1024;
+
+struct RequestHeader {
+  std::uint32_t magic;
+  std::uint32_t size;
+};
+
+static bool make_address(const std::string &path, sockaddr_un *addr) {
+  std::memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(addr->sun_path))
+    return false;
+  std::memcpy(addr->sun_path, path.c_str(), path.size() + 1);
+  return true;
+}
+
+static bool read_full(int fd, char *p, std::size_t n) {
+  while (n > 0) {
+    ssize_t r = ::read(fd, p, n);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return false;
+    p += r;
+    n -= static_cast<std::size_t>(r);
+  }
+  return true;
+}
+
+static bool write_full(int fd, const char *p, std::size_t n) {
+  while (n > 0) {
+    ssize_t r = ::write(fd, p, n);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return false;
+    p += r;
+    n -= static_cast<std::size_t>(r);
+  }
+  return true;
+}
+
+// ---- server ----
+
+static int wake_fd = -1; // write end of the self-pipe
+static volatile std::sig_atomic_t stop_requested = 0;
+static volatile std::sig_atomic_t reload_requested = 0;
+
+static void on_signal(int sig) {
+  if (sig == SIGHUP)
+    reload_requested = 1;
+  else if (sig != SIGCHLD)
+    stop_requested = 1;
+  int saved = errno;
+  char c = 0;
+  [[maybe_unused]] auto r = ::write(wake_fd, &c, 1);
+  errno = saved;
+}
+
+// Reads one request: arguments plus the three stdio descriptors.
+static bool read_request(int conn, std::vector<std::string> *args,
+                         int fds[3]) {
+  RequestHeader h{};
+  iovec iov{&h, sizeof(h)};
+  alignas(cmsghdr) char ctrl[CMSG_SPACE(3 * sizeof(int))];
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctrl;
+  msg.msg_controllen = sizeof(ctrl);
+
+  ssize_t r;
+  do {
+    r = ::recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+  } while (r < 0 && errno == EINTR);
+  if (r <= 0)
+    return false;
+
+  int got = 0;
+  for (cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+    if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+      got = static_cast<int>((c->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+      std::memcpy(fds, CMSG_DATA(c), std::min(got, 3) * sizeof(int));
+      for (int i = 3; i < got; i++) {
+        int extra;
+        std::memcpy(&extra, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+        ::close(extra);
+      }
+    }
+  }
+  auto drop_fds = [&] {
+    for (int i = 0; i < std::min(got, 3); i++)
+      ::close(fds[i]);
+  };
+
+  if (got != 3 ||
+      (static_cast<std::size_t>(r) < sizeof(h) &&
+       !read_full(conn, reinterpret_cast<char *>(&h) + r, sizeof(h) - r)) ||
+      h.magic != ZYGOTE_MAGIC || h.size > MAX_REQUEST) {
+    drop_fds();
+    return false;
+  }
+  std::string payload(h.size, '\0');
+  if (!read_full(conn, payload.data(), payload.size()) ||
+      (!payload.empty() && payload.back() != '\0')) {
+    drop_fds();
+    return false;
+  }
+  args->clear();
+  for (std::size_t pos = 0; pos < payload.size();) {
+    auto end = payload.find('\0', pos);
+    args->emplace_back(payload, pos, end - pos);
+    pos = end + 1;
+  }
+  return true;
+}
+
+static bool same_user(int conn) {
+  ucred cred{};
+  socklen_t len = sizeof(cred);
+  return ::getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 &&
+         cred.uid == ::geteuid();
+}
+
+// Runs in the forked child: reads the request there, so a client that
+// stalls mid-request holds up only its own child, never the accept loop.
+[[noreturn]] static void run_child(const ZygoteHandler &handler,
+                                   int listen_fd, int wake_rd, int conn) {
+  std::signal(SIGCHLD, SIG_DFL);
+  std::signal(SIGTERM, SIG_DFL);
+  std::signal(SIGINT, SIG_DFL);
+  std::signal(SIGHUP, SIG_DFL);
+  ::close(listen_fd);
+  ::close(wake_rd);
+  ::close(wake_fd);
+
+  std::vector<std::string> args;
+  int fds[3] = {-1, -1, -1};
+  if (!read_request(conn, &args, fds)) {
+    // No reply: the server's exit report then fails on the shut socket,
+    // and the client sees the connection closed, as for any bad request.
+    ::shutdown(conn, SHUT_RDWR);
+    ::_exit(3);
+  }
+  std::signal(SIGPIPE, SIG_DFL);
+  ::close(conn);
+  for (int i = 0; i < 3; i++) {
+    ::dup2(fds[i], i);
+    ::close(fds[i]);
+  }
+
+  int code = 3;
+  try {
+    code = handler(args);
+  } catch (...) {
+  }
+  // _exit skips the exit-time flush: what a handler left in stdio buffers
+  // would be lost. Handlers write through write_fd, no iostreams.
+  std::fflush(nullptr);
+  ::_exit(code);
+}
+
+static void report_exit(int conn, int status) {
+  std::int32_t code = WIFEXITED(status)     ? WEXITSTATUS(status)
+                      : WIFSIGNALED(status) ? 128 + WTERMSIG(status)
+                                            : 3;
+  write_full(conn, reinterpret_cast<const char *>(&code), sizeof(code));
+  ::close(conn);
+}
+
+int serve_zygote(const std::string &socket_path, const ZygoteHandler &handler,
+                 bool debug) {
+  sockaddr_un addr;
+  if (!make_address(socket_path, &addr)) {
+    write_fd(STDERR_FILENO, {"[zygote] invalid socket path\n"});
+    return 2;
+  }
+
+  int listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  struct stat st;
+  if (::lstat(socket_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+    ::unlink(socket_path.c_str()); // stale socket from a previous run
+  mode_t old_mask = ::umask(0077);
+  bool bound = listen_fd >= 0 &&
+               ::bind(listen_fd, reinterpret_cast<sockaddr *>(&addr),
+                      sizeof(addr)) == 0 &&
+               ::listen(listen_fd, 128) == 0;
+  ::umask(old_mask);
+  if (!bound) {
+    write_fd(STDERR_FILENO, {"[zygote] cannot listen on ", socket_path, ": ",
+                             std::strerror(errno), "\n"});
+    if (listen_fd >= 0)
+      ::close(listen_fd);
+    return 2;
+  }
+
+  int wake[2];
+  if (::pipe2(wake, O_CLOEXEC | O_NONBLOCK) != 0) {
+    ::close(listen_fd);
+    return 2;
+  }
+  wake_fd = wake[1];
+  stop_requested = 0;
+  reload_requested = 0;
+
+  struct sigaction sa{};
+  sa.sa_handler = on_signal;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+  ::sigaction(SIGCHLD, &sa, nullptr);
+  ::sigaction(SIGTERM, &sa, nullptr);
+  ::sigaction(SIGINT, &sa, nullptr);
+  ::sigaction(SIGHUP, &sa, nullptr);
+  std::signal(SIGPIPE, SIG_IGN); // clients may leave before their reply
+
+  if (debug)
+    write_fd(STDERR_FILENO, {"[zygote] listening on ", socket_path, "\n"});
+
+  std::unordered_map<pid_t, int> running; // child -> client connection
+  auto reap = [&](int flags) {
+    int status;
+    pid_t pid;
+    while ((pid = ::waitpid(-1, &status, flags)) > 0) {
+      auto it = running.find(pid);
+      if (it == running.end())
+        continue;
+      report_exit(it->second, status);
+      running.erase(it);
+    }
+  };
+
+  while (!stop_requested) {
+    pollfd pfd[2] = {{listen_fd, POLLIN, 0}, {wake[0], POLLIN, 0}};
+    if (::poll(pfd, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (pfd[1].revents & POLLIN) {
+      char buf[64];
+      while (::read(wake[0], buf, sizeof(buf)) > 0) {
+      }
+      reap(WNOHANG);
+    }
+    if (reload_requested) {
+      // Children forked from now on get the new pack; running ones keep
+      // their copy.
+      reload_requested = 0;
+      std::string error;
+      if (!reload_rule_pack(&error))
+        write_fd(STDERR_FILENO, {"[zygote] ", error, "\n"});
+      else if (debug)
+        write_fd(STDERR_FILENO,
+                 {"[zygote] rules ", active_rule_pack()->version(), "\n"});
+    }
+    if (stop_requested || !(pfd[0].revents & POLLIN))
+      continue;
+
+    int conn = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (conn < 0)
+      continue;
+    if (!same_user(conn)) {
+      ::close(conn);
+      continue;
+    }
+    // The child reads the request; a client that never sends it only
+    // keeps its child waiting, for this long.
+    timeval tv{1, 0};
+    ::setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    pid_t pid = ::fork();
+    if (pid == 0)
+      run_child(handler, listen_fd, wake[0], conn);
+    if (pid < 0) {
+      std::int32_t code = 3;
+      write_full(conn, reinterpret_cast<const char *>(&code), sizeof(code));
+      ::close(conn);
+      continue;
+    }
+    running.emplace(pid, conn);
+  }
+
+  if (debug)
+    write_fd(STDERR_FILENO, {"[zygote] stopping, ",
+                             std::to_string(running.size()),
+                             " request(s) in flight\n"});
+  while (!running.empty()) {
+    std::size_t before = running.size();
+    reap(0);
+    if (running.size() == before)
+      break; // no children left to wait for
+  }
+  for (auto &[pid, conn] : running)
+    ::close(conn);
+
+  std::signal(SIGCHLD, SIG_DFL);
+  std::signal(SIGTERM, SIG_DFL);
+  std::signal(SIGINT, SIG_DFL);
+  std::signal(SIGHUP, SIG_DFL);
+  ::close(wake[0]);
+  ::close(wake[1]);
+  wake_fd = -1;
+  ::close(listen_fd);
+  ::unlink(socket_path.c_str());
+  return 0;
+}
+
+// ---- client ----
+
+int zygote_call(const std::string &socket_path,
+                const std::vector<std::string> &args, int in_fd, int out_fd,
+                int err_fd) {
+  sockaddr_un addr;
+  if (!make_address(socket_path, &addr))
+    return -1;
+  int conn = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (conn < 0)
+    return -1;
+  if (::connect(conn, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) !=
+      0) {
+    ::close(conn);
+    return -1;
+  }
+
+  std::string payload;
+  for (const auto &a : args) {
+    payload += a;
+    payload.push_back('\0');
+  }
+  RequestHeader h{ZYGOTE_MAGIC, static_cast<std::uint32_t>(payload.size())};
+
+  int fds[3] = {in_fd, out_fd, err_fd};
+  iovec iov{&h, sizeof(h)};
+  alignas(cmsghdr) char ctrl[CMSG_SPACE(sizeof(fds))];
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctrl;
+  msg.msg_controllen = sizeof(ctrl);
+  cmsghdr *c = CMSG_FIRSTHDR(&msg);
+  c->cmsg_level = SOL_SOCKET;
+  c->cmsg_type = SCM_RIGHTS;
+  c->cmsg_len = CMSG_LEN(sizeof(fds));
+  std::memcpy(CMSG_DATA(c), fds, sizeof(fds));
+
+  ssize_t r;
+  do {
+    r = ::sendmsg(conn, &msg, MSG_NOSIGNAL);
+  } while (r < 0 && errno == EINTR);
+
+  // Once the descriptors are sent, a child may already be reading stdin.
+  std::int32_t code = -1;
+  if (r != static_cast<ssize_t>(sizeof(h)))
+    code = -1;
+  else if (!write_full(conn, payload.data(), payload.size()) ||
+           !read_full(conn, reinterpret_cast<char *>(&code), sizeof(code)))
+    code = -2;
+  ::close(conn);
+  return code;
+}
+
+} // namespace tv
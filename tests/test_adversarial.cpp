@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <catch2/catch_all.hpp>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tv/engine.hpp"
+#include "tv/normalize.hpp"
+#include "tv/parse_merchant.hpp"
+#include "tv/parse_total.hpp"
+#include "tv/signals.hpp"
+#include "tv/utf8.hpp"
+
+// Adversarial inputs: each one repeats a unit that keeps a matcher busy
+// (partial labels, labels without amounts, digit runs one short, endless
+// whitespace or lines, broken UTF-8). Every stage must stay linear in the
+// input size on all of them.
+struct Adversarial {
+  const char *name;
+  std::string unit;
+  std::string prefix = "";
+};
+
+static const std::vector<Adversarial> &corpus() {
+  static const std::vector<Adversarial> c = {
+      {"labels_without_amount", "TOTAL TTC : \xE2\x82\xAC \n"},
+      {"label_prefixes", "TOTA NET A PAYE A PAYE TOTAL TT "},
+      {"label_then_whitespace", " \t \n", "TOTAL :"},
+      {"amount_groups", " 000", "TOTAL 1"},
+      {"company_id_one_short", "SIRET 1234567890123 "},
+      {"company_id_long_run", "0", "SIRET "},
+      {"card_prefixes", "CARTE BANCAIR CART VIS MASTERCAR "},
+      {"word_glued_keywords", "CBTVASIRETCARTEBANCAIRE"},
+      {"one_long_line", "ABCDEFGHIJ"},
+      {"many_header_lines", "CAFE DU PORT\n"},
+      {"blank_lines", " \n"},
+      {"broken_utf8", "\xC3\xFF\xE2\x82\xF0\x9F\x98"},
+      {"nbsp_runs", "\xC2\xA0 \xC2\xA0\xC2"},
+  };
+  return c;
+}
+
+static std::string make_input(const Adversarial &a, std::size_t bytes) {
+  std::string s = a.prefix;
+  s.reserve(bytes + a.unit.size());
+  while (s.size() < bytes)
+    s += a.unit;
+  return s;
+}
+
+// Best of three, in seconds.
+static double time_of(const std::function<void()> &f) {
+  double best = 1e9;
+  for (int i = 0; i < 3; i++) {
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+    best = std::min(best, dt.count());
+  }
+  return best;
+}
+
+TEST_CASE("[adversarial] every stage stays linear in input size",
+          "[.perf]") {
+  using Stage = std::function<void(const std::string &)>;
+  const std::vector<std::pair<const char *, Stage>> stages = {
+      {"repair_utf8",
+       [](const std::string &s) {
+         std::string out;
+         tv::repair_utf8(s, out);
+       }},
+      {"normalize_ocr", [](const std::string &s) { tv::normalize_ocr(s); }},
+      {"detect_signals", [](const std::string &s) { tv::detect_signals(s); }},
+      {"parse_total",
+       [](const std::string &s) {
+         tv::ParsedTicket t;
+         tv::parse_total(s, t);
+       }},
+      {"parse_merchant",
+       [](const std::string &s) {
+         tv::ParsedTicket t;
+         tv::parse_merchant(s, t);
+       }},
+      {"run",
+       [](const std::string &s) {
+         tv::Options opt;
+         opt.max_lines = 1u << 30;
+         tv::run(s, opt);
+       }},
+  };
+
+  constexpr std::size_t small = 256 * 1024;
+  for (const auto &a : corpus()) {
+    auto s1 = make_input(a, small);
+    auto s4 = make_input(a, 4 * small);
+    for (const auto &[stage, f] : stages) {
+      double t1 = time_of([&] { f(s1); });
+      double t4 = time_of([&] { f(s4); });
+      INFO(a.name << " / " << stage << ": " << t1 * 1e3 << " ms -> "
+                  << t4 * 1e3 << " ms");
+      // 4x the input: ~4x the time when linear, 16x when quadratic. The
+      // constant absorbs timer noise on very fast stages.
+      REQUIRE(t4 <= 8 * t1 + 0.002);
+    }
+  }
+}
+
+TEST_CASE("budget_ms stops a huge ticket with DEADLINE_EXCEEDED") {
+  std::string text = "CAFE DE LA PLACE\nRUE DU PORT\nTOTAL 4,00 \xE2\x82\xAC\n";
+  text += make_input(corpus()[0], 48 * 1024 * 1024);
+
+  tv::Options opt;
+  opt.max_lines = 1u << 30;
+  opt.budget_ms = 1;
+  auto out = tv::run(text, opt);
+
+  REQUIRE(std::any_of(out.ticket.warnings.begin(), out.ticket.warnings.end(),
+                      [](const tv::Warning &w) {
+                        return w.code == "DEADLINE_EXCEEDED";
+                      }));
+  // Fields decided before the deadline are kept, but never reported as ok.
+  REQUIRE(out.ticket.total.value.has_value());
+  REQUIRE(out.ticket.total.value->value == Catch::Approx(4.00));
+  REQUIRE(out.status == tv::Status::Partial);
+  REQUIRE(out.input.chars == text.size());
+}
+
+TEST_CASE("budget_ms bounds the time spent on a huge ticket", "[.perf]") {
+  std::string text = make_input(corpus()[0], 48 * 1024 * 1024);
+  tv::Options opt;
+  opt.max_lines = 1u << 30;
+  opt.budget_ms = 1;
+  auto t0 = std::chrono::steady_clock::now();
+  (void)tv::run(text, opt);
+  std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+  REQUIRE(dt.count() < 0.1);
+}
+
+TEST_CASE("a session's budget starts with its first chunk") {
+  tv::Options opt;
+  opt.budget_ms = 100;
+  tv::Session session;
+  session.begin(opt);
+  // As the CLI waiting on stdin: not counted against the budget.
+  std::this_thread::sleep_for(std::chrono::milliseconds(150));
+  session.feed("CAFE DE LA PLACE\nTOTAL 4,00 \xE2\x82\xAC\n");
+  auto out = session.finish();
+  REQUIRE(out.status == tv::Status::Ok);
+  REQUIRE(out.ticket.warnings.empty());
+}
+
+TEST_CASE("a generous budget does not change the result") {
+  std::string text = "CAFE DE LA PLACE\nTOTAL 4,00 \xE2\x82\xAC\nCB\n";
+  tv::Options opt;
+  auto plain = tv::run(text, opt);
+  opt.budget_ms = 60000;
+  auto budgeted = tv::run(text, opt);
+  REQUIRE(budgeted.status == plain.status);
+  REQUIRE(budgeted.ticket.warnings.size() == plain.ticket.warnings.size());
+  REQUIRE(*budgeted.ticket.merchant.value == *plain.ticket.merchant.value);
+  REQUIRE(budgeted.ticket.signals.has_card_keywords);
+}
@@ -0,0 +1,132 @@
+#include <array>
+#include <catch2/catch_all.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "test_util.hpp"
+#include "tv/engine.hpp"
+#include "tv/json.hpp"
+#include "tv/prefilter.hpp"
+#include "tv/rules.hpp"
+#include "tv/scan.hpp"
+
+// run_batch() against run() one document at a time.
+static void require_same_as_run(const std::vector<std::string> &texts,
+                                const tv::Options &opt) {
+  std::vector<std::string_view> docs(texts.begin(), texts.end());
+  auto outs = tv::run_batch(docs, opt);
+  REQUIRE(outs.size() == docs.size());
+  for (std::size_t i = 0; i < docs.size(); i++) {
+    INFO("document " << i << ": " << texts[i]);
+    REQUIRE(json_without_timing(outs[i]) ==
+            json_without_timing(tv::run(docs[i], opt)));
+  }
+}
+
+TEST_CASE("KeywordPrefilter flags the lines where a keyword may start") {
+  tv::KeywordPrefilter filter(tv::rules::Pipeline<tv::rules::FrFR,
+                                                  tv::rules::AnyDomain>::rules);
+  std::string text = "LE PETIT PORT\n"           // 0: nothing
+                     "Plat du jour 14,50\n"      // 14: nothing
+                     "total ttc 14,50\n"         // 33: total
+                     "Paiement Carte Bancaire\n" // 49: card
+                     "TVA: 10%\n"                // 73: tax
+                     "SIRET 90888159000015";     // 82: company id
+  tv::KeywordSpans spans;
+  filter.scan(text, spans);
+
+  REQUIRE(spans.total.size() == 1);
+  REQUIRE(spans.total[0].begin == 33);
+  REQUIRE(spans.total[0].end == 49);
+  REQUIRE(spans.card.size() == 1);
+  REQUIRE(spans.card[0].begin == 49);
+  REQUIRE(spans.card[0].end == 73);
+  REQUIRE(spans.tax.size() == 1);
+  REQUIRE(spans.tax[0].begin == 73);
+  REQUIRE(spans.company_id.size() == 1);
+  REQUIRE(spans.company_id[0].begin == 82);
+  REQUIRE(spans.company_id[0].end == text.size());
+
+  // "A " may start A PAYER: a common pair, the line is flagged all the same.
+  filter.scan("Paiement a table\n", spans);
+  REQUIRE(spans.total.size() == 1);
+}
+
+TEST_CASE("a limited PhraseScanner only starts matches inside its spans") {
+  static constexpr std::array<std::string_view, 1> phrases = {"TOTAL TTC"};
+  tv::PhraseScanner scanner(phrases);
+  std::string_view text = "TOTAL TTC 1,00\nTOTAL\nTTC 2,00\n";
+
+  tv::CandidateSpans second = {{15, 21}};
+  scanner.limit_to(&second);
+  auto m = scanner.find(text, 0, true);
+  REQUIRE(m.has_value());
+  REQUIRE(m->begin == 15); // runs past the end of its line
+  REQUIRE(m->end == 24);
+
+  tv::CandidateSpans none;
+  scanner.limit_to(&none);
+  REQUIRE_FALSE(scanner.find(text, 0, true).has_value());
+
+  scanner.limit_to(nullptr);
+  REQUIRE(scanner.find(text, 0, true)->begin == 0);
+}
+
+TEST_CASE("run_batch matches run document by document") {
+  auto receipt = fixture();
+  REQUIRE(!receipt.empty());
+  std::vector<std::string> texts = {
+      receipt,
+      "",
+      " \r\n\t ",
+      "BRASSERIE DU PORT\r\nTOTAL\r\nTTC : 12,50 EUR\r\n",
+      "Le Petit Bistrot\ntotal ttc\xC2\xA0 8,20 \xE2\x82\xAC\ncb sans contact\n",
+      "SUPERMERCADO SOL\nIVA 21%\nTOTAL A PAGAR 15,30\nTARJETA\nCIF "
+      "12345678\n",
+      "EPICERIE\nTOTAL CHF 9.80\nMWST 7.7%\nCHE 123456789\nTWINT\n",
+      "CAFE\xFF\nBTW 6%\nTOTAL TVAC 4,00\nBCE 0123456789\nBANCONTACT\n",
+      "no keyword at all, only a fairly long line of text\nand another",
+      "   NET A PAYER     3,00   \n\n\nSIRET\n90888159000015",
+      receipt + receipt,
+  };
+
+  tv::Options fr;
+  fr.locale = tv::Locale::FrFR;
+  fr.max_lines = 1u << 30;
+  tv::Options autodetect;
+  require_same_as_run(texts, fr);
+  require_same_as_run(texts, autodetect);
+
+  tv::Options budget;
+  budget.budget_ms = 1000;
+  require_same_as_run(texts, budget);
+
+  REQUIRE(tv::run_batch({}, autodetect).empty());
+}
+
+TEST_CASE("run_batch matches run on random keyword soup") {
+  // Keywords cut and glued every way the scanners may meet them: across
+  // lines, in both cases, without the amount or digits that follow.
+  const std::vector<std::string> words = {
+      "TOTAL", "total", "TTC",  "A",     "PAYER", "NET",  "TVA",    "tva",
+      "CB",    "cb",    "VISA", "SIRET", "siret", "CARTE", "BANCAIRE",
+      "12,50", "3.00",  "€",    "EUR",   ":",     "90888159000015", "x",
+      "\xC2\xA0", "T",  "IVA",  "TWINT", "BCE"};
+  const std::vector<std::string> gaps = {" ", "\n", "  ", "\r\n", "\t", ""};
+  std::mt19937 rng(39);
+  std::vector<std::string> texts;
+  for (int d = 0; d < 300; d++) {
+    std::string text;
+    std::size_t n = rng() % 40;
+    for (std::size_t i = 0; i < n; i++) {
+      text += words[rng() % words.size()];
+      text += gaps[rng() % gaps.size()];
+    }
+    texts.push_back(std::move(text));
+  }
+  tv::Options fr;
+  fr.locale = tv::Locale::FrFR;
+  require_same_as_run(texts, fr);
+  require_same_as_run(texts, tv::Options{});
+}
@@ -0,0 +1,148 @@
+#include <catch2/catch_all.hpp>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "test_util.hpp"
+#include "tv/columnar.hpp"
+#include "tv/engine.hpp"
+#include "tv/json.hpp"
+
+TEST_CASE("columnar files read back what was written, block by block") {
+  const std::string path = temp_path("roundtrip.col");
+  const std::string receipt = fixture();
+  const char *const others[] = {
+      "CAFE DE LA GARE\nTOTAL 4,50 EUR\nCB\n",
+      "BOULANGERIE PAUL\nTVA 5,5%\nTOTAL 12,00 EUR\n",
+      "illegible\n",
+  };
+  // More rows than a block, to cross a block boundary.
+  const std::size_t rows = tv::ColumnarWriter::block_rows + 10;
+  std::vector<tv::EngineOutput> outs;
+  for (std::size_t i = 0; i < 4; i++)
+    outs.push_back(tv::run(i == 3 ? receipt : others[i], tv::Options{}));
+
+  tv::ColumnarWriter writer(path);
+  for (std::size_t i = 0; i < rows; i++) {
+    const std::string name = "t" + std::to_string(i);
+    if (i % 5 == 4)
+      writer.add(name, nullptr, "INPUT_EMPTY");
+    else
+      writer.add(name, &outs[i % 5]);
+  }
+  writer.finish();
+  REQUIRE(writer.rows() == rows);
+  REQUIRE(writer.bytes() == read_file(path).size());
+
+  tv::ColumnarReader reader(path);
+  tv::ColumnarBlock block;
+  std::size_t row = 0, blocks = 0;
+  while (reader.next(&block)) {
+    blocks++;
+    for (std::size_t r = 0; r < block.rows; r++, row++) {
+      INFO(row);
+      REQUIRE(block.file[r] == "t" + std::to_string(row));
+      if (row % 5 == 4) {
+        REQUIRE(block.status[r] == tv::Status::Error);
+        REQUIRE(block.error[r] == "INPUT_EMPTY");
+        REQUIRE(!block.merchant[r]);
+        REQUIRE(!block.total_cents[r]);
+        REQUIRE(block.warnings[r].empty());
+        REQUIRE(!block.timing_total_ms[r]);
+        continue;
+      }
+      const tv::EngineOutput &o = outs[row % 5];
+      REQUIRE(block.status[r] == o.status);
+      REQUIRE(!block.error[r]);
+      REQUIRE(std::abs(block.confidence[r] - o.confidence) <= 0.00005);
+      REQUIRE(block.merchant[r] == o.ticket.merchant.value);
+      REQUIRE(block.total_cents[r].has_value() ==
+              o.ticket.total.value.has_value());
+      if (o.ticket.total.value) {
+        REQUIRE(*block.total_cents[r] ==
+                std::llround(o.ticket.total.value->value * 100));
+        REQUIRE(block.currency[r] == o.ticket.total.value->currency);
+      }
+      REQUIRE(block.has_tva[r] == o.ticket.signals.has_tva);
+      REQUIRE(block.has_siret[r] == o.ticket.signals.has_siret);
+      REQUIRE(block.has_card_keywords[r] ==
+              o.ticket.signals.has_card_keywords);
+      REQUIRE(block.warnings[r].size() == o.ticket.warnings.size());
+      for (std::size_t w = 0; w < o.ticket.warnings.size(); w++)
+        REQUIRE(block.warnings[r][w] == o.ticket.warnings[w].code);
+      REQUIRE(block.timing_total_ms[r] == o.timing.total);
+      REQUIRE(block.timing_parse_ms[r] == o.timing.parse);
+    }
+  }
+  REQUIRE(row == rows);
+  REQUIRE(blocks == 2);
+  REQUIRE(!reader.next(&block));
+  std::remove(path.c_str());
+}
+
+TEST_CASE("a columnar reader decodes only the columns asked for") {
+  const std::string path = temp_path("columns.col");
+  auto out = tv::run("CAFE DE LA GARE\nTOTAL 4,50 EUR\n", tv::Options{});
+  tv::ColumnarWriter writer(path);
+  for (int i = 0; i < 100; i++)
+    writer.add("f", &out);
+  writer.finish();
+
+  tv::ColumnarReader reader(path);
+  tv::ColumnarBlock block;
+  REQUIRE(reader.next(&block, tv::column_bit(tv::ColumnId::TotalCents) |
+                                  tv::column_bit(tv::ColumnId::Status)));
+  REQUIRE(block.rows == 100);
+  REQUIRE(block.total_cents.size() == 100);
+  REQUIRE(block.total_cents[99] == 450);
+  REQUIRE(block.status.size() == 100);
+  REQUIRE(block.file.empty());
+  REQUIRE(block.merchant.empty());
+  REQUIRE(!reader.next(&block));
+  std::remove(path.c_str());
+}
+
+TEST_CASE("columns of repeated values take a few bits per row") {
+  const std::string path = temp_path("compact.col");
+  auto out = tv::run(fixture(), tv::Options{});
+  const std::size_t rows = 4096;
+  tv::ColumnarWriter writer(path);
+  for (std::size_t i = 0; i < rows; i++)
+    writer.add(std::to_string(i), &out);
+  writer.finish();
+  // File names aside (up to 5 bytes each), well under 16 bytes a row.
+  REQUIRE(writer.bytes() < rows * (5 + 16));
+  REQUIRE(writer.bytes() < tv::to_json_v1(out).size() * rows / 50);
+  std::remove(path.c_str());
+}
+
+TEST_CASE("a columnar reader rejects what is not a valid file") {
+  const std::string path = temp_path("bad.col");
+  std::ofstream(path, std::ios::binary) << "{\"json\":true}\n";
+  REQUIRE(error_of([&] { tv::ColumnarReader r(path); })
+              .find("not a columnar file") != std::string::npos);
+
+  auto out = tv::run("CAFE DE LA GARE\nTOTAL 4,50 EUR\n", tv::Options{});
+  {
+    tv::ColumnarWriter writer(path);
+    for (int i = 0; i < 10; i++)
+      writer.add("f", &out);
+    writer.finish();
+  }
+  // Cut in the middle of the block: its columns overrun the file.
+  std::string data = read_file(path);
+  std::ofstream(path, std::ios::binary | std::ios::trunc)
+      << data.substr(0, data.size() / 2);
+  tv::ColumnarReader reader(path);
+  tv::ColumnarBlock block;
+  REQUIRE(error_of([&] { reader.next(&block); }).find("corrupt block") !=
+          std::string::npos);
+  std::remove(path.c_str());
+
+  REQUIRE(error_of([] { tv::ColumnarWriter w("/nonexistent-dir/x.col"); })
+              .find("columnar") != std::string::npos);
+}
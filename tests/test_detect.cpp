@@ -0,0 +1,52 @@
+#include "test_util.hpp"
+#include "tv/detect.hpp"
+#include "tv/engine.hpp"
+#include <catch2/catch_all.hpp>
+
+TEST_CASE("detect_locale_domain recognizes the real French cafe receipt") {
+  auto text = fixture();
+  REQUIRE(!text.empty());
+  auto d = tv::detect_locale_domain(text);
+  REQUIRE(d.locale == tv::Locale::FrFR);
+  REQUIRE(d.domain == tv::Domain::Cafe);
+  REQUIRE(d.domain_confidence >= 0.6);
+}
+
+TEST_CASE("detect_locale_domain recognizes Belgian, Swiss and Spanish "
+          "receipts") {
+  auto be = tv::detect_locale_domain("FRITERIE DU PARC\n1000 Bruxelles\n"
+                                     "Total TVAC 12,50\nBancontact\n");
+  REQUIRE(be.locale == tv::Locale::FrBE);
+
+  auto ch = tv::detect_locale_domain("BOULANGERIE DU LAC\n1003 Lausanne\n"
+                                     "Total CHF 8.40\nTWINT\nMWST 2.6%\n");
+  REQUIRE(ch.locale == tv::Locale::FrCH);
+
+  auto es = tv::detect_locale_domain("BAR EL RINCÓN\n28013 Madrid\n"
+                                     "Cortado 1,50\nTOTAL A PAGAR 4,20\n"
+                                     "IVA incluido\nGracias por su visita\n");
+  REQUIRE(es.locale == tv::Locale::EsES);
+  REQUIRE(es.locale_confidence > 0.5);
+}
+
+TEST_CASE("detect_locale_domain falls back to fr_FR and no domain") {
+  auto d = tv::detect_locale_domain("XYZ 12\n");
+  REQUIRE(d.locale == tv::Locale::FrFR);
+  REQUIRE(d.domain == tv::Domain::Auto);
+}
+
+TEST_CASE("engine applies detected rules and records them in input meta") {
+  tv::Options opt;
+  auto out = tv::run("CERVECERIA LA PLAZA\nCalle Mayor 3\n28013 Madrid\n"
+                     "TOTAL A PAGAR 12,40\nIVA 10%\nTARJETA\n",
+                     opt);
+  REQUIRE(out.input.locale == "auto");
+  REQUIRE(out.input.detected_locale == "es_ES");
+  REQUIRE(out.ticket.total.value.has_value());
+  REQUIRE(out.ticket.total.value->value == Catch::Approx(12.40));
+  REQUIRE(out.ticket.signals.has_card_keywords);
+
+  opt.locale = tv::Locale::FrFR;
+  auto hinted = tv::run("TOTAL 3,00\n", opt);
+  REQUIRE(hinted.input.detected_locale.empty());
+}
@@ -1,20 +1,12 @@
 #include <catch2/catch_all.hpp>
-#include <fstream>
-#include <sstream>
 
+#include "test_util.hpp"
 #include "tv/engine.hpp"
 
-static std::string load_fixture(const std::string &path) {
-  std::ifstream f(path);
-  std::stringstream ss;
-  ss << f.rdbuf();
-  return ss.str();
-}
-
 TEST_CASE("[engine_real_receipt][real_receipt] engine parses a real cafe "
           "receipt OCR") {
   tv::Options opt;
-  auto text = load_fixture("../../tests/fixtures/receipt_real_001.txt");
+  auto text = fixture();
   auto out = tv::run(text, opt);
   INFO("text" << text);
   INFO("status=" << static_cast<int>(out.status));
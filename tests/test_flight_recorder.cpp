@@ -0,0 +1,166 @@
+#include <atomic>
+#include <catch2/catch_all.hpp>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tv/flight_recorder.hpp"
+
+namespace {
+
+// A record whose every field is derived from `id`, so that a torn copy
+// shows.
+tv::FlightRecord record_of(std::uint64_t id, std::uint32_t service_us = 0) {
+  tv::FlightRecord r;
+  r.id = id;
+  r.input_hash = id * 0xC2B2AE3D27D4EB4Full;
+  r.fingerprint = id * 0x9E3779B97F4A7C15ull;
+  r.finished_us = static_cast<std::int64_t>(id) * 3;
+  r.bytes = static_cast<std::uint32_t>(id) * 5;
+  r.lines = static_cast<std::uint32_t>(id) * 7;
+  r.queue_us = static_cast<std::uint32_t>(id) % 1000;
+  r.run_us = service_us;
+  r.score_ns = static_cast<std::uint32_t>(id) % 977;
+  std::snprintf(r.first_warning, sizeof r.first_warning, "W%llu",
+                static_cast<unsigned long long>(id));
+  r.warnings = 1;
+  return r;
+}
+
+bool consistent(const nlohmann::json &j) {
+  auto id = j["id"].get<std::uint64_t>();
+  auto expected = record_of(id);
+  char hash[17];
+  std::snprintf(hash, sizeof hash, "%016llx",
+                static_cast<unsigned long long>(expected.input_hash));
+  return j["input_hash"] == std::string(hash) &&
+         j["bytes"] == expected.bytes && j["lines"] == expected.lines &&
+         j["finished_us"] == expected.finished_us &&
+         j["stages_us"]["queue"] == expected.queue_us &&
+         j["first_warning"] == std::string(expected.first_warning);
+}
+
+} // namespace
+
+TEST_CASE("the flight recorder keeps the last tickets of every worker") {
+  tv::FlightRecorder recorder(2, 0, 8);
+  for (std::uint64_t id = 0; id < 20; id++)
+    recorder.record(id % 2, record_of(id), "ignored");
+  recorder.record(1, record_of(20), "");
+
+  auto doc = nlohmann::json::parse(recorder.dump_json());
+  REQUIRE(doc["pid"] == ::getpid());
+  REQUIRE(doc["slow"].empty()); // threshold 0: no input kept
+  REQUIRE(doc["workers"].size() == 2);
+  const auto &w0 = doc["workers"][0];
+  const auto &w1 = doc["workers"][1];
+  REQUIRE(w0.size() == 8);
+  REQUIRE(w0.front()["id"] == 4); // 0, 2 dropped
+  REQUIRE(w0.back()["id"] == 18);
+  REQUIRE(w1.size() == 8);
+  REQUIRE(w1.front()["id"] == 7);
+  REQUIRE(w1.back()["id"] == 20);
+  for (const auto &w : doc["workers"])
+    for (const auto &r : w)
+      REQUIRE(consistent(r));
+  REQUIRE(w0.front()["fingerprint"] == "simhash:78dde6e5fd29f054");
+  REQUIRE(w0.front()["status"] == "ok");
+}
+
+TEST_CASE("slow tickets keep their input within a byte bound") {
+  tv::FlightRecorder recorder(1, 1000, 4, 10);
+  recorder.record(0, record_of(1, 999), "fast");
+  recorder.record(0, record_of(2, 1000), "slow-2");
+  recorder.record(0, record_of(3, 5000), "slow-3");
+  auto doc = nlohmann::json::parse(recorder.dump_json());
+  // 6 + 6 bytes > 10: the oldest went.
+  REQUIRE(doc["slow"].size() == 1);
+  REQUIRE(doc["slow"][0]["id"] == 3);
+  REQUIRE(doc["slow"][0]["input"] == "slow-3");
+  REQUIRE(doc["slow"][0]["service_us"] == 5000);
+
+  // An input larger than the whole buffer keeps its head; raw bytes are
+  // repaired on output.
+  recorder.record(0, record_of(4, 2000), "\xFF" "23456789ABCDEF");
+  doc = nlohmann::json::parse(recorder.dump_json());
+  REQUIRE(doc["slow"].size() == 1);
+  REQUIRE(doc["slow"][0]["input"] == "\xEF\xBF\xBD" "23456789A");
+}
+
+TEST_CASE("dumps taken while workers record never see a torn record") {
+  tv::FlightRecorder recorder(2, 0, 16);
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> workers;
+  for (std::uint32_t w = 0; w < 2; w++)
+    workers.emplace_back([&, w] {
+      for (std::uint64_t id = w; !stop; id += 2)
+        recorder.record(w, record_of(id), "");
+    });
+  int records = 0;
+  auto until = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  // 200 dumps at least, and until one catches the workers running.
+  for (int dumps = 0; dumps < 200 || records == 0; dumps++) {
+    REQUIRE(std::chrono::steady_clock::now() < until);
+    auto doc = nlohmann::json::parse(recorder.dump_json());
+    for (const auto &w : doc["workers"])
+      for (const auto &r : w) {
+        REQUIRE(consistent(r));
+        records++;
+      }
+  }
+  stop = true;
+  for (auto &t : workers)
+    t.join();
+  REQUIRE(records > 0);
+}
+
+TEST_CASE("dump() writes the document and counts what it holds") {
+  std::string path =
+      "/tmp/tv_flight_test_" + std::to_string(::getpid()) + ".json";
+  tv::FlightRecorder recorder(1, 1);
+  recorder.record(0, record_of(1, 10), "CAFE\nTOTAL 4,00\n");
+  recorder.record(0, record_of(2), "");
+  auto d = recorder.dump(path);
+  REQUIRE(d.path == path);
+  REQUIRE(d.records == 2);
+  REQUIRE(d.slow == 1);
+  std::ifstream f(path);
+  std::stringstream ss;
+  ss << f.rdbuf();
+  auto doc = nlohmann::json::parse(ss.str());
+  REQUIRE(doc["slow"][0]["input"] == "CAFE\nTOTAL 4,00\n");
+  std::remove(path.c_str());
+  REQUIRE_THROWS(recorder.dump("/nonexistent-dir/flight.json"));
+}
+
+TEST_CASE("dump() writes a private file and never through a planted link") {
+  const std::string path =
+      "/tmp/tv_flight_test_link_" + std::to_string(::getpid()) + ".json";
+  const std::string victim = path + ".victim";
+  std::ofstream(victim) << "untouched";
+  // Where the dump used to write first.
+  REQUIRE(::symlink(victim.c_str(), (path + ".tmp").c_str()) == 0);
+  tv::FlightRecorder recorder(1, 1);
+  recorder.record(0, record_of(1, 10), "CAFE\nTOTAL 4,00\n");
+  recorder.dump(path);
+
+  struct stat st;
+  REQUIRE(::lstat(path.c_str(), &st) == 0);
+  REQUIRE(S_ISREG(st.st_mode));
+  REQUIRE((st.st_mode & 0777) == 0600);
+  std::ifstream f(victim);
+  std::stringstream ss;
+  ss << f.rdbuf();
+  REQUIRE(ss.str() == "untouched");
+  std::remove(path.c_str());
+  std::remove((path + ".tmp").c_str());
+  std::remove(victim.c_str());
+}
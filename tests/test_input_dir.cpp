@@ -0,0 +1,275 @@
+#include <catch2/catch_all.hpp>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "test_util.hpp"
+#include "tv/batch_summary.hpp"
+#include "tv/columnar.hpp"
+#include "tv/engine.hpp"
+#include "tv/input_dir.hpp"
+#include "tv/json.hpp"
+#include "tv/near_duplicate.hpp"
+
+namespace {
+
+// A temporary directory of tickets, removed with its files.
+struct TempDir {
+  std::string path;
+  std::vector<std::string> files;
+
+  TempDir() {
+    char tmpl[] = "/tmp/tv_input_dir_test_XXXXXX";
+    REQUIRE(::mkdtemp(tmpl) != nullptr);
+    path = tmpl;
+  }
+  ~TempDir() {
+    for (const auto &f : files)
+      std::remove((path + "/" + f).c_str());
+    ::rmdir(path.c_str());
+  }
+  void add(const std::string &name, const std::string &text) {
+    std::ofstream(path + "/" + name, std::ios::binary) << text;
+    files.push_back(name);
+  }
+};
+
+// The files the tests read: enough to fill several groups, one larger than
+// a read buffer, and blank ones.
+std::map<std::string, std::string> archive(TempDir &dir) {
+  std::map<std::string, std::string> texts;
+  const std::string receipt = fixture();
+  auto add = [&](const std::string &name, const std::string &text) {
+    dir.add(name, text);
+    texts[name] = text;
+  };
+  for (int i = 0; i < 150; i++) {
+    char name[32];
+    std::snprintf(name, sizeof name, "t%03d.txt", i);
+    add(name, i % 3 == 0 ? receipt
+                         : "CAFE " + std::to_string(i) + "\nTOTAL " +
+                               std::to_string(i) + ",50 EUR\n");
+  }
+  std::string large;
+  while (large.size() < 3 * tv::FileReader::buffer_size)
+    large += receipt;
+  add("large.txt", large);
+  add("blank.txt", " \n\t\n");
+  add("empty.txt", "");
+  return texts;
+}
+
+std::string run_to_string(const std::string &dir, tv::ReadMethod method,
+                          tv::InputDirStats *stats) {
+  char tmpl[] = "/tmp/tv_input_dir_out_XXXXXX";
+  int fd = ::mkstemp(tmpl);
+  REQUIRE(fd >= 0);
+  *stats = tv::run_input_dir(dir, tv::Options{}, fd, method);
+  ::close(fd);
+  std::ifstream f(tmpl, std::ios::binary);
+  std::stringstream ss;
+  ss << f.rdbuf();
+  std::remove(tmpl);
+  return ss.str();
+}
+
+std::vector<nlohmann::json> lines_of(const std::string &out) {
+  std::vector<nlohmann::json> docs;
+  std::istringstream in(out);
+  for (std::string line; std::getline(in, line);)
+    docs.push_back(nlohmann::json::parse(line));
+  return docs;
+}
+
+} // namespace
+
+TEST_CASE("list_input_dir lists the regular files sorted by name") {
+  TempDir dir;
+  dir.add("b.txt", "x");
+  dir.add("a.txt", "x");
+  REQUIRE(::mkdir((dir.path + "/sub").c_str(), 0700) == 0);
+  auto names = tv::list_input_dir(dir.path);
+  ::rmdir((dir.path + "/sub").c_str());
+  REQUIRE(names == std::vector<std::string>{"a.txt", "b.txt"});
+  REQUIRE(error_of([] { tv::list_input_dir("/nonexistent-dir"); })
+              .find("/nonexistent-dir") != std::string::npos);
+}
+
+TEST_CASE("every read method reads the same files") {
+  TempDir dir;
+  auto texts = archive(dir);
+  std::vector<std::string> names = tv::list_input_dir(dir.path);
+  names.push_back("missing.txt");
+  int dir_fd = ::open(dir.path.c_str(), O_RDONLY | O_DIRECTORY);
+  REQUIRE(dir_fd >= 0);
+
+  for (auto method : {tv::ReadMethod::Uring, tv::ReadMethod::Threads,
+                      tv::ReadMethod::Serial}) {
+    tv::FileReader reader(method, 2 * tv::FileReader::buffer_size, 8);
+    INFO(tv::read_method_name(reader.method()));
+    std::vector<std::string> got(names.size());
+    std::vector<int> errors(names.size(), -1);
+    reader.read(dir_fd, names, 0, names.size(),
+                [&](std::size_t i, std::string &&text, int error) {
+                  got[i] = std::move(text);
+                  errors[i] = error;
+                });
+    for (std::size_t i = 0; i < names.size(); i++) {
+      INFO(names[i]);
+      if (names[i] == "missing.txt") {
+        REQUIRE(errors[i] == ENOENT);
+      } else if (names[i] == "large.txt") {
+        REQUIRE(errors[i] == EFBIG);
+      } else {
+        REQUIRE(errors[i] == 0);
+        REQUIRE(got[i] == texts[names[i]]);
+      }
+    }
+  }
+  ::close(dir_fd);
+}
+
+TEST_CASE("run_input_dir prints the CLI's document for each file in order") {
+  TempDir dir;
+  auto texts = archive(dir);
+
+  tv::InputDirStats stats;
+  const std::string serial =
+      run_to_string(dir.path, tv::ReadMethod::Serial, &stats);
+  REQUIRE(stats.method == tv::ReadMethod::Serial);
+  REQUIRE(stats.files == texts.size());
+  REQUIRE(stats.failed == 0);
+
+  auto docs = lines_of(serial);
+  REQUIRE(docs.size() == texts.size());
+  auto it = texts.begin();
+  for (auto &doc : docs) {
+    INFO(it->first);
+    REQUIRE(doc["file"] == it->first);
+    doc.erase("file");
+    bool blank = it->second.find_first_not_of(" \t\n") == std::string::npos;
+    if (blank) {
+      REQUIRE(doc["error"]["code"] == "INPUT_EMPTY");
+    } else {
+      // Cut at max_lines, as the CLI reads stdin.
+      tv::Options opt;
+      auto expected = nlohmann::json::parse(tv::to_json_v1(
+          tv::run(tv::first_lines(it->second, opt.max_lines), opt)));
+      expected.erase("timing_ms");
+      doc.erase("timing_ms");
+      REQUIRE(doc == expected);
+    }
+    ++it;
+  }
+
+  // Only the timings differ between methods.
+  auto stable = [](const std::string &out) {
+    auto docs = lines_of(out);
+    for (auto &d : docs)
+      d.erase("timing_ms");
+    return docs;
+  };
+  for (auto method : {tv::ReadMethod::Uring, tv::ReadMethod::Threads}) {
+    auto out = run_to_string(dir.path, method, &stats);
+    REQUIRE(stats.files == texts.size());
+    REQUIRE(stable(out) == stable(serial));
+  }
+}
+
+TEST_CASE("run_input_dir fills a summary of every file") {
+  TempDir dir;
+  auto texts = archive(dir);
+  int null_fd = ::open("/dev/null", O_WRONLY);
+  tv::BatchSummary summary;
+  auto stats = tv::run_input_dir(dir.path, tv::Options{}, null_fd,
+                                 tv::ReadMethod::Auto, &summary);
+  ::close(null_fd);
+  auto doc = nlohmann::json::parse(summary.to_json());
+  REQUIRE(doc["tickets"].get<std::size_t>() +
+              doc["skipped"].get<std::size_t>() ==
+          stats.files);
+  REQUIRE(doc["skipped"] == 2); // blank.txt, empty.txt
+  REQUIRE(doc["totals"]["EUR"]["count"].get<std::size_t>() > 100);
+}
+
+TEST_CASE("run_input_dir writes every file to a columnar writer in order") {
+  TempDir dir;
+  auto texts = archive(dir);
+  const std::string path = dir.path + "/../" +
+                           dir.path.substr(dir.path.rfind('/') + 1) + ".col";
+  int null_fd = ::open("/dev/null", O_WRONLY);
+  {
+    tv::ColumnarWriter writer(path);
+    tv::run_input_dir(dir.path, tv::Options{}, null_fd, tv::ReadMethod::Auto,
+                      nullptr, &writer);
+    writer.finish();
+  }
+  ::close(null_fd);
+  tv::ColumnarReader reader(path);
+  tv::ColumnarBlock block;
+  REQUIRE(reader.next(&block));
+  REQUIRE(block.rows == texts.size());
+  auto it = texts.begin();
+  for (std::size_t r = 0; r < block.rows; r++, ++it) {
+    INFO(it->first);
+    REQUIRE(block.file[r] == it->first);
+    bool blank = it->second.find_first_not_of(" \t\n") == std::string::npos;
+    REQUIRE(block.error[r] ==
+            (blank ? std::optional<std::string>("INPUT_EMPTY") : std::nullopt));
+  }
+  REQUIRE(!reader.next(&block));
+  std::remove(path.c_str());
+}
+
+TEST_CASE("run_input_dir checks near-duplicates in name order") {
+  // The same receipt first and after a group of large tickets, so the
+  // later groups are parsed first when there are threads for it: only the
+  // first receipt by name is new, every other one is flagged against it.
+  TempDir dir;
+  const std::string receipt = fixture();
+  std::string large;
+  while (large.size() < 64 * 1024)
+    large += receipt;
+  for (int i = 0; i < 300; i++) {
+    char name[32];
+    std::snprintf(name, sizeof name, "t%03d.txt", i);
+    dir.add(name, i == 0 || i >= 64 ? receipt
+                                    : large + std::to_string(i) + "\n");
+  }
+  tv::set_active_near_duplicates(std::make_shared<tv::NearDuplicateIndex>());
+  tv::InputDirStats stats;
+  auto docs = lines_of(run_to_string(dir.path, tv::ReadMethod::Auto, &stats));
+  REQUIRE(docs.size() == 300);
+  for (std::size_t i = 0; i < docs.size(); i++) {
+    if (i > 0 && i < 64)
+      continue;
+    INFO(docs[i]["file"]);
+    std::string flagged;
+    for (const auto &w : docs[i]["result"]["warnings"])
+      if (w["code"] == "NEAR_DUPLICATE")
+        flagged = w["message"];
+    if (i == 0)
+      REQUIRE(flagged.empty());
+    else
+      REQUIRE(flagged.find("ticket #0 ") != std::string::npos);
+  }
+  tv::set_active_near_duplicates(nullptr);
+}
+
+TEST_CASE("run_input_dir rejects a missing directory") {
+  tv::InputDirStats stats;
+  REQUIRE(error_of([&] {
+            stats = tv::run_input_dir("/nonexistent-dir", tv::Options{}, 1);
+          }).find("input dir") != std::string::npos);
+}
@@ -0,0 +1,155 @@
+#include <catch2/catch_all.hpp>
+#include <cstdio>
+#include <nlohmann/json.hpp>
+#include <string>
+
+#include <unistd.h>
+
+#include "test_util.hpp"
+#include "tv/engine.hpp"
+#include "tv/json.hpp"
+#include "tv/merchant_dict.hpp"
+
+namespace {
+
+std::string key_of(std::string_view text) {
+  char buf[tv::merchant_key_max];
+  return std::string(buf, tv::merchant_key(text, buf));
+}
+
+std::shared_ptr<const tv::MerchantDictionary>
+compile(const char *name, const std::string &list) {
+  auto src = temp_path(name);
+  auto out = src + ".dict";
+  write_file(src, list);
+  tv::compile_merchant_dictionary(src, out);
+  auto d = tv::MerchantDictionary::open(out);
+  std::remove(src.c_str());
+  std::remove(out.c_str());
+  return d;
+}
+
+} // namespace
+
+TEST_CASE("merchant_key upper-cases, folds accents and collapses the rest") {
+  REQUIRE(key_of("  Carrefour   City ") == "CARREFOUR CITY");
+  REQUIRE(key_of("Crêperie de l'Église") == "CREPERIE DE L EGLISE");
+  REQUIRE(key_of("BŒUF & CO.") == "BOEUF CO");
+  REQUIRE(key_of("*** 24/24 ***") == "24 24");
+  REQUIRE(key_of("--- ").empty());
+  REQUIRE(key_of(std::string(100, 'A')).size() == tv::merchant_key_max);
+}
+
+TEST_CASE("OCR errors resolve to the canonical name") {
+  auto d = compile("ocr", "# name;aliases\n"
+                          "CARREFOUR CITY;CRF CITY\n"
+                          "MONOPRIX;MONOP'\n"
+                          "BOULANGERIE PAUL\n"
+                          "LIDL\n");
+  REQUIRE(d->names() == 4);
+  REQUIRE(d->keys() == 6);
+
+  auto m = d->find("CARREF0UR C1TY");
+  REQUIRE(m);
+  REQUIRE(m->name == "CARREFOUR CITY");
+  REQUIRE(m->distance == 2);
+  REQUIRE_FALSE(m->ambiguous);
+  REQUIRE(d->find("carrefour city")->distance == 0);
+  REQUIRE(d->find("Boulangerie Paul")->name == "BOULANGERIE PAUL");
+  REQUIRE(d->find("BOULANEGRIE PAUL")->distance == 1); // transposition
+
+  // Aliases map to their name.
+  auto alias = d->find("MONOP");
+  REQUIRE(alias->name == "MONOPRIX");
+  REQUIRE(alias->key == "MONOP");
+  REQUIRE(d->find("CRF CTY")->name == "CARREFOUR CITY");
+
+  // Short names must match exactly, longer ones within one or two edits.
+  REQUIRE(d->find("LIDL")->name == "LIDL");
+  REQUIRE_FALSE(d->find("LIDI"));
+  REQUIRE(d->find("M0NOPRIX")->distance == 1);
+  REQUIRE_FALSE(d->find("M0N0PRIX"));
+  REQUIRE_FALSE(d->find("C4RREF0UR C1TY"));
+  REQUIRE_FALSE(d->find("PHARMACIE"));
+  REQUIRE_FALSE(d->find("***"));
+}
+
+TEST_CASE("a merchant as close to two names is ambiguous") {
+  auto d = compile("ambiguous", "CAFE DE PARIS\nCAFE DE PARIZ\n");
+  auto m = d->find("CAFE DE PARIX");
+  REQUIRE(m);
+  REQUIRE(m->name == "CAFE DE PARIS"); // listed first
+  REQUIRE(m->ambiguous);
+  REQUIRE_FALSE(d->find("CAFE DE PARIS")->ambiguous);
+}
+
+TEST_CASE("lookups scale to a large dictionary") {
+  std::string list;
+  for (int i = 0; i < 20000; i++)
+    list += "BOULANGERIE " + std::to_string(i * 7919) + "\n";
+  auto d = compile("large", list);
+  REQUIRE(d->names() == 20000);
+  for (int i = 0; i < 20000; i += 97) {
+    auto name = "BOULANGERIE " + std::to_string(i * 7919);
+    auto ocr = name;
+    ocr[2] = '0';
+    auto m = d->find(ocr);
+    REQUIRE(m);
+    REQUIRE(m->name == name);
+    REQUIRE(m->distance == 1);
+  }
+}
+
+TEST_CASE("compile_merchant_dictionary rejects bad lines and keeps the old "
+          "file") {
+  auto src = temp_path("bad.txt");
+  auto out = temp_path("bad.dict");
+  write_file(src, "MONOPRIX\n");
+  REQUIRE(tv::compile_merchant_dictionary(src, out) == 1);
+
+  auto rejects = [&](const std::string &text, const std::string &what) {
+    write_file(src, text);
+    auto error = error_of([&] { tv::compile_merchant_dictionary(src, out); });
+    REQUIRE(error.find(what) != std::string::npos);
+  };
+  rejects("LIDL;--\n", "line 1: '--' has no letter or digit");
+  rejects("# chains\nMONOPRIX\nMONOP;monoprix\n",
+          "line 3: 'monoprix' is already a key of line 2");
+  REQUIRE(tv::MerchantDictionary::open(out)->find("MONOPRIX"));
+
+  write_file(out, "not a merchant dictionary, but long enough for a header "
+                  "...........................................");
+  REQUIRE(error_of([&] { tv::MerchantDictionary::open(out); })
+              .find("not a compiled merchant dictionary") != std::string::npos);
+  REQUIRE_THROWS(tv::MerchantDictionary::open(temp_path("missing.dict")));
+  REQUIRE_THROWS(
+      tv::compile_merchant_dictionary(temp_path("missing.txt"), out));
+  std::remove(src.c_str());
+  std::remove(out.c_str());
+}
+
+TEST_CASE("the active dictionary adds the canonical merchant to the output") {
+  tv::set_active_merchant_dictionary(
+      compile("active", "CARREFOUR CITY;CRF CITY\n"));
+  tv::Options opt;
+  auto out = tv::run("CAREFOUR CITY\n12 RUE DE LA PAIX\nTOTAL 4,20\n", opt);
+  REQUIRE(*out.ticket.merchant.value == "CAREFOUR CITY"); // as read
+  const auto &c = out.ticket.merchant_canonical;
+  REQUIRE(c.value->name == "CARREFOUR CITY");
+  REQUIRE(c.value->distance == 1);
+  REQUIRE(c.confidence == Catch::Approx(0.85));
+  REQUIRE(c.source == "dictionary:CARREFOUR CITY");
+
+  auto merchant = nlohmann::json::parse(
+      tv::to_json_v1(out))["result"]["fields"]["merchant"];
+  REQUIRE(merchant["value"] == "CAREFOUR CITY");
+  REQUIRE(merchant["canonical"]["value"] == "CARREFOUR CITY");
+  REQUIRE(merchant["canonical"]["distance"] == 1);
+
+  auto unknown = tv::run("PHARMACIE DU MARCHE\nTOTAL 4,20\n", opt);
+  REQUIRE_FALSE(unknown.ticket.merchant_canonical.value);
+  REQUIRE_FALSE(nlohmann::json::parse(tv::to_json_v1(unknown))["result"]
+                    ["fields"]["merchant"]
+                        .contains("canonical"));
+  tv::set_active_merchant_dictionary(nullptr);
+}
@@ -0,0 +1,196 @@
+#include <catch2/catch_all.hpp>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+#include <unistd.h>
+
+#include "test_util.hpp"
+#include "tv/engine.hpp"
+#include "tv/fingerprint.hpp"
+#include "tv/near_duplicate.hpp"
+#include "tv/score.hpp"
+#include "tv/task_pool.hpp"
+
+namespace {
+
+// `fingerprint` with `bits` distinct bits flipped.
+std::uint64_t flip(std::uint64_t fingerprint, int bits, std::mt19937_64 &rng) {
+  std::uint64_t mask = 0;
+  while (std::popcount(mask) < bits)
+    mask |= std::uint64_t{1} << (rng() % 64);
+  return fingerprint ^ mask;
+}
+
+} // namespace
+
+TEST_CASE("the fingerprint ignores case, punctuation and line wrapping") {
+  auto f = tv::simhash("CAFE DE LA PLACE\nCafé crème 2,50\nTOTAL 2,50\n");
+  REQUIRE(f != 0);
+  REQUIRE(tv::simhash("cafe de la place cafÉ CRÈME 2 50 - total: 2 50") ==
+          tv::simhash("CAFE DE LA PLACE CAFÉ CRÈME 2 50 TOTAL 2 50"));
+  REQUIRE(tv::simhash("CAFE DE LA PLACE\nCafé crème 2,50\nTOTAL 2,50") == f);
+  REQUIRE(tv::simhash("") == 0);
+  REQUIRE(tv::simhash(" \n--- ;\n") == 0);
+
+  // Any chunking gives the same fingerprint.
+  std::string text = fixture();
+  REQUIRE_FALSE(text.empty());
+  for (std::size_t chunk : {1, 5, 64}) {
+    tv::SimHasher h;
+    for (std::size_t i = 0; i < text.size(); i += chunk)
+      h.feed(std::string_view(text).substr(i, chunk));
+    REQUIRE(h.finish() == tv::simhash(text));
+  }
+}
+
+TEST_CASE("a re-OCRed receipt stays close, another receipt does not") {
+  std::string text = fixture();
+  tv::Options opt;
+  auto original = tv::run(text, opt);
+  REQUIRE(original.input.fingerprint != 0);
+
+  std::string ocr = text;
+  ocr.replace(ocr.find("Chocolat"), 8, "Ch0colat");
+  ocr.replace(ocr.find("Parcheminerie"), 13, "Parchemlnerie");
+  auto rescanned = tv::run(ocr, opt);
+  REQUIRE(tv::fingerprint_distance(original.input.fingerprint,
+                                   rescanned.input.fingerprint) <=
+          tv::NearDuplicateIndex::default_max_distance);
+
+  auto other = tv::run("BOULANGERIE MARTIN\n3 PLACE DU MARCHE\n"
+                       "BAGUETTE 1,20\nCROISSANT 1,10\nTOTAL 2,30\n",
+                       opt);
+  REQUIRE(tv::fingerprint_distance(original.input.fingerprint,
+                                   other.input.fingerprint) > 10);
+
+  // Every path computes it on the same normalized text.
+  tv::Session s;
+  s.begin(opt);
+  for (std::size_t i = 0; i < text.size(); i += 7)
+    s.feed(std::string_view(text).substr(i, 7));
+  REQUIRE(s.finish().input.fingerprint == original.input.fingerprint);
+  tv::TaskPool pool(2);
+  REQUIRE(tv::run(text, opt, pool).input.fingerprint ==
+          original.input.fingerprint);
+  REQUIRE(tv::run_batch({text}, opt)[0].input.fingerprint ==
+          original.input.fingerprint);
+  REQUIRE(tv::run(" \n\n", opt).input.fingerprint == 0);
+}
+
+TEST_CASE("the index finds every fingerprint within its distance") {
+  std::mt19937_64 rng(42);
+  for (std::uint32_t distance : {0u, 2u, 4u, 7u}) {
+    tv::NearDuplicateIndex index(distance);
+    std::vector<std::uint64_t> seen;
+    for (int i = 0; i < 2000; i++) {
+      seen.push_back(rng());
+      REQUIRE(index.add(seen.back()) == static_cast<std::uint64_t>(i));
+    }
+    REQUIRE(index.size() == 2000);
+    for (int i = 0; i < 2000; i += 7) {
+      for (int bits = 0; bits <= static_cast<int>(distance); bits++) {
+        auto m = index.find(flip(seen[i], bits, rng));
+        REQUIRE(m);
+        REQUIRE(m->ticket == static_cast<std::uint64_t>(i));
+        REQUIRE(m->distance == static_cast<std::uint32_t>(bits));
+      }
+      // Random fingerprints are about 32 bits apart.
+      REQUIRE_FALSE(index.find(flip(seen[i], 20, rng)));
+    }
+  }
+  REQUIRE_THROWS_AS(tv::NearDuplicateIndex(16), std::invalid_argument);
+}
+
+TEST_CASE("the closest ticket wins, the first one added on a tie") {
+  tv::NearDuplicateIndex index;
+  const std::uint64_t f = 0x0123456789ABCDEFull;
+  index.add(f ^ 0x7);  // 3 bits
+  index.add(f ^ 0x30); // 2 bits
+  index.add(f ^ 0x300);
+  REQUIRE(index.find(f)->ticket == 1);
+  REQUIRE(index.find(f)->distance == 2);
+  REQUIRE_FALSE(index.find_and_add(~f));
+  REQUIRE(index.find_and_add(f)->ticket == 1);
+  REQUIRE(index.find_and_add(f)->ticket == 4); // the copy just added
+  REQUIRE(index.size() == 6);
+}
+
+TEST_CASE("a snapshot restores the index") {
+  auto path = temp_path("snapshot");
+  std::mt19937_64 rng(7);
+  tv::NearDuplicateIndex index(3);
+  std::vector<std::uint64_t> seen;
+  for (int i = 0; i < 5000; i++) {
+    seen.push_back(i % 10 == 9 ? seen[i - 1] : rng());
+    index.add(seen.back());
+  }
+  index.save(path);
+  auto loaded = tv::NearDuplicateIndex::load(path);
+  REQUIRE(loaded->size() == 5000);
+  REQUIRE(loaded->max_distance() == 3);
+  for (int i = 0; i < 5000; i += 3) {
+    auto m = loaded->find(seen[i]);
+    REQUIRE(m);
+    REQUIRE(m->ticket == static_cast<std::uint64_t>(i % 10 == 9 ? i - 1 : i));
+    REQUIRE(m->distance == 0);
+  }
+  REQUIRE(loaded->add(1) == 5000);
+
+  std::ofstream(path, std::ios::binary | std::ios::app) << "x";
+  REQUIRE(error_of([&] { tv::NearDuplicateIndex::load(path); })
+              .find("trailing bytes") != std::string::npos);
+  std::ofstream(path, std::ios::binary) << "TVNEARDP but cut short";
+  REQUIRE(error_of([&] { tv::NearDuplicateIndex::load(path); })
+              .find("truncated") != std::string::npos);
+  std::ofstream(path, std::ios::binary) << std::string(64, 'x');
+  REQUIRE(error_of([&] { tv::NearDuplicateIndex::load(path); })
+              .find("not a near-duplicate index") != std::string::npos);
+  REQUIRE_THROWS(tv::NearDuplicateIndex::load(temp_path("missing")));
+  std::remove(path.c_str());
+}
+
+TEST_CASE("run_batch flags a resubmitted receipt against the active index") {
+  std::string text = fixture();
+  std::string again = text;
+  again.replace(again.find("Matcha"), 6, "Matoha");
+  tv::set_active_near_duplicates(std::make_shared<tv::NearDuplicateIndex>());
+  tv::Options opt;
+  auto outs = tv::run_batch({text, "CAFE\nTOTAL 4,20\n", "  \n", again}, opt);
+  auto flagged = [](const tv::EngineOutput &out) {
+    for (const auto &w : out.ticket.warnings)
+      if (w.code == "NEAR_DUPLICATE")
+        return w.message;
+    return std::string();
+  };
+  REQUIRE(flagged(outs[0]).empty());
+  REQUIRE(flagged(outs[1]).empty());
+  REQUIRE(flagged(outs[2]).empty());
+  REQUIRE(flagged(outs[3]).find("ticket #0") != std::string::npos);
+  REQUIRE(tv::active_near_duplicates()->size() == 3); // blank not added
+
+  // A later batch sees the earlier ones.
+  auto later = tv::run_batch({"CAFE\nTOTAL 4,20\n"}, opt);
+  REQUIRE(flagged(later[0]).find("ticket #1 seen before (0 ") !=
+          std::string::npos);
+  tv::set_active_near_duplicates(nullptr);
+}
+
+TEST_CASE("a near-duplicate counts against the ticket's status and confidence") {
+  std::string text = fixture();
+  tv::Options opt;
+  auto alone = tv::run(text, opt);
+  REQUIRE(alone.status == tv::Status::Ok);
+
+  tv::set_active_near_duplicates(std::make_shared<tv::NearDuplicateIndex>());
+  auto outs = tv::run_batch({text, text}, opt);
+  tv::set_active_near_duplicates(nullptr);
+  REQUIRE(outs[0].status == tv::Status::Ok);
+  REQUIRE(outs[0].confidence == alone.confidence);
+  REQUIRE(outs[1].status == tv::Status::Partial);
+  REQUIRE(outs[1].confidence < alone.confidence);
+  REQUIRE(outs[1].confidence ==
+          tv::score(tv::score_features(outs[1]), tv::default_scoring));
+}
@@ -0,0 +1,111 @@
+#include <catch2/catch_all.hpp>
+#include <string>
+
+#include "test_util.hpp"
+#include "tv/engine.hpp"
+#include "tv/json.hpp"
+#include "tv/parse_company.hpp"
+#include "tv/task_pool.hpp"
+
+static tv::ParsedTicket parse(std::string_view text) {
+  tv::ParsedTicket t;
+  tv::parse_company(text, t);
+  return t;
+}
+
+TEST_CASE("SIREN and SIRET checksums") {
+  REQUIRE(tv::valid_siren("732829320"));
+  REQUIRE_FALSE(tv::valid_siren("732829321"));
+  REQUIRE_FALSE(tv::valid_siren("73282932"));
+  REQUIRE(tv::valid_siret("73282932000017"));
+  REQUIRE_FALSE(tv::valid_siret("73282932000018"));
+  REQUIRE_FALSE(tv::valid_siret("12345678900012"));
+  // Luhn over the 14 digits, but not over the SIREN.
+  REQUIRE_FALSE(tv::valid_siret("73282932100007"));
+  // La Poste: digit sum multiple of 5, whatever Luhn says.
+  REQUIRE(tv::valid_siret("35600000000056"));
+  REQUIRE_FALSE(tv::valid_siret("35600000000048")); // Luhn-valid
+}
+
+TEST_CASE("parse_company reads contiguous and grouped numbers") {
+  for (auto text : {"SIRET 73282932000017", "Siret: 732 829 320 00017",
+                    "SIRET N\xC2\xB0 732.829.320.00017 APE 5610A",
+                    "SIRET :\n732 829 320 00017"}) {
+    auto t = parse(text);
+    REQUIRE(t.company.value);
+    REQUIRE(t.company.value->siret == "73282932000017");
+    REQUIRE(t.company.value->siren == "732829320");
+    REQUIRE(t.company.confidence == Catch::Approx(0.8));
+    REQUIRE(t.company.source == "line:1");
+    REQUIRE(t.signals.has_siret);
+  }
+
+  auto siren = parse("CAFE\nSIREN 552 081 317 - RCS PARIS\n");
+  REQUIRE(siren.company.value->siren == "552081317");
+  REQUIRE(siren.company.value->siret.empty());
+  REQUIRE(siren.company.source == "line:2");
+  REQUIRE_FALSE(siren.signals.has_siret);
+
+  // 14 digits that fail the checksum: the SIREN at the 9th digit may stand.
+  auto bad = parse("SIRET 552 081 317 00099");
+  REQUIRE(bad.company.value->siren == "552081317");
+  REQUIRE(bad.company.value->siret.empty());
+}
+
+TEST_CASE("parse_company rejects what is not a company number") {
+  REQUIRE_FALSE(parse("SIRET 90888159000015").company.value); // checksum
+  REQUIRE_FALSE(parse("SIRET 7328293200001").company.value);  // 13 digits
+  REQUIRE_FALSE(parse("SIRET 7328293200001700").company.value);
+  REQUIRE_FALSE(parse("SIRETTE 73282932000017").company.value);
+  REQUIRE_FALSE(parse("NOSIRET 73282932000017").company.value);
+  REQUIRE_FALSE(parse("SIRET " + std::string(30, '.') + "73282932000017")
+                    .company.value); // too far from the label
+  REQUIRE_FALSE(parse("73282932000017").company.value); // no label
+
+  // A later label with a valid number still counts.
+  auto t = parse("SIRET 12345678900012\nSIRET 73282932000025\n");
+  REQUIRE(t.company.value->siret == "73282932000025");
+  REQUIRE(t.company.source == "line:2");
+}
+
+TEST_CASE("the company is the same through run, Session and FrameCache") {
+  std::string text = "CAFE DU COMMERCE\n"
+                     "1 rue de la Gare\n"
+                     "SIRET 732 829\n"
+                     "TOTAL 4,20\n";
+  tv::Options opt;
+  auto expected = tv::run(text, opt);
+  REQUIRE_FALSE(expected.ticket.company.value); // "829" ends the number
+
+  text.replace(text.find("829\n"), 4, "829 320 00017\n");
+  expected = tv::run(text, opt);
+  REQUIRE(expected.ticket.company.value->siret == "73282932000017");
+  auto json = json_without_timing(expected);
+  REQUIRE(json.find("\"company\":{\"confidence\":0.8,\"source\":\"line:3\","
+                    "\"value\":{\"siren\":\"732829320\",\"siret\":"
+                    "\"73282932000017\"}}") != std::string::npos);
+
+  for (std::size_t chunk : {1, 3, 7, 64, 4096}) {
+    tv::Session s;
+    s.begin(opt, tv::RulePack::builtin());
+    for (std::size_t i = 0; i < text.size(); i += chunk)
+      s.feed(std::string_view(text).substr(i, chunk));
+    auto out = s.finish();
+    REQUIRE(json_without_timing(out) == json);
+    REQUIRE(s.shadow()->output.ticket.company.value->siret ==
+            "73282932000017");
+  }
+
+  tv::TaskPool pool(2);
+  auto graph = tv::run(text, opt, pool);
+  REQUIRE(json_without_timing(graph) == json);
+
+  auto batch = tv::run_batch({text}, opt);
+  REQUIRE(json_without_timing(batch[0]) == json);
+
+  tv::FrameCache frames;
+  auto first = frames.run("s", "CAFE DU COMMERCE\nSIRET 732 829", opt);
+  REQUIRE_FALSE(first.ticket.company.value);
+  auto second = frames.run("s", text, opt);
+  REQUIRE(json_without_timing(second) == json);
+}
@@ -0,0 +1,80 @@
+#include <catch2/catch_all.hpp>
+#include <string>
+
+#include "test_util.hpp"
+#include "tv/engine.hpp"
+#include "tv/json.hpp"
+#include "tv/parse_datetime.hpp"
+
+static std::string datetime(std::string_view text) {
+  tv::ParsedTicket t;
+  tv::parse_datetime(text, t);
+  return t.datetime_iso.value.value_or("");
+}
+
+TEST_CASE("parse_datetime reads French date and time forms") {
+  REQUIRE(datetime("19/01/2025 16:15:59") == "2025-01-19T16:15:59");
+  REQUIRE(datetime("Le 19/01/25 a 16:15") == "2025-01-19T16:15:00");
+  REQUIRE(datetime("Date 03.11.2024 Heure 9h05") == "2024-11-03T09:05:00");
+  REQUIRE(datetime("1/2/2024") == "2024-02-01");
+  REQUIRE(datetime("16:15 19/01/2025") == "2025-01-19T16:15:00");
+}
+
+TEST_CASE("parse_datetime takes the time from the next line, not further") {
+  tv::ParsedTicket t;
+  tv::parse_datetime("CAFE\n19/01/2025\n16H15\n", t);
+  REQUIRE(*t.datetime_iso.value == "2025-01-19T16:15:00");
+  REQUIRE(t.datetime_iso.confidence == Catch::Approx(0.9));
+  REQUIRE(t.datetime_iso.source == "line:2");
+
+  tv::ParsedTicket u;
+  tv::parse_datetime("19/01/2025\nTable 4\n16:15\n", u);
+  REQUIRE(*u.datetime_iso.value == "2025-01-19");
+  REQUIRE(u.datetime_iso.confidence == Catch::Approx(0.7));
+
+  // A time on an earlier line belongs to no date.
+  REQUIRE(datetime("16:15\n19/01/2025") == "2025-01-19");
+}
+
+TEST_CASE("parse_datetime validates the calendar and the clock") {
+  REQUIRE(datetime("29/02/2024") == "2024-02-29");
+  REQUIRE(datetime("29/02/2023") == "");
+  REQUIRE(datetime("31/04/2024") == "");
+  REQUIRE(datetime("00/01/2024 32/13/2024 01/01/1969") == "");
+  REQUIRE(datetime("12/05/2024 24:00") == "2024-05-12");
+  REQUIRE(datetime("12/05/2024 23:60") == "2024-05-12");
+  REQUIRE(datetime("12/05/2024 23:59:60") == "2024-05-12T23:59:00");
+}
+
+TEST_CASE("parse_datetime ignores numbers glued to other digits") {
+  REQUIRE(datetime("119/01/2025") == "");
+  REQUIRE(datetime("19/01/20251") == "");
+  REQUIRE(datetime("12.50 EUR 1.5.24") == ""); // dd.mm.yy is not a form
+  REQUIRE(datetime("Ref 0019/01/2025 then 02/03/2024") == "2024-03-02");
+  REQUIRE(datetime("12/05/2024 123:45 10:30") == "2024-05-12T10:30:00");
+}
+
+TEST_CASE("the datetime is the same through run and Session chunks") {
+  std::string text = "BOULANGERIE\n"
+                     "TOTAL 4,20\n"
+                     "Le 07/06/2024\n"
+                     "a 08h42\n";
+  tv::Options opt;
+  auto expected = tv::run(text, opt);
+  REQUIRE(*expected.ticket.datetime_iso.value == "2024-06-07T08:42:00");
+  auto json = json_without_timing(expected);
+  for (std::size_t chunk : {1, 2, 3, 5, 11, 4096}) {
+    tv::Session s;
+    s.begin(opt);
+    for (std::size_t i = 0; i < text.size(); i += chunk)
+      s.feed(std::string_view(text).substr(i, chunk));
+    auto out = s.finish();
+    REQUIRE(json_without_timing(out) == json);
+  }
+
+  tv::FrameCache frames;
+  auto first = frames.run("s", text, opt);
+  auto second = frames.run("s", text + "Merci\n", opt);
+  REQUIRE(*first.ticket.datetime_iso.value == "2024-06-07T08:42:00");
+  REQUIRE(*second.ticket.datetime_iso.value == "2024-06-07T08:42:00");
+}
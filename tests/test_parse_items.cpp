@@ -0,0 +1,116 @@
+#include <catch2/catch_all.hpp>
+#include <string>
+
+#include "test_util.hpp"
+#include "tv/engine.hpp"
+#include "tv/json.hpp"
+#include "tv/parse_items.hpp"
+#include "tv/parse_total.hpp"
+#include "tv/task_pool.hpp"
+
+static tv::ParsedTicket parse(std::string_view text) {
+  tv::ParsedTicket t;
+  tv::parse_total(text, t);
+  tv::parse_items(text, t);
+  return t;
+}
+
+TEST_CASE("parse_items reads the price column up to the total") {
+  auto t = parse("BRASSERIE DU PORT\n"
+                 "Table 4\n"
+                 "2 x Cafe 3,00 A\n"
+                 "Croque monsieur 8,50 \xE2\x82\xAC B\n"
+                 "Eau 50cl 2 x 1,75 3,50\n"
+                 "Remise fidelite -1,00\n"
+                 "TOTAL TTC 14,00\n"
+                 "CB 14,00\n"
+                 "Dessert 5,00\n");
+  REQUIRE(t.items.size() == 4);
+
+  REQUIRE(t.items[0].label == "Cafe");
+  REQUIRE(t.items[0].qty == 2);
+  REQUIRE(*t.items[0].unit_price == Catch::Approx(1.5));
+  REQUIRE(*t.items[0].total == Catch::Approx(3.0));
+  REQUIRE(t.items[0].source == "line:3");
+
+  REQUIRE(t.items[1].label == "Croque monsieur");
+  REQUIRE(t.items[1].qty == 1);
+  REQUIRE(*t.items[1].total == Catch::Approx(8.5));
+
+  REQUIRE(t.items[2].label == "Eau 50cl");
+  REQUIRE(t.items[2].qty == 2);
+  REQUIRE(*t.items[2].unit_price == Catch::Approx(1.75));
+
+  REQUIRE(t.items[3].label == "Remise fidelite");
+  REQUIRE(*t.items[3].total == Catch::Approx(-1.0));
+
+  // The items add up to the total: no warning, confidence raised.
+  REQUIRE(t.warnings.empty());
+  REQUIRE(t.items[1].confidence == Catch::Approx(0.75));
+  REQUIRE(t.items[2].confidence == Catch::Approx(0.95)); // qty x unit agrees
+}
+
+TEST_CASE("parse_items warns when the items disagree with the total") {
+  auto t = parse("Menu midi 15,90\nCafe 2,00\nTOTAL 19,90\n");
+  REQUIRE(t.items.size() == 2);
+  REQUIRE(t.items[0].confidence == Catch::Approx(0.6));
+  REQUIRE(t.warnings.size() == 1);
+  REQUIRE(t.warnings[0].code == "ITEMS_TOTAL_MISMATCH");
+  REQUIRE(t.warnings[0].message == "Items sum to 17.90, total is 19.90.");
+
+  // Without a total there is nothing to check against.
+  auto u = parse("Menu midi 15,90\n");
+  REQUIRE(u.items.size() == 1);
+  REQUIRE(u.warnings.empty());
+}
+
+TEST_CASE("parse_items skips lines that are not items") {
+  auto t = parse("12,50\n"                      // price without a label
+                 "19/01/2025 16:15\n"           // no price column
+                 "Ref 1234 9,99\n"              // the only item
+                 "TVA 10% 1,14\n"               // tax line
+                 "Carte bancaire 12,50\n"       // card line
+                 "SIRET 90888159000015 0,00\n"  // company id line
+                 "Prix 12,5\n"                  // one decimal: not a price
+                 "Cafe 1234567890,00\n"         // too many digits
+                 "x 3,00\n");                   // fewer than 2 letters
+  REQUIRE(t.items.size() == 1);
+  REQUIRE(t.items[0].label == "Ref 1234");
+}
+
+TEST_CASE("the real receipt has its prices in a separate column block") {
+  // OCR read the price column after the labels: no line holds both.
+  auto t = parse("Chocolat chaud\nMatcha latte\n\nPU\n4,00\xE2\x82\xAC\n"
+                 "8,00\xE2\x82\xAC B\nTotal TTC\n31,70\xE2\x82\xAC\n");
+  REQUIRE(t.items.empty());
+  REQUIRE(t.warnings.empty());
+}
+
+TEST_CASE("items are the same through run, Session and the task graph") {
+  std::string text = "LE PETIT BISTROT\r\n"
+                     "1 Plat du jour   14,50 \xE2\x82\xAC\r\n" +
+                     std::string(tv::item_line_max + 10, 'z') +
+                     " 99,00\n"
+                     "2 * Verre de vin 9,00\n"
+                     "Cafe gourmand\xC2\xA0 7,20\n"
+                     "TOTAL TTC\n30,70 EUR\n";
+  tv::Options opt;
+  auto expected = tv::run(text, opt);
+  REQUIRE(expected.ticket.items.size() == 3); // the long line is skipped
+  REQUIRE(expected.ticket.items[2].label == "Cafe gourmand");
+  REQUIRE(expected.ticket.warnings.empty());
+  auto json = json_without_timing(expected);
+
+  for (std::size_t chunk : {1, 7, 64, 4096}) {
+    tv::Session s;
+    s.begin(opt);
+    for (std::size_t i = 0; i < text.size(); i += chunk)
+      s.feed(std::string_view(text).substr(i, chunk));
+    auto out = s.finish();
+    REQUIRE(json_without_timing(out) == json);
+  }
+
+  tv::TaskPool pool(2);
+  auto graph = tv::run(text, opt, pool);
+  REQUIRE(json_without_timing(graph) == json);
+}
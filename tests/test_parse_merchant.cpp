@@ -78,3 +78,32 @@ TEST_CASE("parse_merchant can merge consecutive header lines into a single "
   REQUIRE(t.merchant.value.has_value());
   REQUIRE(*t.merchant.value == "CAFÉ DE QUARTIER");
 }
+
+TEST_CASE("parse_merchant does not read past merchant_header_bytes") {
+  std::string pad(tv::merchant_header_bytes, ' ');
+  tv::ParsedTicket early, late;
+  tv::parse_merchant("BOULANGERIE DU PORT\n" + pad, early);
+  tv::parse_merchant(pad + "\nBOULANGERIE DU PORT\n", late);
+  REQUIRE(early.merchant.value.has_value());
+  REQUIRE(!late.merchant.value.has_value());
+}
+
+TEST_CASE("parse_merchant only accepts short lines with keywords of the "
+          "domain") {
+  const char *text = "CAFÉ\n"
+                     "DE QUARTIER\n"
+                     "TOTAL 31,70 €\n";
+  using tv::rules::FrFR;
+
+  tv::ParsedTicket cafe;
+  tv::parse_merchant(text, cafe,
+                     tv::rules::Pipeline<FrFR, tv::rules::Cafe>::rules);
+  REQUIRE(cafe.merchant.value.has_value());
+  REQUIRE(*cafe.merchant.value == "CAFÉ DE QUARTIER");
+
+  tv::ParsedTicket resto;
+  tv::parse_merchant(text, resto,
+                     tv::rules::Pipeline<FrFR, tv::rules::Resto>::rules);
+  REQUIRE(resto.merchant.value.has_value());
+  REQUIRE(*resto.merchant.value == "DE QUARTIER");
+}
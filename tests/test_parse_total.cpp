@@ -72,3 +72,13 @@ TEST_CASE("parse_total supports TOTAL TTC amount on the next line") {
   REQUIRE(t.total.value.has_value());
   REQUIRE(t.total.value->value == Catch::Approx(31.70));
 }
+
+TEST_CASE("parse_total skips labels without an amount") {
+  tv::ParsedTicket t;
+  tv::parse_total("TOTAL HT\n"
+                  "NET A PAYER : EUR 12,50\n",
+                  t);
+
+  REQUIRE(t.total.value.has_value());
+  REQUIRE(t.total.value->value == Catch::Approx(12.5));
+}
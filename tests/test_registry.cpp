@@ -0,0 +1,142 @@
+#include <catch2/catch_all.hpp>
+#include <cstdio>
+#include <string>
+
+#include <unistd.h>
+
+#include "test_util.hpp"
+#include "tv/engine.hpp"
+#include "tv/parse_company.hpp"
+#include "tv/registry.hpp"
+
+namespace {
+
+// Smallest completion of `prefix` (8 or 13 digits) passing Luhn.
+std::string luhn_complete(const std::string &prefix) {
+  for (char c = '0'; c <= '9'; c++) {
+    auto d = prefix + c;
+    if (d.size() == 9 ? tv::valid_siren(d) : tv::valid_siret(d))
+      return d;
+  }
+  return {};
+}
+
+} // namespace
+
+TEST_CASE("a compiled registry maps back every entry") {
+  auto csv = temp_path("big.csv");
+  auto reg = temp_path("big.reg");
+  std::string text = "# number;name;naf;trade_name\n\n";
+  std::vector<std::string> sirens;
+  for (int i = 0; i < 5000; i++) {
+    auto siren = luhn_complete(std::to_string(10000000 + i * 7919));
+    sirens.push_back(siren);
+    text += siren + ";SOCIETE " + std::to_string(i) + ";56.10A\r\n";
+    if (i % 3 == 0)
+      text += luhn_complete(siren + "0001") + ";SOCIETE " +
+              std::to_string(i) + ";56.30Z;BAR " + std::to_string(i) + "\n";
+  }
+  write_file(csv, text);
+  REQUIRE(tv::compile_registry(csv, reg) == 5000 + 1667);
+
+  auto r = tv::CompanyRegistry::open(reg);
+  REQUIRE(r->size() == 5000 + 1667);
+  for (int i = 0; i < 5000; i++) {
+    auto e = r->find_siren(sirens[i]);
+    REQUIRE(e);
+    REQUIRE(e->name == "SOCIETE " + std::to_string(i));
+    REQUIRE(e->trade_name.empty());
+    REQUIRE(e->naf == "56.10A");
+
+    // Registered establishment, else the legal unit.
+    auto siret = luhn_complete(sirens[i] + "0001");
+    auto s = r->find_siret(siret);
+    REQUIRE(s);
+    REQUIRE(s->naf == (i % 3 == 0 ? "56.30Z" : "56.10A"));
+    REQUIRE(s->trade_name ==
+            (i % 3 == 0 ? "BAR " + std::to_string(i) : std::string()));
+  }
+  REQUIRE_FALSE(r->find_siren("732829320"));
+  REQUIRE_FALSE(r->find_siret("73282932000017"));
+  REQUIRE_FALSE(r->find_siren("12345"));
+  REQUIRE_FALSE(r->find_siren("abcdefghi"));
+  std::remove(csv.c_str());
+  std::remove(reg.c_str());
+}
+
+TEST_CASE("compile_registry rejects bad lines and keeps the old file") {
+  auto csv = temp_path("bad.csv");
+  auto reg = temp_path("bad.reg");
+  write_file(csv, "732829320;CAFE DU COMMERCE;56.30Z\n");
+  REQUIRE(tv::compile_registry(csv, reg) == 1);
+
+  auto rejects = [&](const std::string &text, const std::string &what) {
+    write_file(csv, text);
+    auto error = error_of([&] { tv::compile_registry(csv, reg); });
+    REQUIRE(error.find(what) != std::string::npos);
+  };
+  rejects("732829321;X;56.30Z\n", "line 1: invalid SIREN/SIRET");
+  rejects("732829320;X\n", "line 1: expected");
+  rejects("732829320;X;56.30ZZ\n", "NAF code");
+  rejects("# dup\n732829320;A;56.30Z\n552081317;B;47.11F\n732829320;C;\n",
+          "line 4: duplicate of line 2");
+  REQUIRE(tv::CompanyRegistry::open(reg)->find_siren("732829320")->name ==
+          "CAFE DU COMMERCE");
+
+  write_file(reg, "not a registry at all, but long enough for a header......"
+                  "....................");
+  REQUIRE(error_of([&] { tv::CompanyRegistry::open(reg); })
+              .find("not a compiled registry") != std::string::npos);
+  REQUIRE_THROWS(tv::CompanyRegistry::open(temp_path("missing.reg")));
+  std::remove(csv.c_str());
+  std::remove(reg.c_str());
+}
+
+TEST_CASE("an empty registry finds nothing") {
+  auto csv = temp_path("empty.csv");
+  auto reg = temp_path("empty.reg");
+  write_file(csv, "# nothing yet\n");
+  REQUIRE(tv::compile_registry(csv, reg) == 0);
+  auto r = tv::CompanyRegistry::open(reg);
+  REQUIRE(r->size() == 0);
+  REQUIRE_FALSE(r->find_siren("732829320"));
+  std::remove(csv.c_str());
+  std::remove(reg.c_str());
+}
+
+TEST_CASE("the active registry completes the company and checks the merchant") {
+  auto csv = temp_path("active.csv");
+  auto reg = temp_path("active.reg");
+  write_file(csv, "732829320;SARL DUPONT ET FILS;56.30Z;CAFE DU COMMERCE\n"
+                  "552081317;BOULANGERIE MARTIN;10.71C\n");
+  tv::compile_registry(csv, reg);
+  tv::set_active_registry(tv::CompanyRegistry::open(reg));
+
+  tv::Options opt;
+  auto out = tv::run("CAFE DU COMMERCE\nSIRET 732 829 320 00017\nTOTAL 4,20\n",
+                     opt);
+  const auto &c = *out.ticket.company.value;
+  REQUIRE(c.name == "SARL DUPONT ET FILS");
+  REQUIRE(c.trade_name == "CAFE DU COMMERCE");
+  REQUIRE(c.naf == "56.30Z");
+  REQUIRE(out.ticket.company.confidence == Catch::Approx(0.95));
+  REQUIRE(out.ticket.warnings.empty());
+
+  auto other = tv::run("BAR DES AMIS\nSIREN 552081317\nTOTAL 4,20\n", opt);
+  REQUIRE(other.ticket.company.value->name == "BOULANGERIE MARTIN");
+  REQUIRE_FALSE(other.ticket.company.value->trade_name);
+  REQUIRE(other.ticket.warnings.size() == 1);
+  REQUIRE(other.ticket.warnings[0].code == "MERCHANT_REGISTRY_MISMATCH");
+
+  // An unknown establishment resolves to its legal unit; an unknown
+  // number keeps the checksum confidence.
+  auto unit = tv::run("CAFE\nSIRET 55208131700034\nTOTAL 4,20\n", opt);
+  REQUIRE(unit.ticket.company.value->name == "BOULANGERIE MARTIN");
+  auto absent = tv::run("CAFE\nSIREN 123456782\nTOTAL 4,20\n", opt);
+  REQUIRE_FALSE(absent.ticket.company.value->name);
+  REQUIRE(absent.ticket.company.confidence == Catch::Approx(0.8));
+
+  tv::set_active_registry(nullptr);
+  std::remove(csv.c_str());
+  std::remove(reg.c_str());
+}
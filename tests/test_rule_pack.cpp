@@ -0,0 +1,130 @@
+#include <atomic>
+#include <catch2/catch_all.hpp>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "test_util.hpp"
+#include "tv/engine.hpp"
+#include "tv/rule_pack.hpp"
+
+// Restores the built-in pack when a test ends, whatever happened.
+struct ActivePackGuard {
+  ~ActivePackGuard() { tv::set_active_rule_pack(nullptr); }
+};
+
+static const char *montant_pack = R"({
+  "version": "test-2",
+  "scoring": {"bias": 0.0, "total": 0.0, "amount": 0.0, "lines": 0.0},
+  "locales": {"fr_FR": {"total_keywords": ["MONTANT"]}},
+  "domains": {"cafe": {"business_keywords": ["BISTROT"]}}
+})";
+
+static const std::string montant_ticket =
+    "BISTROT DU COIN\nMONTANT 4,00 \xE2\x82\xAC\n";
+
+TEST_CASE("built-in rule pack is active by default") {
+  auto pack = tv::active_rule_pack();
+  REQUIRE(pack->is_builtin());
+  REQUIRE(pack->version() == "builtin");
+  REQUIRE(pack->scoring().bias == tv::default_scoring.bias);
+
+  auto out = tv::run(montant_ticket, fr_cafe());
+  REQUIRE(out.rules_version == "builtin");
+  REQUIRE_FALSE(out.ticket.total.value.has_value());
+}
+
+TEST_CASE("a loaded pack replaces the tables it names") {
+  ActivePackGuard guard;
+  auto pack = tv::RulePack::parse(montant_pack);
+  REQUIRE(pack->version() == "test-2");
+  REQUIRE_FALSE(pack->is_builtin());
+  // Untouched entries keep the built-in tables.
+  REQUIRE(pack->rules(tv::Locale::FrBE, tv::Domain::Resto).total_keywords[0] ==
+          "TOTAL TVAC");
+  REQUIRE(pack->rules(tv::Locale::FrFR, tv::Domain::Resto)
+              .total_keywords.size() == 1);
+
+  tv::set_active_rule_pack(pack);
+  auto out = tv::run(montant_ticket, fr_cafe());
+  REQUIRE(out.rules_version == "test-2");
+  REQUIRE(out.ticket.total.value.has_value());
+  REQUIRE(out.ticket.total.value->value == Catch::Approx(4.00));
+  REQUIRE(*out.ticket.merchant.value == "BISTROT DU COIN");
+  REQUIRE(out.status == tv::Status::Ok);
+
+  tv::Options partial = fr_cafe();
+  out = tv::run("MONTANT 4,00\n", partial);
+  REQUIRE(out.status == tv::Status::Partial);
+  REQUIRE(out.confidence == Catch::Approx(0.5)); // z = 0
+}
+
+TEST_CASE("malformed rule packs are rejected with the offending entry") {
+  auto rejects = [](const char *text, const char *where) {
+    try {
+      tv::RulePack::parse(text);
+    } catch (const std::runtime_error &e) {
+      INFO(e.what());
+      REQUIRE(std::string(e.what()).find(where) != std::string::npos);
+      return;
+    }
+    FAIL("accepted: " << text);
+  };
+  rejects("[]", "document");
+  rejects(R"({"locales": {}})", "version");
+  rejects(R"({"version": "x", "rulez": {}})", "rulez");
+  rejects(R"({"version": "x", "scoring": {"ok": 0.8}})", "scoring.ok");
+  rejects(R"({"version": "x", "scoring": {"bias": 75}})", "scoring.bias");
+  rejects(R"({"version": "x", "scoring": {"card": "1"}})", "scoring.card");
+  rejects(R"({"version": "x", "locales": {"de_DE": {}}})", "de_DE");
+  rejects(R"({"version": "x", "locales": {"fr_FR": {"card_keywords": [""]}}})",
+          "card_keywords");
+  rejects(R"({"version": "x",
+              "locales": {"es_ES": {"company_id_digits": 0}}})",
+          "company_id_digits");
+  rejects(R"({"version": "x", "domains": {"cafe": {"keywords": []}}})",
+          "domains.cafe.keywords");
+}
+
+TEST_CASE("tickets keep the pack they started with") {
+  ActivePackGuard guard;
+  tv::Session session;
+  session.begin(fr_cafe());
+  session.feed(montant_ticket.substr(0, 10));
+  tv::set_active_rule_pack(tv::RulePack::parse(montant_pack));
+  session.feed(montant_ticket.substr(10));
+  auto out = session.finish();
+  REQUIRE(out.rules_version == "builtin");
+  REQUIRE_FALSE(out.ticket.total.value.has_value());
+
+  // FrameCache: a new pack starts the frame over.
+  tv::FrameCache frames;
+  tv::set_active_rule_pack(nullptr);
+  REQUIRE_FALSE(frames.run("s", montant_ticket, fr_cafe()).ticket.total.value);
+  tv::set_active_rule_pack(tv::RulePack::parse(montant_pack));
+  auto again = frames.run("s", montant_ticket, fr_cafe());
+  REQUIRE(again.ticket.total.value.has_value());
+  REQUIRE(frames.last_rescanned_lines() == 2);
+}
+
+TEST_CASE("swapping packs under concurrent tickets is consistent") {
+  ActivePackGuard guard;
+  auto v2 = tv::RulePack::parse(montant_pack);
+  std::atomic<bool> stop{false};
+  std::atomic<int> inconsistent{0}, runs{0};
+
+  std::thread worker([&] {
+    while (!stop.load()) {
+      auto out = tv::run(montant_ticket, fr_cafe());
+      bool found = out.ticket.total.value.has_value();
+      if (found != (out.rules_version == "test-2"))
+        inconsistent++;
+      runs++;
+    }
+  });
+  for (int i = 0; i < 2000 || runs.load() < 100; i++)
+    tv::set_active_rule_pack(i % 2 ? v2 : nullptr);
+  stop = true;
+  worker.join();
+  REQUIRE(inconsistent.load() == 0);
+}
@@ -0,0 +1,34 @@
+#include <catch2/catch_all.hpp>
+
+#include "tv/scan.hpp"
+
+#include <array>
+#include <string_view>
+
+TEST_CASE("match_phrase is case-insensitive and lets spaces span whitespace") {
+  using tv::match_phrase;
+  REQUIRE(match_phrase("net a payer 8,20", 0, "NET A PAYER") == 11);
+  REQUIRE(match_phrase("Carte\nBancaire", 0, "CARTE BANCAIRE") == 14);
+  REQUIRE(match_phrase("NETA PAYER", 0, "NET A PAYER") ==
+          std::string_view::npos);
+  REQUIRE(match_phrase("TOT", 0, "TOTAL") == std::string_view::npos);
+}
+
+TEST_CASE("PhraseScanner finds the leftmost phrase, table order first") {
+  static constexpr std::array<std::string_view, 2> phrases = {"TOTAL TTC",
+                                                              "TOTAL"};
+  tv::PhraseScanner scanner(phrases);
+
+  auto m = scanner.find("HT 1,00\nTotal TTC 2,00", 0, false);
+  REQUIRE(m.has_value());
+  REQUIRE(m->begin == 8);
+  REQUIRE(m->index == 0);
+}
+
+TEST_CASE("PhraseScanner whole-word matching follows regex \\b") {
+  static constexpr std::array<std::string_view, 1> phrases = {"CB"};
+  tv::PhraseScanner scanner(phrases);
+
+  REQUIRE_FALSE(scanner.find("XCB CB_ CB1", 0, true).has_value());
+  REQUIRE(scanner.find("PAYE PAR CB.", 0, true).has_value());
+}
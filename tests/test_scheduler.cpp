@@ -0,0 +1,84 @@
+#include <catch2/catch_all.hpp>
+#include <chrono>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+#include "tv/json.hpp"
+#include "tv/scheduler.hpp"
+
+using namespace std::chrono_literals;
+using clock_type = tv::Scheduler<int>::clock;
+
+static std::vector<int> drain(tv::Scheduler<int> &s) {
+  std::vector<int> order;
+  while (auto e = s.pop())
+    order.push_back(e->item);
+  return order;
+}
+
+TEST_CASE("Scheduler serves interactive first, earliest deadline first") {
+  tv::Scheduler<int> s;
+  auto now = clock_type::now();
+  s.push(1, tv::Priority::Bulk, now + 10ms);
+  s.push(2, tv::Priority::Interactive, std::nullopt);
+  s.push(3, tv::Priority::Interactive, now + 50s);
+  s.push(4, tv::Priority::Bulk, std::nullopt);
+  s.push(5, tv::Priority::Interactive, now + 20s);
+  s.push(6, tv::Priority::Interactive, std::nullopt);
+  s.push(7, tv::Priority::Bulk, now + 5ms);
+  REQUIRE(s.size() == 7);
+  // Bulk deadlines of a few ms may pass while the test runs: order only.
+  REQUIRE(drain(s) == std::vector<int>{5, 3, 2, 6, 7, 1, 4});
+  REQUIRE(s.size() == 0);
+}
+
+TEST_CASE("Scheduler marks requests whose deadline passed while queued") {
+  tv::Scheduler<int> s;
+  auto now = clock_type::now();
+  s.push(1, tv::Priority::Interactive, now - 1ms);
+  s.push(2, tv::Priority::Interactive, now + 60s);
+  s.push(3, tv::Priority::Bulk, now - 1s);
+
+  auto a = s.pop();
+  REQUIRE(a->item == 1);
+  REQUIRE(a->expired);
+  auto b = s.pop();
+  REQUIRE(b->item == 2);
+  REQUIRE_FALSE(b->expired);
+  s.served(*b, 1500us);
+  REQUIRE(drain(s) == std::vector<int>{3});
+
+  auto stats = s.stats();
+  REQUIRE(stats[0].expired == 1);
+  REQUIRE(stats[1].expired == 1);
+  REQUIRE(stats[0].queue_wait.count == 1); // expired ones are not served
+  REQUIRE(stats[0].service.count == 1);
+  REQUIRE(stats[0].service.max_us == 1500);
+  REQUIRE(stats[1].service.count == 0);
+}
+
+TEST_CASE("LatencyHistogram buckets by powers of two") {
+  tv::LatencyHistogram h;
+  REQUIRE(h.quantile(0.5) == 0);
+  for (int i = 0; i < 90; i++)
+    h.add(3us); // bucket [2, 4)
+  for (int i = 0; i < 10; i++)
+    h.add(1000us); // bucket [512, 1024)
+  REQUIRE(h.count == 100);
+  REQUIRE(h.counts[2] == 90);
+  REQUIRE(h.counts[10] == 10);
+  REQUIRE(h.quantile(0.50) == 4);
+  REQUIRE(h.quantile(0.99) == 1000); // capped at the largest value seen
+  REQUIRE(h.sum_us == 90 * 3 + 10 * 1000);
+
+  tv::SchedulerStats stats;
+  stats[1].service = h;
+  auto doc = nlohmann::json::parse(tv::stats_json(stats, 3));
+  REQUIRE(doc["scheduler"]["queued"] == 3);
+  auto bulk = doc["scheduler"]["classes"]["bulk"]["service_us"];
+  REQUIRE(bulk["count"] == 100);
+  REQUIRE(bulk["p50"] == 4);
+  REQUIRE(bulk["buckets"].size() == 11);
+  REQUIRE(doc["scheduler"]["classes"]["interactive"]["expired"] == 0);
+}
@@ -0,0 +1,86 @@
+#include <catch2/catch_all.hpp>
+#include <cmath>
+#include <nlohmann/json.hpp>
+#include <string>
+
+#include "test_util.hpp"
+#include "tv/engine.hpp"
+#include "tv/json.hpp"
+#include "tv/score.hpp"
+
+TEST_CASE("every score feature has a name") {
+  REQUIRE(std::size(tv::score_terms) ==
+          sizeof(tv::ScoreTerms) / sizeof(double));
+  for (std::size_t i = 0; i < std::size(tv::score_terms); i++)
+    for (std::size_t j = 0; j < i; j++) {
+      REQUIRE(tv::score_terms[i].name != tv::score_terms[j].name);
+      REQUIRE(tv::score_terms[i].member != tv::score_terms[j].member);
+    }
+}
+
+TEST_CASE("the default model orders tickets by what was found") {
+  tv::Options opt;
+  auto full = tv::run(fixture(), opt);
+  auto ok = tv::run("CAFE DE LA PLACE\nTOTAL 4,00 €\n", opt);
+  auto partial = tv::run("TOTAL 4,00 €\n", opt);
+  auto reject = tv::run("CAFE DE LA PLACE\nMERCI\n", opt);
+  REQUIRE(full.status == tv::Status::Ok);
+  REQUIRE(ok.status == tv::Status::Ok);
+  REQUIRE(partial.status == tv::Status::Partial);
+  REQUIRE(reject.status == tv::Status::Reject);
+
+  REQUIRE(full.confidence > ok.confidence);
+  REQUIRE(ok.confidence >= 0.75);
+  REQUIRE(partial.confidence > 0.4);
+  REQUIRE(partial.confidence < 0.75);
+  REQUIRE(reject.confidence < 0.15);
+}
+
+TEST_CASE("features come from the extracted fields") {
+  tv::Options opt;
+  auto out = tv::run(fixture(), opt);
+  auto f = tv::score_features(out);
+  REQUIRE(f.total == out.ticket.total.confidence);
+  REQUIRE(f.merchant == out.ticket.merchant.confidence);
+  REQUIRE(f.datetime == out.ticket.datetime_iso.confidence);
+  REQUIRE(f.merchant_known == 0.0); // no dictionary
+  REQUIRE(f.tax == (out.ticket.signals.has_tva ? 1.0 : 0.0));
+  REQUIRE(f.lines == 1.0);
+  REQUIRE(f.amount == 1.0);
+  REQUIRE(out.confidence ==
+          Catch::Approx(tv::score(f, tv::default_scoring)));
+
+  // A huge total is less plausible, a warning counts against the ticket.
+  out.ticket.total.value->value = 5000.0;
+  REQUIRE(tv::score_features(out).amount == 0.5);
+  out.ticket.warnings.push_back({"X", "x", "high"});
+  REQUIRE(tv::score(tv::score_features(out), tv::default_scoring) <
+          out.confidence);
+}
+
+TEST_CASE("the score is the logistic of the weighted features") {
+  tv::ScoreTerms f;
+  f.total = 1.0;
+  f.warnings = 0.5;
+  tv::Scoring s;
+  s.bias = -1.0;
+  s.weights = {};
+  s.weights.total = 2.0;
+  s.weights.warnings = -2.0;
+  REQUIRE(tv::score(f, s) == Catch::Approx(0.5)); // z = -1 + 2 - 1
+  s.bias = 0.0;
+  REQUIRE(tv::score(f, s) == Catch::Approx(1.0 / (1.0 + std::exp(-1.0))));
+}
+
+TEST_CASE("the scoring cost is reported in timing_ms") {
+  tv::Options opt;
+  auto out = tv::run(fixture(), opt);
+  REQUIRE(out.timing.score_ns > 0);
+  REQUIRE(out.timing.score_ns < 1000000);
+  REQUIRE(out.timing.score == 0);
+  auto j = nlohmann::json::parse(tv::to_json_v1(out));
+  // ticketverify.v1 keeps its integer milliseconds.
+  REQUIRE(j["timing_ms"]["score"].is_number_integer());
+  REQUIRE(j["timing_ms"]["score"] == 0);
+  REQUIRE(j["timing_ms"]["score_ns"] == out.timing.score_ns);
+}
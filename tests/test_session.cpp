@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <catch2/catch_all.hpp>
+
+#include "test_util.hpp"
+#include "tv/engine.hpp"
+#include "tv/json.hpp"
+#include "tv/normalize.hpp"
+
+static tv::EngineOutput run_chunked(std::string_view text, std::size_t chunk,
+                                    const tv::Options &opt) {
+  tv::Session s;
+  s.begin(opt);
+  for (std::size_t i = 0; i < text.size(); i += chunk)
+    s.feed(text.substr(i, chunk));
+  return s.finish();
+}
+
+TEST_CASE("Session matches run on the real receipt for any chunk size") {
+  auto text = fixture();
+  REQUIRE(!text.empty());
+  tv::Options opt;
+  auto expected = json_without_timing(tv::run(text, opt));
+  for (std::size_t chunk : {1, 2, 3, 5, 64, 4096})
+    REQUIRE(json_without_timing(run_chunked(text, chunk, opt)) == expected);
+}
+
+TEST_CASE("Session carries matches, UTF-8 and NBSP across chunk boundaries") {
+  // "TOTAL TTC" label split from its amount, an 'é' and an NBSP cut in two,
+  // an invalid byte, CRLF and trailing blanks.
+  std::string text = "CAF\xC3\xA9 DU\xC2\xA0PORT\r\nTable 4\n\xFF\n"
+                     "TOTAL   TTC :\n  12,50 \xE2\x82\xAC\r\nCB\nSIRET "
+                     "90888159000015 \n \n";
+  tv::Options opt;
+  auto expected = json_without_timing(tv::run(text, opt));
+  for (std::size_t chunk = 1; chunk <= text.size(); chunk++)
+    REQUIRE(json_without_timing(run_chunked(text, chunk, opt)) == expected);
+
+  auto out = run_chunked(text, 1, opt);
+  REQUIRE(out.ticket.total.value.has_value());
+  REQUIRE(out.ticket.total.value->value == Catch::Approx(12.50));
+  REQUIRE(out.ticket.signals.has_siret);
+  REQUIRE(out.ticket.signals.has_card_keywords);
+}
+
+TEST_CASE("Session rejects whitespace-only input like run") {
+  tv::Options opt;
+  auto out = run_chunked(" \n\t\n", 1, opt);
+  REQUIRE(out.status == tv::Status::Reject);
+  REQUIRE(out.normalization_applied ==
+          std::vector<std::string>{"input_whitespace_only"});
+}
+
+TEST_CASE("Session keeps a bounded merchant header on a huge first line") {
+  // One line far longer than the header cap, then what would otherwise be
+  // the merchant: neither run nor the session reads past the cap.
+  std::string text(1 << 20, ' ');
+  for (std::size_t i = 0; i < text.size(); i += 8)
+    text[i] = 'x';
+  text += "\nBOULANGERIE DU PORT\nTOTAL 4,20 EUR\n";
+  tv::Options opt;
+  auto expected = json_without_timing(tv::run(text, opt));
+  for (std::size_t chunk : {7, 4096, 1 << 16})
+    REQUIRE(json_without_timing(run_chunked(text, chunk, opt)) == expected);
+  auto out = run_chunked(text, 4096, opt);
+  REQUIRE(out.ticket.merchant.value.value_or("").find("BOULANGERIE") ==
+          std::string::npos);
+}
+
+TEST_CASE("Normalizer output does not depend on chunking") {
+  std::string text = "  A \xC2\xA0 B\r\n\n  C  \t\n ";
+  auto expected = tv::normalize_ocr(text).text;
+  for (std::size_t chunk = 1; chunk <= text.size(); chunk++) {
+    tv::Normalizer n;
+    std::string out;
+    for (std::size_t i = 0; i < text.size(); i += chunk)
+      n.feed(std::string_view(text).substr(i, chunk), out);
+    n.finish(out);
+    REQUIRE(out == expected);
+  }
+}
+
+TEST_CASE("FrameCache matches run on successive frames and reuses the "
+          "unchanged head") {
+  auto text = fixture();
+  REQUIRE(!text.empty());
+  tv::Options opt;
+  tv::FrameCache cache;
+
+  // Frames of a live OCR: the receipt revealed top-down, then a corrected
+  // last line.
+  std::vector<std::string> frames = {text.substr(0, text.size() / 3),
+                                     text.substr(0, 2 * text.size() / 3),
+                                     text, text + "Merci de votre visite\n"};
+  std::size_t lines = 0;
+  for (const auto &f : frames) {
+    REQUIRE(json_without_timing(cache.run("cam-1", f, opt)) ==
+            json_without_timing(tv::run(f, opt)));
+    lines = static_cast<std::size_t>(std::count(f.begin(), f.end(), '\n'));
+  }
+  REQUIRE(cache.last_rescanned_lines() < lines / 4);
+
+  // An edit in the header invalidates the merchant.
+  std::string edited = text;
+  edited.replace(0, 5, "Canix");
+  REQUIRE(json_without_timing(cache.run("cam-1", edited, opt)) ==
+          json_without_timing(tv::run(edited, opt)));
+}
+
+TEST_CASE("FrameCache keeps sessions apart and evicts the least recently "
+          "used past its byte budget") {
+  tv::Options opt;
+  // Room for the first two sessions only.
+  tv::FrameCache probe;
+  probe.run("a", "CAFE DE LA PLACE\nTOTAL 4,00 €\n", opt);
+  probe.run("b", "BRASSERIE DU PORT\nTOTAL 9,00 €\n", opt);
+  tv::FrameCache cache(probe.bytes());
+  cache.run("a", "CAFE DE LA PLACE\nTOTAL 4,00 €\n", opt);
+  cache.run("b", "BRASSERIE DU PORT\nTOTAL 9,00 €\n", opt);
+  auto a = cache.run("a", "CAFE DE LA PLACE\nTOTAL 5,00 €\n", opt);
+  REQUIRE(*a.ticket.merchant.value == "CAFE DE LA PLACE");
+  REQUIRE(a.ticket.total.value->value == Catch::Approx(5.00));
+
+  REQUIRE(cache.size() == 2);
+
+  cache.run("c", "BAR\nTOTAL 1,00\n", opt); // evicts "b"
+  REQUIRE(cache.size() == 2);
+  REQUIRE(cache.bytes() <= probe.bytes());
+  cache.run("b", "BRASSERIE DU PORT\nTOTAL 9,00 €\n", opt);
+  REQUIRE(cache.last_rescanned_lines() == 2);
+
+  // A frame larger than the whole budget is still kept, alone.
+  std::string large;
+  for (int i = 0; i < 200; i++)
+    large += "LIGNE " + std::to_string(i) + "\n";
+  cache.run("d", large, opt);
+  REQUIRE(cache.size() == 1);
+  cache.erase("d");
+  REQUIRE(cache.bytes() == 0);
+}
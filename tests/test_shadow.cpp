@@ -0,0 +1,110 @@
+#include <catch2/catch_all.hpp>
+#include <nlohmann/json.hpp>
+#include <string>
+
+#include <unistd.h>
+
+#include "test_util.hpp"
+#include "tv/engine.hpp"
+#include "tv/json.hpp"
+#include "tv/rule_pack.hpp"
+#include "tv/shadow.hpp"
+
+static const char *candidate_pack = R"({
+  "version": "candidate-1",
+  "locales": {"fr_FR": {"total_keywords": ["MONTANT"]}},
+  "domains": {"cafe": {"business_keywords": ["BISTROT"]}}
+})";
+
+static const std::string ticket =
+    "BISTROT DU COIN\nMONTANT 4,00 \xE2\x82\xAC\nCB\n";
+
+static tv::EngineOutput shadowed(const std::string &text,
+                                 std::shared_ptr<const tv::RulePack> pack,
+                                 tv::ShadowRun *run) {
+  tv::Session s;
+  s.begin(fr_cafe(), std::move(pack));
+  for (std::size_t i = 0; i < text.size(); i += 7)
+    s.feed(std::string_view(text).substr(i, 7));
+  auto out = s.finish();
+  REQUIRE(s.shadow());
+  *run = *s.shadow();
+  return out;
+}
+
+TEST_CASE("a shadowed session returns the primary result unchanged") {
+  auto candidate = tv::RulePack::parse(candidate_pack);
+  tv::ShadowRun run;
+  auto out = shadowed(ticket, candidate, &run);
+  REQUIRE(json_without_timing(out) == json_without_timing(tv::run(ticket, fr_cafe())));
+  REQUIRE_FALSE(out.ticket.total.value.has_value());
+
+  // The candidate saw the same text: its output is what it gives alone.
+  tv::set_active_rule_pack(candidate);
+  auto alone = tv::run(ticket, fr_cafe());
+  tv::set_active_rule_pack(nullptr);
+  REQUIRE(json_without_timing(run.output) == json_without_timing(alone));
+  REQUIRE(run.output.rules_version == "candidate-1");
+  REQUIRE(run.shadow_time <= run.total_time);
+}
+
+TEST_CASE("shadow records list the fields that differ") {
+  tv::ShadowRun run;
+  auto out = shadowed(ticket, tv::RulePack::parse(candidate_pack), &run);
+  auto rec = nlohmann::json::parse(tv::shadow_json(out, run));
+  REQUIRE(rec["primary_rules"] == "builtin");
+  REQUIRE(rec["shadow_rules"] == "candidate-1");
+  REQUIRE(rec["confidence_delta"].get<double>() ==
+          Catch::Approx(run.output.confidence - out.confidence));
+
+  auto find = [&](const std::string &field) -> nlohmann::json {
+    for (const auto &d : rec["diffs"])
+      if (d["field"] == field)
+        return d;
+    return nullptr;
+  };
+  auto total = find("fields.total");
+  REQUIRE(total.is_object());
+  REQUIRE(total["old"].is_null());
+  REQUIRE(total["new"]["value"] == 4.0);
+  REQUIRE(total["confidence_delta"].get<double>() > 0.0);
+  REQUIRE(find("status")["new"] == "ok");
+  REQUIRE(find("signals.has_card_keywords").is_null()); // same in both
+  REQUIRE(rec["cost_us"]["shadow"].get<double>() >= 0.0);
+
+  // The active pack as its own shadow: nothing differs.
+  auto same = shadowed(ticket, tv::active_rule_pack(), &run);
+  rec = nlohmann::json::parse(tv::shadow_json(same, run));
+  REQUIRE(rec["diffs"].empty());
+}
+
+TEST_CASE("sampled tickets are shadowed into the log") {
+  int fds[2];
+  REQUIRE(::pipe(fds) == 0);
+  struct Off {
+    ~Off() { tv::set_shadow({}); }
+  } off;
+
+  tv::ShadowConfig cfg;
+  cfg.candidate = tv::RulePack::parse(candidate_pack);
+  cfg.log_fd = fds[1];
+  cfg.sample_rate = 0.0;
+  tv::set_shadow(cfg);
+  REQUIRE_FALSE(tv::shadow_candidate());
+
+  cfg.sample_rate = 1.0;
+  tv::set_shadow(cfg);
+  REQUIRE(tv::shadow_candidate() == cfg.candidate);
+  auto out = tv::run_shadowed(ticket, fr_cafe());
+  REQUIRE_FALSE(out.ticket.total.value.has_value()); // primary result
+  ::close(fds[1]);
+
+  std::string log;
+  char buf[4096];
+  for (ssize_t n; (n = ::read(fds[0], buf, sizeof(buf))) > 0;)
+    log.append(buf, static_cast<std::size_t>(n));
+  ::close(fds[0]);
+  REQUIRE(log.back() == '\n');
+  REQUIRE(log.find('\n') == log.size() - 1); // one record
+  REQUIRE(nlohmann::json::parse(log)["shadow_rules"] == "candidate-1");
+}
@@ -0,0 +1,282 @@
+#include <atomic>
+#include <catch2/catch_all.hpp>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "test_util.hpp"
+#include "tv/engine.hpp"
+#include "tv/json.hpp"
+#include "tv/near_duplicate.hpp"
+#include "tv/shm.hpp"
+#include "tv/sketch.hpp"
+
+TEST_CASE("write_json_v1 writes to_json_v1 into a buffer") {
+  auto out = tv::run("CAFE DE LA PLACE\nTOTAL 4,00 \xE2\x82\xAC\n", {});
+  std::string doc = tv::to_json_v1(out);
+  std::string buf(doc.size() + 16, '#');
+  REQUIRE(tv::write_json_v1(out, buf.data(), buf.size()) == doc.size());
+  REQUIRE(stable(buf.substr(0, doc.size())) == stable(doc));
+  // Too small: nothing past cap, full length still reported.
+  std::string small(8, '#');
+  REQUIRE(tv::write_json_v1(out, small.data(), 4) == doc.size());
+  REQUIRE(small.substr(4) == "####");
+}
+
+TEST_CASE("error_json escapes and repairs its fields") {
+  std::string detail = "a\"b\n\xFF";
+  auto doc = tv::error_json("X", "m\\", &detail);
+  auto j = nlohmann::json::parse(doc);
+  REQUIRE(j["ok"] == false);
+  REQUIRE(j["error"]["message"] == "m\\");
+  REQUIRE(j["error"]["detail"] == "a\"b\n\xEF\xBF\xBD");
+}
+
+static pid_t fork_server(const std::string &name, const tv::ShmConfig &cfg) {
+  pid_t server = ::fork();
+  if (server == 0)
+    ::_exit(tv::serve_shm(name, cfg));
+  return server;
+}
+
+TEST_CASE("shm transport answers like the CLI") {
+  std::string name = "/tv_shm_test_" + std::to_string(::getpid());
+  tv::ShmConfig cfg;
+  cfg.slot_count = 4;
+  cfg.slot_size = 4096;
+  pid_t server = fork_server(name, cfg);
+  REQUIRE(server >= 0);
+  Reap reap{server, name, ::shm_unlink};
+
+  tv::ShmClient client;
+  REQUIRE(client.open(name, 5000));
+  tv::ShmClient second;
+  REQUIRE_FALSE(second.open(name, 0)); // one live client per segment
+
+  std::string text = "CAFE DE LA PLACE\nSIRET 12345678900012\n"
+                     "TOTAL 4,00 \xE2\x82\xAC\nCB\n";
+  tv::Options opt;
+  std::string json;
+  // More requests than slots: the counters wrap around the rings.
+  for (int i = 0; i < 10; i++) {
+    REQUIRE(client.call(text, opt, &json) == 0);
+    REQUIRE(stable(json) == stable(tv::to_json_v1(tv::run(text, opt))));
+  }
+
+  opt.locale = tv::Locale::EsES;
+  opt.max_lines = 1; // as the CLI: only the first line is read
+  REQUIRE(client.call(text, opt, &json) == 0);
+  REQUIRE(stable(json) ==
+          stable(tv::to_json_v1(tv::run("CAFE DE LA PLACE\n", opt))));
+
+  REQUIRE(client.call(" \n\t", {}, &json) == 2);
+  REQUIRE(nlohmann::json::parse(json)["error"]["code"] == "INPUT_EMPTY");
+  REQUIRE(client.call(std::string(5000, 'x'), {}, &json) == 2);
+  REQUIRE(nlohmann::json::parse(json)["error"]["code"] == "INPUT_TOO_LARGE");
+
+  ::kill(server, SIGTERM);
+  int status = 0;
+  REQUIRE(::waitpid(server, &status, 0) == server);
+  reap.pid = 0;
+  REQUIRE(WIFEXITED(status));
+  REQUIRE(WEXITSTATUS(status) == 0);
+  REQUIRE(client.call(text, {}, &json) == -1); // engine gone
+}
+
+TEST_CASE("shm session requests go through the frame cache like run") {
+  std::string name = "/tv_shm_test_session_" + std::to_string(::getpid());
+  tv::ShmConfig cfg;
+  cfg.workers = 2;
+  pid_t server = fork_server(name, cfg);
+  REQUIRE(server >= 0);
+  Reap reap{server, name, ::shm_unlink};
+
+  tv::ShmClient client;
+  REQUIRE(client.open(name, 5000));
+  // Frames of two receipts revealed top-down, interleaved.
+  std::string text = "CAFE DE LA PLACE\nSIRET 12345678900012\n"
+                     "TOTAL 4,00 \xE2\x82\xAC\nCB\nMerci\n";
+  std::string other = "BRASSERIE DU PORT\nTOTAL 9,00 \xE2\x82\xAC\n";
+  tv::Options opt;
+  std::string json;
+  for (std::size_t n = 1; n <= text.size(); n += 7)
+    for (std::uint64_t session : {1, 2}) {
+      auto frame = (session == 1 ? text : other).substr(0, n);
+      if (frame.find_first_not_of(" \n") == std::string::npos)
+        continue;
+      REQUIRE(client.call(frame, opt, &json, tv::Priority::Interactive, 0,
+                          session) == 0);
+      REQUIRE(stable(json) == stable(tv::to_json_v1(tv::run(frame, opt))));
+    }
+}
+
+TEST_CASE("shm session frames are not checked against the near-duplicate "
+          "index") {
+  std::string name = "/tv_shm_test_frames_nd_" + std::to_string(::getpid());
+  // Inherited by the forked server.
+  tv::set_active_near_duplicates(std::make_shared<tv::NearDuplicateIndex>());
+  pid_t server = fork_server(name, tv::ShmConfig{});
+  tv::set_active_near_duplicates(nullptr);
+  REQUIRE(server >= 0);
+  Reap reap{server, name, ::shm_unlink};
+
+  tv::ShmClient client;
+  REQUIRE(client.open(name, 5000));
+  const std::string receipt = fixture();
+  std::string json;
+  for (std::size_t n : {receipt.size() / 2, 3 * receipt.size() / 4,
+                        receipt.size()}) {
+    REQUIRE(client.call(receipt.substr(0, n), {}, &json,
+                        tv::Priority::Interactive, 0, 7) == 0);
+    REQUIRE(json.find("NEAR_DUPLICATE") == std::string::npos);
+  }
+  // Tickets outside a session still are.
+  REQUIRE(client.call(receipt, {}, &json) == 0);
+  REQUIRE(json.find("NEAR_DUPLICATE") == std::string::npos);
+  REQUIRE(client.call(receipt, {}, &json) == 0);
+  REQUIRE(json.find("NEAR_DUPLICATE") != std::string::npos);
+}
+
+TEST_CASE("shm server ignores a ring geometry rewritten by the client") {
+  std::string name = "/tv_shm_geometry_" + std::to_string(::getpid());
+  tv::ShmConfig cfg;
+  cfg.slot_count = 4;
+  cfg.slot_size = 4096;
+  pid_t server = fork_server(name, cfg);
+  REQUIRE(server >= 0);
+  Reap reap{server, name, ::shm_unlink};
+  tv::ShmClient client; // waits for the segment, takes the client side
+  REQUIRE(client.open(name, 5000));
+
+  const std::size_t size = tv_shm_segment_size(cfg.slot_count, cfg.slot_size);
+  int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+  REQUIRE(fd >= 0);
+  void *mem = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  REQUIRE(mem != MAP_FAILED);
+  auto *h = static_cast<tv_shm_header *>(mem);
+  h->slot_size = 1u << 24;
+  h->slot_count = 1u << 20;
+
+  // A well-formed request in the real geometry, its length a lie too.
+  const tv_shm_geometry g{cfg.slot_count, cfg.slot_size};
+  std::string text = "CAFE DE LA PLACE\nTOTAL 4,00 \xE2\x82\xAC\n";
+  tv_shm_slot *req = tv_shm_try_reserve_g(h, g, &h->req);
+  REQUIRE(req);
+  *req = tv_shm_slot{};
+  req->id = 7;
+  req->len = 1u << 24;
+  text.resize(cfg.slot_size, ' '); // what the capped length takes in
+  std::memcpy(tv_shm_payload(req), text.data(), text.size());
+  tv_shm_publish(&h->req);
+
+  tv_shm_slot *resp = nullptr;
+  for (int i = 0; i < 50 && !resp; i++)
+    resp = tv_shm_wait_peek_g(h, g, &h->resp, 100);
+  REQUIRE(resp);
+  REQUIRE(resp->id == 7);
+  REQUIRE(resp->code == 0);
+  REQUIRE(resp->len <= cfg.slot_size);
+  std::string json(tv_shm_payload(resp), resp->len);
+  REQUIRE(stable(json) == stable(tv::to_json_v1(tv::run(text, {}))));
+  tv_shm_release(&h->resp);
+  REQUIRE(::waitpid(server, nullptr, WNOHANG) == 0); // still serving
+  ::munmap(mem, size);
+}
+
+TEST_CASE("shm serves concurrent callers of both classes and reports stats") {
+  std::string name = "/tv_shm_sched_" + std::to_string(::getpid());
+  tv::ShmConfig cfg;
+  cfg.slot_count = 4;
+  cfg.slot_size = 4096;
+  cfg.workers = 2;
+  cfg.slow_ms = 0;
+  cfg.flight_dump = "/tmp/tv_shm_flight_" + std::to_string(::getpid());
+  pid_t server = fork_server(name, cfg);
+  REQUIRE(server >= 0);
+  Reap reap{server, name, ::shm_unlink};
+
+  tv::ShmClient client;
+  REQUIRE(client.open(name, 5000));
+
+  // More callers than slots, each checking that it got its own response.
+  std::atomic<int> mismatches{0};
+  std::vector<std::thread> callers;
+  for (int t = 0; t < 6; t++)
+    callers.emplace_back([&, t] {
+      auto priority = t % 2 ? tv::Priority::Bulk : tv::Priority::Interactive;
+      for (int i = 0; i < 20; i++) {
+        std::string text = "CAFE " + std::to_string(t) + "\nTOTAL " +
+                           std::to_string(i) + ",50\n";
+        std::string json;
+        if (client.call(text, {}, &json, priority, 60000) != 0 ||
+            stable(json) != stable(tv::to_json_v1(tv::run(text, {}))))
+          mismatches++;
+      }
+    });
+  for (auto &c : callers)
+    c.join();
+  REQUIRE(mismatches.load() == 0);
+
+  std::string json;
+  REQUIRE(client.stats(&json) == 0);
+  auto classes = nlohmann::json::parse(json)["scheduler"]["classes"];
+  for (const char *c : {"interactive", "bulk"}) {
+    REQUIRE(classes[c]["service_us"]["count"] == 60);
+    REQUIRE(classes[c]["queue_wait_us"]["count"] == 60);
+    REQUIRE(classes[c]["expired"] == 0);
+  }
+
+  // The stats request dumped the flight recorder: every ticket, by thread.
+  auto flight = nlohmann::json::parse(json)["flight_recorder"];
+  REQUIRE(flight["path"] == cfg.flight_dump);
+  REQUIRE(flight["records"] == 120);
+  std::ifstream f(cfg.flight_dump);
+  std::stringstream ss;
+  ss << f.rdbuf();
+  auto dump = nlohmann::json::parse(ss.str());
+  REQUIRE(dump["pid"] == server);
+  REQUIRE(dump["workers"].size() == 2);
+  std::size_t records = 0;
+  std::set<std::string> hashes; // of every text sent
+  for (int t = 0; t < 6; t++)
+    for (int i = 0; i < 20; i++) {
+      char hex[17];
+      std::snprintf(hex, sizeof hex, "%016llx",
+                    static_cast<unsigned long long>(tv::sketch_hash(
+                        "CAFE " + std::to_string(t) + "\nTOTAL " +
+                        std::to_string(i) + ",50\n")));
+      hashes.insert(hex);
+    }
+  for (const auto &w : dump["workers"])
+    for (const auto &r : w) {
+      REQUIRE(r["code"] == 0);
+      REQUIRE(hashes.count(r["input_hash"].get<std::string>()) == 1);
+      REQUIRE(r["lines"] == 2);
+      records++;
+    }
+  REQUIRE(records == 120);
+  std::remove(cfg.flight_dump.c_str());
+
+  // So does SIGUSR1.
+  ::kill(server, SIGUSR1);
+  for (int i = 0; i < 500 && ::access(cfg.flight_dump.c_str(), F_OK) != 0;
+       i++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  REQUIRE(::access(cfg.flight_dump.c_str(), F_OK) == 0);
+  std::remove(cfg.flight_dump.c_str());
+}
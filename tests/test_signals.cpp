@@ -19,3 +19,10 @@ TEST_CASE("detect_signals finds SIRET") {
   auto s = tv::detect_signals("SIRET 90888159000015\n");
   REQUIRE(s.has_siret == true);
 }
+
+TEST_CASE("detect_signals matches whole words only") {
+  auto s = tv::detect_signals("ABCB TVAX\nSIRET 908881590000151\n");
+  REQUIRE(s.has_card_keywords == false);
+  REQUIRE(s.has_tva == false);
+  REQUIRE(s.has_siret == false);
+}
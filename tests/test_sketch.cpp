@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <catch2/catch_all.hpp>
+#include <cmath>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "tv/batch_summary.hpp"
+#include "tv/engine.hpp"
+#include "tv/sketch.hpp"
+
+TEST_CASE("HyperLogLog estimates distinct counts within its error") {
+  for (std::size_t n : {0u, 10u, 1000u, 200000u}) {
+    tv::HyperLogLog h;
+    for (std::size_t i = 0; i < n; i++)
+      for (int repeat = 0; repeat < 3; repeat++)
+        h.add(tv::sketch_hash("merchant " + std::to_string(i)));
+    INFO(n);
+    REQUIRE(std::abs(h.estimate() - double(n)) <=
+            4 * h.standard_error() * double(n) + 0.5);
+  }
+}
+
+TEST_CASE("merged HyperLogLogs equal one fed both streams") {
+  tv::HyperLogLog a, b, both;
+  for (int i = 0; i < 50000; i++) {
+    auto h = tv::sketch_hash(std::to_string(i));
+    (i % 2 ? a : b).add(h);
+    both.add(h);
+  }
+  a.merge(b);
+  REQUIRE(a.estimate() == both.estimate());
+  REQUIRE_THROWS(a.merge(tv::HyperLogLog(10)));
+}
+
+TEST_CASE("SpaceSaving keeps the heavy hitters with bounded error") {
+  // Zipf-like: key k seen about n / k times, plus a long tail of singletons.
+  std::vector<std::string> stream;
+  std::map<std::string, std::uint64_t> truth;
+  for (int k = 1; k <= 50; k++)
+    for (int i = 0; i < 5000 / k; i++)
+      stream.push_back("hot" + std::to_string(k));
+  for (int i = 0; i < 20000; i++)
+    stream.push_back("tail" + std::to_string(i));
+  std::shuffle(stream.begin(), stream.end(), std::mt19937(7));
+  for (const auto &s : stream)
+    truth[s]++;
+
+  tv::SpaceSaving ss(64);
+  for (const auto &s : stream)
+    ss.add(s, s.size() % 2);
+  REQUIRE(ss.size() == 64);
+
+  auto top = ss.top(10);
+  REQUIRE(top.size() == 10);
+  for (std::size_t i = 0; i < top.size(); i++) {
+    INFO(top[i].key);
+    REQUIRE(top[i].key == "hot" + std::to_string(i + 1));
+    REQUIRE(top[i].count >= truth[top[i].key]);
+    REQUIRE(top[i].count - top[i].error <= truth[top[i].key]);
+    REQUIRE(top[i].by_kind[0] + top[i].by_kind[1] <= truth[top[i].key]);
+  }
+  // Every key seen more than n / capacity times is kept.
+  for (const auto &[key, count] : truth)
+    if (count > stream.size() / 64) {
+      auto all = ss.top(64);
+      REQUIRE(std::any_of(all.begin(), all.end(),
+                          [&](const auto &e) { return e.key == key; }));
+    }
+}
+
+TEST_CASE("merged SpaceSavings keep the guarantees of the whole stream") {
+  std::vector<std::string> stream;
+  for (int k = 1; k <= 20; k++)
+    for (int i = 0; i < 2000 / k; i++)
+      stream.push_back("m" + std::to_string(k));
+  for (int i = 0; i < 5000; i++)
+    stream.push_back("t" + std::to_string(i));
+  std::shuffle(stream.begin(), stream.end(), std::mt19937(3));
+  std::map<std::string, std::uint64_t> truth;
+  for (const auto &s : stream)
+    truth[s]++;
+
+  std::vector<tv::SpaceSaving> parts(4, tv::SpaceSaving(32));
+  for (std::size_t i = 0; i < stream.size(); i++)
+    parts[i % parts.size()].add(stream[i], 0);
+  tv::SpaceSaving merged(32);
+  for (const auto &p : parts)
+    merged.merge(p);
+  REQUIRE(merged.size() == 32);
+  auto top = merged.top(5);
+  for (std::size_t i = 0; i < top.size(); i++) {
+    INFO(top[i].key);
+    REQUIRE(top[i].key == "m" + std::to_string(i + 1));
+    REQUIRE(top[i].count >= truth[top[i].key]);
+    REQUIRE(top[i].count - top[i].error <= truth[top[i].key]);
+  }
+}
+
+TEST_CASE("DDSketch quantiles are within the relative accuracy") {
+  std::mt19937_64 rng(11);
+  std::lognormal_distribution<double> amounts(2.5, 1.0);
+  std::vector<double> values;
+  tv::DDSketch sketch;
+  for (int i = 0; i < 100000; i++) {
+    values.push_back(amounts(rng));
+    sketch.add(values.back());
+  }
+  std::sort(values.begin(), values.end());
+  REQUIRE(sketch.count() == values.size());
+  REQUIRE(sketch.min() == values.front());
+  REQUIRE(sketch.max() == values.back());
+  for (double q : {0.0, 0.1, 0.5, 0.9, 0.99, 1.0}) {
+    double exact = values[static_cast<std::size_t>(q * (values.size() - 1))];
+    INFO(q);
+    REQUIRE(std::abs(sketch.quantile(q) - exact) <= 0.011 * exact);
+  }
+  REQUIRE(sketch.memory() < 2048 * 8);
+  REQUIRE(tv::DDSketch().quantile(0.5) == 0.0);
+}
+
+TEST_CASE("DDSketch stays within max_buckets and merges exactly") {
+  tv::DDSketch a(0.01, 64), b(0.01, 64), both(0.01, 64);
+  for (int i = 0; i < 1000; i++) {
+    double v = std::pow(10.0, (i % 100) / 10.0 - 2); // 0.01 .. 1e8
+    (i % 2 ? a : b).add(v);
+    both.add(v);
+  }
+  REQUIRE(a.memory() <= 64 * 8);
+  a.merge(b);
+  REQUIRE(a.count() == both.count());
+  REQUIRE(a.quantile(0.99) == both.quantile(0.99));
+  REQUIRE(a.quantile(0.5) == both.quantile(0.5));
+  // High quantiles keep their guarantee; low ones were collapsed.
+  REQUIRE(std::abs(a.quantile(1.0) - 1e8 / std::pow(10.0, 0.1)) <=
+          0.011 * 1e8);
+
+  tv::DDSketch z;
+  z.add(0.0);
+  z.add(-3.0);
+  z.add(5.0);
+  REQUIRE(z.quantile(0.0) == 0.0);
+  REQUIRE(std::abs(z.quantile(1.0) - 5.0) <= 0.05);
+  REQUIRE_THROWS(z.merge(tv::DDSketch(0.05)));
+}
+
+TEST_CASE("a batch summary merges into what one summary would hold") {
+  const char *const tickets[] = {
+      "CAFE DE LA GARE\nTOTAL 4,50 EUR\nCB\n",
+      "BOULANGERIE PAUL\nTVA 5,5%\nTOTAL 12,00 EUR\n",
+      "CAFE DE LA GARE\nTOTAL 3,00 EUR\nSIRET 732 829 320 00017\n",
+      "illegible\n", // read as the merchant, rejected
+  };
+  tv::BatchSummary one, a, b;
+  for (int i = 0; i < 40; i++) {
+    auto out = tv::run(tickets[i % 4], tv::Options{});
+    one.add(out);
+    (i % 3 ? a : b).add(out);
+  }
+  one.add_skipped();
+  b.add_skipped();
+  a.merge(b);
+
+  auto doc = nlohmann::json::parse(one.to_json());
+  REQUIRE(doc == nlohmann::json::parse(a.to_json()));
+  REQUIRE(doc["tickets"] == 40);
+  REQUIRE(doc["skipped"] == 1);
+  REQUIRE(doc["merchants"]["distinct"] == 3);
+  REQUIRE(doc["merchants"]["without"] == 0);
+  REQUIRE(doc["merchants"]["top"][0]["name"] == "CAFE DE LA GARE");
+  REQUIRE(doc["merchants"]["top"][0]["count"] == 20);
+  REQUIRE(doc["totals"]["EUR"]["count"] == 30);
+  REQUIRE(std::abs(doc["totals"]["EUR"]["max"].get<double>() - 12.0) < 1e-9);
+  REQUIRE(doc["signals"]["has_card_keywords"]["has_card_keywords"] == 10);
+  REQUIRE(doc["signals"]["has_siret"]["has_card_keywords"] == 0);
+  REQUIRE(doc["status"]["reject"] == 10);
+  REQUIRE(doc["merchants"]["top"][2]["status"]["reject"] == 10);
+}
@@ -0,0 +1,116 @@
+#include <atomic>
+#include <catch2/catch_all.hpp>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "test_util.hpp"
+#include "tv/engine.hpp"
+#include "tv/json.hpp"
+#include "tv/normalize.hpp"
+#include "tv/task_pool.hpp"
+
+static std::string graph_json(std::string_view text, const tv::Options &opt,
+                              tv::TaskPool &pool) {
+  return json_without_timing(tv::run(text, opt, pool));
+}
+
+TEST_CASE("TaskPool runs every task, nested groups included") {
+  for (std::size_t workers : {0, 1, 3}) {
+    tv::TaskPool pool(workers);
+    std::atomic<int> done{0};
+    tv::TaskGroup outer(pool);
+    for (int i = 0; i < 16; i++)
+      outer.run([&] {
+        tv::TaskGroup inner(pool);
+        for (int j = 0; j < 8; j++)
+          inner.run([&] { done++; });
+        inner.wait();
+      });
+    outer.wait();
+    REQUIRE(done.load() == 16 * 8);
+  }
+}
+
+TEST_CASE("TaskPool without workers runs tasks inline, in order") {
+  tv::TaskPool pool(0);
+  REQUIRE(pool.workers() == 0);
+  std::vector<int> order;
+  tv::TaskGroup group(pool);
+  for (int i = 0; i < 4; i++)
+    group.run([&, i] { order.push_back(i); });
+  REQUIRE(order.empty());
+  group.wait();
+  REQUIRE(order == std::vector<int>{0, 1, 2, 3});
+}
+
+TEST_CASE("TaskGroup::wait rethrows a task's exception") {
+  tv::TaskPool pool(2);
+  tv::TaskGroup group(pool);
+  std::atomic<int> done{0};
+  group.run([] { throw std::runtime_error("stage failed"); });
+  for (int i = 0; i < 8; i++)
+    group.run([&] { done++; });
+  REQUIRE_THROWS_WITH(group.wait(), "stage failed");
+  REQUIRE(done.load() == 8);
+}
+
+TEST_CASE("Normalizer resumes mid-text after a plain byte") {
+  std::string a = "  A \xC2\xA0 B", b = "\n\n  C\xC2\xA0\r\n  \t";
+  auto expected = tv::normalize_ocr(a + b).text;
+  std::string out;
+  tv::Normalizer first;
+  first.feed(a, out);
+  tv::Normalizer rest = tv::Normalizer::after_text();
+  rest.feed(b, out);
+  rest.finish(out);
+  REQUIRE(out == expected);
+}
+
+TEST_CASE("the task graph matches serial execution on large inputs") {
+  // Whitespace runs, CRLF, NBSP (whole and cut by a newline), invalid and
+  // truncated UTF-8 and blank lines, so that chunk boundaries land next to
+  // all of them.
+  const std::vector<std::string> lines = {
+      "CAF\xC3\xA9 DU\xC2\xA0PORT\r\n",
+      "  \t \n",
+      "\xFF\n",
+      "Table 4\xC2\n",
+      "Menu \xE2\x82\n",
+      "x\xC2\xA0\n",
+      "\n",
+      "Plat du jour   14,50 \xE2\x82\xAC  \n",
+      "CB SANS CONTACT\n",
+  };
+  std::string body;
+  for (std::size_t i = 0; body.size() < 600 * 1024; i++)
+    body += lines[(i * 7) % lines.size()];
+
+  tv::Options fr;
+  fr.max_lines = 1u << 30;
+  tv::Options autodetect;
+
+  std::vector<std::string> inputs = {
+      "BRASSERIE DU PORT\n" + body + "TOTAL TTC 42,00 \xE2\x82\xAC\nSIRET "
+                                     "90888159000015\n",
+      std::string(100 * 1024, ' ') + "\n\n" + body + " \n\t",
+      body + "\xC2",
+      std::string(300 * 1024, '\n'),
+      "TOTAL 3,00\n",
+  };
+  tv::TaskPool none(0), some(3);
+  for (const auto &text : inputs)
+    for (const auto *opt : {&fr, &autodetect}) {
+      auto expected = serial_json(text, *opt);
+      REQUIRE(graph_json(text, *opt, none) == expected);
+      REQUIRE(graph_json(text, *opt, some) == expected);
+      REQUIRE(graph_json(text, *opt, tv::TaskPool::shared()) == expected);
+    }
+
+  auto out = tv::run(inputs[0], fr, some);
+  REQUIRE(out.ticket.total.value.has_value());
+  REQUIRE(out.ticket.signals.has_siret);
+  REQUIRE(out.ticket.warnings.size() == 2);
+  REQUIRE(out.ticket.warnings[0].code == "UTF8_REPAIRED");
+  REQUIRE(out.ticket.warnings[1].code == "ITEMS_TOTAL_MISMATCH");
+}
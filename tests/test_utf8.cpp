@@ -0,0 +1,58 @@
+#include <catch2/catch_all.hpp>
+
+#include "tv/engine.hpp"
+#include "tv/utf8.hpp"
+
+TEST_CASE("validate_utf8 accepts ASCII and multi-byte text") {
+  REQUIRE(tv::validate_utf8(""));
+  REQUIRE(tv::validate_utf8("TOTAL 4,00\n"));
+  REQUIRE(tv::validate_utf8("CAFÉ crème 4,50 € \xF0\x9F\x98\x80"));
+}
+
+TEST_CASE("validate_utf8 rejects overlongs, surrogates and truncated "
+          "sequences") {
+  REQUIRE_FALSE(tv::validate_utf8("\xC0\xAF"));         // overlong '/'
+  REQUIRE_FALSE(tv::validate_utf8("\xED\xA0\x80"));     // surrogate
+  REQUIRE_FALSE(tv::validate_utf8("\xF4\x90\x80\x80")); // > U+10FFFF
+  REQUIRE_FALSE(tv::validate_utf8("TOTAL 4,00 \xE2\x82"));
+}
+
+TEST_CASE("repair_utf8 replaces each maximal invalid subpart with U+FFFD") {
+  std::string out;
+  REQUIRE(tv::repair_utf8("CAF\xC9 4,00", out) == 1); // Latin-1 'É'
+  REQUIRE(out == "CAF\xEF\xBF\xBD 4,00");
+
+  REQUIRE(tv::repair_utf8("a\xE2\x82z\xFF", out) == 2);
+  REQUIRE(out == "a\xEF\xBF\xBDz\xEF\xBF\xBD");
+
+  REQUIRE(tv::repair_utf8("déjà", out) == 0);
+  REQUIRE(out == "déjà");
+}
+
+TEST_CASE("repair_utf8 finds errors past the vectorized blocks") {
+  std::string in(1000, 'x');
+  in += "é";
+  in += std::string(37, 'y');
+  in += "\x80";
+  in += std::string(100, 'z');
+  in += "\xF0\x9F"; // truncated at the very end
+
+  std::string out;
+  REQUIRE(tv::repair_utf8(in, out) == 2);
+  REQUIRE(tv::validate_utf8(out));
+  REQUIRE(out.size() == in.size() - 1 - 2 + 3 + 3);
+}
+
+TEST_CASE("engine repairs invalid input once and reports it as a warning") {
+  tv::Options opt;
+  auto out = tv::run("CAF\xC9 DE LA PLACE\nTOTAL 4,00 \x80\n", opt);
+
+  REQUIRE(out.ticket.total.value.has_value());
+  REQUIRE(tv::validate_utf8(out.normalized_text_preview));
+
+  bool found = false;
+  for (const auto &w : out.ticket.warnings)
+    if (w.code == "UTF8_REPAIRED")
+      found = true;
+  REQUIRE(found);
+}
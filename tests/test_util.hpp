@@ -0,0 +1,91 @@
+#pragma once
+// Helpers shared by the test files. Tests run from the build's tests
+// directory, hence the relative fixture path.
+#include <cstdio>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "tv/engine.hpp"
+#include "tv/json.hpp"
+
+inline std::string read_file(const std::string &path) {
+  std::ifstream f(path, std::ios::binary);
+  std::stringstream ss;
+  ss << f.rdbuf();
+  return ss.str();
+}
+
+inline void write_file(const std::string &path, const std::string &content) {
+  std::ofstream(path, std::ios::binary) << content;
+}
+
+// The real receipt the end-to-end tests run on.
+inline std::string fixture() {
+  return read_file("../../tests/fixtures/receipt_real_001.txt");
+}
+
+// A scratch file name unique to this process.
+inline std::string temp_path(const char *name) {
+  return "/tmp/tv_test_" + std::to_string(::getpid()) + "_" + name;
+}
+
+// what() of the exception `f` throws, empty if none.
+template <class F> std::string error_of(F f) {
+  try {
+    f();
+  } catch (const std::runtime_error &e) {
+    return e.what();
+  }
+  return {};
+}
+
+// French café rules, whatever the detectors would pick.
+inline tv::Options fr_cafe() {
+  tv::Options opt;
+  opt.locale = tv::Locale::FrFR;
+  opt.domain = tv::Domain::Cafe;
+  return opt;
+}
+
+// The JSON document without timing, which differs from run to run.
+inline std::string json_without_timing(tv::EngineOutput out) {
+  out.timing = {};
+  return tv::to_json_v1(out);
+}
+
+inline nlohmann::json stable(const std::string &doc) {
+  auto j = nlohmann::json::parse(doc);
+  j.erase("timing_ms");
+  return j;
+}
+
+// Session never goes through the task graph: it is the serial reference.
+inline std::string serial_json(std::string_view text, const tv::Options &opt) {
+  tv::Session s;
+  s.begin(opt);
+  s.feed(text);
+  return json_without_timing(s.finish());
+}
+
+// Never leaves a forked server behind, even on a failed REQUIRE: kills it
+// and removes what it listens on with `remove` (unlink, shm_unlink).
+struct Reap {
+  pid_t pid;
+  std::string path;
+  int (*remove)(const char *);
+  ~Reap() {
+    if (pid > 0) {
+      ::kill(pid, SIGKILL);
+      ::waitpid(pid, nullptr, 0);
+      remove(path.c_str());
+    }
+  }
+};
@@ -0,0 +1,183 @@
+#include <catch2/catch_all.hpp>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "test_util.hpp"
+#include "tv/mapped_file.hpp"
+#include "tv/zygote.hpp"
+
+static std::string read_all(int fd) {
+  std::string s;
+  char buf[256];
+  ssize_t n;
+  while ((n = ::read(fd, buf, sizeof(buf))) > 0)
+    s.append(buf, static_cast<std::size_t>(n));
+  return s;
+}
+
+// Echoes its arguments and stdin through write_fd, as the CLI writes, then
+// "!" left unflushed in stdio; exit code 7, or dies on "abort".
+static int echo_handler(const std::vector<std::string> &args) {
+  if (!args.empty() && args[0] == "abort")
+    std::abort();
+  std::string in = read_all(STDIN_FILENO);
+  tv::write_fd(STDERR_FILENO, {"err"});
+  for (const auto &a : args)
+    tv::write_fd(STDOUT_FILENO, {a, "|"});
+  tv::write_fd(STDOUT_FILENO, {in});
+  std::printf("!");
+  return 7;
+}
+
+struct Call {
+  int code;
+  std::string out, err;
+};
+
+static Call call(const std::string &path, const std::vector<std::string> &args,
+                 const std::string &input) {
+  int in[2], out[2], err[2];
+  REQUIRE(::pipe(in) == 0);
+  REQUIRE(::pipe(out) == 0);
+  REQUIRE(::pipe(err) == 0);
+  REQUIRE(::write(in[1], input.data(), input.size()) ==
+          static_cast<ssize_t>(input.size()));
+  ::close(in[1]);
+
+  Call c;
+  c.code = tv::zygote_call(path, args, in[0], out[1], err[1]);
+  // The child holds its own copies; these ends are ours to drop.
+  ::close(in[0]);
+  ::close(out[1]);
+  ::close(err[1]);
+  c.out = read_all(out[0]);
+  c.err = read_all(err[0]);
+  ::close(out[0]);
+  ::close(err[0]);
+  return c;
+}
+
+// Forks a zygote on `path` running echo_handler, once it listens.
+static pid_t fork_server(const std::string &path) {
+  // Buffered test output would otherwise be written again by the child.
+  std::cout.flush();
+  std::fflush(nullptr);
+  pid_t server = ::fork();
+  if (server == 0)
+    ::_exit(tv::serve_zygote(path, echo_handler));
+  struct stat st;
+  for (int i = 0; i < 500 && ::stat(path.c_str(), &st) != 0; i++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  return server;
+}
+
+TEST_CASE("zygote forks one child per request on the client's stdio") {
+  std::string path =
+      "/tmp/tv_zygote_test_" + std::to_string(::getpid()) + ".sock";
+  pid_t server = fork_server(path);
+  REQUIRE(server >= 0);
+  Reap reap{server, path, ::unlink};
+  struct stat st;
+
+  auto a = call(path, {"--locale", "fr_FR"}, "TOTAL 4,00\n");
+  REQUIRE(a.code == 7);
+  REQUIRE(a.out == "--locale|fr_FR|TOTAL 4,00\n!");
+  REQUIRE(a.err == "err");
+
+  auto b = call(path, {}, "");
+  REQUIRE(b.code == 7);
+  REQUIRE(b.out == "!");
+
+  // A crashing child is reported as 128 + signal; the server keeps going.
+  auto c = call(path, {"abort"}, "");
+  REQUIRE(c.code == 128 + SIGABRT);
+  REQUIRE(call(path, {"x"}, "y").out == "x|y!");
+
+  ::kill(server, SIGTERM);
+  int status = 0;
+  REQUIRE(::waitpid(server, &status, 0) == server);
+  reap.pid = 0;
+  REQUIRE(WIFEXITED(status));
+  REQUIRE(WEXITSTATUS(status) == 0);
+  REQUIRE(::stat(path.c_str(), &st) != 0); // socket removed
+}
+
+TEST_CASE("a client stalled mid-request does not hold up the zygote") {
+  std::string path =
+      "/tmp/tv_zygote_stall_" + std::to_string(::getpid()) + ".sock";
+  pid_t server = fork_server(path);
+  REQUIRE(server >= 0);
+  Reap reap{server, path, ::unlink};
+
+  // Connects and sends nothing: its child waits for the request (up to
+  // one second) while the next client is served.
+  int stalled = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  REQUIRE(::connect(stalled, reinterpret_cast<sockaddr *>(&addr),
+                    sizeof(addr)) == 0);
+
+  REQUIRE(call(path, {"x"}, "y").out == "x|y!");
+  // Served while the stalled connection is still open, not after the
+  // server gave up on it.
+  pollfd pfd{stalled, POLLIN, 0};
+  REQUIRE(::poll(&pfd, 1, 0) == 0);
+  ::close(stalled);
+}
+
+TEST_CASE("zygote_call reports an unreachable zygote") {
+  REQUIRE(tv::zygote_call("/tmp/tv_zygote_missing.sock", {}) == -1);
+  REQUIRE(tv::zygote_call(std::string(200, 'x'), {}) == -1);
+}
+
+TEST_CASE("zygote_call reports a zygote lost after taking stdin") {
+  std::string path =
+      "/tmp/tv_zygote_lost_" + std::to_string(::getpid()) + ".sock";
+  int listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  REQUIRE(::bind(listen_fd, reinterpret_cast<sockaddr *>(&addr),
+                 sizeof(addr)) == 0);
+  REQUIRE(::listen(listen_fd, 1) == 0);
+
+  // Takes the descriptors, reads part of stdin, then goes away unanswered.
+  std::thread zygote([&] {
+    int conn = ::accept(listen_fd, nullptr, nullptr);
+    char header[64];
+    iovec iov{header, sizeof(header)};
+    alignas(cmsghdr) char ctrl[CMSG_SPACE(3 * sizeof(int))];
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl;
+    msg.msg_controllen = sizeof(ctrl);
+    if (::recvmsg(conn, &msg, 0) > 0 && CMSG_FIRSTHDR(&msg)) {
+      int fds[3];
+      std::memcpy(fds, CMSG_DATA(CMSG_FIRSTHDR(&msg)), sizeof(fds));
+      char part[5];
+      (void)::read(fds[0], part, sizeof(part));
+      for (int fd : fds)
+        ::close(fd);
+    }
+    ::close(conn);
+  });
+  auto c = call(path, {}, "TOTAL 4,00\n");
+  zygote.join();
+  ::close(listen_fd);
+  ::unlink(path.c_str());
+  REQUIRE(c.code == -2);
+}